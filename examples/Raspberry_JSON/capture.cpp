@@ -0,0 +1,207 @@
+// **********************************************************************************
+// Raspberry PI LibTeleinfo raw capture file reader
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo or use, see my blog
+// https://hallard.me/category/tinfo
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "capture.h"
+
+/* ======================================================================
+Class   : TInfoCapture
+Purpose : Constructor
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+TInfoCapture::TInfoCapture()
+{
+  _map = NULL;
+  _size = 0;
+}
+
+/* ======================================================================
+Function: open
+Purpose : map a capture file in memory
+Input   : file path
+Output  : true if ok
+Comments: -
+====================================================================== */
+boolean TInfoCapture::open(const char * path)
+{
+  struct stat st;
+  void * map;
+  int fd;
+
+  if ( (fd = ::open(path, O_RDONLY)) < 0 )
+    return false;
+
+  if (fstat(fd, &st) < 0 || st.st_size == 0) {
+    ::close(fd);
+    return false;
+  }
+
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+
+  if (map == MAP_FAILED)
+    return false;
+
+  // Capture is read once from start to end
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+  _map = (const char *) map;
+  _size = st.st_size;
+  return true;
+}
+
+/* ======================================================================
+Function: close
+Purpose : unmap capture file
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+void TInfoCapture::close(void)
+{
+  if (_map)
+    munmap((void *) _map, _size);
+
+  _map = NULL;
+  _size = 0;
+}
+
+/* ======================================================================
+Function: decode
+Purpose : decode the whole capture with a teleinfo object
+Input   : teleinfo object (callbacks already attached)
+Output  : teleinfo state at end of capture
+Comments: whole file is there, checksums are computed by batches
+====================================================================== */
+_State_e TInfoCapture::decode(TInfo & tinfo)
+{
+  return tinfo.processBatch(_map, _size);
+}
+
+/* ======================================================================
+Function: split
+Purpose : split the capture in parts starting on a STX char
+Input   : wanted number of parts, table of parts to fill
+Output  : number of parts really filled
+Comments: a part does not hold the decoder state at its start, decoder
+          must be given the frames before it with prime() first
+====================================================================== */
+uint16_t TInfoCapture::split(uint16_t nparts, _CapturePart * parts)
+{
+  const char * end = _map + _size;
+  const char * start = _map;
+  uint16_t n = 0;
+
+  if (!_map || !nparts)
+    return 0;
+
+  while (start < end && n < nparts) {
+    const char * cut = _map + (_size / nparts) * (n + 1);
+
+    // last part takes all remaining data
+    if (n == nparts - 1 || cut >= end) {
+      cut = end;
+    } else {
+      // move cut to next STX
+      if (cut <= start)
+        cut = start + 1;
+      while (cut < end && (*cut & 0x7F) != TINFO_STX)
+        cut++;
+    }
+
+    parts[n].data = start;
+    parts[n].size = cut - start;
+    n++;
+    start = cut;
+  }
+
+  return n;
+}
+
+/* ======================================================================
+Function: prime
+Purpose : bring a decoder in the state it has at start of a part when
+          the whole capture is decoded
+Input   : teleinfo object (callbacks already attached), part
+Output  : teleinfo state at start of the part
+Comments: frames before the part are decoded and their callbacks called,
+          caller must not output them. A damaged group leaves the label
+          with its value of a frame before, or missing if the label was
+          never received. So priming goes back until one frame before
+          the part has all its groups good (as many as LF and CR chars
+          in it, a group cut by ETX is not counted as an error), from it
+          on the table has every label the meter sends and the same
+          values as with the whole capture. Each try goes back twice
+          more frames, up to the start of the capture. A label the meter
+          only sent before that frame (an old EJP notice...) is missing
+====================================================================== */
+_State_e TInfoCapture::prime(TInfo & tinfo, const _CapturePart & part)
+{
+  _State_e state = TINFO_INIT;
+  uint32_t back = 2;
+
+  for (;;) {
+    const char * first = part.data;
+    const char * start;
+    boolean clean = false;
+
+    // start of frame back frames before the part
+    for (uint32_t n = 0; n < back && first > _map; ) {
+      first--;
+      if ((*first & 0x7F) == TINFO_STX)
+        n++;
+    }
+
+    tinfo.init();
+    state = TINFO_INIT;
+
+    // decode frame by frame, first one only syncs the decoder
+    for (start = first; start < part.data; ) {
+      const char * end = start + 1;
+      uint32_t sgr = 0, egr = 0;
+      TInfoStats before, after;
+
+      for ( ; end < part.data && (*end & 0x7F) != TINFO_STX; end++) {
+        if ((*end & 0x7F) == TINFO_SGR)
+          sgr++;
+        else if ((*end & 0x7F) == TINFO_EGR)
+          egr++;
+      }
+
+      tinfo.getStats(&before);
+      state = tinfo.processBatch(start, end - start);
+      tinfo.getStats(&after);
+
+      if ( start != first && after.frames == before.frames + 1 &&
+           after.groups - before.groups == sgr && sgr == egr &&
+           after.aborted == before.aborted && after.checksum == before.checksum &&
+           after.overflow == before.overflow && after.full == before.full &&
+           after.unknown == before.unknown && after.resync == before.resync )
+        clean = true;
+
+      start = end;
+    }
+
+    if (clean || first <= _map)
+      return state;
+
+    back *= 2;
+  }
+}
@@ -0,0 +1,52 @@
+// **********************************************************************************
+// Raspberry PI LibTeleinfo raw capture file reader include file
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo or use, see my blog
+// https://hallard.me/category/tinfo
+//
+// A capture file is the raw byte stream received from the meter. It is
+// mapped in memory and given directly to TInfo::process(buf, len), so
+// decoding does not copy nor read() it char by char.
+// The capture can be split in parts starting on a STX char to be decoded
+// in parallel by independent TInfo objects
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "../../src/LibTeleinfo.h"
+
+// One part of the capture, starting on a STX char
+typedef struct
+{
+  const char * data;  // first byte of the part
+  size_t       size;  // size of the part
+} _CapturePart;
+
+class TInfoCapture
+{
+  public:
+    TInfoCapture();
+    boolean      open(const char * path);
+    void         close(void);
+    _State_e     decode(TInfo & tinfo);
+    uint16_t     split(uint16_t nparts, _CapturePart * parts);
+    _State_e     prime(TInfo & tinfo, const _CapturePart & part);
+    const char * data(void) { return _map; }
+    size_t       size(void) { return _size; }
+
+  private:
+    const char * _map;
+    size_t       _size;
+};
+
+#endif
@@ -0,0 +1,185 @@
+// **********************************************************************************
+// Raspberry PI / Linux LibTeleinfo multicast frame feed receiver
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo or use, see my blog
+// https://hallard.me/category/tinfo
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "feedrecv.h"
+
+/* ======================================================================
+Class   : TInfoFeedReceiver
+Purpose : Constructor
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+TInfoFeedReceiver::TInfoFeedReceiver()
+{
+  _fd = -1;
+  _errors = 0;
+  memset(_meters, 0, sizeof(_meters));
+}
+
+/* ======================================================================
+Function: begin
+Purpose : join a multicast group
+Input   : group address, UDP port, address of interface (NULL for any)
+Output  : false on error, errno is set
+Comments: socket is shared with other receivers of same port on host
+====================================================================== */
+boolean TInfoFeedReceiver::begin(const char * group, uint16_t port, const char * iface)
+{
+  struct sockaddr_in addr;
+  struct ip_mreq mreq;
+  int on = 1;
+
+  memset(&mreq, 0, sizeof(mreq));
+  if (!inet_aton(group, &mreq.imr_multiaddr) || !IN_MULTICAST(ntohl(mreq.imr_multiaddr.s_addr))) {
+    errno = EINVAL;
+    return false;
+  }
+  mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+  if (iface && !inet_aton(iface, &mreq.imr_interface)) {
+    errno = EINVAL;
+    return false;
+  }
+
+  if ( (_fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0 )
+    return false;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr = mreq.imr_multiaddr;
+
+  if ( setsockopt(_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0 ||
+       bind(_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+       setsockopt(_fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0 ) {
+    int err = errno;
+    ::close(_fd);
+    _fd = -1;
+    errno = err;
+    return false;
+  }
+
+  return true;
+}
+
+/* ======================================================================
+Function: close
+Purpose : leave group
+Input   : -
+Output  : -
+Comments: counters are kept
+====================================================================== */
+void TInfoFeedReceiver::close(void)
+{
+  if (_fd >= 0)
+    ::close(_fd);
+  _fd = -1;
+}
+
+/* ======================================================================
+Function: track
+Purpose : follow frame numbers of a datagram meter
+Input   : received header
+Output  : frames lost just before this one
+Comments: called by receive(), also for datagrams parsed by the caller
+====================================================================== */
+uint32_t TInfoFeedReceiver::track(const TInfoFeedFrame * f)
+{
+  _TFeedMeter * m = NULL;
+  int32_t d;
+  uint8_t i;
+
+  for (i = 0; i < TFEED_METERS && !m; i++)
+    if (_meters[i].used && !strcmp(_meters[i].meter, f->meter))
+      m = &_meters[i];
+
+  // New meter, starts from the number it has now
+  if (!m) {
+    for (i = 0; i < TFEED_METERS && !m; i++)
+      if (!_meters[i].used)
+        m = &_meters[i];
+    if (!m)
+      return 0;
+    memset(m, 0, sizeof(*m));
+    strcpy(m->meter, f->meter);
+    m->used = true;
+    m->last = f->seq;
+    m->window = 1;
+    m->received = 1;
+    return 0;
+  }
+
+  m->received++;
+  d = (int32_t) (f->seq - m->last);
+
+  if (d > 0 && f->seq != 1) {
+    m->window = d < 32 ? (m->window << d) | 1 : 1;
+    m->last = f->seq;
+    m->lost += d - 1;
+    return d - 1;
+  }
+
+  // Late ones in window are counted once, older ones can't be told from
+  // duplicates
+  if (d == 0 || (d < 0 && d > -32 && (m->window & ((uint32_t) 1 << -d)))) {
+    m->duplicate++;
+  } else if (d < 0 && d > -TFEED_LATE_WINDOW && f->seq != 1) {
+    if (d > -32)
+      m->window |= (uint32_t) 1 << -d;
+    m->late++;
+    if (m->lost)
+      m->lost--;
+  } else {
+    m->restarts++;
+    m->last = f->seq;
+    m->window = 1;
+  }
+
+  return 0;
+}
+
+/* ======================================================================
+Function: receive
+Purpose : read a datagram
+Input   : header to fill, frames lost before it (filled)
+Output  : 1 if a datagram was read, 0 if none or not a feed, -1 on error
+Comments: does not wait if socket has nothing. Labels stay in receiver
+          buffer until next call
+====================================================================== */
+int TInfoFeedReceiver::receive(TInfoFeedFrame * f, uint32_t * lost)
+{
+  ssize_t n;
+
+  *lost = 0;
+  if (_fd < 0)
+    return -1;
+
+  n = recv(_fd, _buf, sizeof(_buf), MSG_DONTWAIT);
+  if (n < 0)
+    return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+
+  if (!TInfoFeed::parse(_buf, n, f)) {
+    _errors++;
+    return 0;
+  }
+
+  *lost = track(f);
+  return 1;
+}
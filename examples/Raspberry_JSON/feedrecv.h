@@ -0,0 +1,68 @@
+// **********************************************************************************
+// Raspberry PI / Linux LibTeleinfo multicast frame feed receiver include file
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo or use, see my blog
+// https://hallard.me/category/tinfo
+//
+// Joins the multicast group of a Wifinfo (or raspjson -m) frame feed and
+// reads its datagrams (see LibTeleinfoFeed.h). Frame numbers are followed
+// for each meter id:
+//   - a number after the expected one counts the frames between as lost
+//   - a number a bit before it is a late datagram, it is no more lost, or
+//     a duplicate if it was already received (last 32 frames)
+//   - a number far before it (or 1) is a sender restart
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#ifndef FEEDRECV_H
+#define FEEDRECV_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "../../src/LibTeleinfo.h"
+#include "../../src/LibTeleinfoFeed.h"
+
+#define TFEED_METERS        8     // meters followed
+#define TFEED_LATE_WINDOW   1024  // frames a datagram can be late, else restart
+
+// Frame numbers of a meter
+typedef struct
+{
+  char     meter[TINFO_FEED_METER+1];
+  boolean  used;
+  uint32_t last;        // last frame number
+  uint32_t window;      // bit n set if last - n was received
+  uint32_t received;    // datagrams
+  uint32_t lost;        // frames never received
+  uint32_t late;        // datagrams received after a newer one
+  uint32_t duplicate;   // same number again
+  uint32_t restarts;    // sender started numbers again
+} _TFeedMeter;
+
+class TInfoFeedReceiver
+{
+  public:
+    TInfoFeedReceiver();
+    boolean   begin(const char * group, uint16_t port, const char * iface);
+    void      close(void);
+    int       fd(void) { return _fd; }
+    int       receive(TInfoFeedFrame * f, uint32_t * lost);
+    uint32_t  track(const TInfoFeedFrame * f);
+    uint8_t   meters(void) { return TFEED_METERS; }
+    const _TFeedMeter * meter(uint8_t i) { return _meters[i].used ? &_meters[i] : NULL; }
+    uint32_t  errors(void) { return _errors; }
+
+  private:
+    int         _fd;
+    uint32_t    _errors;    // datagrams that are not a feed
+    _TFeedMeter _meters[TFEED_METERS];
+    uint8_t     _buf[TINFO_FEED_SIZE * 2];
+};
+
+#endif
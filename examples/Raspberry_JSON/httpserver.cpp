@@ -0,0 +1,633 @@
+// **********************************************************************************
+// Raspberry PI LibTeleinfo minimal HTTP server
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo or use, see my blog
+// https://hallard.me/category/tinfo
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include "httpserver.h"
+
+// Appended to client key for the handshake answer
+#define WS_GUID   "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+// Frame opcodes
+#define WS_TEXT   0x1
+#define WS_CLOSE  0x8
+#define WS_PING   0x9
+#define WS_PONG   0xA
+
+/* ======================================================================
+Function: sha1
+Purpose : SHA-1 digest, only for the WebSocket handshake
+Input   : data, its size, digest filled (20 bytes)
+Output  : -
+Comments: data is short (key and GUID), 2 blocks at most
+====================================================================== */
+static void sha1(const uint8_t * data, size_t len, uint8_t * digest)
+{
+  uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+  uint32_t w[80];
+  uint8_t block[64];
+  uint64_t bits = (uint64_t) len * 8;
+  size_t total = ((len + 8) / 64 + 1) * 64;
+  uint32_t a, b, c, d, e, f, k, t;
+
+  for (size_t off = 0; off < total; off += 64) {
+    // Message, then 0x80, zeros and length in bits
+    for (size_t i = 0; i < 64; i++) {
+      size_t pos = off + i;
+      if (pos < len)
+        block[i] = data[pos];
+      else if (pos == len)
+        block[i] = 0x80;
+      else if (pos >= total - 8)
+        block[i] = (uint8_t) (bits >> ((total - 1 - pos) * 8));
+      else
+        block[i] = 0;
+    }
+
+    for (int i = 0; i < 16; i++)
+      w[i] = (uint32_t) block[i*4] << 24 | (uint32_t) block[i*4+1] << 16 |
+             (uint32_t) block[i*4+2] << 8 | block[i*4+3];
+    for (int i = 16; i < 80; i++) {
+      t = w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16];
+      w[i] = t << 1 | t >> 31;
+    }
+
+    a = h[0]; b = h[1]; c = h[2]; d = h[3]; e = h[4];
+    for (int i = 0; i < 80; i++) {
+      if (i < 20)      { f = (b & c) | (~b & d);          k = 0x5A827999; }
+      else if (i < 40) { f = b ^ c ^ d;                   k = 0x6ED9EBA1; }
+      else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+      else             { f = b ^ c ^ d;                   k = 0xCA62C1D6; }
+      t = (a << 5 | a >> 27) + f + e + k + w[i];
+      e = d; d = c; c = b << 30 | b >> 2; b = a; a = t;
+    }
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+  }
+
+  for (int i = 0; i < 20; i++)
+    digest[i] = (uint8_t) (h[i/4] >> (24 - (i%4) * 8));
+}
+
+/* ======================================================================
+Function: base64
+Purpose : encode in base64
+Input   : data, its size, string filled (4 chars per 3 bytes + 1)
+Output  : -
+Comments: -
+====================================================================== */
+static void base64(const uint8_t * data, size_t len, char * out)
+{
+  static const char b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  uint32_t v;
+
+  for (size_t i = 0; i < len; i += 3) {
+    v = (uint32_t) data[i] << 16;
+    if (i + 1 < len) v |= (uint32_t) data[i+1] << 8;
+    if (i + 2 < len) v |= data[i+2];
+    *out++ = b64[v >> 18 & 0x3F];
+    *out++ = b64[v >> 12 & 0x3F];
+    *out++ = i + 1 < len ? b64[v >> 6 & 0x3F] : '=';
+    *out++ = i + 2 < len ? b64[v & 0x3F] : '=';
+  }
+  *out = '\0';
+}
+
+/* ======================================================================
+Class   : TInfoHttp
+Purpose : Constructor
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+TInfoHttp::TInfoHttp()
+{
+  _fd = -1;
+  _nroutes = 0;
+  _ws_path = NULL;
+  _ws_fn = NULL;
+  for (uint8_t i = 0; i < HTTP_WS_CLIENTS; i++)
+    _ws[i].fd = -1;
+}
+
+/* ======================================================================
+Function: begin
+Purpose : listen on a TCP port
+Input   : port
+Output  : true if ok
+Comments: -
+====================================================================== */
+boolean TInfoHttp::begin(int port)
+{
+  struct sockaddr_in addr;
+  int on = 1;
+
+  if ( (_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0 )
+    return false;
+
+  setsockopt(_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+
+  if (bind(_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+      listen(_fd, 4) < 0 ||
+      fcntl(_fd, F_SETFL, O_NONBLOCK) < 0) {
+    close();
+    return false;
+  }
+
+  return true;
+}
+
+/* ======================================================================
+Function: on
+Purpose : add a route
+Input   : path (must stay in memory), handler
+Output  : -
+Comments: HTTP_ROUTES max
+====================================================================== */
+void TInfoHttp::on(const char * path, HttpHandler fn)
+{
+  if (_nroutes < HTTP_ROUTES) {
+    _routes[_nroutes].path = path;
+    _routes[_nroutes].fn = fn;
+    _routes[_nroutes].stream = NULL;
+    _nroutes++;
+  }
+}
+
+/* ======================================================================
+Function: onStream
+Purpose : add a route that can keep its client
+Input   : path (must stay in memory), handler
+Output  : -
+Comments: socket belongs to the handler when it returns true
+====================================================================== */
+void TInfoHttp::onStream(const char * path, HttpStreamHandler fn)
+{
+  if (_nroutes < HTTP_ROUTES) {
+    _routes[_nroutes].path = path;
+    _routes[_nroutes].fn = NULL;
+    _routes[_nroutes].stream = fn;
+    _nroutes++;
+  }
+}
+
+/* ======================================================================
+Function: websocket
+Purpose : set the WebSocket path
+Input   : path (must stay in memory), handler
+Output  : -
+Comments: handler is called when a client connects and for its texts
+====================================================================== */
+void TInfoHttp::websocket(const char * path, WsHandler fn)
+{
+  _ws_path = path;
+  _ws_fn = fn;
+}
+
+/* ======================================================================
+Function: close
+Purpose : stop listening
+Input   : -
+Output  : -
+Comments: WebSocket clients are closed too
+====================================================================== */
+void TInfoHttp::close(void)
+{
+  for (uint8_t i = 0; i < HTTP_WS_CLIENTS; i++)
+    drop(&_ws[i]);
+
+  if (_fd >= 0)
+    ::close(_fd);
+  _fd = -1;
+}
+
+/* ======================================================================
+Function: drop
+Purpose : close a WebSocket client
+Input   : client
+Output  : -
+Comments: -
+====================================================================== */
+void TInfoHttp::drop(_HttpWsClient * k)
+{
+  if (k->fd >= 0)
+    ::close(k->fd);
+  k->fd = -1;
+  k->len = 0;
+}
+
+/* ======================================================================
+Function: fdset
+Purpose : add sockets to wait on
+Input   : set for select()
+Output  : highest socket added, -1 if none
+Comments: listening socket and WebSocket clients
+====================================================================== */
+int TInfoHttp::fdset(fd_set * set)
+{
+  int max = _fd;
+
+  if (_fd >= 0)
+    FD_SET(_fd, set);
+
+  for (uint8_t i = 0; i < HTTP_WS_CLIENTS; i++) {
+    if (_ws[i].fd >= 0) {
+      FD_SET(_ws[i].fd, set);
+      if (_ws[i].fd > max)
+        max = _ws[i].fd;
+    }
+  }
+
+  return max;
+}
+
+/* ======================================================================
+Function: clients
+Purpose : WebSocket clients connected
+Input   : -
+Output  : number of clients
+Comments: -
+====================================================================== */
+uint8_t TInfoHttp::clients(void)
+{
+  uint8_t n = 0;
+
+  for (uint8_t i = 0; i < HTTP_WS_CLIENTS; i++)
+    if (_ws[i].fd >= 0)
+      n++;
+
+  return n;
+}
+
+/* ======================================================================
+Function: send
+Purpose : send all data to a client
+Input   : client socket, data and its size
+Output  : false if client is gone
+Comments: blocks at most the send timeout set when client was accepted
+====================================================================== */
+boolean TInfoHttp::send(int fd, const char * buf, size_t len)
+{
+  ssize_t n;
+
+  while (len) {
+    n = ::send(fd, buf, len, MSG_NOSIGNAL);
+    if (n <= 0)
+      return false;
+    buf += n;
+    len -= n;
+  }
+
+  return true;
+}
+
+/* ======================================================================
+Function: wsHeader
+Purpose : build a server frame header
+Input   : opcode, payload size, header filled (10 bytes max)
+Output  : header size
+Comments: server frames are not masked
+====================================================================== */
+size_t TInfoHttp::wsHeader(uint8_t opcode, size_t len, uint8_t * head)
+{
+  head[0] = 0x80 | opcode;
+
+  if (len < 126) {
+    head[1] = len;
+    return 2;
+  }
+
+  if (len < 65536) {
+    head[1] = 126;
+    head[2] = len >> 8;
+    head[3] = len;
+    return 4;
+  }
+
+  head[1] = 127;
+  for (int i = 0; i < 8; i++)
+    head[2+i] = (uint8_t) ((uint64_t) len >> (56 - i * 8));
+  return 10;
+}
+
+/* ======================================================================
+Function: wsFrame
+Purpose : send a frame to a client
+Input   : client socket, opcode, payload and its size
+Output  : false if client is gone
+Comments: -
+====================================================================== */
+boolean TInfoHttp::wsFrame(int fd, uint8_t opcode, const char * msg, size_t len)
+{
+  uint8_t head[10];
+  size_t n = wsHeader(opcode, len, head);
+
+  return send(fd, (const char *) head, n) && send(fd, msg, len);
+}
+
+/* ======================================================================
+Function: wsSend
+Purpose : send a text to a WebSocket client
+Input   : client socket, text and its size
+Output  : false if client is gone
+Comments: blocks at most the send timeout, for answers to one client
+====================================================================== */
+boolean TInfoHttp::wsSend(int fd, const char * msg, size_t len)
+{
+  return wsFrame(fd, WS_TEXT, msg, len);
+}
+
+/* ======================================================================
+Function: broadcast
+Purpose : send a text to all WebSocket clients
+Input   : text and its size
+Output  : -
+Comments: framed once, one write per client that never waits. A client
+          whose socket can't take the whole frame is dropped, it will
+          connect again and get a snapshot
+====================================================================== */
+void TInfoHttp::broadcast(const char * msg, size_t len)
+{
+  uint8_t head[10];
+  struct iovec iov[2];
+  struct msghdr mh;
+  ssize_t n;
+
+  iov[0].iov_base = head;
+  iov[0].iov_len = wsHeader(WS_TEXT, len, head);
+  iov[1].iov_base = (void *) msg;
+  iov[1].iov_len = len;
+  memset(&mh, 0, sizeof(mh));
+  mh.msg_iov = iov;
+  mh.msg_iovlen = 2;
+
+  for (uint8_t i = 0; i < HTTP_WS_CLIENTS; i++) {
+    if (_ws[i].fd < 0)
+      continue;
+    n = sendmsg(_ws[i].fd, &mh, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (n != (ssize_t) (iov[0].iov_len + len))
+      drop(&_ws[i]);
+  }
+}
+
+/* ======================================================================
+Function: upgrade
+Purpose : answer a WebSocket handshake
+Input   : client socket, request headers
+Output  : true if client is now a WebSocket one
+Comments: -
+====================================================================== */
+boolean TInfoHttp::upgrade(int fd, const char * headers)
+{
+  char key[64 + sizeof(WS_GUID)];
+  uint8_t digest[20];
+  char accept[32];
+  char head[256];
+  const char * p;
+  size_t n = 0;
+  uint8_t i;
+
+  p = strcasestr(headers, "\r\nSec-WebSocket-Key:");
+  if (!p || !strcasestr(headers, "\r\nUpgrade: websocket")) {
+    sendHeader(fd, 400, "text/plain");
+    send(fd, "WebSocket only\n", 15);
+    return false;
+  }
+
+  for (p += 20; *p == ' '; p++)
+    ;
+  while (n < 64 && *p && *p != '\r' && *p != ' ')
+    key[n++] = *p++;
+  strcpy(key + n, WS_GUID);
+
+  for (i = 0; i < HTTP_WS_CLIENTS && _ws[i].fd >= 0; i++)
+    ;
+  if (i == HTTP_WS_CLIENTS) {
+    snprintf(head, sizeof(head), "HTTP/1.1 503 Service Unavailable\r\nConnection: close\r\n\r\n");
+    send(fd, head, strlen(head));
+    return false;
+  }
+
+  sha1((const uint8_t *) key, strlen(key), digest);
+  base64(digest, sizeof(digest), accept);
+  snprintf(head, sizeof(head),
+           "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\n"
+           "Connection: Upgrade\r\nSec-WebSocket-Accept: %s\r\n\r\n", accept);
+  if (!send(fd, head, strlen(head)))
+    return false;
+
+  _ws[i].fd = fd;
+  _ws[i].len = 0;
+  if (_ws_fn)
+    _ws_fn(fd, NULL);
+
+  return true;
+}
+
+/* ======================================================================
+Function: receive
+Purpose : read frames from a WebSocket client
+Input   : client
+Output  : -
+Comments: never waits. Texts go to the handler, ping is answered,
+          close or a frame bigger than HTTP_WS_RXSIZE drops the client
+====================================================================== */
+void TInfoHttp::receive(_HttpWsClient * k)
+{
+  char msg[HTTP_WS_RXSIZE];
+  uint8_t * mask;
+  size_t head;
+  size_t size;
+  ssize_t n;
+
+  n = recv(k->fd, k->buf + k->len, sizeof(k->buf) - k->len, MSG_DONTWAIT);
+  if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+    drop(k);
+    return;
+  }
+  if (n > 0)
+    k->len += n;
+
+  // Whole frames only, client ones are always masked
+  while (k->len >= 2) {
+    size = k->buf[1] & 0x7F;
+    head = 2;
+    if (size == 126) {
+      if (k->len < 4)
+        return;
+      size = (size_t) k->buf[2] << 8 | k->buf[3];
+      head = 4;
+    } else if (size == 127) {
+      drop(k);
+      return;
+    }
+
+    if (!(k->buf[1] & 0x80) || head + 4 + size >= sizeof(k->buf)) {
+      drop(k);
+      return;
+    }
+    if (k->len < head + 4 + size)
+      return;
+
+    mask = k->buf + head;
+    for (size_t i = 0; i < size; i++)
+      msg[i] = k->buf[head + 4 + i] ^ mask[i % 4];
+    msg[size] = '\0';
+
+    switch (k->buf[0] & 0x0F) {
+      case WS_TEXT:
+        if (_ws_fn)
+          _ws_fn(k->fd, msg);
+        break;
+
+      case WS_PING:
+        wsFrame(k->fd, WS_PONG, msg, size);
+        break;
+
+      case WS_CLOSE:
+        wsFrame(k->fd, WS_CLOSE, msg, size < 2 ? size : 2);
+        drop(k);
+        return;
+    }
+
+    // Handler may have dropped it
+    if (k->fd < 0)
+      return;
+
+    k->len -= head + 4 + size;
+    memmove(k->buf, k->buf + head + 4 + size, k->len);
+  }
+}
+
+/* ======================================================================
+Function: sendHeader
+Purpose : send status line and headers
+Input   : client socket, HTTP status, content type
+Output  : false if client is gone
+Comments: no content length, end of answer is when connection is closed
+====================================================================== */
+boolean TInfoHttp::sendHeader(int fd, int code, const char * type)
+{
+  char head[256];
+
+  snprintf(head, sizeof(head),
+           "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nConnection: close\r\n\r\n",
+           code, code == 200 ? "OK" : code == 404 ? "Not Found" :
+                 code == 503 ? "Service Unavailable" : "Bad Request", type);
+
+  return send(fd, head, strlen(head));
+}
+
+/* ======================================================================
+Function: serve
+Purpose : read a request and answer it
+Input   : client socket
+Output  : true if socket is kept (WebSocket client or stream)
+Comments: -
+====================================================================== */
+boolean TInfoHttp::serve(int fd)
+{
+  char req[HTTP_REQSIZE];
+  char * path;
+  char * query;
+  char * end;
+  size_t len = 0;
+  ssize_t n;
+
+  // Request line and headers, body is never used
+  while (len < sizeof(req) - 1) {
+    n = recv(fd, req + len, sizeof(req) - 1 - len, 0);
+    if (n <= 0)
+      break;
+    len += n;
+    req[len] = '\0';
+    if (strstr(req, "\r\n\r\n"))
+      break;
+  }
+  req[len] = '\0';
+
+  if (strncmp(req, "GET ", 4) || !(end = strchr(req + 4, ' '))) {
+    sendHeader(fd, 400, "text/plain");
+    send(fd, "Bad request\n", 12);
+    return false;
+  }
+
+  *end = '\0';
+  path = req + 4;
+  query = strchr(path, '?');
+  if (query)
+    *query++ = '\0';
+  else
+    query = end;
+
+  if (_ws_path && !strcmp(path, _ws_path))
+    return upgrade(fd, end + 1);
+
+  for (uint8_t i = 0; i < _nroutes; i++) {
+    if (!strcmp(path, _routes[i].path)) {
+      if (_routes[i].stream)
+        return _routes[i].stream(fd, query);
+      _routes[i].fn(fd, query);
+      return false;
+    }
+  }
+
+  sendHeader(fd, 404, "text/plain");
+  send(fd, "Not found\n", 10);
+  return false;
+}
+
+/* ======================================================================
+Function: handle
+Purpose : answer clients waiting
+Input   : -
+Output  : -
+Comments: returns at once if no client, WebSocket clients are read
+====================================================================== */
+void TInfoHttp::handle(void)
+{
+  struct timeval tv;
+  int fd;
+
+  if (_fd < 0)
+    return;
+
+  while ( (fd = accept(_fd, NULL, NULL)) >= 0 ) {
+    // Client socket is blocking, but not for long
+    fcntl(fd, F_SETFL, 0);
+    tv.tv_sec = 0;
+    tv.tv_usec = HTTP_TIMEOUT * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    tv.tv_sec = 1;
+    tv.tv_usec = 0;
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    if (!serve(fd))
+      ::close(fd);
+  }
+
+  for (uint8_t i = 0; i < HTTP_WS_CLIENTS; i++)
+    if (_ws[i].fd >= 0)
+      receive(&_ws[i]);
+}
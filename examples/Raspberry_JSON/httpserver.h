@@ -0,0 +1,96 @@
+// **********************************************************************************
+// Raspberry PI LibTeleinfo minimal HTTP server include file
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo or use, see my blog
+// https://hallard.me/category/tinfo
+//
+// Just enough HTTP to be scraped: GET requests only, one client at a time,
+// connection closed after each answer unless a stream handler keeps it.
+// The listening socket is non blocking so handle() can be called from the
+// main loop between two serial reads.
+// One path can be a WebSocket (RFC 6455): clients stay connected, the same
+// message is framed once and written to all of them by broadcast(), a
+// client too slow to take it at once is dropped
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#ifndef HTTPSERVER_H
+#define HTTPSERVER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/select.h>
+#include "../../src/LibTeleinfo.h"
+
+#define HTTP_ROUTES   8
+#define HTTP_REQSIZE  1024  // request line and headers
+#define HTTP_TIMEOUT  200   // ms to receive a request
+
+#define HTTP_WS_CLIENTS 8
+#define HTTP_WS_RXSIZE  256 // client frame, only short commands expected
+
+// Route handler, query is after '?' in url (empty if none)
+typedef void (*HttpHandler)(int fd, const char * query);
+
+// Stream handler, returns true if it keeps the socket (event stream)
+typedef boolean (*HttpStreamHandler)(int fd, const char * query);
+
+// WebSocket handler, msg is NULL when client connects, else its text
+typedef void (*WsHandler)(int fd, const char * msg);
+
+typedef struct
+{
+  const char * path;
+  HttpHandler  fn;
+  HttpStreamHandler stream;
+} _HttpRoute;
+
+// WebSocket client and its partial frame
+typedef struct
+{
+  int     fd;       // -1 if free
+  size_t  len;
+  uint8_t buf[HTTP_WS_RXSIZE];
+} _HttpWsClient;
+
+class TInfoHttp
+{
+  public:
+    TInfoHttp();
+    boolean begin(int port);
+    void    on(const char * path, HttpHandler fn);
+    void    onStream(const char * path, HttpStreamHandler fn);
+    void    websocket(const char * path, WsHandler fn);
+    void    handle(void);
+    void    close(void);
+    int     fd(void) { return _fd; }
+    int     fdset(fd_set * set);
+    void    broadcast(const char * msg, size_t len);
+    uint8_t clients(void);
+    static boolean sendHeader(int fd, int code, const char * type);
+    static boolean send(int fd, const char * buf, size_t len);
+    static boolean wsSend(int fd, const char * msg, size_t len);
+
+  private:
+    boolean serve(int fd);
+    boolean upgrade(int fd, const char * headers);
+    void    receive(_HttpWsClient * k);
+    void    drop(_HttpWsClient * k);
+    static size_t wsHeader(uint8_t opcode, size_t len, uint8_t * head);
+    static boolean wsFrame(int fd, uint8_t opcode, const char * msg, size_t len);
+
+    int        _fd;
+    _HttpRoute _routes[HTTP_ROUTES];
+    uint8_t    _nroutes;
+    const char * _ws_path;
+    WsHandler  _ws_fn;
+    _HttpWsClient _ws[HTTP_WS_CLIENTS];
+};
+
+#endif
@@ -33,7 +33,22 @@
 #include <termios.h>
 #include <getopt.h>
 #include <sys/sysinfo.h>
-#include "../../LibTeleinfo.h"
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "../../src/LibTeleinfo.h"
+#include "../../src/LibTeleinfoDerived.h"
+#include "../../src/LibTeleinfoAggregate.h"
+#include "../../src/LibTeleinfoRules.h"
+#include "../../src/LibTeleinfoShedder.h"
+#include "../../src/LibTeleinfoMetrics.h"
+#include "../../src/LibTeleinfoDelta.h"
+#include "../../src/LibTeleinfoEvents.h"
+#include "../../src/LibTeleinfoFeed.h"
+#include "recorder.h"
+#include "capture.h"
+#include "httpserver.h"
 
 // ----------------
 // Constants
@@ -45,6 +60,13 @@
 #define TELEINFO_DEVICE   ""
 #define TELEINFO_BUFSIZE  512
 
+// Serial speed detection, historic mode is 1200 bps, Standard 9600 bps
+#define PROBE_TIME        4   // seconds of data read for each speed tried
+#define PROBE_GROUPS      3   // good groups needed to keep a speed
+#define PROBE_SILENCE     60  // seconds without frame before probing again
+static const int probe_bauds[] = { 1200, 9600 };
+#define PROBE_BAUDS       (int) (sizeof(probe_bauds) / sizeof(probe_bauds[0]))
+
 
 // Some enum for serial
 enum parity_e     {  P_NONE,  P_EVEN,    P_ODD };
@@ -63,11 +85,20 @@ static struct
   char parity_str[32];
   int databits;
   int verbose;
+  char record[128];
+  char capture[128];
+  char energy[32];
+  uint32_t from;
+  uint32_t to;
+  int shed;
+  int http;
+  char feed[64];
 // Configuration structure defaults values
 } opts ;
 
 
 void sendJSON(ValueList * me, boolean all);
+void log_syslog( FILE * stream, const char *format, ...);
 
 
 // ======================================================================
@@ -76,8 +107,55 @@ void sendJSON(ValueList * me, boolean all);
 int   g_fd_teleinfo;          // teleinfo serial handle
 struct termios g_oldtermios ; // old serial config
 int   g_exit_pgm;             // indicate en of the program
+time_t g_last_frame;          // time of last frame received
 struct sysinfo g_info;
 TInfo tinfo; // Teleinfo object
+TInfoRecorder recorder; // Frames history
+TInfoDerived derived; // Active power from indexes
+TInfoAggregate aggregate; // Min/max/mean between full frames
+TInfoRules rules; // Thresholds and events
+TInfoShedder shedder; // Loads shedding
+TInfoMetrics metrics; // OpenMetrics counters and values
+TInfoDelta delta; // Changed labels pushed to /ws and /events clients
+TInfoEvents events; // /events stream clients
+TInfoHttp http; // /metrics, /ws and /events server
+TInfoFeed feed; // Datagram of each frame for the multicast group
+int   g_fd_feed = -1;         // multicast feed socket
+struct sockaddr_in g_feed_addr;
+
+// Serial speed detection, done by main loop so it never blocks it
+struct
+{
+  int     speed;      // index in probe_bauds, -1 when speed is known
+  time_t  end;        // end of try of current speed
+  int     good;       // good groups received at current speed
+  _Mode_e mode;       // mode of last good group
+  int     idx;        // chars of current group, -1 if not in a group
+  char    group[TINFO_BUFSIZE];
+} g_probe = { -1, 0, 0, TINFO_MODE_AUTO, -1, "" };
+
+// Shed above 95% of subscribed, restore below 80% for 30 s
+const _TInfoShedConfig shed_config = { 950, 800, 2000, 30000 };
+
+// Loads outputs, printed as JSON since we have no relay there
+class ShedOutput : public TInfoOutput
+{
+  public:
+    void set(uint8_t load, boolean on)
+    {
+      printf( "{\"SHED\":%d, \"ON\":%d}\r\n", load, on ? 1 : 0);
+      fflush(stdout);
+    }
+};
+ShedOutput shed_output;
+
+// Overload near subscribed power for 5 s, tariff period changes
+const _TInfoRule rules_table[] = {
+  { "IINST",  TINFO_RULE_ABOVE,   900,    "ISOUSC", 1,   5000 },
+  { "SINSTS", TINFO_RULE_ABOVE,   900000, "PREF",   100, 5000 },
+  { "PTEC",   TINFO_RULE_CHANGED, 0,      NULL,     0,   0    },
+  { "NTARF",  TINFO_RULE_CHANGED, 0,      NULL,     0,   0    },
+};
 
 // Used to indicate if we need to send all date or just modified ones
 boolean fulldata = true;
@@ -98,12 +176,274 @@ void ADPSCallback(uint8_t phase)
 {
   // Envoyer JSON { "ADPS"; n}
   // n = numero de la phase 1 à 3
+  char alert[48];
+  int n;
+
+  // Evenement pour les clients /events, ADPS ou ADIRn
+  n = snprintf(alert, sizeof(alert), phase ? "{\"label\":\"ADIR%d\",\"phase\":%d}" : 
+                                             "{\"label\":\"ADPS\",\"phase\":0}", phase, phase);
+  events.send("alert", 0, alert, n);
+
   if (phase == 0)
     phase = 1;
   printf( "{\"ADPS\":%c}\r\n",'0' + phase);
   fflush(stdout);
 }
 
+/* ======================================================================
+Function: millis 
+Purpose : milliseconds from a monotonic clock, as on Arduino
+Input   : -
+Output  : ms
+Comments: -
+====================================================================== */
+uint32_t millis(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t) ts.tv_sec * 1000UL + ts.tv_nsec / 1000000UL;
+}
+
+/* ======================================================================
+Function: micros 
+Purpose : microseconds from a monotonic clock, as on Arduino
+Input   : -
+Output  : us
+Comments: -
+====================================================================== */
+uint32_t micros(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t) ts.tv_sec * 1000000UL + ts.tv_nsec / 1000UL;
+}
+
+/* ======================================================================
+Function: RuleCallback 
+Purpose : called when a rule becomes active or is released
+Input   : rule index in rules_table, true if active
+Output  : - 
+Comments: -
+====================================================================== */
+void RuleCallback(uint8_t rule, boolean active)
+{
+  printf( "{\"RULE\":\"%s\", \"ACTIVE\":%d}\r\n", rules_table[rule].name, active ? 1 : 0);
+  fflush(stdout);
+}
+
+/* ======================================================================
+Function: DataCallback 
+Purpose : called by library for each new or modified value
+Input   : value, flags TINFO_FLAGS_ADDED/TINFO_FLAGS_UPDATED
+Output  : - 
+Comments: -
+====================================================================== */
+void DataCallback(ValueList * me, uint8_t flags)
+{
+  rules.data(me, flags, millis());
+  shedder.data(me, flags, millis());
+}
+
+/* ======================================================================
+Function: MetricsHandler 
+Purpose : answer /metrics in OpenMetrics format
+Input   : client socket, query (not used)
+Output  : - 
+Comments: rendered a buffer at a time
+====================================================================== */
+void MetricsHandler(int fd, const char * /* query */)
+{
+  _TInfoMetricsCursor cursor;
+  char buffer[1024];
+  size_t n;
+
+  if (!TInfoHttp::sendHeader(fd, 200, TINFO_METRICS_TYPE))
+    return;
+
+  metrics.open(&cursor, millis());
+  while ( (n = metrics.render(&cursor, buffer, sizeof(buffer))) ) {
+    if (!TInfoHttp::send(fd, buffer, n))
+      break;
+  }
+}
+
+/* ======================================================================
+Function: LiveHandler 
+Purpose : WebSocket /ws, snapshot to a new client or on its demand
+Input   : client socket, text received (NULL when it connects)
+Output  : - 
+Comments: changed labels are then pushed to all clients by frame callbacks
+====================================================================== */
+void LiveHandler(int fd, const char * msg)
+{
+  static char buffer[TINFO_DELTA_SIZE * 2];
+  size_t n;
+
+  if (msg && strcmp(msg, TINFO_DELTA_ASK))
+    return;
+
+  if ( (n = delta.snapshot(buffer, sizeof(buffer))) )
+    TInfoHttp::wsSend(fd, buffer, n);
+}
+
+/* ======================================================================
+Function: EventsWrite 
+Purpose : write to an /events client without waiting
+Input   : client socket, chars and their number
+Output  : chars written, -1 if client is gone
+Comments: -
+====================================================================== */
+int EventsWrite(int fd, const char * buf, size_t len)
+{
+  ssize_t n = send(fd, buf, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+  if (n < 0)
+    return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+
+  return n;
+}
+
+/* ======================================================================
+Function: EventsClose 
+Purpose : close an /events client
+Input   : client socket
+Output  : - 
+Comments: -
+====================================================================== */
+void EventsClose(int fd)
+{
+  close(fd);
+}
+
+/* ======================================================================
+Function: EventsHandler 
+Purpose : /events, keep client for frame and alert events
+Input   : client socket, query (not used)
+Output  : true if client is kept
+Comments: first event has all labels
+====================================================================== */
+boolean EventsHandler(int fd, const char * /* query */)
+{
+  static char buffer[TINFO_DELTA_SIZE * 2];
+  size_t n;
+
+  if (events.clients() >= TINFO_EVENTS_CLIENTS) {
+    TInfoHttp::sendHeader(fd, 503, "text/plain");
+    return false;
+  }
+
+  if (!TInfoHttp::sendHeader(fd, 200, TINFO_EVENTS_TYPE) || !events.add(fd))
+    return false;
+
+  if ( (n = delta.snapshot(buffer, sizeof(buffer))) )
+    events.sendTo(fd, "frame", delta.seq(), buffer, n);
+
+  return true;
+}
+
+/* ======================================================================
+Function: pushFrame 
+Purpose : push labels changed by the frame to /ws and /events clients
+Input   : linked list pointer on the concerned data
+Output  : - 
+Comments: serialized once for all clients
+====================================================================== */
+void pushFrame(ValueList * me)
+{
+  if (!delta.frame(me, millis()))
+    return;
+
+  if (http.clients())
+    http.broadcast(delta.message(), delta.length());
+  events.send("frame", delta.seq(), delta.message(), delta.length());
+}
+
+/* ======================================================================
+Function: feedOpen 
+Purpose : open socket of multicast frame feed
+Input   : group:port
+Output  : false if address is not a multicast group or on socket error
+Comments: datagrams stay on local network (TTL 1)
+====================================================================== */
+boolean feedOpen(const char * dest)
+{
+  char group[64];
+  char * port;
+  unsigned char ttl = 1;
+
+  strncpy(group, dest, sizeof(group) - 1);
+  group[sizeof(group) - 1] = '\0';
+  if ( !(port = strchr(group, ':')) ) {
+    errno = EINVAL;
+    return false;
+  }
+  *port++ = '\0';
+
+  memset(&g_feed_addr, 0, sizeof(g_feed_addr));
+  g_feed_addr.sin_family = AF_INET;
+  g_feed_addr.sin_port = htons(atoi(port));
+  if (!inet_aton(group, &g_feed_addr.sin_addr) || !IN_MULTICAST(ntohl(g_feed_addr.sin_addr.s_addr)) ||
+      !g_feed_addr.sin_port) {
+    errno = EINVAL;
+    return false;
+  }
+
+  if ( (g_fd_feed = socket(AF_INET, SOCK_DGRAM, 0)) < 0 )
+    return false;
+  setsockopt(g_fd_feed, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+  return true;
+}
+
+/* ======================================================================
+Function: feedFrame 
+Purpose : send the frame to the multicast group
+Input   : linked list pointer on the concerned data
+Output  : - 
+Comments: called for every frame, receivers count lost ones with numbers
+====================================================================== */
+void feedFrame(ValueList * me)
+{
+  if (g_fd_feed < 0 || !feed.frame(me, millis()))
+    return;
+
+  if (sendto(g_fd_feed, feed.data(), feed.length(), MSG_DONTWAIT,
+             (struct sockaddr *) &g_feed_addr, sizeof(g_feed_addr)) < 0 && opts.verbose)
+    log_syslog(stderr, "cannot send feed frame %u: %s\n", feed.seq(), strerror(errno));
+}
+
+#ifdef TINFO_LATENCY
+/* ======================================================================
+Function: LatencyHandler 
+Purpose : answer /latency with stages histograms in JSON
+Input   : client socket, query (not used)
+Output  : - 
+Comments: -
+====================================================================== */
+void LatencyHandler(int fd, const char * /* query */)
+{
+  char buffer[512];
+  size_t n = tinfo.latencyJSON(buffer, sizeof(buffer));
+
+  if (TInfoHttp::sendHeader(fd, 200, "application/json"))
+    TInfoHttp::send(fd, buffer, n);
+}
+#endif
+
+/* ======================================================================
+Function: recordFrame 
+Purpose : append the frame just received to the record file
+Input   : -
+Output  : - 
+Comments: called for every frame, updated or not
+====================================================================== */
+void recordFrame(void)
+{
+  if (recorder.isOpen() && !recorder.addFrame(tinfo.getList(), time(NULL)))
+    log_syslog(stderr, "cannot write record file %s: %s\n", opts.record, strerror(errno));
+}
+
 /* ======================================================================
 Function: NewFrame 
 Purpose : callback when we received a complete teleinfo frame
@@ -113,6 +453,14 @@ Comments: -
 ====================================================================== */
 void NewFrame(ValueList * me)
 {
+  g_last_frame = time(NULL);
+  derived.frame(me, millis());
+  aggregate.frame(me);
+  metrics.frame(millis());
+  pushFrame(me);
+  feedFrame(me);
+  recordFrame();
+
   // Envoyer les valeurs uniquement si demandé
   if (fulldata) 
     sendJSON(me, true);
@@ -130,6 +478,14 @@ Comments: it's called only if one data in the frame is different than
 ====================================================================== */
 void UpdatedFrame(ValueList * me)
 {
+  g_last_frame = time(NULL);
+  derived.frame(me, millis());
+  aggregate.frame(me);
+  metrics.frame(millis());
+  pushFrame(me);
+  feedFrame(me);
+  recordFrame();
+
   // Envoyer les valeurs 
   sendJSON(me, fulldata);
   fulldata = false;
@@ -162,6 +518,10 @@ void sendJSON(ValueList * me, boolean all)
       // go to next node
       me = me->next;
 
+      // empty entry of the table
+      if (me->free)
+        continue;
+
       // uniquement sur les nouvelles valeurs ou celles modifiées 
       // sauf si explicitement demandé toutes
       if ( all || ( me->flags & (TINFO_FLAGS_UPDATED | TINFO_FLAGS_ADDED) ) )
@@ -196,11 +556,29 @@ void sendJSON(ValueList * me, boolean all)
           else
             printf("%ld",atol(me->value));
         }
+        // Standard mode DATE has only an horodate
+        else
+          printf("\"%s\"", me->horodate) ;
+      }
+    }
+
+    // Aggregates since last full frame
+    if (all) {
+      for (uint8_t i = 0; i < aggregate.count(); i++) {
+        _TInfoAggregate * a = aggregate.get(i);
+
+        if (a->count)
+          printf(", \"%s_MIN\":%d, \"%s_MAX\":%d, \"%s_AVG\":%d",
+                 a->name, a->min, a->name, a->max, a->name, TInfoAggregate::mean(a));
       }
+      aggregate.restart();
     }
    // Json end
    printf("}\r\n") ;
    fflush(stdout);
+#ifdef TINFO_LATENCY
+   tinfo.latencyExport();
+#endif
   }
 }
 
@@ -258,6 +636,32 @@ void clean_exit (int exit_code)
   // free up linked list
   tinfo.listDelete();
 
+  // write pending frames
+  recorder.close();
+  http.close();
+  if (g_fd_feed >= 0)
+    close(g_fd_feed);
+
+  // Decoder counters
+  TInfoStats stats;
+  tinfo.getStats(&stats);
+  fprintf(stderr, "{\"bytes\":%u, \"frames\":%u, \"aborted\":%u, \"groups\":%u, "
+                  "\"checksum\":%u, \"overflow\":%u, \"full\":%u, \"unknown\":%u, "
+                  "\"resync\":%u, \"recovered\":%u}\n",
+          stats.bytes, stats.frames, stats.aborted, stats.groups,
+          stats.checksum, stats.overflow, stats.full, stats.unknown,
+          stats.resync, stats.recovered);
+
+  // Shedding reaction times
+  if (opts.shed) {
+    fprintf(stderr, "shed latency (ms):");
+    for (uint8_t i = 0; i < TINFO_SHED_LATENCY; i++) {
+      if (shedder.latency(i))
+        fprintf(stderr, " <%u:%u", 1U << i, shedder.latency(i));
+    }
+    fprintf(stderr, "\n");
+  }
+
   // close serials
   if (g_fd_teleinfo)
   {
@@ -328,39 +732,40 @@ void signal_handler (int signum)
 }
 
 /* ======================================================================
-Function: tlf_init_serial
-Purpose : initialize serial port for receiving teleinfo
-Input   : -
-Output  : Serial Port Handle
-Comments: -
+Function: tlf_set_serial
+Purpose : set serial port speed and teleinfo framing
+Input   : Serial Port Handle
+          speed in bps
+Output  : true if speed has been set
+Comments: teleinfo is always 7 databits even parity, 1 stop bit
 ====================================================================== */
-int tlf_init_serial(void)
+int tlf_set_serial(int tty_fd, int baud)
 {
-  int tty_fd, r ;
   struct termios  termios ;
+  speed_t speed;
 
-  // Open serial device
-  if ( (tty_fd = open(opts.port, O_RDWR | O_NOCTTY | O_NDELAY | O_NONBLOCK)) < 0 ) 
-    fatal( "tlf_init_serial %s: %s", opts.port, strerror(errno));
-  else
-    log_syslog( stdout, "'%s' opened.\n",opts.port);
-    
-  // Set descriptor status flags
-  fcntl (tty_fd, F_SETFL, O_RDWR ) ;
+  switch (baud) {
+    case 1200:  speed = B1200;  break;
+    case 2400:  speed = B2400;  break;
+    case 4800:  speed = B4800;  break;
+    case 9600:  speed = B9600;  break;
+    case 19200: speed = B19200; break;
+    default:
+      log_syslog(stderr, "unsupported serial speed %d bps\n", baud);
+      return false;
+  }
 
-  // Get current parameters for saving
-  if (  (r = tcgetattr(tty_fd, &g_oldtermios)) < 0 )
-    log_syslog(stderr, "cannot get current parameters %s: %s",  opts.port, strerror(errno));
-    
-  // copy current parameters and change for our own
+  // copy saved parameters and change for our own
   memcpy( &termios, &g_oldtermios, sizeof(termios)); 
   
   // raw mode
   cfmakeraw(&termios);
   
-  // Set serial speed to 1200 bps
-  if (cfsetospeed(&termios, B1200) < 0 || cfsetispeed(&termios, B1200) < 0 )
-    log_syslog(stderr, "cannot set serial speed to 1200 bps: %s",  strerror(errno));
+  // Set serial speed
+  if (cfsetospeed(&termios, speed) < 0 || cfsetispeed(&termios, speed) < 0 ) {
+    log_syslog(stderr, "cannot set serial speed to %d bps: %s", baud, strerror(errno));
+    return false;
+  }
     
   // Parity Even
   termios.c_cflag &= ~PARODD;
@@ -381,14 +786,143 @@ int tlf_init_serial(void)
   termios.c_cc [VTIME] = 50 ; 
 
   // now setup the whole parameters
-  if ( tcsetattr (tty_fd, TCSANOW | TCSAFLUSH, &termios) <0) 
+  if ( tcsetattr (tty_fd, TCSANOW | TCSAFLUSH, &termios) <0) {
     log_syslog(stderr, "cannot set current parameters %s: %s",  opts.port, strerror(errno));
+    return false;
+  }
     
   // Sleep 50ms
   // trust me don't forget this one, it will remove you some
   // headache to find why serial is not working
   usleep(50000);
 
+  return true;
+}
+
+/* ======================================================================
+Function: tlf_probe_speed
+Purpose : try a serial speed for the meter
+Input   : Serial Port Handle
+          index of speed in probe_bauds
+Output  : -
+Comments: chars read are then given to tlf_probe_data() until the speed
+          is found or PROBE_TIME is over
+====================================================================== */
+void tlf_probe_speed(int tty_fd, int speed)
+{
+  if (opts.verbose)
+    log_syslog(stdout, "Trying %d bps\n", probe_bauds[speed]);
+
+  g_probe.speed = speed;
+  g_probe.good = 0;
+  g_probe.idx = -1;
+  g_probe.end = time(NULL) + PROBE_TIME;
+
+  // speed not set, try next one at next tick
+  if (!tlf_set_serial(tty_fd, probe_bauds[speed]))
+    g_probe.end = 0;
+
+  // forget what we received with previous speed
+  tcflush(tty_fd, TCIFLUSH);
+}
+
+/* ======================================================================
+Function: tlf_probe_data
+Purpose : count good teleinfo groups received with current serial speed
+Input   : chars read, number of chars
+Output  : speed found, 0 if not yet
+Comments: a group is good if its checksum is right in historic or
+          Standard mode, with a wrong speed we only get garbage
+====================================================================== */
+int tlf_probe_data(const char * buff, int n)
+{
+  for (int i = 0; i < n; i++) {
+    char c = buff[i] & 0x7F;
+
+    if (c == TINFO_SGR) {
+      g_probe.idx = 0;
+    } else if (c == TINFO_EGR) {
+      if (g_probe.idx > 0) {
+        _Mode_e m = TInfo::groupMode(g_probe.group, g_probe.idx);
+        if (m != TINFO_MODE_AUTO) {
+          g_probe.mode = m;
+          g_probe.good++;
+        }
+      }
+      g_probe.idx = -1;
+    } else if (g_probe.idx >= 0) {
+      // too long, can't be a group
+      if (g_probe.idx < (int) sizeof(g_probe.group))
+        g_probe.group[g_probe.idx++] = c;
+      else
+        g_probe.idx = -1;
+    }
+  }
+
+  if (g_probe.good < PROBE_GROUPS)
+    return 0;
+
+  log_syslog(stdout, "Teleinfo found at %d bps, %s mode\n", probe_bauds[g_probe.speed],
+             g_probe.mode == TINFO_MODE_STANDARD ? "standard" : "historic");
+  n = probe_bauds[g_probe.speed];
+  g_probe.speed = -1;
+  return n;
+}
+
+/* ======================================================================
+Function: tlf_probe_tick
+Purpose : go to next speed when time of current one is over
+Input   : Serial Port Handle
+Output  : -
+Comments: called by main loop, never waits, so /metrics, /ws and /events
+          clients are served while no meter answers. After the last speed
+          probing starts again from the first one
+====================================================================== */
+void tlf_probe_tick(int tty_fd)
+{
+  if (g_probe.speed < 0 || time(NULL) < g_probe.end)
+    return;
+
+  if (g_probe.speed + 1 < PROBE_BAUDS) {
+    tlf_probe_speed(tty_fd, g_probe.speed + 1);
+  } else {
+    log_syslog(stderr, "No teleinfo found on %s, trying again\n", opts.port);
+    tlf_probe_speed(tty_fd, 0);
+  }
+}
+
+/* ======================================================================
+Function: tlf_init_serial
+Purpose : initialize serial port for receiving teleinfo
+Input   : -
+Output  : Serial Port Handle
+Comments: speed is detected if not given in options
+====================================================================== */
+int tlf_init_serial(void)
+{
+  int tty_fd, r ;
+
+  // Open serial device
+  if ( (tty_fd = open(opts.port, O_RDWR | O_NOCTTY | O_NDELAY | O_NONBLOCK)) < 0 ) 
+    fatal( "tlf_init_serial %s: %s", opts.port, strerror(errno));
+  else
+    log_syslog( stdout, "'%s' opened.\n",opts.port);
+    
+  // Set descriptor status flags
+  fcntl (tty_fd, F_SETFL, O_RDWR ) ;
+
+  // Get current parameters for saving
+  if (  (r = tcgetattr(tty_fd, &g_oldtermios)) < 0 )
+    log_syslog(stderr, "cannot get current parameters %s: %s",  opts.port, strerror(errno));
+    
+  // Use the speed asked or detect it from main loop
+  if (opts.baud) {
+    if (!tlf_set_serial(tty_fd, opts.baud))
+      fatal("cannot set %s to %d bps", opts.port, opts.baud);
+  } else {
+    tlf_probe_speed(tty_fd, 0);
+  }
+
   return tty_fd ;
 }
 
@@ -423,13 +957,28 @@ int usage( char * name)
   printf("Usage is: %s [options] -d device\n", PRG_NAME);
   printf("Options are:\n");
   printf("  --<d>evice dev : open serial device name\n");
+  printf("  --<b>aud bps   : serial speed, 0 to detect it (default)\n");
   printf("  --<v>erbose    : speak more to user\n");
+  printf("  --<r>ecord file: append each frame to a compressed record file\n");
+  printf("  --<e>nergy lbl : print energy of index lbl between --from and --to\n");
+  printf("                   from the record file, then exit\n");
+  printf("  --<c>apture f  : decode raw teleinfo capture file instead of device\n");
+  printf("  --<f>rom time  : start of energy query (epoch seconds)\n");
+  printf("  --<t>o time    : end of energy query (epoch seconds, default now)\n");
+  printf("  --<s>hed n     : shed n simulated loads on overload (printed as JSON)\n");
+  printf("  --<w>eb port   : serve /metrics (OpenMetrics), /ws (WebSocket) and /events on TCP port\n");
+  printf("  --<m>ulticast g: send each frame to multicast group:port (see ticfeed)\n");
   printf("  --<h>elp\n");
   printf("<?> indicates the equivalent short option.\n");
   printf("Short options are prefixed by \"-\" instead of by \"--\".\n");
   printf("Example :\n");
   printf( "%s -d /dev/ttyAMA0\n\tstart listeming on hardware serial port /dev/ttyAMA0\n\n", PRG_NAME);
   printf( "%s -d /dev/ttyUSB0\n\tstart listeming on USB microteleinfo dongle\n\n", PRG_NAME);
+  printf( "%s -d /dev/ttyUSB0 -r /var/lib/teleinfo.rec\n\tsame as above and keep history of frames\n\n", PRG_NAME);
+  printf( "%s -c /var/lib/teleinfo.raw\n\tdecode a raw capture of teleinfo bytes\n\n", PRG_NAME);
+  printf( "%s -r /var/lib/teleinfo.rec -e HCHC -f 1500000000\n\tenergy of HCHC index since given time\n\n", PRG_NAME);
+  printf( "%s -d /dev/ttyUSB0 -w 9100\n\tsame as above and serve http://host:9100/metrics\n\n", PRG_NAME);
+  printf( "%s -d /dev/ttyUSB0 -m 239.255.12.1:1201\n\tsame as above and send frames to LAN receivers\n\n", PRG_NAME);
 }
 
 /* ======================================================================
@@ -446,7 +995,16 @@ void read_config(int argc, char *argv[])
   static struct option longOptions[] =
   {
     {"port",    required_argument,0, 'p'},
+    {"baud",    required_argument,0, 'b'},
     {"verbose", no_argument,      0, 'v'},
+    {"record",  required_argument,0, 'r'},
+    {"energy",  required_argument,0, 'e'},
+    {"capture", required_argument,0, 'c'},
+    {"from",    required_argument,0, 'f'},
+    {"to",      required_argument,0, 't'},
+    {"shed",    required_argument,0, 's'},
+    {"web",     required_argument,0, 'w'},
+    {"multicast",required_argument,0, 'm'},
     {"help",    no_argument,      0, 'h'},
     {0, 0, 0, 0}
   };
@@ -463,17 +1021,25 @@ void read_config(int argc, char *argv[])
   
   // default values
   *opts.port = '\0';
-  opts.baud = 1200;
+  opts.baud = 0;
   opts.flow = FC_NONE;
   strcpy(opts.flow_str, "none");
   opts.parity = P_EVEN;
   strcpy(opts.parity_str, "even");
   opts.databits = 7;
   opts.verbose = false;
+  *opts.record = '\0';
+  *opts.energy = '\0';
+  *opts.capture = '\0';
+  opts.from = 0;
+  opts.to = time(NULL);
+  opts.shed = 0;
+  opts.http = 0;
+  *opts.feed = '\0';
 
   
   // default options
-  strcpy( str_opt, "hvd:");
+  strcpy( str_opt, "hvd:b:r:e:c:f:t:s:w:m:");
 
   // We will scan all options given on command line.
   while (1) 
@@ -499,6 +1065,46 @@ void read_config(int argc, char *argv[])
         opts.port[sizeof(opts.port) - 1] = '\0';
       break;
 
+      case 'b':
+        opts.baud = atoi(optarg);
+      break;
+
+      case 'r':
+        strncpy(opts.record, optarg, sizeof(opts.record) - 1);
+        opts.record[sizeof(opts.record) - 1] = '\0';
+      break;
+
+      case 'e':
+        strncpy(opts.energy, optarg, sizeof(opts.energy) - 1);
+        opts.energy[sizeof(opts.energy) - 1] = '\0';
+      break;
+
+      case 'c':
+        strncpy(opts.capture, optarg, sizeof(opts.capture) - 1);
+        opts.capture[sizeof(opts.capture) - 1] = '\0';
+      break;
+
+      case 'f':
+        opts.from = strtoul(optarg, NULL, 10);
+      break;
+
+      case 't':
+        opts.to = strtoul(optarg, NULL, 10);
+      break;
+
+      case 's':
+        opts.shed = atoi(optarg);
+      break;
+
+      case 'w':
+        opts.http = atoi(optarg);
+      break;
+
+      case 'm':
+        strncpy(opts.feed, optarg, sizeof(opts.feed) - 1);
+        opts.feed[sizeof(opts.feed) - 1] = '\0';
+      break;
+
       // These ones exit direct
       case 'h':
       case '?':
@@ -514,7 +1120,13 @@ void read_config(int argc, char *argv[])
     }
   } 
   
-  if ( !*opts.port)
+  if ( *opts.energy && !*opts.record)
+  { 
+    fprintf(stderr, "Energy query needs a record file (--record)\n");
+    exit(EXIT_FAILURE);
+  }
+
+  if ( !*opts.port && !*opts.energy && !*opts.capture)
   { 
     fprintf(stderr, "No tty device given\n");
     fprintf(stderr, "please select at least tty device such as /dev/ttyS0\n");
@@ -529,16 +1141,70 @@ void read_config(int argc, char *argv[])
     printf("-- Serial Stuff -- \n");
     printf("tty device     : %s\n", opts.port);
     printf("flowcontrol    : %s\n", opts.flow_str);
-    printf("baudrate is    : %d\n", opts.baud);
+    if (opts.baud)
+      printf("baudrate is    : %d\n", opts.baud);
+    else
+      printf("baudrate is    : auto\n");
     printf("parity is      : %s\n", opts.parity_str);
     printf("databits are   : %d\n", opts.databits);
 
     printf("-- Other Stuff -- \n");
     printf("verbose is     : %s\n", opts.verbose? "yes" : "no");
+    printf("record file    : %s\n", *opts.record ? opts.record : "none");
+    printf("capture file   : %s\n", *opts.capture ? opts.capture : "none");
     printf("\n");
   } 
 }
 
+/* ======================================================================
+Function: query_energy
+Purpose : display energy of one index between two dates from record file
+Input   : -
+Output  : exit code
+Comments: -
+====================================================================== */
+int query_energy(void)
+{
+  TInfoRecordReader reader;
+  int64_t wh;
+
+  if (!reader.open(opts.record)) {
+    fprintf(stderr, "cannot open record file %s\n", opts.record);
+    return EXIT_FAILURE;
+  }
+
+  if (!reader.energy(opts.energy, opts.from, opts.to, &wh)) {
+    fprintf(stderr, "no %s value recorded at %u and %u\n", opts.energy, opts.from, opts.to);
+    reader.close();
+    return EXIT_FAILURE;
+  }
+
+  printf("{\"%s\":%lld, \"from\":%u, \"to\":%u}\r\n", opts.energy, (long long) wh, opts.from, opts.to);
+  reader.close();
+  return EXIT_SUCCESS;
+}
+
+/* ======================================================================
+Function: decode_capture
+Purpose : decode a raw capture file, sending JSON as for serial port
+Input   : -
+Output  : exit code
+Comments: -
+====================================================================== */
+int decode_capture(void)
+{
+  TInfoCapture capture;
+
+  if (!capture.open(opts.capture)) {
+    fprintf(stderr, "cannot open capture file %s: %s\n", opts.capture, strerror(errno));
+    return EXIT_FAILURE;
+  }
+
+  capture.decode(tinfo);
+  capture.close();
+  return EXIT_SUCCESS;
+}
+
 /* ======================================================================
 Function: main
 Purpose : Main entry Point
@@ -550,6 +1216,7 @@ int main(int argc, char **argv)
 {
   struct sigaction sa;
   fd_set rdset, wrset;
+  int   maxfd;
   unsigned char c;
   char  rcv_buff[TELEINFO_BUFSIZE];
   int   rcv_idx;
@@ -565,6 +1232,10 @@ int main(int argc, char **argv)
   // get configuration
   read_config(argc, argv);
 
+  // Energy query on record file, no need of serial
+  if (*opts.energy) 
+    return query_energy();
+
   // Set up the structure to specify the exit action.
   sa.sa_handler = signal_handler;
   sa.sa_flags = SA_RESTART;
@@ -572,28 +1243,103 @@ int main(int argc, char **argv)
   sigaction (SIGTERM, &sa, NULL);
   sigaction (SIGINT, &sa, NULL); 
 
-  // Open serial port
-  g_fd_teleinfo = tlf_init_serial();
-
   // Init teleinfo
   tinfo.init();
+  aggregate.init();
+  rules.init(rules_table, sizeof(rules_table) / sizeof(rules_table[0]), RuleCallback);
+  if (opts.shed)
+    shedder.init(&tinfo, &shed_output, opts.shed, &shed_config);
+
+  // Open history file
+  if (*opts.record && !recorder.open(opts.record))
+    fatal("cannot open record file %s: %s", opts.record, strerror(errno));
 
   // Attacher les callback dont nous avons besoin
   // pour cette demo, ADPS et TRAME modifiée
   tinfo.attachADPS(ADPSCallback);
+  tinfo.attachData(DataCallback);
   tinfo.attachUpdatedFrame(UpdatedFrame);
   tinfo.attachNewFrame(NewFrame); 
 
+  // Frames sent to LAN receivers, also from a capture
+  if (*opts.feed && !feedOpen(opts.feed))
+    fatal("cannot send to multicast group %s: %s", opts.feed, strerror(errno));
+
+  // Offline decoding of a capture file
+  if (*opts.capture) 
+    clean_exit(decode_capture());
+
+  // Open serial port
+  g_fd_teleinfo = tlf_init_serial();
+  g_last_frame = time(NULL);
+
+  // Derived values need real frame times, not for captures
+  derived.init(&tinfo);
+  metrics.init(&tinfo);
+  delta.init(&tinfo);
+  events.init(EventsWrite, EventsClose);
+
+  // Metrics server
+  if (opts.http) {
+    if (!http.begin(opts.http))
+      fatal("cannot listen on port %d: %s", opts.http, strerror(errno));
+    http.on("/metrics", MetricsHandler);
+    http.websocket("/ws", LiveHandler);
+    http.onStream("/events", EventsHandler);
+#ifdef TINFO_LATENCY
+    http.on("/latency", LatencyHandler);
+#endif
+  }
+
   log_syslog(stdout, "Inits succeded, entering Main loop\n");
   
   // Do while not end
   while ( ! g_exit_pgm ) {
-    // Read from serial port
-    n = read(g_fd_teleinfo, &c, 1);
-    
-    if (n >= 0)
-      tinfo.process(c);
+    struct timeval tv;
+    uint32_t start;
+
+    // Wait for chars or a scrape, serial read would wait VTIME
+    FD_ZERO(&rdset);
+    FD_SET(g_fd_teleinfo, &rdset);
+    maxfd = http.fdset(&rdset);
+    if (maxfd < g_fd_teleinfo)
+      maxfd = g_fd_teleinfo;
+    tv.tv_sec = 1;
+    tv.tv_usec = 0;
+    n = select(maxfd + 1, &rdset, NULL, NULL, &tv);
+    start = micros();
+
+    // Read all available chars from serial port
+    if (n > 0 && FD_ISSET(g_fd_teleinfo, &rdset)) {
+      n = read(g_fd_teleinfo, rcv_buff, sizeof(rcv_buff));
+
+      // Chars are for speed detection until speed is found, groups are
+      // timed from their read, for shedder reaction times
+      if (n > 0 && g_probe.speed >= 0) {
+        if (tlf_probe_data(rcv_buff, n))
+          g_last_frame = time(NULL);
+      } else if (n > 0) {
+        tinfo.process(rcv_buff, n, millis());
+      }
+    }
+
+    // Rules waiting for their duration
+    rules.tick(millis());
+    shedder.tick(millis());
+
+    // Frames recorded a minute ago are written even if meter is silent
+    if (recorder.isOpen() && !recorder.tick(time(NULL)))
+      log_syslog(stderr, "cannot write record file %s: %s\n", opts.record, strerror(errno));
     
+    // Speed detection going on, or nothing received for a while and
+    // meter speed may have changed
+    if (g_probe.speed >= 0) {
+      tlf_probe_tick(g_fd_teleinfo);
+    } else if (!opts.baud && time(NULL) > g_last_frame + PROBE_SILENCE) {
+      log_syslog(stderr, "No frame for %d sec, probing speed\n", PROBE_SILENCE);
+      tlf_probe_speed(g_fd_teleinfo, 0);
+    }
+
     // Check full frame every 60 sec
     sysinfo(&info);
     if (info.uptime >= g_info.uptime + 60) {
@@ -601,6 +1347,11 @@ int main(int argc, char **argv)
       fulldata = true;
     }
     
+    // Scrapes and WebSocket clients waiting, events not sent yet
+    http.handle();
+    events.flush();
+    metrics.loop(micros() - start);
+
     // Sleep 10ms; let time to others process
     usleep(10000);
   } 
@@ -0,0 +1,686 @@
+// **********************************************************************************
+// Raspberry PI LibTeleinfo columnar frame recorder
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo or use, see my blog
+// https://hallard.me/category/tinfo
+//
+// Chunk layout on disk (little endian)
+//   u32 magic "TCHK"
+//   u32 size of the chunk following this field
+//   u16 frames count, u16 columns count
+//   u32 first timestamp, u32 last timestamp
+//   u32 timestamps size, timestamps varint deltas
+//   for each column :
+//     u8 type, u8 label length, label, u16 first frame, u32 data size, data
+//   numeric column : one zigzag varint delta per frame
+//   text column    : one varint per frame, 0 unchanged else length+1 then bytes
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "recorder.h"
+
+/* ======================================================================
+Function: bufPut
+Purpose : append bytes to a growing buffer
+Input   : buffer, data pointer and size
+Output  : true if ok, false if out of memory
+Comments: -
+====================================================================== */
+static boolean bufPut(_TRecBuffer * b, const void * data, size_t len)
+{
+  if (b->size + len > b->alloc) {
+    size_t alloc = b->alloc ? b->alloc * 2 : 256;
+    uint8_t * p;
+
+    while (alloc < b->size + len)
+      alloc *= 2;
+
+    if ( (p = (uint8_t *) realloc(b->data, alloc)) == NULL )
+      return false;
+
+    b->data = p;
+    b->alloc = alloc;
+  }
+  memcpy(b->data + b->size, data, len);
+  b->size += len;
+  return true;
+}
+
+/* ======================================================================
+Function: bufVarint
+Purpose : append an unsigned LEB128 varint to a growing buffer
+Input   : buffer, value
+Output  : true if ok, false if out of memory
+Comments: -
+====================================================================== */
+static boolean bufVarint(_TRecBuffer * b, uint64_t v)
+{
+  uint8_t tmp[10];
+  uint8_t n = 0;
+
+  do {
+    tmp[n] = v & 0x7F;
+    v >>= 7;
+    if (v)
+      tmp[n] |= 0x80;
+    n++;
+  } while (v);
+
+  return bufPut(b, tmp, n);
+}
+
+/* ======================================================================
+Function: getVarint
+Purpose : read an unsigned LEB128 varint from a memory area
+Input   : pointer on current position (updated), end of area, value
+Output  : true if ok, false if area is truncated
+Comments: -
+====================================================================== */
+static boolean getVarint(const uint8_t ** pp, const uint8_t * end, uint64_t * v)
+{
+  const uint8_t * p = *pp;
+  uint64_t val = 0;
+  uint8_t shift = 0;
+
+  while (p < end && shift < 64) {
+    val |= (uint64_t) (*p & 0x7F) << shift;
+    if ( !(*p++ & 0x80) ) {
+      *pp = p;
+      *v = val;
+      return true;
+    }
+    shift += 7;
+  }
+  return false;
+}
+
+// zigzag encoding so small negative deltas stay small
+static uint64_t zigzag(int64_t v)   { return ((uint64_t) v << 1) ^ (uint64_t) (v >> 63); }
+static int64_t  unzigzag(uint64_t v) { return (int64_t) (v >> 1) ^ -(int64_t) (v & 1); }
+
+static void     put16(uint8_t * p, uint16_t v) { p[0] = v; p[1] = v >> 8; }
+static void     put32(uint8_t * p, uint32_t v) { p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24; }
+static uint16_t get16(const uint8_t * p) { return p[0] | (p[1] << 8); }
+static uint32_t get32(const uint8_t * p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24); }
+
+/* ======================================================================
+Function: isNumeric
+Purpose : check if a TIC value can be stored in a numeric column
+Input   : value string
+Output  : true if only digits (and not too long for an int64)
+Comments: leading zeros of indexes are not kept
+====================================================================== */
+static boolean isNumeric(const char * value)
+{
+  uint8_t len = 0;
+
+  if (!*value)
+    return false;
+
+  while (*value) {
+    if (*value < '0' || *value > '9' || ++len > 18)
+      return false;
+    value++;
+  }
+  return true;
+}
+
+/* ======================================================================
+Function: writeAll
+Purpose : write a whole buffer to a file descriptor
+Input   : file descriptor, data, size
+Output  : true if ok
+Comments: -
+====================================================================== */
+static boolean writeAll(int fd, const void * data, size_t len)
+{
+  const uint8_t * p = (const uint8_t *) data;
+  ssize_t n;
+
+  while (len) {
+    n = write(fd, p, len);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+/* ======================================================================
+Class   : TInfoRecorder
+Purpose : Constructor
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+TInfoRecorder::TInfoRecorder()
+{
+  _fd = -1;
+  memset(&_ts, 0, sizeof(_ts));
+  memset(_columns, 0, sizeof(_columns));
+  _nframes = 0;
+  _ncolumns = 0;
+}
+
+/* ======================================================================
+Function: open
+Purpose : open (or create) a record file for appending frames
+Input   : file path
+Output  : true if ok
+Comments: a file header is written if the file is new
+====================================================================== */
+boolean TInfoRecorder::open(const char * path)
+{
+  struct stat st;
+
+  if ( (_fd = ::open(path, O_WRONLY | O_CREAT | O_APPEND, 0644)) < 0 )
+    return false;
+
+  if ( fstat(_fd, &st) < 0 || (st.st_size == 0 && !writeAll(_fd, TREC_MAGIC, TREC_MAGIC_SIZE)) ) {
+    ::close(_fd);
+    _fd = -1;
+    return false;
+  }
+
+  resetChunk();
+  return true;
+}
+
+/* ======================================================================
+Function: resetChunk
+Purpose : empty the current chunk keeping allocated buffers
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+void TInfoRecorder::resetChunk(void)
+{
+  _ts.size = 0;
+  for (uint8_t i = 0; i < _ncolumns; i++)
+    _columns[i].buf.size = 0;
+  _ncolumns = 0;
+  _nframes = 0;
+}
+
+/* ======================================================================
+Function: findColumn
+Purpose : get the column of a label in the current chunk
+Input   : label name
+Output  : column pointer, NULL if not found
+Comments: -
+====================================================================== */
+_TRecColumn * TInfoRecorder::findColumn(const char * name)
+{
+  for (uint8_t i = 0; i < _ncolumns; i++) {
+    if (strcmp(_columns[i].name, name) == 0)
+      return &_columns[i];
+  }
+  return NULL;
+}
+
+/* ======================================================================
+Function: column
+Purpose : get (or create) the column of a label in the current chunk
+Input   : label name, wanted type
+Output  : column pointer, NULL if table is full or type differs
+Comments: -
+====================================================================== */
+_TRecColumn * TInfoRecorder::column(const char * name, uint8_t type)
+{
+  _TRecColumn * col = findColumn(name);
+  _TRecBuffer   buf;
+
+  if (col)
+    return col->type == type ? col : NULL;
+
+  if (_ncolumns >= TREC_MAX_COLUMNS)
+    return NULL;
+
+  // keep buffer already allocated by a previous chunk
+  col = &_columns[_ncolumns++];
+  buf = col->buf;
+  memset(col, 0, sizeof(_TRecColumn));
+  col->buf = buf;
+  col->buf.size = 0;
+
+  strncpy(col->name, name, TREC_LABEL_SIZE);
+  col->type = type;
+  col->first_frame = _nframes;
+  return col;
+}
+
+/* ======================================================================
+Function: typeChanged
+Purpose : check if a label of the frame changed between numeric and text
+Input   : top of the values table
+Output  : true if one label changed type in the current chunk
+Comments: -
+====================================================================== */
+boolean TInfoRecorder::typeChanged(ValueList * me)
+{
+  for ( ; me ; me = me->next) {
+    if (me->free || !*me->name)
+      continue;
+
+    _TRecColumn * col = findColumn(me->name);
+    if (col && col->type != (isNumeric(me->value) ? TREC_COL_NUMERIC : TREC_COL_TEXT))
+      return true;
+  }
+  return false;
+}
+
+/* ======================================================================
+Function: addFrame
+Purpose : append one decoded frame to the record
+Input   : top of the values table, timestamp (epoch seconds)
+Output  : true if ok
+Comments: chunk is written to file when full or TREC_CHUNK_SECS old.
+          Out of memory, the chunk has a frame half written and is
+          dropped
+====================================================================== */
+boolean TInfoRecorder::addFrame(ValueList * me, uint32_t t)
+{
+  boolean ok = true;
+
+  if (_fd < 0 || !me)
+    return false;
+
+  // a column has only one type, start a new chunk if needed
+  if (_nframes > 0 && typeChanged(me) && !flush())
+    return false;
+
+  if (_nframes == 0) {
+    _t_first = t;
+    _t_prev = t;
+  }
+
+  // Clock going backward is stored as "same time"
+  if (t < _t_prev)
+    t = _t_prev;
+  if (!bufVarint(&_ts, t - _t_prev)) {
+    resetChunk();
+    return false;
+  }
+  _t_prev = t;
+
+  for ( ; me && ok ; me = me->next) {
+    if (me->free || !*me->name)
+      continue;
+
+    uint8_t type = isNumeric(me->value) ? TREC_COL_NUMERIC : TREC_COL_TEXT;
+    _TRecColumn * col = column(me->name, type);
+
+    if (!col)
+      continue;
+
+    // fill the frames this label was missing as "unchanged"
+    while (ok && col->first_frame + col->count < _nframes) {
+      ok = bufVarint(&col->buf, 0);
+      col->count++;
+    }
+
+    if (type == TREC_COL_NUMERIC) {
+      int64_t v = strtoll(me->value, NULL, 10);
+      ok &= bufVarint(&col->buf, zigzag(v - col->last_num));
+      col->last_num = v;
+    } else if (col->count && strcmp(col->last_text, me->value) == 0) {
+      ok &= bufVarint(&col->buf, 0);
+    } else {
+      size_t len = strlen(me->value);
+      ok &= bufVarint(&col->buf, len + 1) && bufPut(&col->buf, me->value, len);
+      strncpy(col->last_text, me->value, TREC_VALUE_SIZE - 1);
+    }
+    col->count++;
+  }
+
+  if (!ok) {
+    resetChunk();
+    return false;
+  }
+
+  if (++_nframes >= TREC_CHUNK_FRAMES || t - _t_first >= TREC_CHUNK_SECS)
+    return flush();
+
+  return true;
+}
+
+/* ======================================================================
+Function: tick
+Purpose : write the current chunk if it is old enough
+Input   : current time (epoch seconds)
+Output  : true if ok
+Comments: call it even when no frame comes, so frames received before
+          the meter went silent are not only in memory
+====================================================================== */
+boolean TInfoRecorder::tick(uint32_t t)
+{
+  if (_fd < 0 || _nframes == 0 || t < _t_first || t - _t_first < TREC_CHUNK_SECS)
+    return true;
+
+  return flush();
+}
+
+/* ======================================================================
+Function: flush
+Purpose : write the current chunk to the file
+Input   : -
+Output  : true if ok
+Comments: -
+====================================================================== */
+boolean TInfoRecorder::flush(void)
+{
+  _TRecBuffer out;
+  uint8_t hdr[24];
+  boolean ok = true;
+
+  if (_fd < 0 || _nframes == 0)
+    return _fd >= 0;
+
+  memset(&out, 0, sizeof(out));
+
+  // chunk header, size patched when everything is known
+  put32(hdr, TREC_CHUNK_MAGIC);
+  put32(hdr + 4, 0);
+  put16(hdr + 8, _nframes);
+  put16(hdr + 10, _ncolumns);
+  put32(hdr + 12, _t_first);
+  put32(hdr + 16, _t_prev);
+  put32(hdr + 20, _ts.size);
+  ok &= bufPut(&out, hdr, 24);
+  ok &= bufPut(&out, _ts.data, _ts.size);
+
+  for (uint8_t i = 0; i < _ncolumns && ok; i++) {
+    _TRecColumn * col = &_columns[i];
+    uint8_t lg = strlen(col->name);
+
+    // pad label missing in last frames
+    while (ok && col->first_frame + col->count < _nframes) {
+      ok = bufVarint(&col->buf, 0);
+      col->count++;
+    }
+
+    hdr[0] = col->type;
+    hdr[1] = lg;
+    ok &= bufPut(&out, hdr, 2);
+    ok &= bufPut(&out, col->name, lg);
+    put16(hdr, col->first_frame);
+    put32(hdr + 2, col->buf.size);
+    ok &= bufPut(&out, hdr, 6);
+    ok &= bufPut(&out, col->buf.data, col->buf.size);
+  }
+
+  if (ok) {
+    put32(out.data + 4, out.size - 8);
+    ok = writeAll(_fd, out.data, out.size);
+  }
+
+  free(out.data);
+  resetChunk();
+  return ok;
+}
+
+/* ======================================================================
+Function: close
+Purpose : flush pending frames and close the record file
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+void TInfoRecorder::close(void)
+{
+  if (_fd < 0)
+    return;
+
+  flush();
+  ::close(_fd);
+  _fd = -1;
+
+  free(_ts.data);
+  memset(&_ts, 0, sizeof(_ts));
+  for (uint8_t i = 0; i < TREC_MAX_COLUMNS; i++) {
+    free(_columns[i].buf.data);
+    memset(&_columns[i].buf, 0, sizeof(_TRecBuffer));
+  }
+}
+
+/* ======================================================================
+Class   : TInfoRecordReader
+Purpose : Constructor
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+TInfoRecordReader::TInfoRecordReader()
+{
+  _map = NULL;
+  _size = 0;
+  _chunks = NULL;
+  _nchunks = 0;
+}
+
+/* ======================================================================
+Function: open
+Purpose : map a record file in memory and index its chunks
+Input   : file path
+Output  : true if ok
+Comments: a truncated last chunk (crash while writing) is ignored
+====================================================================== */
+boolean TInfoRecordReader::open(const char * path)
+{
+  struct stat st;
+  const uint8_t * p;
+  const uint8_t * end;
+  uint32_t alloc = 0;
+  int fd;
+
+  if ( (fd = ::open(path, O_RDONLY)) < 0 )
+    return false;
+
+  if (fstat(fd, &st) < 0 || st.st_size < TREC_MAGIC_SIZE) {
+    ::close(fd);
+    return false;
+  }
+
+  _size = st.st_size;
+  _map = (const uint8_t *) mmap(NULL, _size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+
+  if (_map == MAP_FAILED) {
+    _map = NULL;
+    return false;
+  }
+
+  if (memcmp(_map, TREC_MAGIC, TREC_MAGIC_SIZE)) {
+    close();
+    return false;
+  }
+
+  // We'll jump from chunk to chunk, let the kernel read ahead
+  madvise((void *) _map, _size, MADV_WILLNEED);
+
+  p = _map + TREC_MAGIC_SIZE;
+  end = _map + _size;
+
+  while (p + 24 <= end && get32(p) == TREC_CHUNK_MAGIC) {
+    uint32_t size = get32(p + 4);
+
+    if (size < 16 || p + 8 + size > end)
+      break;
+
+    if (_nchunks >= alloc) {
+      _TRecChunk * c;
+      alloc = alloc ? alloc * 2 : 64;
+      if ( (c = (_TRecChunk *) realloc(_chunks, alloc * sizeof(_TRecChunk))) == NULL )
+        break;
+      _chunks = c;
+    }
+
+    _TRecChunk * c = &_chunks[_nchunks++];
+    c->ptr      = p + 8;
+    c->end      = p + 8 + size;
+    c->nframes  = get16(p + 8);
+    c->ncolumns = get16(p + 10);
+    c->t_first  = get32(p + 12);
+    c->t_last   = get32(p + 16);
+
+    p += 8 + size;
+  }
+
+  return true;
+}
+
+/* ======================================================================
+Function: close
+Purpose : unmap record file
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+void TInfoRecordReader::close(void)
+{
+  if (_map)
+    munmap((void *) _map, _size);
+  free(_chunks);
+
+  _map = NULL;
+  _size = 0;
+  _chunks = NULL;
+  _nchunks = 0;
+}
+
+/* ======================================================================
+Function: chunkValue
+Purpose : get numeric value of a label at a given time in one chunk
+Input   : chunk, label name, timestamp, pointer on value
+Output  : true if found
+Comments: value is the one of the last frame received before or at t
+====================================================================== */
+boolean TInfoRecordReader::chunkValue(_TRecChunk * c, const char * label, uint32_t t, int64_t * value)
+{
+  const uint8_t * p = c->ptr + 16;
+  const uint8_t * ts_end;
+  uint32_t ts = c->t_first;
+  uint64_t v;
+  int32_t  k = -1;
+  uint8_t  lglabel = strlen(label);
+
+  if (t < c->t_first)
+    return false;
+
+  // Find last frame index with timestamp <= t
+  ts_end = p + get32(c->ptr + 12);
+  if (ts_end > c->end)
+    return false;
+
+  for (uint16_t i = 0; i < c->nframes && getVarint(&p, ts_end, &v); i++) {
+    ts += v;
+    if (ts > t)
+      break;
+    k = i;
+  }
+  if (k < 0)
+    return false;
+
+  // Walk columns, skipping them by size until we find the label
+  p = ts_end;
+  for (uint16_t i = 0; i < c->ncolumns; i++) {
+    uint8_t  type, lg;
+    uint16_t first;
+    uint32_t size;
+
+    if (p + 2 > c->end)
+      return false;
+    type = p[0];
+    lg = p[1];
+    if (p + 2 + lg + 6 > c->end)
+      return false;
+
+    first = get16(p + 2 + lg);
+    size = get32(p + 4 + lg);
+
+    if (lg == lglabel && !memcmp(p + 2, label, lg)) {
+      const uint8_t * d = p + 8 + lg;
+      const uint8_t * dend = d + size;
+      int64_t val = 0;
+
+      if (type != TREC_COL_NUMERIC || k < first || dend > c->end)
+        return false;
+
+      for (int32_t f = first; f <= k; f++) {
+        if (!getVarint(&d, dend, &v))
+          return false;
+        val += unzigzag(v);
+      }
+      *value = val;
+      return true;
+    }
+    p += 8 + lg + size;
+  }
+
+  return false;
+}
+
+/* ======================================================================
+Function: valueAt
+Purpose : get numeric value of a label at a given time
+Input   : label name, timestamp, pointer on value
+Output  : true if found
+Comments: -
+====================================================================== */
+boolean TInfoRecordReader::valueAt(const char * label, uint32_t t, int64_t * value)
+{
+  int32_t lo = 0, hi = (int32_t) _nchunks - 1, last = -1;
+
+  // binary search last chunk starting before or at t
+  while (lo <= hi) {
+    int32_t mid = (lo + hi) / 2;
+    if (_chunks[mid].t_first <= t) {
+      last = mid;
+      lo = mid + 1;
+    } else {
+      hi = mid - 1;
+    }
+  }
+
+  // label may not be in this chunk, go back in time
+  for ( ; last >= 0; last--) {
+    if (chunkValue(&_chunks[last], label, t, value))
+      return true;
+  }
+  return false;
+}
+
+/* ======================================================================
+Function: energy
+Purpose : get energy consumed on one index between two times
+Input   : index label name (BASE, HCHC, EAST...), t1, t2, pointer on result
+Output  : true if both values found
+Comments: result is in the index unit (Wh)
+====================================================================== */
+boolean TInfoRecordReader::energy(const char * label, uint32_t t1, uint32_t t2, int64_t * wh)
+{
+  int64_t v1, v2;
+
+  if (t2 < t1 || !valueAt(label, t1, &v1) || !valueAt(label, t2, &v2))
+    return false;
+
+  *wh = v2 - v1;
+  return true;
+}
@@ -0,0 +1,122 @@
+// **********************************************************************************
+// Raspberry PI LibTeleinfo columnar frame recorder include file
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo or use, see my blog
+// https://hallard.me/category/tinfo
+//
+// Each decoded frame is appended to a chunk held in memory, one column per
+// label. When the chunk is full, a minute old (or on close) it is written
+// to the file, so a crash loses one minute of frames at most:
+//   - timestamps are stored as varint deltas from the chunk first timestamp
+//   - numeric values (indexes BASE, HCHC, EAST, EASF01...) are stored as
+//     zigzag varint deltas from the previous frame value
+//   - text values are stored only when they change
+//   - horodates of Standard mode labels (SMAXSN, DATE...) are not stored,
+//     only values are
+// The reader mmap() the whole file and only decodes the columns it needs
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "../../src/LibTeleinfo.h"
+
+#define TREC_MAGIC          "TICREC1\n" // File header
+#define TREC_MAGIC_SIZE     8
+#define TREC_CHUNK_MAGIC    0x4B484354  // "TCHK" little endian
+#define TREC_CHUNK_FRAMES   256         // frames per chunk (~6 min at 1.5s/frame)
+#define TREC_CHUNK_SECS     60          // chunk written when this old (s)
+#define TREC_MAX_COLUMNS    64          // labels per chunk
+#define TREC_LABEL_SIZE     16          // same as ValueList name
+#define TREC_VALUE_SIZE     100         // large enough for any TIC value
+
+// Column types
+#define TREC_COL_NUMERIC    0x01
+#define TREC_COL_TEXT       0x02
+
+// Growing byte buffer used for one column of the current chunk
+typedef struct
+{
+  uint8_t * data;
+  size_t    size;
+  size_t    alloc;
+} _TRecBuffer;
+
+// One column of the current chunk
+typedef struct
+{
+  char        name[TREC_LABEL_SIZE+1];
+  uint8_t     type;        // TREC_COL_xxx
+  uint16_t    first_frame; // frame index where the column starts in chunk
+  uint16_t    count;       // frames written in the column
+  int64_t     last_num;    // last numeric value written
+  char        last_text[TREC_VALUE_SIZE];
+  _TRecBuffer buf;
+} _TRecColumn;
+
+// Chunk index entry built by the reader when opening a file
+typedef struct
+{
+  const uint8_t * ptr;     // chunk start (after magic and size)
+  const uint8_t * end;     // chunk end
+  uint32_t        t_first;
+  uint32_t        t_last;
+  uint16_t        nframes;
+  uint16_t        ncolumns;
+} _TRecChunk;
+
+class TInfoRecorder
+{
+  public:
+    TInfoRecorder();
+    boolean   open(const char * path);
+    boolean   addFrame(ValueList * me, uint32_t t);
+    boolean   tick(uint32_t t);
+    boolean   flush(void);
+    void      close(void);
+    boolean   isOpen(void) { return _fd >= 0; }
+
+  private:
+    _TRecColumn * findColumn(const char * name);
+    _TRecColumn * column(const char * name, uint8_t type);
+    boolean   typeChanged(ValueList * me);
+    void      resetChunk(void);
+
+    int          _fd;
+    uint16_t     _nframes;
+    uint8_t      _ncolumns;
+    uint32_t     _t_first;
+    uint32_t     _t_prev;
+    _TRecBuffer  _ts;
+    _TRecColumn  _columns[TREC_MAX_COLUMNS];
+};
+
+class TInfoRecordReader
+{
+  public:
+    TInfoRecordReader();
+    boolean   open(const char * path);
+    void      close(void);
+    boolean   valueAt(const char * label, uint32_t t, int64_t * value);
+    boolean   energy(const char * label, uint32_t t1, uint32_t t2, int64_t * wh);
+    uint32_t  chunkCount(void) { return _nchunks; }
+
+  private:
+    boolean   chunkValue(_TRecChunk * c, const char * label, uint32_t t, int64_t * value);
+
+    const uint8_t * _map;
+    size_t          _size;
+    _TRecChunk *    _chunks;
+    uint32_t        _nchunks;
+};
+
+#endif
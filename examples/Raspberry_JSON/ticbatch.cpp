@@ -0,0 +1,343 @@
+// **********************************************************************************
+// Raspberry PI / Linux LibTeleinfo batch decoder of raw teleinfo captures
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo or use, see my blog
+// https://hallard.me/category/tinfo
+//
+// Each capture file is mapped in memory and split in parts starting on
+// STX. Parts of all files are decoded by a pool of threads, each part with
+// its own TInfo object, and the frames are written in order on stdout as
+// JSON lines, one line per frame with all values of the table
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "../../src/LibTeleinfo.h"
+#include "capture.h"
+
+#define PRG_NAME        "ticbatch"
+#define BATCH_MAX_FILES 4096
+#define BATCH_PART_SIZE (1024 * 1024) // default part size, about 2 days at 1200 bps
+
+// One decoding job : a part of a capture file
+typedef struct
+{
+  uint16_t     file;      // index of capture file
+  _CapturePart part;      // part to decode
+  char *       out;       // JSON lines of decoded frames
+  size_t       out_size;
+  size_t       out_alloc;
+  uint32_t     frames;    // frames decoded
+  boolean      done;      // job finished
+} _BatchJob;
+
+// Configuration structure
+static struct
+{
+  int threads;
+  size_t part_size;
+  int verbose;
+} opts ;
+
+// ======================================================================
+// Global vars
+// ======================================================================
+TInfoCapture    g_captures[BATCH_MAX_FILES];
+char *          g_names[BATCH_MAX_FILES];
+_BatchJob *     g_jobs;
+uint32_t        g_njobs;
+uint32_t        g_next_job;   // next job to give to a worker
+pthread_mutex_t g_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t  g_cond  = PTHREAD_COND_INITIALIZER;
+
+// Job being decoded by this thread, used by frame callback
+static __thread _BatchJob * t_job;
+
+/* ======================================================================
+Function: jobPrint
+Purpose : append formated text to the output of a job
+Input   : job, string to write in printf format, printf other arguments
+Output  : -
+Comments: -
+====================================================================== */
+void jobPrint(_BatchJob * job, const char * format, ...)
+{
+  va_list args;
+  int len;
+
+  for (;;) {
+    size_t room = job->out_alloc - job->out_size;
+
+    va_start(args, format);
+    len = vsnprintf(job->out + job->out_size, room, format, args);
+    va_end(args);
+
+    if (len < 0)
+      return;
+
+    if ((size_t) len < room) {
+      job->out_size += len;
+      return;
+    }
+
+    // grow output buffer and try again
+    size_t alloc = job->out_alloc ? job->out_alloc * 2 : 64 * 1024;
+    while (alloc < job->out_size + len + 1)
+      alloc *= 2;
+
+    char * p = (char *) realloc(job->out, alloc);
+    if (!p) {
+      fprintf(stderr, "%s: out of memory\n", PRG_NAME);
+      exit(EXIT_FAILURE);
+    }
+    job->out = p;
+    job->out_alloc = alloc;
+  }
+}
+
+/* ======================================================================
+Function: FrameCallback
+Purpose : callback when a complete teleinfo frame has been decoded
+Input   : list head pointer on the values table
+Output  : -
+Comments: attached as new and updated frame callback, all values are
+          written for each frame so parts can be merged whatever the
+          state of the table was before the part. Values are written in
+          label order, table order depends on when each label was first
+          received and so on where the part starts
+====================================================================== */
+void FrameCallback(ValueList * me)
+{
+  _BatchJob * job = t_job;
+  ValueList * sorted[TINFO_TABSIZE];
+  int n = 0;
+
+  if (!job || !me)
+    return;
+
+  // insert values in label order
+  while (me->next && n < TINFO_TABSIZE) {
+    int i;
+
+    me = me->next;
+
+    if (me->free || !*me->value)
+      continue;
+
+    for (i = n; i > 0 && strcmp(sorted[i - 1]->name, me->name) > 0; i--)
+      sorted[i] = sorted[i - 1];
+    sorted[i] = me;
+    n++;
+  }
+
+  jobPrint(job, "{\"_FILE\":\"%s\"", g_names[job->file]);
+
+  for (int i = 0; i < n; i++) {
+    me = sorted[i];
+
+    // same number format as raspjson
+    char * p = me->value;
+    while (*p >= '0' && *p <= '9')
+      p++;
+
+    if (*p)
+      jobPrint(job, ", \"%s\":\"%s\"", me->name, me->value);
+    else
+      jobPrint(job, ", \"%s\":%ld", me->name, atol(me->value));
+  }
+
+  jobPrint(job, "}\r\n");
+  job->frames++;
+}
+
+/* ======================================================================
+Function: worker
+Purpose : decoding thread, take jobs until none remains
+Input   : -
+Output  : -
+Comments: each job is decoded by a new TInfo object
+====================================================================== */
+void * worker(void * /* arg */)
+{
+  TInfo * tinfo = new TInfo();
+
+  for (;;) {
+    _BatchJob * job;
+
+    pthread_mutex_lock(&g_mutex);
+    job = g_next_job < g_njobs ? &g_jobs[g_next_job++] : NULL;
+    pthread_mutex_unlock(&g_mutex);
+
+    if (!job)
+      break;
+
+    tinfo->attachNewFrame(FrameCallback);
+    tinfo->attachUpdatedFrame(FrameCallback);
+
+    // Prime decoder with frames before the part, not written
+    t_job = NULL;
+    g_captures[job->file].prime(*tinfo, job->part);
+
+    t_job = job;
+    tinfo->processBatch(job->part.data, job->part.size);
+    t_job = NULL;
+
+    pthread_mutex_lock(&g_mutex);
+    job->done = true;
+    pthread_cond_broadcast(&g_cond);
+    pthread_mutex_unlock(&g_mutex);
+  }
+
+  delete tinfo;
+  return NULL;
+}
+
+/* ======================================================================
+Function: usage
+Purpose : display usage
+Input   : program name
+Output  : -
+Comments:
+====================================================================== */
+void usage(void)
+{
+  printf("%s\n", PRG_NAME);
+  printf("Usage is: %s [options] capture_file [capture_file...]\n", PRG_NAME);
+  printf("Options are:\n");
+  printf("  --<j>obs n     : number of decoding threads (default cpu count)\n");
+  printf("  --<s>ize kb    : size of parts decoded in parallel (default %d)\n", BATCH_PART_SIZE / 1024);
+  printf("  --<v>erbose    : speak more to user\n");
+  printf("  --<h>elp\n");
+  printf("Example :\n");
+  printf( "%s -j 8 /data/meters/*.raw > frames.json\n\n", PRG_NAME);
+}
+
+/* ======================================================================
+Function: main
+Purpose : Main entry Point
+Input   : -
+Output  : -
+Comments:
+====================================================================== */
+int main(int argc, char **argv)
+{
+  static struct option longOptions[] =
+  {
+    {"jobs",    required_argument,0, 'j'},
+    {"size",    required_argument,0, 's'},
+    {"verbose", no_argument,      0, 'v'},
+    {"help",    no_argument,      0, 'h'},
+    {0, 0, 0, 0}
+  };
+  pthread_t * threads;
+  uint32_t nfiles, i, alloc;
+  uint64_t frames = 0;
+  int c;
+
+  opts.threads = sysconf(_SC_NPROCESSORS_ONLN);
+  opts.part_size = BATCH_PART_SIZE;
+  opts.verbose = false;
+
+  while ( (c = getopt_long(argc, argv, "j:s:vh", longOptions, NULL)) >= 0 ) {
+    switch (c) {
+      case 'j': opts.threads = atoi(optarg); break;
+      case 's': opts.part_size = (size_t) atol(optarg) * 1024; break;
+      case 'v': opts.verbose = true; break;
+      default : usage(); exit(c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+  }
+
+  if (optind >= argc || argc - optind > BATCH_MAX_FILES) {
+    usage();
+    exit(EXIT_FAILURE);
+  }
+  if (opts.threads < 1)
+    opts.threads = 1;
+  if (opts.part_size < 4096)
+    opts.part_size = 4096;
+
+  // Map all files and split them in parts
+  alloc = 0;
+  for (nfiles = 0; optind < argc; optind++, nfiles++) {
+    uint16_t nparts;
+    size_t part_size = opts.part_size;
+
+    g_names[nfiles] = argv[optind];
+    if (!g_captures[nfiles].open(argv[optind])) {
+      fprintf(stderr, "%s: cannot open %s: %s\n", PRG_NAME, argv[optind], strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+
+    // No more parts than a job count can hold, bigger parts if needed
+    if (g_captures[nfiles].size() / part_size >= 0xFFFF)
+      part_size = g_captures[nfiles].size() / 0xFFFF + 1;
+    nparts = g_captures[nfiles].size() / part_size + 1;
+
+    if (g_njobs + nparts > alloc) {
+      alloc = (g_njobs + nparts) * 2;
+      g_jobs = (_BatchJob *) realloc(g_jobs, alloc * sizeof(_BatchJob));
+      if (!g_jobs) {
+        fprintf(stderr, "%s: out of memory\n", PRG_NAME);
+        exit(EXIT_FAILURE);
+      }
+    }
+
+    _CapturePart * parts = (_CapturePart *) malloc(nparts * sizeof(_CapturePart));
+    nparts = parts ? g_captures[nfiles].split(nparts, parts) : 0;
+
+    for (i = 0; i < nparts; i++) {
+      memset(&g_jobs[g_njobs], 0, sizeof(_BatchJob));
+      g_jobs[g_njobs].file = nfiles;
+      g_jobs[g_njobs].part = parts[i];
+      g_njobs++;
+    }
+    free(parts);
+  }
+
+  if (opts.verbose)
+    fprintf(stderr, "%s: %u files, %u parts, %d threads\n", PRG_NAME, nfiles, g_njobs, opts.threads);
+
+  // Start decoding
+  threads = (pthread_t *) malloc(opts.threads * sizeof(pthread_t));
+  for (c = 0; c < opts.threads; c++)
+    pthread_create(&threads[c], NULL, worker, NULL);
+
+  // and write results in order as soon as they are available
+  for (i = 0; i < g_njobs; i++) {
+    pthread_mutex_lock(&g_mutex);
+    while (!g_jobs[i].done)
+      pthread_cond_wait(&g_cond, &g_mutex);
+    pthread_mutex_unlock(&g_mutex);
+
+    fwrite(g_jobs[i].out, 1, g_jobs[i].out_size, stdout);
+    frames += g_jobs[i].frames;
+    free(g_jobs[i].out);
+    g_jobs[i].out = NULL;
+  }
+  fflush(stdout);
+
+  for (c = 0; c < opts.threads; c++)
+    pthread_join(threads[c], NULL);
+
+  for (i = 0; i < nfiles; i++)
+    g_captures[i].close();
+
+  if (opts.verbose)
+    fprintf(stderr, "%s: %llu frames decoded\n", PRG_NAME, (unsigned long long) frames);
+
+  free(threads);
+  free(g_jobs);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,216 @@
+// **********************************************************************************
+// Raspberry PI / Linux LibTeleinfo multicast frame feed receiver
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo or use, see my blog
+// https://hallard.me/category/tinfo
+//
+// Listens to the frame feed sent by Wifinfo or raspjson -m and writes each
+// frame on stdout as a JSON line with labels changed by the frame (or all
+// labels), its meter and its number. Lost, late and duplicate frames of
+// each meter are written on stderr when program stops
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include "../../src/LibTeleinfo.h"
+#include "../../src/LibTeleinfoFeed.h"
+#include "feedrecv.h"
+
+#define PRG_NAME        "ticfeed"
+#define FEED_GROUP      "239.255.12.1"
+#define FEED_PORT       1201
+
+// Configuration structure
+static struct
+{
+  char group[32];
+  int port;
+  char iface[32];
+  int all;
+  int verbose;
+} opts ;
+
+// ======================================================================
+// Global vars
+// ======================================================================
+TInfoFeedReceiver g_feed;
+volatile int      g_exit_pgm;
+
+/* ======================================================================
+Function: signal_handler
+Purpose : stop receiving
+Input   : signal
+Output  : -
+Comments: -
+====================================================================== */
+void signal_handler(int signum)
+{
+  g_exit_pgm = true;
+}
+
+/* ======================================================================
+Function: printFrame
+Purpose : write a received frame as a JSON line
+Input   : header, frames lost before it
+Output  : -
+Comments: only labels changed by the frame unless --all
+====================================================================== */
+void printFrame(TInfoFeedFrame * f, uint32_t lost)
+{
+  char name[TINFO_NAME_SIZE];
+  char value[TINFO_VALUE_SIZE];
+  char horodate[TINFO_HORO_SIZE];
+  uint16_t pos = 0;
+  uint8_t i;
+
+  printf("{\"_METER\":\"%s\",\"_SEQ\":%u", f->meter, f->seq);
+  if (lost)
+    printf(",\"_LOST\":%u", lost);
+  if (f->flags & TINFO_FEED_PARTIAL)
+    printf(",\"_PARTIAL\":1");
+
+  for (i = 0; TInfoFeed::label(f, &pos, name, value, horodate); i++) {
+    if (!opts.all && (i >= TINFO_FEED_LABELS || !(f->changed & ((uint64_t) 1 << i))))
+      continue;
+
+    if (*horodate)
+      printf(",\"%s\":[\"%s\",\"%s\"]", name, value, horodate);
+    else
+      printf(",\"%s\":\"%s\"", name, value);
+  }
+
+  printf("}\n");
+  fflush(stdout);
+}
+
+/* ======================================================================
+Function: printStats
+Purpose : write frame numbers counters of each meter
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+void printStats(void)
+{
+  const _TFeedMeter * m;
+
+  for (uint8_t i = 0; i < g_feed.meters(); i++) {
+    if ( !(m = g_feed.meter(i)) )
+      continue;
+    fprintf(stderr, "%s: meter %s received %u lost %u late %u duplicate %u restarts %u\n",
+            PRG_NAME, m->meter, m->received, m->lost, m->late, m->duplicate, m->restarts);
+  }
+  if (g_feed.errors())
+    fprintf(stderr, "%s: %u bad datagrams\n", PRG_NAME, g_feed.errors());
+}
+
+/* ======================================================================
+Function: usage
+Purpose : display usage
+Input   : -
+Output  : -
+Comments:
+====================================================================== */
+void usage(void)
+{
+  printf("%s\n", PRG_NAME);
+  printf("Usage is: %s [options]\n", PRG_NAME);
+  printf("Options are:\n");
+  printf("  --<g>roup addr : multicast group (default %s)\n", FEED_GROUP);
+  printf("  --<p>ort port  : UDP port (default %d)\n", FEED_PORT);
+  printf("  --<i>face addr : address of interface to listen on (default any)\n");
+  printf("  --<a>ll        : write all labels, not only changed ones\n");
+  printf("  --<v>erbose    : write lost frames as they are seen\n");
+  printf("  --<h>elp\n");
+  printf("Example :\n");
+  printf( "%s -g 239.255.12.1 -p 1201 > frames.json\n\n", PRG_NAME);
+}
+
+/* ======================================================================
+Function: main
+Purpose : Main entry Point
+Input   : -
+Output  : -
+Comments:
+====================================================================== */
+int main(int argc, char **argv)
+{
+  static struct option longOptions[] =
+  {
+    {"group",   required_argument,0, 'g'},
+    {"port",    required_argument,0, 'p'},
+    {"iface",   required_argument,0, 'i'},
+    {"all",     no_argument,      0, 'a'},
+    {"verbose", no_argument,      0, 'v'},
+    {"help",    no_argument,      0, 'h'},
+    {0, 0, 0, 0}
+  };
+  TInfoFeedFrame f;
+  uint32_t lost;
+  fd_set rdset;
+  int c;
+
+  strcpy(opts.group, FEED_GROUP);
+  opts.port = FEED_PORT;
+  *opts.iface = '\0';
+  opts.all = false;
+  opts.verbose = false;
+
+  while ( (c = getopt_long(argc, argv, "g:p:i:avh", longOptions, NULL)) >= 0 ) {
+    switch (c) {
+      case 'g': strncpy(opts.group, optarg, sizeof(opts.group) - 1); break;
+      case 'p': opts.port = atoi(optarg); break;
+      case 'i': strncpy(opts.iface, optarg, sizeof(opts.iface) - 1); break;
+      case 'a': opts.all = true; break;
+      case 'v': opts.verbose = true; break;
+      default : usage(); exit(c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+  }
+
+  if (!g_feed.begin(opts.group, opts.port, *opts.iface ? opts.iface : NULL)) {
+    fprintf(stderr, "%s: cannot join %s:%d: %s\n", PRG_NAME, opts.group, opts.port, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  signal(SIGINT, signal_handler);
+  signal(SIGTERM, signal_handler);
+
+  while (!g_exit_pgm) {
+    FD_ZERO(&rdset);
+    FD_SET(g_feed.fd(), &rdset);
+
+    if (select(g_feed.fd() + 1, &rdset, NULL, NULL, NULL) < 0) {
+      if (errno == EINTR)
+        continue;
+      fprintf(stderr, "%s: select: %s\n", PRG_NAME, strerror(errno));
+      break;
+    }
+
+    while ( (c = g_feed.receive(&f, &lost)) > 0 ) {
+      if (lost && opts.verbose)
+        fprintf(stderr, "%s: meter %s lost %u frames before %u\n", PRG_NAME, f.meter, lost, f.seq);
+      printFrame(&f, lost);
+    }
+
+    if (c < 0) {
+      fprintf(stderr, "%s: recv: %s\n", PRG_NAME, strerror(errno));
+      break;
+    }
+  }
+
+  printStats();
+  g_feed.close();
+  return 0;
+}
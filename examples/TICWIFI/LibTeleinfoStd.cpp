@@ -25,6 +25,29 @@
 
 sValueList ValuesTab[TINFO_MAXTOKEN];  //Allocate static table of TIC labels (71 labels in Standard mode)
 
+#ifndef ARDUINO
+#include <time.h>
+#endif
+
+/* ======================================================================
+Function: TInfoMillis
+Purpose : default clock used to timestamp labels
+Input   : -
+Output  : milliseconds from a monotonic clock
+Comments: may wrap, only differences are used
+====================================================================== */
+static uint32_t TInfoMillis (void)
+{
+#ifdef ARDUINO
+  return millis ();
+#else
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (uint32_t) ts.tv_sec * 1000UL + ts.tv_nsec / 1000000UL;
+#endif
+}
+
 /* ======================================================================
 Class   : TInfo
 Purpose : Constructor
@@ -35,11 +58,13 @@ Comments: -
 TInfo::TInfo ()
 {
   init ();
+  ClearStats ();
   // callback
   _fn_data = NULL;   
   _fn_new_frame = NULL;   
   _fn_updated_frame = NULL;
   _fn_error = NULL;
+  _fn_clock = TInfoMillis;
 }
 
 /* ======================================================================
@@ -61,7 +86,9 @@ void TInfo::init ()
   _state_frame = TINFO_WAIT_STX;
   _state_group = TINFO_WAIT_NONE;
   _frame_updated = false;
-  TICDate = "";
+  _resynced = false;
+  TICDate[0] = '\0';
+  TICEpoch = 0;
 }
 
 /* ======================================================================
@@ -168,6 +195,86 @@ void TInfo::attachUpdatedFrame (void (*fn_updated_frame)(void))
   _fn_updated_frame = fn_updated_frame;   
 }
 
+/* ======================================================================
+Function: attachClock 
+Purpose : attach the clock used to timestamp labels
+Input   : function returning milliseconds, NULL for default one
+Output  : - 
+Comments: default is millis()
+====================================================================== */
+void TInfo::attachClock (uint32_t (*fn_clock)(void))
+{
+  _fn_clock = fn_clock ? fn_clock : TInfoMillis;
+}
+
+/* ======================================================================
+Function: IsStale
+Purpose : check if a label has not been received for a while
+Input   : Index of Item, returned by getIndexNextItem or SearchLabel
+          max age in ms
+Output  : True if not received since more than age ms
+====================================================================== */
+boolean TInfo::IsStale (uint8_t index, uint32_t age)
+{
+  if (index > 0 && index <= TINFO_MAXTOKEN)
+  {
+    index--; //real index of item in ValueTab array
+    if (ValuesTab[index].flags > TINFO_FLAGS_NOTHING)
+      return (uint32_t) (_fn_clock () - ValuesTab[index].seen) > age;
+  }
+  return false;
+}
+
+/* ======================================================================
+Function: ChangeRate
+Purpose : how often a label changes
+Input   : Index of Item, returned by getIndexNextItem or SearchLabel
+Output  : number of changes per hour since label was added
+Comment : 0 for labels that never change (ADSC, PREF...)
+====================================================================== */
+uint32_t TInfo::ChangeRate (uint8_t index)
+{
+  uint32_t elapsed;
+
+  if (index > 0 && index <= TINFO_MAXTOKEN)
+  {
+    index--; //real index of item in ValueTab array
+    if (ValuesTab[index].flags > TINFO_FLAGS_NOTHING)
+    {
+      // in seconds, we need at least one
+      elapsed = (uint32_t) (_fn_clock () - ValuesTab[index].added) / 1000;
+      if (elapsed)
+        return (uint32_t) ValuesTab[index].changes * 3600UL / elapsed;
+    }
+  }
+  return 0;
+}
+
+/* ======================================================================
+Function: GetStats
+Purpose : copy the decoder counters
+Input   : Pointer to counters filled
+Output  : -
+Comments: counters are only incremented when receiving, so a copy is
+          enough to get them all at the same time
+====================================================================== */
+void TInfo::GetStats (TInfoStats * stats)
+{
+  memcpy (stats, &_stats, sizeof(TInfoStats));
+}
+
+/* ======================================================================
+Function: ClearStats
+Purpose : reset the decoder counters
+Input   : -
+Output  : -
+Comments: init() keeps them
+====================================================================== */
+void TInfo::ClearStats ()
+{
+  memset (&_stats, 0, sizeof(TInfoStats));
+}
+
 /* ======================================================================
 Function: SearchLabel
 Purpose : Search index of element with corresponding Label
@@ -251,6 +358,8 @@ Comment : set item flags to Updated or None
 uint8_t TInfo::SetItem (uint8_t index, sValueList * item)
 {
   uint8_t mod_label;
+  uint32_t now, added;
+  uint16_t changes;
 
   mod_label = 0x80;
   if (index > 0 && index <= TINFO_MAXTOKEN)
@@ -263,15 +372,23 @@ uint8_t TInfo::SetItem (uint8_t index, sValueList * item)
         mod_label |= 1;
       if (strcmp (item->horodate.rawvalue, ValuesTab[index].horodate.rawvalue) != 0)
         mod_label |= 2;
+      now = _fn_clock ();
       if (mod_label > 0) // overwrite label only if something different
       {
+        // keep timestamps of the label
+        added = ValuesTab[index].added;
+        changes = ValuesTab[index].changes;
         memcpy (&ValuesTab[index], item, sizeof(_ValueList));
         ValuesTab[index].flags = TINFO_FLAGS_UPDATED;
+        ValuesTab[index].added = added;
+        ValuesTab[index].changed = now;
+        ValuesTab[index].changes = changes < 0xFFFF ? changes + 1 : changes;
       }
       else
       {
         ValuesTab[index].flags = TINFO_FLAGS_NONE;
       }
+      ValuesTab[index].seen = now;
     }//different name ! some error
   }
   return mod_label;
@@ -437,6 +554,8 @@ uint8_t TInfo::AddItem (sValueList * item)
     {
       memcpy (&ValuesTab[i], item, sizeof(_ValueList));
       ValuesTab[i].flags = TINFO_FLAGS_ADDED;
+      ValuesTab[i].added = ValuesTab[i].seen = ValuesTab[i].changed = _fn_clock ();
+      ValuesTab[i].changes = 0;
       i ++; //increment as 0 is for error
       break;
     }
@@ -447,6 +566,59 @@ uint8_t TInfo::AddItem (sValueList * item)
   return (i);
 }
 
+/* ======================================================================
+Function: HorodateEpoch
+Purpose : convert an horodate to UTC epoch seconds
+Input   : raw horodate SAAMMJJhhmmss, S is season E (summer time, UTC+2)
+          or H (winter time, UTC+1), lower case if meter clock is not
+          synchronized, space if meter does not manage seasons
+Output  : seconds since 1970-01-01 UTC, 0 if bad horodate
+Comments: integer only, years 2000 to 2099. Copy of horodateEpoch() of
+          the library (src/LibTeleinfo.cpp), this sketch has its own TInfo
+          class and can't link the library one, fix both
+====================================================================== */
+uint32_t TInfo::HorodateEpoch (const char * rawvalue)
+{
+  uint8_t f[6]; // year, month, day, hour, minute, second
+  int32_t y, m, days;
+  uint32_t offset;
+  uint8_t i;
+
+  switch (rawvalue[0])
+  {
+    case 'E': case 'e':
+      offset = 7200;
+      break;
+    case 'H': case 'h': case ' ':
+      offset = 3600;
+      break;
+    default:
+      return 0;
+  }
+
+  for (i = 0; i < 6; i++)
+  {
+    char d = rawvalue[1 + 2 * i];
+    char u = rawvalue[2 + 2 * i];
+    if (d < '0' || d > '9' || u < '0' || u > '9')
+      return 0;
+    f[i] = (d - '0') * 10 + (u - '0');
+  }
+
+  if (f[1] < 1 || f[1] > 12 || f[2] < 1 || f[2] > 31 || f[3] > 23 || f[4] > 59 || f[5] > 59)
+    return 0;
+
+  // days from 1970-01-01, year starting in march so leap day is the last
+  y = 2000 + f[0];
+  m = f[1];
+  if (m <= 2)
+    y--;
+  m = m > 2 ? m - 3 : m + 9;
+  days = 365L * y + y / 4 - y / 100 + y / 400 + (153 * m + 2) / 5 + f[2] - 1 - 719468L;
+
+  return (uint32_t) days * 86400UL + f[3] * 3600UL + f[4] * 60UL + f[5] - offset;
+}
+
 /* ======================================================================
 Function: CheckGroup
 Purpose : check one group of teleinfo received between SGR and EGR flag
@@ -465,6 +637,7 @@ uint8_t TInfo::CheckGroup (void)
   char recv_checksum; //received checksum from transmission
   char buff_char;
   int tmp_readvalue_index;
+  uint8_t i;
   char tmp_readvalue [TINFO_VALUE_MAXLEN];
   sValueList recv_item;
   
@@ -561,28 +734,28 @@ uint8_t TInfo::CheckGroup (void)
     // calc checksum is ok ?
     if (checksum == recv_checksum) 
     {
+      // convert horodate once, exporters can use the integer
+      if (recv_item.horodate.rawvalue[0])
+        recv_item.epoch = HorodateEpoch (recv_item.horodate.rawvalue);
+
       //Label DATE is used only to update member TICDate and not put in array of labels
       if (strcmp (recv_item.name, "DATE") == 0) 
       {
-        //format horodate : (H/E)AAMMDDHHMMSS
-        TICDate = "20";
-        TICDate += recv_item.horodate.Year[0];
-        TICDate += recv_item.horodate.Year[1];
-        TICDate += "/";
-        TICDate += recv_item.horodate.Month[0];
-        TICDate += recv_item.horodate.Month[1];
-        TICDate += "/";
-        TICDate += recv_item.horodate.Day[0];
-        TICDate += recv_item.horodate.Day[1];
-        TICDate += " ";
-        TICDate += recv_item.horodate.Hour[0];
-        TICDate += recv_item.horodate.Hour[1];
-        TICDate += ":";
-        TICDate += recv_item.horodate.Min[0];
-        TICDate += recv_item.horodate.Min[1];
-        TICDate += ":";
-        TICDate += recv_item.horodate.Sec[0];
-        TICDate += recv_item.horodate.Sec[1];
+        //format horodate : (H/E)AAMMDDHHMMSS to 20AA/MM/DD HH:MM:SS
+        const char * p = &recv_item.horodate.rawvalue[1];
+        char * d = TICDate;
+
+        *d++ = '2';
+        *d++ = '0';
+        for (i = 0; i < 6; i++)
+        {
+          *d++ = *p++;
+          *d++ = *p++;
+          if (i < 5)
+            *d++ = i < 2 ? '/' : (i == 2 ? ' ' : ':');
+        }
+        *d = '\0';
+        TICEpoch = recv_item.epoch;
       }
       else
       {
@@ -629,6 +802,20 @@ uint8_t TInfo::CheckGroup (void)
     }
   }
 
+  // count group result, checksum error first as fields can't be trusted
+  if (errnb == 0 && count_SEP >= 2)
+  {
+    _stats.groups++;
+    if (_resynced)
+      _stats.recovered++;
+  }
+  else if (errnb & 2)
+    _stats.checksum++;
+  else if (errnb & 8)
+    _stats.full++;
+  else
+    _stats.unknown++;
+
   return errnb;
 }
 
@@ -645,6 +832,7 @@ _State_e TInfo::process(char c)
   
   // be sure 7 bits only
   c &= 0x7F;
+  _stats.bytes++;
   // What we received ?
   switch (c)  
   {
@@ -654,14 +842,23 @@ _State_e TInfo::process(char c)
       clearBuffer();
       // by default frame is not "updated", if data change we'll set this flag
       _frame_updated = false;
+      if (_state_frame == TINFO_WAIT_ETX) //previous frame never ended
+        _stats.aborted++;
       _state_frame = TINFO_WAIT_ETX;
       _state_group = TINFO_WAIT_SGR;
+      _resynced = false;
     break;
       
     // Start of group
     case  TINFO_SGR:
 	  if (_state_frame == TINFO_WAIT_ETX) //only if we have received an STX
 	  {
+        // previous group never ended or was dropped, go on with this one
+        if (_state_group != TINFO_WAIT_SGR)
+        {
+          _stats.resync++;
+          _resynced = true;
+        }
         _state_group = TINFO_WAIT_EGR; //ok for start receiving a group and waiting for EGR
 	  }
 	  else
@@ -690,7 +887,15 @@ _State_e TInfo::process(char c)
               _fn_error (error_cg);
             }
           }
+          else
+          {
+            _stats.overflow++;
+          }
           _state_group = TINFO_WAIT_SGR; // waiting for another group or ETX
+        }
+        else if (_state_group == TINFO_WAIT_SGR) // SGR was lost, next SGR resyncs
+        {
+          _state_group = TINFO_WAIT_NONE;
         }
 	  }
 	  else
@@ -705,6 +910,7 @@ _State_e TInfo::process(char c)
       // Normal working mode ?
       if (_state_frame == TINFO_WAIT_ETX) //normal mode, end of frame
       {
+        _stats.frames++;
         // Call user callback if any
         if (_frame_updated == true)
         {
@@ -722,6 +928,7 @@ _State_e TInfo::process(char c)
 	  clearBuffer();  
       _state_frame = TINFO_WAIT_STX;
       _state_group = TINFO_WAIT_NONE;
+      _resynced = false;
     break;
 
     // other char ?
@@ -735,10 +942,10 @@ _State_e TInfo::process(char c)
         {
           _recv_buff[_recv_idx++] = c;
         }
-        else //problem of more data than normal, reseting states and buffer
+        else //problem of more data than normal, drop this group until next SGR
         {
+          _stats.overflow++;
 		  clearBuffer();
-          _state_frame = TINFO_WAIT_STX;
           _state_group = TINFO_WAIT_NONE;
         }
       }
@@ -59,6 +59,7 @@
 #define TINFO_LABEL_MAXLEN   9  // Max len of label (Doc ENEDIS) + 1 for '\0' terminating string
 #define TINFO_HORO_MAXLEN   14  // Max len of Horodate  (Doc ENEDIS) + 1 for '\0' terminating string
 #define TINFO_VALUE_MAXLEN  99  // Max len of group value (Label PJOUR+1) + 1 for '\0' terminating string
+#define TINFO_DATE_MAXLEN   20  // Len of TICDate "20AA/MM/JJ hh:mm:ss" + 1 for '\0' terminating string
 
 // state of label
 #define TINFO_FLAGS_NOTHING  0x00 //struct index is empty
@@ -113,11 +114,31 @@ struct _ValueList
   char      name     [TINFO_LABEL_MAXLEN]; // Label of value
   char      value    [TINFO_VALUE_MAXLEN]; // value 
   uHorodate horodate;                      // horodate of value
-  char      dummy    [5];                  //padding to 128 bytes struct
+  uint32_t  epoch;                         // horodate in UTC epoch seconds, 0 if none
+  uint32_t  added;                         // clock when label was added (ms)
+  uint32_t  seen;                          // clock when label was last received (ms)
+  uint32_t  changed;                       // clock when value/horodate last changed (ms)
+  uint16_t  changes;                       // number of changes since added
+  char      dummy    [3];                  //padding to 144 bytes struct
 };
 
 #pragma pack(pop) //return to previous alignement
 
+// Decoder counters, since TInfo was created
+typedef struct
+{
+  uint32_t bytes;     // chars received
+  uint32_t frames;    // frames complete
+  uint32_t aborted;   // frames started again before their end
+  uint32_t groups;    // good groups
+  uint32_t checksum;  // groups with bad checksum
+  uint32_t overflow;  // groups too long for the buffer
+  uint32_t full;      // labels lost, array full
+  uint32_t unknown;   // good checksum but bad label or fields
+  uint32_t resync;    // damaged groups dropped at next LF, frame kept
+  uint32_t recovered; // good groups after a resync in the same frame
+} TInfoStats;
+
 class TInfo
 {
   public:
@@ -128,6 +149,7 @@ class TInfo
     void        attachDataError (void (*fn_error)(uint8_t error_nb));  
     void        attachNewFrame (void (*fn_new_frame)(void));
     void        attachUpdatedFrame (void (*fn_updated_frame)(void));  
+    void        attachClock (uint32_t (*fn_clock)(void));
     uint8_t     SearchLabel (char * name);
     uint8_t     getIndexNextItem (uint8_t index);
     boolean     ValueGet (uint8_t index, char * value);
@@ -135,9 +157,15 @@ class TInfo
     boolean     FlagsGet (uint8_t index, uint8_t * flags);
     boolean     GetItem (uint8_t index, sValueList * item);
     uint8_t     labelCount ();
+    boolean     IsStale (uint8_t index, uint32_t age);
+    uint32_t    ChangeRate (uint8_t index);
     void        listDelete ();
+    void        GetStats (TInfoStats * stats);
+    void        ClearStats ();
+    static uint32_t HorodateEpoch (const char * rawvalue);
 
-    String      TICDate; // Date received from Teleinfo
+    char        TICDate[TINFO_DATE_MAXLEN]; // Date received from Teleinfo
+    uint32_t    TICEpoch;                   // Same in UTC epoch seconds
 
   private:
     void     clearBuffer ();
@@ -152,12 +180,15 @@ class TInfo
     void     (*_fn_error)(uint8_t error_nb);
     void     (*_fn_new_frame)(void);
     void     (*_fn_updated_frame)(void);
+    uint32_t (*_fn_clock)(void);
   
     _State_e _state_group;              // Teleinfo machine state for groups
     _State_e _state_frame;              // Teleinfo machine state for frames
     boolean  _frame_updated;            // Data on the frame has been updated
     uint8_t  _recv_idx;                 // index in receive buffer
     char     _recv_buff[TINFO_BUFSIZE]; // frame receive buffer
+    TInfoStats _stats;                  // decoder counters
+    boolean  _resynced;                 // a group was dropped in this frame
 };
 
 #endif
@@ -49,7 +49,8 @@ extern "C" {
 typedef struct 
 {
   String  sys_uptime;
-  String  TICDate;
+  char    TICDate[TINFO_DATE_MAXLEN];
+  uint32_t TICEpoch;
   uint8_t LastError;
   uint32_t jeedom_POSTret; // returned code of last POST request
 } _sysinfo;
@@ -183,7 +183,8 @@ Comments: -
 void NewFrame (void)
 {
   // Do whatever you want there
-  sysinfo.TICDate = tinfo.TICDate; //take date from TIC
+  strcpy (sysinfo.TICDate, tinfo.TICDate); //take date from TIC
+  sysinfo.TICEpoch = tinfo.TICEpoch;
 }
 
 /* ======================================================================
@@ -610,6 +610,35 @@ void getSysJSONData (String& response)
   response += sysinfo.TICDate;
   response += "\"},\r\n";
 
+  TInfoStats stats;
+  tinfo.GetStats (&stats);
+  response += "{\"na\":\"TIC Bytes\",\"va\":\"";
+  response += stats.bytes;
+  response += "\"},\r\n";
+  response += "{\"na\":\"TIC Frames\",\"va\":\"";
+  response += stats.frames;
+  response += " (aborted ";
+  response += stats.aborted;
+  response += ")\"},\r\n";
+  response += "{\"na\":\"TIC Groups\",\"va\":\"";
+  response += stats.groups;
+  response += "\"},\r\n";
+  response += "{\"na\":\"TIC Group errors\",\"va\":\"";
+  response += "checksum ";
+  response += stats.checksum;
+  response += ", overflow ";
+  response += stats.overflow;
+  response += ", full ";
+  response += stats.full;
+  response += ", label ";
+  response += stats.unknown;
+  response += "\"},\r\n";
+  response += "{\"na\":\"TIC Groups resync\",\"va\":\"";
+  response += stats.resync;
+  response += " (recovered ";
+  response += stats.recovered;
+  response += ")\"},\r\n";
+
   response +=
     "{\"na\":\"Jeedom last err\",\"va\":\"";
   sprintf_P (buffer, "%u", sysinfo.jeedom_POSTret);
@@ -32,10 +32,20 @@
 #include <Syslog.h>
 #include <EEPROM.h>
 #include <Ticker.h>
-//#include <WebSocketsServer.h>
+#include <WebSocketsServer.h>
 //#include <Hash.h>
 #include <NeoPixelBus.h>
 #include <LibTeleinfo.h>
+#include <LibTeleinfoDerived.h>
+#include <LibTeleinfoHistory.h>
+#include <LibTeleinfoAggregate.h>
+#include <LibTeleinfoMetrics.h>
+#include <LibTeleinfoProfiler.h>
+#include <LibTeleinfoScheduler.h>
+#include <LibTeleinfoLog.h>
+#include <LibTeleinfoDelta.h>
+#include <LibTeleinfoEvents.h>
+#include <LibTeleinfoFeed.h>
 #include <FS.h>
 
 extern "C" {
@@ -96,6 +106,11 @@ extern "C" {
 #define MACRO
 // Definit le client syslog
 #define APP_NAME "Wifinfo"
+// Lignes envoyées par datagrammes, au plus un toutes les SYSLOG_FLUSH_MS,
+// au plus SYSLOG_RATE lignes/s en régime établi (SYSLOG_BURST d'un coup)
+#define SYSLOG_FLUSH_MS 200
+#define SYSLOG_RATE     20
+#define SYSLOG_BURST    80
 #endif
 
 // voir : https://github.com/arduino/Arduino/tree/master/hardware/arduino/avr/cores/arduino
@@ -123,6 +138,28 @@ extern "C" {
 #define RGB_LED_PIN    14 
 #define RED_LED_PIN    12
 
+// Teleinfo serial, HardwareSerial receive buffer is 256 chars
+#define TINFO_BAUD      1200
+#define TINFO_RX_SIZE   256
+
+// Main loop tasks timed, in profiler.task() order
+enum { PROFILE_WEB, PROFILE_OTA, PROFILE_1SEC, PROFILE_EMONCMS, 
+       PROFILE_JEEDOM, PROFILE_HTTP, PROFILE_TINFO };
+
+// Tasks posted by tickers, in scheduler.add() order
+enum { TASK_1SEC, TASK_EMONCMS, TASK_JEEDOM, TASK_HTTP, TASK_SYSLOG, TASK_PUSH, 
+       TASK_FEED, TASK_UPDSW };
+
+// ms the scheduler can use each loop, serial is read between tasks
+#define SCHED_BUDGET    20
+
+// WebSocket port, changed labels are pushed there after each frame
+#define WS_PORT         81
+
+// Snapshot of all labels for a new WebSocket or /events client, as big
+// as a delta: a full frame fits in it
+#define LIVE_SIZE       TINFO_DELTA_SIZE
+
 // value for HSL color
 // see http://www.workwithcolor.com/blue-color-hue-range-01.htm
 #define COLOR_RED             0
@@ -167,6 +204,22 @@ typedef struct
 extern ESP8266WebServer server;
 extern WiFiUDP OTA;
 extern TInfo tinfo;
+extern TInfoDerived derived;
+extern TInfoHistory history;
+extern TInfoAggregate emoncms_agg;
+extern TInfoAggregate jeedom_agg;
+extern TInfoMetrics metrics;
+extern TInfoProfiler profiler;
+extern TInfoScheduler scheduler;
+extern TInfoDelta delta;
+extern TInfoEvents events;
+extern WiFiClient events_clients[TINFO_EVENTS_CLIENTS];
+extern char live_buffer[LIVE_SIZE];
+extern TInfoFeed feed;
+extern uint32_t feed_errors;
+#ifdef SYSLOG
+extern TInfoLog logger;
+#endif
 extern uint8_t rgb_brightness;
 extern unsigned long seconds;
 extern _sysinfo sysinfo;
@@ -182,6 +235,7 @@ void ResetConfig(void);
 void Task_emoncms();
 void Task_jeedom();
 void Task_httpRequest();
+boolean feedEnabled(void);
 
 #ifdef MACRO
 void Myprint(void);
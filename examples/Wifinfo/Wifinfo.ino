@@ -59,10 +59,21 @@
 #include <ArduinoOTA.h>
 #include <EEPROM.h>
 #include <Ticker.h>
-//#include <WebSocketsServer.h>
+#include <WebSocketsServer.h>
 //#include <Hash.h>
 #include <NeoPixelBus.h>
 #include <LibTeleinfo.h>
+#include <LibTeleinfoDerived.h>
+#include <LibTeleinfoHistory.h>
+#include <LibTeleinfoAggregate.h>
+#include <LibTeleinfoRules.h>
+#include <LibTeleinfoMetrics.h>
+#include <LibTeleinfoProfiler.h>
+#include <LibTeleinfoScheduler.h>
+#include <LibTeleinfoLog.h>
+#include <LibTeleinfoDelta.h>
+#include <LibTeleinfoEvents.h>
+#include <LibTeleinfoFeed.h>
 #include <FS.h>
 #include <SPI.h>
 
@@ -76,6 +87,30 @@ char optval[48];
 
 // Teleinfo
 TInfo tinfo;
+TInfoDerived derived;
+TInfoHistory history;
+TInfoAggregate emoncms_agg;  // between emoncms posts
+TInfoAggregate jeedom_agg;   // between jeedom posts
+TInfoRules rules;
+TInfoMetrics metrics;
+TInfoProfiler profiler;
+TInfoScheduler scheduler;
+TInfoDelta delta;            // changed labels, pushed to WebSocket and /events clients
+WebSocketsServer webSocket(WS_PORT);
+TInfoEvents events;          // /events stream
+WiFiClient events_clients[TINFO_EVENTS_CLIENTS];
+char live_buffer[LIVE_SIZE]; // snapshot for a new client
+TInfoFeed feed;              // datagram of each frame for the multicast group
+WiFiUDP feedUdp;
+uint32_t feed_errors = 0;    // datagrams not sent
+
+// Overload near subscribed power for 5 s, tariff period changes
+const _TInfoRule rules_table[] = {
+  { "IINST",  TINFO_RULE_ABOVE,   900,    "ISOUSC", 1,   5000 },
+  { "SINSTS", TINFO_RULE_ABOVE,   900000, "PREF",   100, 5000 },
+  { "PTEC",   TINFO_RULE_CHANGED, 0,      NULL,     0,   0    },
+  { "NTARF",  TINFO_RULE_CHANGED, 0,      NULL,     0,   0    },
+};
 
 // RGB Led
 #ifdef RGB_LED_PIN
@@ -95,12 +130,8 @@ Ticker Every_1_Sec;
 Ticker Tick_emoncms;
 Ticker Tick_jeedom;
 Ticker Tick_httpRequest;
+Ticker Tick_syslog;
 
-volatile boolean task_1_sec = false;
-volatile boolean task_emoncms = false;
-volatile boolean task_jeedom = false;
-volatile boolean task_httpRequest = false;
-volatile boolean task_updsw = false;
 unsigned long seconds = 0;
 char buff[132];   //To format debug strings
 // sysinfo data
@@ -109,6 +140,7 @@ _sysinfo sysinfo;
 #ifdef SYSLOG
 WiFiUDP udpClient;
 Syslog syslog(udpClient, SYSLOG_PROTO_IETF);
+TInfoLog logger;    // Debug lines waiting to be sent
 #endif
 
 // count Wifi connect attempts, to check stability
@@ -143,14 +175,6 @@ unsigned long tempo = 200;    // temps necessaire a la stabilisation du switch (
 // non liées au port Serial ou Serial1
 char logbuffer[255];
 
-#ifdef SYSLOG
-char waitbuffer[255];
-char *lines[50];
-int in=-1;
-int out=-1;
-#endif
-
-unsigned int pending = 0 ;
 volatile boolean SYSLOGusable=false;
 volatile boolean SYSLOGselected=false;
 int plog=0;
@@ -172,21 +196,9 @@ void convert(const __FlashStringHelper *ifsh)
 }
 
 #ifdef SYSLOG
-void process_line(char *msg) {
-    strcat(waitbuffer,msg);
-    pending=strlen(waitbuffer);
-    if( waitbuffer[pending-1] == 0x0D || waitbuffer[pending-1] == 0x0A) {
-      //Cette ligne est complete : l'envoyer !
-      for(int i=0; i < pending-1; i++) {
-        if(waitbuffer[i] <= 0x20)
-          waitbuffer[i] = 0x20;
-      }
-      syslog.log(LOG_INFO,waitbuffer);
-      delay(2*pending);
-      memset(waitbuffer,0,255);
-      pending=0;
-      
-    }
+// Envoi d'un datagramme de lignes, appelé par logger.flush()
+boolean syslogSend(const char *buf, size_t len) {
+  return syslog.log(LOG_INFO, buf);
 }
 #endif
 
@@ -198,23 +210,10 @@ void Myprint(char *msg) {
 #endif
 
 #ifdef SYSLOG
-  if( SYSLOGusable ) {
-    process_line(msg);   
-  } else if ( SYSLOGselected) {
-    //syslog non encore disponible
-    //stocker les messages à envoyer plus tard
-    in++;
-    if(in >= 50) {
-      //table saturée !
-      in=0;
-    }
-    if(lines[in]) {
-      //entrée occupée : l'écraser, tant pis !
-      free(lines[in]);
-    }
-    lines[in]=(char *)malloc(strlen(msg)+2);
-    memset(lines[in],0,strlen(msg+1));
-    strcpy(lines[in],msg);   
+  // Copie dans l'anneau, envoyée plus tard par la tache syslog
+  // (y compris les lignes écrites avant la connexion au reseau)
+  if( SYSLOGselected ) {
+    logger.write(msg);
   }
 #endif
 
@@ -312,7 +311,7 @@ Comments: -
 ====================================================================== */
 void Task_1_Sec()
 {
-  task_1_sec = true;
+  scheduler.post(TASK_1SEC);
   seconds++;
 }
 /* ======================================================================
@@ -324,7 +323,7 @@ Comments: Like an Interrupt, need to be short, we set flag for main loop
 ====================================================================== */
 void Task_emoncms()
 {
-  task_emoncms = true;
+  scheduler.post(TASK_EMONCMS);
 }
 
 /* ======================================================================
@@ -336,7 +335,7 @@ Comments: Like an Interrupt, need to be short, we set flag for main loop
 ====================================================================== */
 void Task_jeedom()
 {
-  task_jeedom = true;
+  scheduler.post(TASK_JEEDOM);
 }
 
 /* ======================================================================
@@ -348,7 +347,19 @@ Comments: Like an Interrupt, need to be short, we set flag for main loop
 ====================================================================== */
 void Task_httpRequest()
 {
-  task_httpRequest = true;
+  scheduler.post(TASK_HTTP);
+}
+
+/* ======================================================================
+Function: Task_syslog
+Purpose : callback of syslog ticker
+Input   : 
+Output  : -
+Comments: Like an Interrupt, need to be short, we set flag for main loop
+====================================================================== */
+void Task_syslog()
+{
+  scheduler.post(TASK_SYSLOG);
 }
 
 /* ======================================================================
@@ -415,6 +426,18 @@ void LedRGBOFF(void)
 #endif
 
 
+/* ======================================================================
+Function: profilerClock 
+Purpose : clock of the main loop profiler
+Input   : - 
+Output  : us
+Comments: micros() is unsigned long, the profiler needs an uint32_t one
+====================================================================== */
+uint32_t profilerClock(void)
+{
+  return micros();
+}
+
 /* ======================================================================
 Function: ADPSCallback 
 Purpose : called by library when we detected a ADPS on any phased
@@ -429,6 +452,14 @@ Comments: should have been initialised in the main sketch with a
 ====================================================================== */
 void ADPSCallback(uint8_t phase)
 {
+  char alert[48];
+  int n;
+
+  // Evenement pour les clients /events, ADPS ou ADIRn
+  n = sprintf(alert, phase ? "{\"label\":\"ADIR%d\",\"phase\":%d}" : 
+                             "{\"label\":\"ADPS\",\"phase\":0}", phase, phase);
+  events.send("alert", 0, alert, n);
+
   // Monophasé
   if (phase == 0 ) {
     Debugln(F("ADPS"));
@@ -438,6 +469,25 @@ void ADPSCallback(uint8_t phase)
   }
 }
 
+/* ======================================================================
+Function: RuleCallback 
+Purpose : callback when a rule becomes active or is released
+Input   : rule index in rules_table, true if active
+Output  : - 
+Comments: exporters are sent now instead of waiting their period
+====================================================================== */
+void RuleCallback(uint8_t rule, boolean active)
+{
+  Debug(F("Rule "));
+  Debug(rules_table[rule].name);
+  Debugln(active ? F(" active") : F(" released"));
+
+  if (config.emoncms.freq)
+    scheduler.post(TASK_EMONCMS);
+  if (config.jeedom.freq)
+    scheduler.post(TASK_JEEDOM);
+}
+
 /* ======================================================================
 Function: DataCallback 
 Purpose : callback when we detected new or modified data received
@@ -448,6 +498,8 @@ Comments: -
 ====================================================================== */
 void DataCallback(ValueList * me, uint8_t flags)
 {
+  // Rules using this label
+  rules.data(me, flags, millis());
 
   // This is for simulating ADPS during my tests
   // ===========================================
@@ -482,6 +534,47 @@ void DataCallback(ValueList * me, uint8_t flags)
 */
 }
 
+/* ======================================================================
+Function: frameHooks
+Purpose : give a frame to all modules working on frames
+Input   : linked list pointer on the concerned data
+Output  : - 
+Comments: same for new and updated frames, sends are posted to the
+          scheduler, not done there
+====================================================================== */
+void frameHooks(ValueList * me)
+{
+  derived.frame(me, millis());
+  history.frame(me, millis());
+  metrics.frame(millis());
+  emoncms_agg.frame(me);
+  jeedom_agg.frame(me);
+  if (delta.frame(me, millis()))
+    scheduler.post(TASK_PUSH);
+  if (feedEnabled() && feed.frame(me, millis()))
+    scheduler.post(TASK_FEED);
+}
+
+/* ======================================================================
+Function: frameHooksReset
+Purpose : forget what frame modules got from the values table
+Input   : -
+Output  : - 
+Comments: called when the table is cleared because of polluted entries,
+          their values may be in power windows, history, aggregates and
+          last delta. Live clients and feed receivers see numbers start
+          again and get the whole table with next frame
+====================================================================== */
+void frameHooksReset(void)
+{
+  derived.reset();
+  history.init();
+  emoncms_agg.init();
+  jeedom_agg.init();
+  delta.init(&tinfo);
+  feed.init();
+}
+
 /* ======================================================================
 Function: NewFrame 
 Purpose : callback when we received a complete teleinfo frame
@@ -491,6 +584,8 @@ Comments: -
 ====================================================================== */
 void NewFrame(ValueList * me) 
 {
+  frameHooks(me);
+
   // Light the RGB LED 
   if ( config.config & CFG_RGB_LED) {
     LedRGBON(COLOR_GREEN);
@@ -511,6 +606,8 @@ Comments: it's called only if one data in the frame is different than
 ====================================================================== */
 void UpdatedFrame(ValueList * me)
 {
+  frameHooks(me);
+
   // Light the RGB LED (purple)
   if ( config.config & CFG_RGB_LED) {
     LedRGBON(COLOR_MAGENTA);
@@ -519,38 +616,6 @@ void UpdatedFrame(ValueList * me)
     rgb_ticker.once_ms(BLINK_LED_MS, LedOff, RGB_LED_PIN);
   }
   //Debugln("UpdatedFrame received");
-
-/*
-  // Got at least one ?
-  if (me) {
-    WiFiUDP myudp;
-    IPAddress ip = WiFi.localIP();
-
-    // start UDP server
-    myudp.begin(1201);
-    ip[3] = 255;
-
-    // transmit broadcast package
-    myudp.beginPacket(ip, 1201);
-
-    // start of frame
-    myudp.write(TINFO_STX);
-
-    // Loop thru the node
-    while (me->next) {
-      me = me->next;
-      // prepare line and write it
-      sprintf_P( buff, PSTR("%s %s %c\n"),me->name, me->value, me->checksum );
-      myudp.write( buff);
-    }
-
-    // End of frame
-    myudp.write(TINFO_ETX);
-    myudp.endPacket();
-    myudp.flush();
-
-  }
-*/
 }
 
 
@@ -695,12 +760,11 @@ int WifiHandleConn(boolean setup = false)
       syslog.deviceHostname(config.host);
       syslog.appName(APP_NAME);
       syslog.defaultPriority(LOG_KERN);
-      memset(waitbuffer,0,255);
-      pending=0;
       SYSLOGusable=true;
     } else {
       SYSLOGusable=false;
       SYSLOGselected=false;
+      logger.clear();
     }
 #endif
     
@@ -781,6 +845,8 @@ void setup() {
 #ifdef SYSLOG
   SYSLOGselected=true;  //Par défaut, au moins stocker les premiers msg debug
   SYSLOGusable=false;   //Tant que non connecté, ne pas émettre sur réseau
+  logger.init(schedulerClock, syslogSend, SYSLOG_FLUSH_MS);
+  logger.setRate(SYSLOG_RATE, SYSLOG_BURST);
 #endif
   
   memset(optval,0,48);
@@ -814,19 +880,12 @@ void setup() {
   DEBUG_SERIAL.begin(115200);
 #endif
 
-#ifdef SYSLOG
-  for(int i=0; i<50; i++)
-    lines[i]=0;
-  in=-1;
-  out=-1;
-#endif
-
   // Teleinfo is connected to RXD2 (GPIO13 or D7) to 
   // avoid conflict when flashing, this is why
   // we swap RXD1/TXD1 to RXD2/TXD2 
   // Note that TXD2 is not used : teleinfo is "receive only"
 #ifdef DEBUG_SERIAL1
-  Serial.begin(1200, SERIAL_7E1);
+  Serial.begin(TINFO_BAUD, SERIAL_7E1);
   Serial.swap();
   Debugln("Sortie Debug sur D4 (TXD2), entrée Teleinfo sur D7 (RXD1)");
 #else
@@ -886,22 +945,9 @@ void setup() {
   // start Wifi connect or soft AP
   WifiHandleConn(true);
 
-  //purge previous debug message,
-
+  //previous debug messages are sent by syslog task once connected
 #ifdef SYSLOG
-  if(SYSLOGselected) {
-    if(in != out && in != -1) {
-        //Il y a des messages en attente d'envoi
-        out++;
-        while( out <= in ) {
-          process_line(lines[out]);
-          free(lines[out]);
-          lines[out]=0;
-          out++;
-        }
-        DebuglnF("syslog buffer empty");
-    }
-  } else {
+  if(!SYSLOGselected) {
     DebuglnF("syslog not activated !");
   }
 #endif
@@ -973,6 +1019,13 @@ void setup() {
   server.on("/config.json", confJSONTable);
   server.on("/spiffs.json", spiffsJSONTable);
   server.on("/wifiscan.json", wifiScanJSON);
+  server.on("/history", historyJSON);
+  server.on("/metrics", metricsText);
+  server.on("/sys", profilerJSON);
+  server.on("/events", eventsStream);
+#ifdef TINFO_LATENCY
+  server.on("/latency", latencyJSON);
+#endif
   server.on("/factory_reset", handleFactoryReset);
   server.on("/reset", handleReset);
 
@@ -1058,6 +1111,42 @@ void setup() {
   // Init teleinfo
   need_reinit=false;
   tinfo.init();
+  derived.init(&tinfo);
+  metrics.init(&tinfo);
+
+  // Main loop tasks times and serial gaps
+  profiler.init(TINFO_BAUD, TINFO_RX_SIZE, profilerClock);
+  profiler.task("web");
+  profiler.task("ota");
+  profiler.task("1sec");
+  profiler.task("emoncms");
+  profiler.task("jeedom");
+  profiler.task("http");
+  profiler.task("tinfo");
+
+  // Tasks run from loop, deadline and budget in ms
+  scheduler.init(schedulerClock, serialDrain);
+  scheduler.add("1sec",    doTask1Sec,    100,  10);
+  scheduler.add("emoncms", doEmoncms,     2000, 500);
+  scheduler.add("jeedom",  doJeedom,      2000, 500);
+  scheduler.add("http",    doHttpRequest, 2000, 500);
+  scheduler.add("syslog",  doSyslog,      200,  5);
+  scheduler.add("push",    doPush,        200,  20);
+  scheduler.add("feed",    doFeed,        100,  5);
+#ifdef SENSOR
+  scheduler.add("switch",  doUpdSwitch,   500,  200);
+#endif
+
+  // Charts history, power of historic or standard meter
+  history.track("PAPP");
+  history.track("SINSTS");
+
+  // Peaks between two posts
+  emoncms_agg.init();
+  jeedom_agg.init();
+
+  // Thresholds and events
+  rules.init(rules_table, sizeof(rules_table) / sizeof(rules_table[0]), RuleCallback);
 
   // Attach the callback we need
   // set all as an example
@@ -1066,8 +1155,12 @@ void setup() {
   tinfo.attachNewFrame(NewFrame);
   tinfo.attachUpdatedFrame(UpdatedFrame);
 
-  //webSocket.begin();
-  //webSocket.onEvent(webSocketEvent);
+  // Changed labels pushed to live clients
+  delta.init(&tinfo);
+  webSocket.begin();
+  webSocket.onEvent(webSocketEvent);
+  events.init(eventsWrite, eventsClose);
+  feed.init();
 
   // Light off the RGB LED
   LedRGBOFF();
@@ -1087,6 +1180,11 @@ void setup() {
   if (config.httpReq.freq) 
     Tick_httpRequest.attach(config.httpReq.freq, Task_httpRequest);
 
+#ifdef SYSLOG
+  // Send debug lines waiting, by datagrams
+  Tick_syslog.attach_ms(SYSLOG_FLUSH_MS, Task_syslog);
+#endif
+
 //To simulate Teleinfo on not connected module
 #ifdef SIMU
     String name1 = "ADCO";
@@ -1111,57 +1209,293 @@ void setup() {
 
 }
 
+/* ======================================================================
+Function: schedulerClock 
+Purpose : clock of the scheduler
+Input   : - 
+Output  : ms
+Comments: millis() is unsigned long, the scheduler needs an uint32_t one
+====================================================================== */
+uint32_t schedulerClock(void)
+{
+  return millis();
+}
+
+/* ======================================================================
+Function: serialDrain
+Purpose : give all chars received to teleinfo
+Input   : -
+Output  : - 
+Comments: called by the scheduler before and after each task, chars are
+          processed by blocks instead of one per loop
+====================================================================== */
+void serialDrain(void)
+{
+  char buf[64];
+  int n;
+
+  // Some polluted entries have been detected in Teleinfo ListValues
+  if (need_reinit) {
+    need_reinit=false;
+    nb_reinit++;    //account of reinit operations, for system infos
+    tinfo.init();   //Clear ListValues, buffer, and wait for next STX
+    frameHooksReset();
+  }
+
+  if ( Serial.available() ) {
+    profiler.begin(PROFILE_TINFO);
+    while ( (n = Serial.available()) > 0 ) {
+      if (n > (int) sizeof(buf))
+        n = sizeof(buf);
+      n = Serial.readBytes(buf, n);
+      tinfo.process(buf, n, millis());
+    }
+    profiler.end(PROFILE_TINFO);
+  }
+
+  // Nothing waiting, chars can't have been lost since last time
+  profiler.drain();
+}
+
+/* ======================================================================
+Function: doTask1Sec
+Purpose : job done each second
+Input   : -
+Output  : - 
+Comments: -
+====================================================================== */
+void doTask1Sec(void)
+{
+  profiler.begin(PROFILE_1SEC);
+  UpdateSysinfo(false, false); 
+  rules.tick(millis());
+  profiler.end(PROFILE_1SEC);
+
+//To simulate Teleinfo on not connected module
+#ifdef SIMU
+  loop_cpt++;
+  if(loop_cpt % 10)
+  {
+    // each 10 second, try to change HCHC value
+    //Increase v2 value
+    sprintf(v2, "%09d", (loop_cpt) );
+    // and update ListValues
+    flags = TINFO_FLAGS_UPDATED;
+    tinfo.addCustomValue(s2, v2, &flags);   
+  }
+#endif
+}
+
+/* ======================================================================
+Function: doEmoncms
+Purpose : post to emoncms
+Input   : -
+Output  : - 
+Comments: -
+====================================================================== */
+void doEmoncms(void)
+{
+  profiler.begin(PROFILE_EMONCMS);
+  emoncmsPost(); 
+  profiler.end(PROFILE_EMONCMS);
+#ifdef TINFO_LATENCY
+  tinfo.latencyExport();
+#endif
+}
+
+/* ======================================================================
+Function: doJeedom
+Purpose : post to jeedom
+Input   : -
+Output  : - 
+Comments: -
+====================================================================== */
+void doJeedom(void)
+{
+  profiler.begin(PROFILE_JEEDOM);
+  jeedomPost();  
+  profiler.end(PROFILE_JEEDOM);
+#ifdef TINFO_LATENCY
+  tinfo.latencyExport();
+#endif
+}
+
+/* ======================================================================
+Function: doHttpRequest
+Purpose : send http request
+Input   : -
+Output  : - 
+Comments: -
+====================================================================== */
+void doHttpRequest(void)
+{
+  profiler.begin(PROFILE_HTTP);
+  httpRequest();  
+  profiler.end(PROFILE_HTTP);
+#ifdef TINFO_LATENCY
+  tinfo.latencyExport();
+#endif
+}
+
+/* ======================================================================
+Function: doSyslog
+Purpose : send a datagram of debug lines
+Input   : -
+Output  : - 
+Comments: nothing is sent until wifi is connected, lines wait in ring
+====================================================================== */
+void doSyslog(void)
+{
+#ifdef SYSLOG
+  if (SYSLOGusable)
+    logger.flush();
+#endif
+}
+
+/* ======================================================================
+Function: doPush
+Purpose : push labels changed by last frame to WebSocket and /events clients
+Input   : -
+Output  : - 
+Comments: message is serialized once by frame callback, written to each
+          client there. If a frame came before the push, clients see a
+          hole in numbers and ask a snapshot
+====================================================================== */
+void doPush(void)
+{
+  if (delta.length()) {
+    webSocket.broadcastTXT(delta.message(), delta.length());
+    events.send("frame", delta.seq(), delta.message(), delta.length());
+  }
+}
+
+/* ======================================================================
+Function: feedEnabled
+Purpose : frames are sent to a multicast group
+Input   : -
+Output  : true if a group is set in config
+Comments: -
+====================================================================== */
+boolean feedEnabled(void)
+{
+  return config.feed_ip[0] && config.feed_port;
+}
+
+/* ======================================================================
+Function: doFeed
+Purpose : send datagram of last frame to the multicast group
+Input   : -
+Output  : - 
+Comments: datagram is built by frame callback, a frame that comes before
+          the send or while wifi is down is a hole in receivers numbers
+====================================================================== */
+void doFeed(void)
+{
+  if (!feed.length() || WiFi.status() != WL_CONNECTED)
+    return;
+
+  if ( !feedUdp.beginPacketMulticast(IPAddress(config.feed_ip), config.feed_port, WiFi.localIP()) ||
+       feedUdp.write(feed.data(), feed.length()) != feed.length() ||
+       !feedUdp.endPacket() )
+    feed_errors++;
+}
+
+/* ======================================================================
+Function: webSocketEvent
+Purpose : WebSocket client events
+Input   : client number, event, payload and its size
+Output  : - 
+Comments: a new client, or one that lost a delta, gets all labels
+====================================================================== */
+void webSocketEvent(uint8_t num, WStype_t type, uint8_t * payload, size_t length)
+{
+  size_t n;
+
+  if ( type == WStype_CONNECTED ||
+      (type == WStype_TEXT && !strcmp((char *) payload, TINFO_DELTA_ASK)) ) {
+    if ( (n = delta.snapshot(live_buffer, sizeof(live_buffer))) )
+      webSocket.sendTXT(num, live_buffer, n);
+  }
+}
+
+/* ======================================================================
+Function: eventsWrite
+Purpose : write to an /events client without waiting
+Input   : client slot, chars and their number
+Output  : chars written, -1 if client is gone
+Comments: only what fits in the TCP send buffer now
+====================================================================== */
+int eventsWrite(int id, const char * buf, size_t len)
+{
+  WiFiClient & client = events_clients[id];
+  size_t n;
+
+  if (!client.connected())
+    return -1;
+
+  n = client.availableForWrite();
+  if (n > len)
+    n = len;
+
+  return n ? client.write((const uint8_t *) buf, n) : 0;
+}
+
+/* ======================================================================
+Function: eventsClose
+Purpose : close an /events client
+Input   : client slot
+Output  : - 
+Comments: slot is free again
+====================================================================== */
+void eventsClose(int id)
+{
+  events_clients[id].stop();
+}
+
+#ifdef SENSOR
+/* ======================================================================
+Function: doUpdSwitch
+Purpose : send switch state
+Input   : -
+Output  : - 
+Comments: -
+====================================================================== */
+void doUpdSwitch(void)
+{
+  UPD_switch();  
+}
+#endif
+
 /* ======================================================================
 Function: loop
 Purpose : infinite loop main code
 Input   : -
 Output  : - 
-Comments: -
+Comments: serial is read before and after each job, posted tasks are
+          run by the scheduler for at most SCHED_BUDGET ms per loop
 ====================================================================== */
 void loop()
 {
-  char c;
+  uint32_t start = micros();
 
   // Do all related network stuff
+  serialDrain();
+  profiler.begin(PROFILE_WEB);
   server.handleClient();
+  profiler.end(PROFILE_WEB);
+  serialDrain();
+  profiler.begin(PROFILE_OTA);
   ArduinoOTA.handle();
+  profiler.end(PROFILE_OTA);
 
-  //webSocket.loop();
+  serialDrain();
+  webSocket.loop();
+  events.flush();
 
-  // Only once task per loop, let system do its own task
-  if (task_1_sec) { 
-    UpdateSysinfo(false, false); 
-    task_1_sec = false; 
-    
-//To simulate Teleinfo on not connected module
-#ifdef SIMU
-    loop_cpt++;
-    if(loop_cpt % 10)
-    {
-      // each 10 second, try to change HCHC value
-      //Increase v2 value
-      sprintf(v2, "%09d", (loop_cpt) );
-      // and update ListValues
-      flags = TINFO_FLAGS_UPDATED;
-      tinfo.addCustomValue(s2, v2, &flags);   
-    }
-#endif
-  } else if (task_emoncms) { 
-    emoncmsPost(); 
-    task_emoncms=false; 
-  } else if (task_jeedom) { 
-    jeedomPost();  
-    task_jeedom=false;
-  } else if (task_httpRequest) { 
-    httpRequest();  
-    task_httpRequest=false;
-  } 
-#ifdef SENSOR
-  else if (task_updsw) { 
-    UPD_switch();  
-    task_updsw=false;
-  }
+  // Tasks posted by tickers and frames, earliest deadline first
+  scheduler.run(SCHED_BUDGET);
 
+#ifdef SENSOR
  // read the state of the switch into a local variable:
   reading = digitalRead(SensorPin);
 
@@ -1186,25 +1520,10 @@ void loop()
       Debug(buff);
       SwitchState = reading;
       //Notify HTTP server that switch has changed, on next loop
-      task_updsw=true;
+      scheduler.post(TASK_UPDSW);
     }
   }
 #endif
 
-  if (need_reinit) {
-    //Some polluted entries have been detected in Teleinfo ListValues
-		need_reinit=false;
-    nb_reinit++;    //account of reinit operations, for system infos
-		tinfo.init();		//Clear ListValues, buffer, and wait for next STX
-  } else {
-	  // Handle teleinfo serial
-	  if ( Serial.available() ) {
-	    // Read Serial and process to tinfo
-	    c = Serial.read();
-	    tinfo.process(c);
-    }
-
-    //delay(10);
-  }
-
+  metrics.loop(micros() - start);
 }
@@ -189,6 +189,8 @@ void showConfig()
   DebugF("OTA port :"); Debugln(config.ota_port); 
   DebugF("syslog host :"); Debugln(config.syslog_host); 
   DebugF("syslog port :"); Debugln(config.syslog_port); 
+  DebugF("feed group  :"); Debugln(IPAddress(config.feed_ip).toString()); 
+  DebugF("feed port   :"); Debugln(config.feed_port); 
   DebugF("Config   :"); 
   if (config.config & CFG_RGB_LED) DebugF(" RGB"); 
   if (config.config & CFG_DEBUG)   DebugF(" DEBUG"); 
@@ -57,6 +57,9 @@
 //#define DEFAULT_OTA_AUTH     ""
 #define DEFAULT_SYSLOG_PORT  514
 
+// Frames feed, disabled until a multicast group is set
+#define DEFAULT_FEED_PORT    1201
+
 // Bit definition for different configuration modes
 #define CFG_LCD				  0x0001	// Enable display
 #define CFG_DEBUG			  0x0002	// Enable serial debug
@@ -72,6 +75,8 @@
 #define CFG_FORM_OTA_PORT FPSTR("ota_port")
 #define CFG_FORM_SYSLOG_HOST FPSTR("syslog_host")
 #define CFG_FORM_SYSLOG_PORT FPSTR("syslog_port")
+#define CFG_FORM_FEED_GROUP  FPSTR("feed_group")
+#define CFG_FORM_FEED_PORT   FPSTR("feed_port")
 
 
 #define CFG_FORM_EMON_HOST  FPSTR("emon_host")
@@ -152,7 +157,9 @@ typedef struct
   uint16_t ota_port;         		   // OTA port 
   char     syslog_host[64];        // Adresse IP ou DNS du serveur rsyslog
   uint16_t syslog_port;            // port rsyslog (generalement 514)
-  uint8_t  filler[65];      		   // in case adding data in config avoiding loosing current conf by bad crc
+  uint8_t  feed_ip[4];             // groupe multicast des trames, 0 si desactive
+  uint16_t feed_port;              // port UDP des trames (1201)
+  uint8_t  filler[59];      		   // in case adding data in config avoiding loosing current conf by bad crc
   _emoncms emoncms;                // Emoncms configuration
   _jeedom  jeedom;                 // jeedom configuration
   _httpRequest httpReq;            // HTTP request
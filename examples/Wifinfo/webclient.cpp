@@ -164,6 +164,17 @@ String build_emoncms_json(void)
          } //not free entry
       } // While next
 
+      // Min, max and mean since last post
+      for (uint8_t i = 0; i < emoncms_agg.count(); i++) {
+        _TInfoAggregate * a = emoncms_agg.get(i);
+
+        if (a->count) {
+          url += ",";  url += a->name;  url += "_MIN:";  url += a->min;
+          url += ",";  url += a->name;  url += "_MAX:";  url += a->max;
+          url += ",";  url += a->name;  url += "_AVG:";  url += TInfoAggregate::mean(a);
+        }
+      }
+
   } //if me
   // Json end
   url += "}";
@@ -209,6 +220,9 @@ boolean emoncmsPost(void)
       // And submit all to emoncms
       ret = httpPost( config.emoncms.host, config.emoncms.port, (char *) url.c_str()) ;
 
+      // Next post will have its own peaks
+      emoncms_agg.restart();
+
     } // if me
   } // if host
   return ret;
@@ -272,7 +286,19 @@ boolean jeedomPost(void)
         }
       } // While me
 
+      // Min, max and mean since last post
+      for (uint8_t i = 0; i < jeedom_agg.count(); i++) {
+        _TInfoAggregate * a = jeedom_agg.get(i);
+
+        if (a->count) {
+          url += a->name;  url += "_MIN=";  url += a->min;  url += "&";
+          url += a->name;  url += "_MAX=";  url += a->max;  url += "&";
+          url += a->name;  url += "_AVG=";  url += TInfoAggregate::mean(a);  url += "&";
+        }
+      }
+
       ret = httpPost( config.jeedom.host, config.jeedom.port, (char *) url.c_str()) ;
+      jeedom_agg.restart();
     } // if me
   } // if host
   return ret;
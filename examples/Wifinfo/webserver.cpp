@@ -34,12 +34,13 @@ const char FP_RESTART[] PROGMEM = "OK, Redémarrage en cours\r\n";
 const char FP_NL[] PROGMEM = "\r\n";
 
 //List of authorized value names in Teleinfo, to detect polluted entries
-const String tabnames[35] = { 
+const String tabnames[36] = { 
   "ADCO" , "OPTARIF" , "ISOUSC" , "BASE", "HCHC" , "HCHP",
    "IMAX" , "IINST" , "PTEC", "PMAX", "PAPP", "HHPHC" , "MOTDETAT" , "PPOT",
    "IINST1" , "IINST2" , "IINST3", "IMAX1" , "IMAX2" , "IMAX3" , 
   "EJPHN" , "EJPHPM" , "BBRHCJB" , "BBRHPJB", "BBRHCJW" , "BBRHPJW" , "BBRHCJR" ,
-  "BBRHPJR" , "PEJP" , "DEMAIN" , "ADPS" , "ADIR1", "ADIR2" , "ADIR3"
+  "BBRHPJR" , "PEJP" , "DEMAIN" , "ADPS" , "ADIR1", "ADIR2" , "ADIR3",
+  TINFO_DERIVED_PACT , TINFO_DERIVED_E15MIN
   };
 
 
@@ -161,6 +162,19 @@ void handleFormConfig(void)
     strncpy(config.syslog_host ,   server.arg("syslog_host").c_str(),     64 );
     itemp = server.arg("syslog_port").toInt();
     config.syslog_port = (itemp>=0 && itemp<=65535) ? itemp : DEFAULT_SYSLOG_PORT ;
+
+    // Trames multicast, champs absents de l'ancienne interface
+    if (server.hasArg("feed_group")) {
+      IPAddress group;
+      if (group.fromString(server.arg("feed_group")) && group[0] >= 224 && group[0] <= 239) {
+        for (itemp = 0; itemp < 4; itemp++)
+          config.feed_ip[itemp] = group[itemp];
+      } else {
+        memset(config.feed_ip, 0, sizeof(config.feed_ip));
+      }
+      itemp = server.arg("feed_port").toInt();
+      config.feed_port = (itemp>0 && itemp<=65535) ? itemp : DEFAULT_FEED_PORT ;
+    }
     
     // Emoncms
     strncpy(config.emoncms.host,   server.arg("emon_host").c_str(),  CFG_EMON_HOST_SIZE );
@@ -457,6 +471,81 @@ void getSysJSONData(String & response)
   response += "{\"na\":\"Altérations Data détectées\",\"va\":\"";
   response += nb_reinit;
   response += "\"},\r\n"; 
+
+  TInfoStats stats;
+  tinfo.getStats(&stats);
+  response += "{\"na\":\"TIC octets reçus\",\"va\":\"";
+  response += stats.bytes;
+  response += "\"},\r\n"; 
+  response += "{\"na\":\"TIC trames\",\"va\":\"";
+  response += stats.frames;
+  response += " (interrompues ";
+  response += stats.aborted;
+  response += ")\"},\r\n"; 
+  response += "{\"na\":\"TIC groupes\",\"va\":\"";
+  response += stats.groups;
+  response += "\"},\r\n"; 
+  response += "{\"na\":\"TIC erreurs groupes\",\"va\":\"";
+  response += "checksum ";
+  response += stats.checksum;
+  response += ", trop long ";
+  response += stats.overflow;
+  response += ", table pleine ";
+  response += stats.full;
+  response += ", inconnu ";
+  response += stats.unknown;
+  response += "\"},\r\n"; 
+  response += "{\"na\":\"TIC groupes resynchronisés\",\"va\":\"";
+  response += stats.resync;
+  response += " (récupérés ";
+  response += stats.recovered;
+  response += ")\"},\r\n"; 
+
+#ifdef SYSLOG
+  TInfoLogStats lstats;
+  logger.getStats(&lstats);
+  response += "{\"na\":\"Syslog lignes\",\"va\":\"";
+  response += lstats.lines;
+  response += " (en attente ";
+  response += logger.pending();
+  response += ")\"},\r\n"; 
+  response += "{\"na\":\"Syslog datagrammes\",\"va\":\"";
+  response += lstats.datagrams;
+  response += " (";
+  response += lstats.bytes;
+  response += " octets, erreurs ";
+  response += lstats.errors;
+  response += ")\"},\r\n"; 
+  response += "{\"na\":\"Syslog lignes perdues\",\"va\":\"";
+  response += "anneau plein ";
+  response += lstats.dropped;
+  response += ", débit ";
+  response += lstats.limited;
+  response += ", tronquées ";
+  response += lstats.truncated;
+  response += "\"},\r\n"; 
+#endif
+
+  response += "{\"na\":\"Clients /events\",\"va\":\"";
+  response += events.clients();
+  response += " (déconnectés ";
+  response += events.evicted();
+  response += ")\"},\r\n"; 
+  
+  response += "{\"na\":\"Trames multicast\",\"va\":\"";
+  if (feedEnabled()) {
+    response += IPAddress(config.feed_ip).toString();
+    response += ":";
+    response += config.feed_port;
+    response += " trame ";
+    response += feed.seq();
+    response += " (erreurs ";
+    response += feed_errors;
+    response += ")";
+  } else {
+    response += "arrêtées";
+  }
+  response += "\"},\r\n"; 
   
   response += "{\"na\":\"WifInfo Version\",\"va\":\"" WIFINFO_VERSION "\"},\r\n";
 
@@ -593,6 +682,8 @@ void getConfJSONData(String & r)
   r+=CFG_FORM_OTA_PORT;  r+=FPSTR(FP_QCQ); r+=config.ota_port;       r+= FPSTR(FP_QCNL);
   r+=CFG_FORM_SYSLOG_HOST; r+=FPSTR(FP_QCQ); r+=config.syslog_host;  r+= FPSTR(FP_QCNL); 
   r+=CFG_FORM_SYSLOG_PORT; r+=FPSTR(FP_QCQ); r+=config.syslog_port;  r+= FPSTR(FP_QCNL);
+  r+=CFG_FORM_FEED_GROUP;  r+=FPSTR(FP_QCQ); r+=IPAddress(config.feed_ip).toString(); r+= FPSTR(FP_QCNL);
+  r+=CFG_FORM_FEED_PORT;   r+=FPSTR(FP_QCQ); r+=config.feed_port;    r+= FPSTR(FP_QCNL);
   r+=CFG_FORM_JDOM_HOST; r+=FPSTR(FP_QCQ); r+=config.jeedom.host;   r+= FPSTR(FP_QCNL); 
   r+=CFG_FORM_JDOM_PORT; r+=FPSTR(FP_QCQ); r+=config.jeedom.port;   r+= FPSTR(FP_QCNL); 
   r+=CFG_FORM_JDOM_URL;  r+=FPSTR(FP_QCQ); r+=config.jeedom.url;    r+= FPSTR(FP_QCNL); 
@@ -760,6 +851,138 @@ void sendJSON(void)
 }
 
 
+/* ======================================================================
+Function: historyJSON 
+Purpose : send history of a label, /history?label=PAPP
+Input   : -
+Output  : - 
+Comments: sent in chunks as rendered, the whole history (several KB)
+          is never built in memory
+====================================================================== */
+void historyJSON(void)
+{
+  _TInfoHistoryCursor cursor;
+  char buffer[256];
+
+  ESP.wdtFeed();  //Force software watchdog to restart from 0
+
+  if (!history.open(server.arg("label").c_str(), &cursor)) {
+    server.send ( 404, "text/plain", "Label not tracked" );
+    return;
+  }
+
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send ( 200, "text/json", "" );
+
+  while (history.render(&cursor, buffer, sizeof(buffer))) {
+    server.sendContent(buffer);
+    yield();  //Let a chance to other threads to work
+  }
+  server.sendContent("");
+}
+
+/* ======================================================================
+Function: metricsText 
+Purpose : send decoder counters and label values, /metrics
+Input   : -
+Output  : - 
+Comments: OpenMetrics text for Prometheus, sent in chunks as rendered
+====================================================================== */
+void metricsText(void)
+{
+  _TInfoMetricsCursor cursor;
+  char buffer[512];
+
+  ESP.wdtFeed();  //Force software watchdog to restart from 0
+
+  metrics.open(&cursor, millis());
+
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send ( 200, TINFO_METRICS_TYPE, "" );
+
+  while (metrics.render(&cursor, buffer, sizeof(buffer))) {
+    server.sendContent(buffer);
+    yield();  //Let a chance to other threads to work
+  }
+  server.sendContent("");
+}
+
+/* ======================================================================
+Function: eventsStream 
+Purpose : keep client for frame and alert events, /events
+Input   : -
+Output  : - 
+Comments: text/event-stream, first event has all labels. Client is then
+          written by events object, web server forgets it
+====================================================================== */
+void eventsStream(void)
+{
+  WiFiClient client = server.client();
+  uint8_t i;
+  size_t n;
+
+  for (i = 0; i < TINFO_EVENTS_CLIENTS && events_clients[i].connected(); i++)
+    ;
+
+  if (i == TINFO_EVENTS_CLIENTS) {
+    server.send(503, "text/plain", "Too many clients\r\n");
+    return;
+  }
+
+  // Slot may still be known if its client left between two events
+  events.remove(i);
+
+  client.setNoDelay(true);
+  client.print(F("HTTP/1.1 200 OK\r\n"
+                 "Content-Type: " TINFO_EVENTS_TYPE "\r\n"
+                 "Cache-Control: no-cache\r\n"
+                 "Connection: keep-alive\r\n"
+                 "Access-Control-Allow-Origin: *\r\n\r\n"));
+
+  events_clients[i] = client;
+  if (!events.add(i)) {
+    events_clients[i].stop();
+    return;
+  }
+
+  if ( (n = delta.snapshot(live_buffer, sizeof(live_buffer))) )
+    events.sendTo(i, "frame", delta.seq(), live_buffer, n);
+}
+
+/* ======================================================================
+Function: profilerJSON 
+Purpose : send main loop tasks times and serial gaps, /sys
+Input   : -
+Output  : - 
+Comments: times in us, overflows counts gaps where serial receive
+          buffer may have been full
+====================================================================== */
+void profilerJSON(void)
+{
+  char buffer[512];
+
+  if (!profiler.json(buffer, sizeof(buffer)))
+    strcpy(buffer, "{}");
+  server.send ( 200, "text/json", buffer );
+}
+
+#ifdef TINFO_LATENCY
+/* ======================================================================
+Function: latencyJSON 
+Purpose : send time spent in each stage, /latency
+Input   : -
+Output  : - 
+Comments: histograms of group decode, frame, callback and export times
+====================================================================== */
+void latencyJSON(void)
+{
+  char buffer[512];
+
+  tinfo.latencyJSON(buffer, sizeof(buffer));
+  server.send ( 200, "text/json", buffer );
+}
+#endif
+
 /* ======================================================================
 Function: wifiScanJSON 
 Purpose : scan Wifi Access Point and return JSON code
@@ -949,7 +1172,7 @@ Comments: -
 bool validate_value_name(String name)
 {
 	
-  for (int i=0 ; i < 35; i++ ) {
+  for (int i=0 ; i < 36; i++ ) {
     if( (tabnames[i].length() == name.length()) && (tabnames[i] == name) ) {
       return true;
     }
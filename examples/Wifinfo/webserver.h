@@ -61,6 +61,13 @@ void getSpiffsJSONData(String & r);
 void spiffsJSONTable(void);
 void sendJSON(void);
 void wifiScanJSON(void);
+void historyJSON(void);
+void metricsText(void);
+void profilerJSON(void);
+void eventsStream(void);
+#ifdef TINFO_LATENCY
+void latencyJSON(void);
+#endif
 void handleFactoryReset(void);
 void handleReset(void);
 bool validate_value_name(String name);
@@ -31,9 +31,31 @@
 // **********************************************************************************
 
 #include "LibTeleinfo.h" 
-int ValueItem = 0;					//Index of next position to use
-struct _ValueList ValuesTab[50];	//Allocate static table of 50 items
-									// to don't use anymore malloc & free
+#include "LibTeleinfoScan.h"
+#include "LibTeleinfoDecoder.h"
+
+#ifndef ARDUINO
+#include <time.h>
+#endif
+
+/* ======================================================================
+Function: tinfoMillis
+Purpose : default clock used to timestamp values
+Input   : -
+Output  : milliseconds from a monotonic clock
+Comments: may wrap, only differences are used
+====================================================================== */
+static uint32_t tinfoMillis(void)
+{
+#ifdef ARDUINO
+  return millis();
+#else
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t) ts.tv_sec * 1000UL + ts.tv_nsec / 1000000UL;
+#endif
+}
 
 
 /* ======================================================================
@@ -46,6 +68,8 @@ Comments: -
 TInfo::TInfo()
 {
 	ValueList * me;
+
+	_ValueItem = 0;
   // Init of our linked list
 /*
   _valueslist.name = NULL;
@@ -55,21 +79,41 @@ TInfo::TInfo()
   _valueslist.checksum = '\0';
   _valueslist.flags = TINFO_FLAGS_NONE;
 */
-	for(int i = 0; i < 50; i++) {
-		me = &ValuesTab[i];
-		memset(&ValuesTab[i], 0, sizeof(_ValueList) );	//Also reset the 'free' marker
+	for(int i = 0; i < TINFO_TABSIZE; i++) {
+		me = &_ValuesTab[i];
+		memset(&_ValuesTab[i], 0, sizeof(_ValueList) );	//Also reset the 'free' marker
 		me->free=1;		//Init each entry as free
 		me->flags = TINFO_FLAGS_NONE;
-		if(i < 49)
-			me->next = &ValuesTab[i+1];
+		if(i < TINFO_TABSIZE-1)
+			me->next = &_ValuesTab[i+1];
 	}
 
+  // Head of the list given to frame callbacks
+  _valueslist.next = &_ValuesTab[0];
+
+  // Detect mode from received groups
+  _mode = TINFO_MODE_AUTO;
 
   // callback
   _fn_ADPS = NULL;
   _fn_data = NULL;   
   _fn_new_frame = NULL;   
   _fn_updated_frame = NULL;   
+  _fn_clock = tinfoMillis;
+  _group_start = 0;
+  _rx_time = 0;
+  _rx_timed = false;
+  _batch_checked = false;
+  _batch_mode = TINFO_MODE_AUTO;
+  _batch_len = 0;
+  _frame_open = false;
+  _group_bad = false;
+  _resynced = false;
+#ifdef TINFO_LATENCY
+  _frame_start = 0;
+  _frame_end = 0;
+#endif
+  clearStats();
 }
 
 /* ======================================================================
@@ -89,6 +133,42 @@ void TInfo::init()
 
   // We're in INIT in term of receive data
   _state = TINFO_INIT;
+  _frame_open = false;
+  _group_bad = false;
+  _resynced = false;
+
+  // Restart mode detection if needed
+  setMode(_mode);
+}
+
+/* ======================================================================
+Function: setMode
+Purpose : set teleinfo mode of the meter
+Input   : TINFO_MODE_HISTORIC, TINFO_MODE_STANDARD or TINFO_MODE_AUTO
+Output  : -
+Comments: in auto mode, mode is locked after TINFO_MODE_LOCK good groups
+          using the separator and checksum of the same mode, and detection
+          restart after TINFO_MODE_UNLOCK consecutive bad groups
+====================================================================== */
+void TInfo::setMode(_Mode_e mode)
+{
+  _mode = mode;
+  _mode_current = mode;
+  _mode_detect = TINFO_MODE_AUTO;
+  _mode_good = 0;
+  _mode_bad = 0;
+}
+
+/* ======================================================================
+Function: getMode
+Purpose : get teleinfo mode used to decode groups
+Input   : -
+Output  : mode, TINFO_MODE_AUTO if not yet detected
+Comments: -
+====================================================================== */
+_Mode_e TInfo::getMode(void)
+{
+  return _mode_current;
 }
 
 /* ======================================================================
@@ -144,6 +224,18 @@ void TInfo::attachUpdatedFrame(void (*fn_updated_frame)(ValueList * valueslist))
   _fn_updated_frame = fn_updated_frame;   
 }
 
+/* ======================================================================
+Function: attachClock 
+Purpose : attach the clock used to timestamp values
+Input   : function returning milliseconds, NULL for default one
+Output  : - 
+Comments: default is millis() on Arduino, monotonic clock on Linux
+====================================================================== */
+void TInfo::attachClock(uint32_t (*fn_clock)(void))
+{
+  _fn_clock = fn_clock ? fn_clock : tinfoMillis;
+}
+
 /* ======================================================================
 Function: clearBuffer
 Purpose : clear and init the buffer
@@ -176,7 +268,7 @@ ValueList * TInfo::addCustomValue(char * name, char * value, uint8_t * flags)
 
     // Same as if we really received this line
     customLabel(name, value, flags);
-    me = valueAdd(name, value, calcChecksum(name,value), flags);
+    me = valueAdd(name, value, NULL, calcChecksum(name,value), flags);
 
     if ( me ) {
       // something to do with new datas
@@ -197,96 +289,104 @@ Function: valueAdd
 Purpose : Add element to the Linked List of values
 Input   : Pointer to the label name
           pointer to the value
+          pointer to the horodate (NULL if none)
           checksum value
           flag state of the label (modified by function)
 Output  : pointer to the new node (or founded one)
 Comments: - state of the label changed by the function
+          - checksum has been checked by caller with the mode rule
+          - value can be empty if there is an horodate (DATE label)
 ====================================================================== */
-ValueList * TInfo::valueAdd(char * name, char * value, uint8_t checksum, uint8_t * flags)
+ValueList * TInfo::valueAdd(char * name, char * value, char * horodate, uint8_t checksum, uint8_t * flags)
 {
-  
   uint8_t lgname = strlen(name);
   uint8_t lgvalue = strlen(value);
-  uint8_t thischeck = calcChecksum(name,value);
-	int firstfree = -1;
+  uint8_t lghoro = horodate ? strlen(horodate) : 0;
+  int firstfree = -1;
+  int i;
+  uint32_t now = _fn_clock();
   ValueList * me;
-  
-  // just some paranoia 
-  if (thischeck != checksum ) {
+
+  // Got one and all seems good ?
+  if (!lgname || lgname >= TINFO_NAME_SIZE || lgvalue >= TINFO_VALUE_SIZE ||
+      lghoro >= TINFO_HORO_SIZE || (!lgvalue && !lghoro) || !checksum) {
     TI_Debug(name);
-    TI_Debug('=');
-    TI_Debug(value);
-    TI_Debug(F(" '"));
-    TI_Debug((char) checksum);
-    TI_Debug(F("' Not added bad checksum calculated '"));
-    TI_Debug((char) thischeck);
-    TI_Debugln(F("'"));
-  } else  {
-    // Got one and all seems good ?
-    if (lgname && lgvalue && checksum) {
-		// Parameters seems to be coherent
-		// Scan the existing table
-		int i;
-		for(i=0; i < ValueItem, i < 50 ; i++) {
-			me = &ValuesTab[i];
-			if( ! me->free) {
-				if (strncmp(me->name, name, lgname) == 0) {
-					//entry found for the same value name : reuse it !
-					if (strncmp(me->value, value, lgvalue) == 0) {
-						*flags |= TINFO_FLAGS_EXIST;
-						me->flags = *flags;
-						return ( me );
-		      		} else {
-						//Exist, but value changed
-						*flags |= TINFO_FLAGS_UPDATED;
-						me->flags = *flags ;
-						// Copy new value
-						memset(me->value, 0, 16);
-						memcpy(me->value, value , lgvalue );
-						me->checksum = checksum ;
-
-						// That's all
-						return (me);	
-					}
-				} //name comparison
-			} else {
-				//This entry is free
-				if(firstfree < 0)
-					firstfree=i;	//It's the 1st one detected
-			}
-		} //for
-
-		//No existing entry for this name : Create a new one
-		if(firstfree >= 0) {
-			//Use the 1st free entry found
-			i=firstfree;
-		} else {
-			if(i < 50)
-				ValueItem=i;	//Note new entry as last one
-			else
-				return ( (ValueList *) NULL ); //Table saturated !
-		}
+    TI_Debugln(F(" Not added bad size"));
+    return ( (ValueList *) NULL );
+  }
 
-      // i points the entry to use : get our buffer Safe
-	  me = &ValuesTab[i];
-      memset(me, 0, sizeof(_ValueList) );	//Also reset the 'free' marker
-      me->checksum = checksum;
-	  if(i < 49)
-			me->next = &ValuesTab[i+1];
-
-	  // Copy the string data (name & value)
-      memcpy(me->name, name  , lgname );
-      memcpy(me->value, value , lgvalue );
- 	  if ( (*flags & TINFO_FLAGS_UPDATED) == 0) {
-        // so we added this node !
-        *flags |= TINFO_FLAGS_ADDED ;
-        me->flags = *flags;
-      }
-	  // That's all
-	  return (me);
-	 }
-	} //Checksum check
-}	
+  // Scan the existing table
+  for (i=0; i < TINFO_TABSIZE ; i++) {
+    me = &_ValuesTab[i];
+    if ( ! me->free) {
+      if (strcmp(me->name, name) == 0) {
+        //entry found for the same value name : reuse it !
+        me->seen = now;
+        if (strcmp(me->value, value) == 0 && strcmp(me->horodate, horodate ? horodate : "") == 0) {
+          *flags |= TINFO_FLAGS_EXIST;
+          me->flags = *flags;
+          return ( me );
+        } else {
+          //Exist, but value changed
+          *flags |= TINFO_FLAGS_UPDATED;
+          me->flags = *flags ;
+          // Copy new value
+          memset(me->value, 0, TINFO_VALUE_SIZE);
+          memcpy(me->value, value , lgvalue );
+          memset(me->horodate, 0, TINFO_HORO_SIZE);
+          if (lghoro)
+            memcpy(me->horodate, horodate, lghoro );
+          me->epoch = horodateEpoch(horodate);
+          me->checksum = checksum ;
+          me->changed = now;
+          if (me->changes < 0xFFFF)
+            me->changes++;
+
+          // That's all
+          return (me);
+        }
+      } //name comparison
+    } else {
+      //This entry is free
+      if (firstfree < 0)
+        firstfree=i; //It's the 1st one detected
+    }
+  } //for
+
+  //No existing entry for this name : Create a new one
+  if (firstfree < 0) {
+    _stats.full++;
+    return ( (ValueList *) NULL ); //Table saturated !
+  }
+
+  // Use the 1st free entry found
+  i = firstfree;
+  if (i > _ValueItem)
+    _ValueItem = i; //Note new entry as last one
+
+  // i points the entry to use : get our buffer Safe
+  me = &_ValuesTab[i];
+  memset(me, 0, sizeof(_ValueList) ); //Also reset the 'free' marker
+  me->checksum = checksum;
+  me->added = me->seen = me->changed = now;
+  if (i < TINFO_TABSIZE-1)
+    me->next = &_ValuesTab[i+1];
+
+  // Copy the string data (name, value & horodate)
+  memcpy(me->name, name  , lgname );
+  memcpy(me->value, value , lgvalue );
+  if (lghoro)
+    memcpy(me->horodate, horodate , lghoro );
+  me->epoch = horodateEpoch(horodate);
+  if ( (*flags & TINFO_FLAGS_UPDATED) == 0) {
+    // so we added this node !
+    *flags |= TINFO_FLAGS_ADDED ;
+    me->flags = *flags;
+  }
+
+  // That's all
+  return (me);
+}
 
 /* ======================================================================
 Function: valueRemoveFlagged
@@ -301,8 +401,8 @@ boolean TInfo::valueRemoveFlagged(uint8_t flags)
 	int i;
 	ValueList * me;
 
-	for(i=0; i < ValueItem, i < 50; i++) {
-		me = &ValuesTab[i];
+	for(i=0; i < _ValueItem, i < TINFO_TABSIZE; i++) {
+		me = &_ValuesTab[i];
 		if(! me->free ) {
 			if (me->flags & flags ) {
 				//memset(me, 0, sizeof(_ValueList) );
@@ -324,17 +424,16 @@ Comments: -
 boolean TInfo::valueRemove(char * name)
 {
   boolean deleted = false;
-  uint8_t lgname = strlen(name);
   int i;
 	ValueList * me;
 
-	for(i=0 ; i < ValueItem, i < 50; i++) {
-	  me = &ValuesTab[i];
+	for(i=0 ; i < _ValueItem, i < TINFO_TABSIZE; i++) {
+	  me = &_ValuesTab[i];
 	  if( ! me->free ) {
 		//This entry is busy
 	  	// found ?
-	  	if (strncmp(me->name, name, lgname) == 0) {
-			memset(me->name, 0, 16 );
+	  	if (strcmp(me->name, name) == 0) {
+			memset(me->name, 0, TINFO_NAME_SIZE );
 			// free up this entry
 			me->free=1;
 
@@ -350,38 +449,214 @@ boolean TInfo::valueRemove(char * name)
 Function: valueGet
 Purpose : get value of one element
 Input   : Pointer to the label name
-          pointer to the value where we fill data 
+          pointer to the value where we fill data (TINFO_VALUE_SIZE chars)
 Output  : pointer to the value where we filled data NULL is not found
+Comments: kept for old sketches, use the one with the buffer size
 ====================================================================== */
 char * TInfo::valueGet(char * name, char * value)
 {
-  // Get our linked list 
-  uint8_t lgname = strlen(name);
-  int i;
+  return valueGet(name, value, TINFO_VALUE_SIZE);
+}
+
+/* ======================================================================
+Function: valueGet
+Purpose : get value of one element
+Input   : Pointer to the label name
+          pointer to the value where we fill data
+          size of value buffer
+Output  : pointer to the value where we filled data NULL is not found
+Comments: value is cut to size - 1 chars if buffer is too small, it is
+          always terminated
+====================================================================== */
+char * TInfo::valueGet(const char * name, char * value, size_t size)
+{
   ValueList * me;
+  size_t lg;
 
   // Got one and all seems good ?
-  if (lgname) {
-    // Loop thru the table
-    for(i = 0; i < ValueItem, i < 50; i++) {
-		me = &ValuesTab[i];
-		if( ! me->free) {
-      		// Check if we match this LABEL
-      		if (strncmp(me->name, name, lgname) == 0) {
-        		// copy to dest buffer
-          		uint8_t lgvalue = strlen(me->value);
-          		strncpy(value, me->value , lgvalue );
-          		return ( value );
-			}
-        }
-     } //for
+  if (!name || !*name || !value || !size)
+    return NULL;
 
-  } //lgname
+  // Loop thru the table
+  for (int i = 0; i < TINFO_TABSIZE; i++) {
+    me = &_ValuesTab[i];
+    // Check if we match this LABEL
+    if (!me->free && strcmp(me->name, name) == 0) {
+      // copy to dest buffer
+      lg = strlen(me->value);
+      if (lg >= size)
+        lg = size - 1;
+      memcpy(value, me->value, lg);
+      value[lg] = '\0';
+      return value;
+    }
+  }
 
   // not found
-  return ( NULL);
+  return NULL;
+}
+
+/* ======================================================================
+Function: isStale
+Purpose : check if a value has not been received for a while
+Input   : pointer to the value in the list
+          max age in ms
+Output  : true if not received since more than age ms
+Comments: -
+====================================================================== */
+boolean TInfo::isStale(ValueList * me, uint32_t age)
+{
+  return me && !me->free && (uint32_t) (_fn_clock() - me->seen) > age;
+}
+
+/* ======================================================================
+Function: changeRate
+Purpose : how often a value changes
+Input   : pointer to the value in the list
+Output  : number of changes per hour since the value was added
+Comments: 0 for values that never change (ADCO, ISOUSC, PREF...), so
+          exporters can send them less often
+====================================================================== */
+uint32_t TInfo::changeRate(ValueList * me)
+{
+  uint32_t elapsed;
+
+  if (!me || me->free)
+    return 0;
+
+  // in seconds, we need at least one
+  elapsed = (uint32_t) (_fn_clock() - me->added) / 1000;
+  if (!elapsed)
+    return 0;
+
+  return (uint32_t) me->changes * 3600UL / elapsed;
+}
+
+/* ======================================================================
+Function: groupStart
+Purpose : time the start of the group being decoded was received
+Input   : -
+Output  : time from the clock (ms)
+Comments: in a data callback, clock - groupStart() is the time since
+          the first char of the value was received. With process(c) or
+          untimed bulk process() it is when the LF was decoded, give the
+          read time to bulk process() to measure the whole reaction
+====================================================================== */
+uint32_t TInfo::groupStart(void)
+{
+  return _group_start;
+}
+
+/* ======================================================================
+Function: getStats
+Purpose : copy the decoder counters
+Input   : counters filled
+Output  : -
+Comments: counters are only incremented when receiving, so a copy is
+          enough to get them all at the same time
+====================================================================== */
+void TInfo::getStats(TInfoStats * stats)
+{
+  memcpy(stats, &_stats, sizeof(TInfoStats));
+}
+
+/* ======================================================================
+Function: clearStats
+Purpose : reset the decoder counters
+Input   : -
+Output  : -
+Comments: init() keeps them, so reinit can be counted
+====================================================================== */
+void TInfo::clearStats(void)
+{
+  memset(&_stats, 0, sizeof(TInfoStats));
+#ifdef TINFO_LATENCY
+  memset(&_latency, 0, sizeof(TInfoLatency));
+#endif
+}
+
+#ifdef TINFO_LATENCY
+/* ======================================================================
+Function: latencyAdd
+Purpose : count the time spent in a stage
+Input   : stage, clock when stage started
+Output  : -
+Comments: counts saturate, clearStats() to start again
+====================================================================== */
+void TInfo::latencyAdd(uint8_t stage, uint32_t since)
+{
+  uint32_t t = _fn_clock() - since;
+  uint8_t bucket = 0;
+
+  while (t && bucket < TINFO_LATENCY_BUCKETS - 1) {
+    t >>= 1;
+    bucket++;
+  }
+
+  if (_latency.stage[stage][bucket] < 0xFFFF)
+    _latency.stage[stage][bucket]++;
+}
+
+/* ======================================================================
+Function: getLatency
+Purpose : copy the stage histograms
+Input   : histograms filled
+Output  : -
+Comments: -
+====================================================================== */
+void TInfo::getLatency(TInfoLatency * latency)
+{
+  memcpy(latency, &_latency, sizeof(TInfoLatency));
+}
+
+/* ======================================================================
+Function: latencyExport
+Purpose : note that the last frame has been sent by an exporter
+Input   : -
+Output  : -
+Comments: call it when the post/print of values is complete, time is
+          counted from the ETX of the last frame
+====================================================================== */
+void TInfo::latencyExport(void)
+{
+  if (_stats.frames)
+    latencyAdd(TINFO_LATENCY_EXPORT, _frame_end);
 }
 
+/* ======================================================================
+Function: latencyJSON
+Purpose : render the stage histograms in JSON
+Input   : buffer and its size (512 is enough)
+Output  : number of chars written, 0 if buffer is too small
+Comments: {"group":[n0,n1...],"frame":[...],...} bucket n counts
+          2^(n-1) to 2^n-1 clock units
+====================================================================== */
+size_t TInfo::latencyJSON(char * buf, size_t size)
+{
+  static const char * names[TINFO_LATENCY_STAGES] = { "group", "frame", "callback", "export" };
+  size_t len = 0;
+  int n;
+
+  for (uint8_t s = 0; s < TINFO_LATENCY_STAGES; s++) {
+    for (uint8_t b = 0; b < TINFO_LATENCY_BUCKETS; b++) {
+      if (b)
+        n = snprintf(buf + len, size - len, ",%u", _latency.stage[s][b]);
+      else
+        n = snprintf(buf + len, size - len, "%s\"%s\":[%u", s ? "," : "{", names[s], _latency.stage[s][b]);
+      if (n < 0 || (size_t) n >= size - len)
+        return 0;
+      len += n;
+    }
+    n = snprintf(buf + len, size - len, s == TINFO_LATENCY_STAGES - 1 ? "]}" : "]");
+    if (n < 0 || (size_t) n >= size - len)
+      return 0;
+    len += n;
+  }
+
+  return len;
+}
+#endif
+
 /* ======================================================================
 Function: getTopList
 Purpose : return a pointer on the top of the linked list
@@ -390,7 +665,7 @@ Output  : Pointer
 ====================================================================== */
 ValueList * TInfo::getList(void)
 {
-	ValueList * me = &ValuesTab[0];
+	ValueList * me = &_ValuesTab[0];
   // Get our linked list 
   return me;
 }
@@ -404,14 +679,14 @@ Output  : total number of values
 uint8_t TInfo::valuesDump(void)
 {
   // Get our linked list 
-  ValueList * me = &ValuesTab[0];
+  ValueList * me = &_ValuesTab[0];
   uint8_t index = 0;
 
   // Got one ?
   if (me) {
     // Loop thru the node
-	for(int i=0; i<50; i++) {
-      me = &ValuesTab[i];
+	for(int i=0; i<TINFO_TABSIZE; i++) {
+      me = &_ValuesTab[i];
       if( ! me->free ) {
 		  index++;
 		  TI_Debug(i) ;
@@ -462,8 +737,8 @@ int TInfo::labelCount()
 {
   int count = 0;
 	ValueList * me;
-  for(int i=0 ; i < 50 ; i++) {
-	me = &ValuesTab[i];
+  for(int i=0 ; i < TINFO_TABSIZE ; i++) {
+	me = &_ValuesTab[i];
 	if( ! me->free)
 		count++;
   }
@@ -481,14 +756,15 @@ boolean TInfo::listDelete()
 
 	ValueList * me;
 
-	for(int i = 0; i < 50; i++) {
-		me = &ValuesTab[i];
-		memset(&ValuesTab[i], 0, sizeof(_ValueList) );	//Also reset the 'free' marker
+	for(int i = 0; i < TINFO_TABSIZE; i++) {
+		me = &_ValuesTab[i];
+		memset(&_ValuesTab[i], 0, sizeof(_ValueList) );	//Also reset the 'free' marker
 		me->free=1;		//Init each entry as free
 		me->flags = TINFO_FLAGS_NONE;
-		if(i < 49)
-			me->next = &ValuesTab[i+1];
+		if(i < TINFO_TABSIZE-1)
+			me->next = &_ValuesTab[i+1];
 	}
+	_valueslist.next = &_ValuesTab[0];
 
 	return(true);
 }
@@ -533,21 +809,13 @@ Comments:
 ====================================================================== */
 void TInfo::customLabel( char * plabel, char * pvalue, uint8_t * pflags) 
 {
-  int8_t phase = -1;
-
-  // Monophasé
-  if (strcmp(plabel, "ADPS")==0 ) 
-    phase=0;
+  int8_t phase;
 
-  // For testing
-  //if (strcmp(plabel, "IINST")==0 ) {
-  //  *pflags |= TINFO_FLAGS_ALERT;
-  //}
-
-  // triphasé c'est ADIR + Num Phase
-  if (plabel[0]=='A' && plabel[1]=='D' && plabel[2]=='I' && plabel[3]=='R' && plabel[4]>='1' && plabel[4]<='3') {
-    phase = plabel[4]-'0';
-  }
+  // Monophasé ADPS, triphasé c'est ADIR + Num Phase
+  if (_mode_current == TINFO_MODE_STANDARD)
+    phase = TInfoDecoder<TInfoStandard>::alertPhase(plabel);
+  else
+    phase = TInfoDecoder<TInfoHistoric>::alertPhase(plabel);
 
   // Nous avons un ADPS ?
   if (phase>=0 && phase <=3) {
@@ -560,23 +828,99 @@ void TInfo::customLabel( char * plabel, char * pvalue, uint8_t * pflags)
   }
 }
 
+/* ======================================================================
+Function: groupMode
+Purpose : find the mode of a group by its separator and checksum
+Input   : group chars between start and end of group (excluded)
+          number of chars
+Output  : TINFO_MODE_HISTORIC or TINFO_MODE_STANDARD if checksum is good
+          with this mode rule, TINFO_MODE_AUTO if bad group
+Comments: historic checksum is computed from label to value, Standard one
+          from label to last separator included (ENEDIS-NOI-CPT_54E)
+====================================================================== */
+_Mode_e TInfo::groupMode(const char * group, uint8_t len)
+{
+  if (!group)
+    return TINFO_MODE_AUTO;
+
+  if (TInfoDecoder<TInfoStandard>::check(group, len))
+    return TINFO_MODE_STANDARD;
+
+  if (TInfoDecoder<TInfoHistoric>::check(group, len))
+    return TINFO_MODE_HISTORIC;
+
+  return TINFO_MODE_AUTO;
+}
+
+/* ======================================================================
+Function: horodateEpoch
+Purpose : convert a Standard mode horodate to UTC epoch seconds
+Input   : horodate SAAMMJJhhmmss, S is season E (summer time, UTC+2)
+          or H (winter time, UTC+1), lower case if meter clock is not
+          synchronized, space if meter does not manage seasons
+Output  : seconds since 1970-01-01 UTC, 0 if bad horodate
+Comments: integer only, no timegm() on Arduino, years 2000 to 2099.
+          examples/TICWIFI/LibTeleinfoStd.cpp HorodateEpoch() is a copy,
+          that sketch has its own TInfo class and can't link this one,
+          fix both
+====================================================================== */
+uint32_t TInfo::horodateEpoch(const char * horodate)
+{
+  uint8_t f[6]; // year, month, day, hour, minute, second
+  int32_t y, m, days;
+  uint32_t offset;
+  uint8_t i;
+
+  if (!horodate)
+    return 0;
+
+  switch (horodate[0]) {
+    case 'E': case 'e':
+      offset = 7200;
+    break;
+    case 'H': case 'h': case ' ':
+      offset = 3600;
+    break;
+    default:
+      return 0;
+  }
+
+  for (i = 0; i < 6; i++) {
+    char d = horodate[1+2*i];
+    char u = horodate[2+2*i];
+    if (d < '0' || d > '9' || u < '0' || u > '9')
+      return 0;
+    f[i] = (d - '0') * 10 + (u - '0');
+  }
+
+  if (f[1] < 1 || f[1] > 12 || f[2] < 1 || f[2] > 31 || f[3] > 23 || f[4] > 59 || f[5] > 59)
+    return 0;
+
+  // days from 1970-01-01, year starting in march so leap day is the last
+  y = 2000 + f[0];
+  m = f[1];
+  if (m <= 2)
+    y--;
+  m = m > 2 ? m - 3 : m + 9;
+  days = 365L * y + y / 4 - y / 100 + y / 400 + (153 * m + 2) / 5 + f[2] - 1 - 719468L;
+
+  return (uint32_t) days * 86400UL + f[3] * 3600UL + f[4] * 60UL + f[5] - offset;
+}
+
 /* ======================================================================
 Function: checkLine
 Purpose : check one line of teleinfo received
 Input   : -
 Output  : pointer to the data object in the linked list if OK else NULL
-Comments: 
+Comments: line is LABEL SP VALUE SP CHECKSUM in historic mode and
+          LABEL TAB [HORODATE TAB] VALUE TAB CHECKSUM in Standard mode
 ====================================================================== */
 ValueList * TInfo::checkLine(char * pline) 
 {
-  char * p;
-  char * ptok;
-  char * pend;
-  char * pvalue;
-  char   checksum;
-  char  buff[TINFO_BUFSIZE];
+  _TInfoGroup group;
+  boolean ok;
   uint8_t flags  = TINFO_FLAGS_NONE;
-  boolean err = true ;  // Assume  error
+  _Mode_e mode;
   int len ; // Group len
 
   if (pline==NULL)
@@ -584,80 +928,81 @@ ValueList * TInfo::checkLine(char * pline)
 
   len = strlen(pline); 
 
-  // a line should be at least 7 Char
-  // 2 Label + Space + 1 etiquette + space + checksum + \r
-  if ( len < 7 )
+  // we don't need end of group
+  if (len && pline[len-1] == TINFO_EGR)
+    len--;
+
+  // Group checksum is good in historic or Standard ? processBatch()
+  // may have done it for all groups of its buffer
+  if (_batch_checked && len == _batch_len)
+    mode = _batch_mode;
+  else
+    mode = groupMode(pline, len);
+
+  // Bad group or not in the mode we're decoding
+  if (mode == TINFO_MODE_AUTO || (_mode_current != TINFO_MODE_AUTO && mode != _mode_current)) {
+    // Too many of them, detected mode may be wrong, detect it again
+    // values we have may come from another meter, forget them
+    if (_mode == TINFO_MODE_AUTO && _mode_current != TINFO_MODE_AUTO) {
+      if (++_mode_bad >= TINFO_MODE_UNLOCK) {
+        TI_Debugln(F("TINFO_MODE_AUTO"));
+        setMode(TINFO_MODE_AUTO);
+        listDelete();
+      }
+    }
+    _stats.checksum++;
     return NULL;
+  }
+  _mode_bad = 0;
+
+  // Still detecting, group is good with the rule of its separator so
+  // it can be stored, but mode is locked only after a few good ones
+  if (_mode_current == TINFO_MODE_AUTO) {
+    if (mode != _mode_detect) {
+      _mode_detect = mode;
+      _mode_good = 0;
+    }
+    if (++_mode_good >= TINFO_MODE_LOCK) {
+      TI_Debugln(mode == TINFO_MODE_STANDARD ? F("TINFO_MODE_STANDARD") : F("TINFO_MODE_HISTORIC"));
+      _mode_current = mode;
+    }
+  }
 
-  // Get our own working copy
-  strncpy( buff, _recv_buff, len+1);
+  // Split group in the buffer, we don't need it after
+  if (mode == TINFO_MODE_STANDARD)
+    ok = TInfoDecoder<TInfoStandard>::split(pline, len, &group);
+  else
+    ok = TInfoDecoder<TInfoHistoric>::split(pline, len, &group);
 
-  p = &buff[0];
-  ptok = p;       // for sure we start with token name
-  pend = p + len; // max size
+  if (!ok) {
+    _stats.unknown++;
+    return NULL;
+  }
 
-  // Init values
-  pvalue = NULL;
-  checksum = 0;
+  // In case we need to do things on specific labels
+  customLabel(group.name, group.value, &flags);
 
-  //TI_Debug("Got [");
-  //TI_Debug(len);
-  //TI_Debug("] ");
+  // Add value to linked lists of values
+  ValueList * me = valueAdd(group.name, group.value, group.horodate, group.checksum, &flags);
 
-  
-  // Loop in buffer 
-  while ( p < pend ) {
-    // start of token value
-    if ( *p==' ' && ptok) {           
-      // Isolate token name
-      *p++ = '\0';
-
-      // 1st space, it's the label value
-      if (!pvalue)
-        pvalue = p;
-      else
-        // 2nd space, so it's the checksum
-        checksum = *p;
-    }           
-    // new line ? ok we got all we need ?
-    
-    if ( *p=='\r' ) {           
-      *p='\0';
-
-      // Good format ?
-      if ( ptok && pvalue && checksum ) {
-        // Always check to avoid bad behavior 
-        if(strlen(ptok) && strlen(pvalue)) {
-          // Is checksum is OK
-          if ( calcChecksum(ptok,pvalue) == checksum) {
-            // In case we need to do things on specific labels
-            customLabel(ptok, pvalue, &flags);
-
-            // Add value to linked lists of values
-            ValueList * me = valueAdd(ptok, pvalue, checksum, &flags);
-
-            // value correctly added/changed
-            if ( me ) {
-              // something to do with new datas
-              if (flags & (TINFO_FLAGS_UPDATED | TINFO_FLAGS_ADDED | TINFO_FLAGS_ALERT) ) {
-                // this frame will for sure be updated
-                _frame_updated = true;
-
-                // Do we need to advertise user callback
-                if (_fn_data)
-                  _fn_data(me, flags);
-              }
-            }
-          }
-        }
-      }
-    }           
-    // Next char
-    p++;
+  // value correctly added/changed
+  if ( me ) {
+    _stats.groups++;
+    if (_resynced)
+      _stats.recovered++;
 
-  } // While
+    // something to do with new datas
+    if (flags & (TINFO_FLAGS_UPDATED | TINFO_FLAGS_ADDED | TINFO_FLAGS_ALERT) ) {
+      // this frame will for sure be updated
+      _frame_updated = true;
 
-  return NULL;
+      // Do we need to advertise user callback
+      if (_fn_data)
+        _fn_data(me, flags);
+    }
+  }
+
+  return me;
 }
 
 /* ======================================================================
@@ -671,6 +1016,7 @@ _State_e TInfo::process(char c)
 {
    // be sure 7 bits only
    c &= 0x7F;
+   _stats.bytes++;
 
   // What we received ?
   switch (c)  {
@@ -683,6 +1029,16 @@ _State_e TInfo::process(char c)
       // if data change we'll set this flag
       _frame_updated = false;
 
+      // previous frame never ended
+      if (_frame_open)
+        _stats.aborted++;
+      _frame_open = true;
+      _group_bad = false;
+      _resynced = false;
+#ifdef TINFO_LATENCY
+      _frame_start = _fn_clock();
+#endif
+
       // We were waiting fo this one ?
       if (_state == TINFO_INIT || _state == TINFO_WAIT_STX ) {
           TI_Debugln(F("TINFO_WAIT_ETX"));
@@ -697,6 +1053,15 @@ _State_e TInfo::process(char c)
       if (_state == TINFO_READY) {
         // Get on top of our linked list 
         ValueList * me = &_valueslist;
+
+        if (_frame_open)
+          _stats.frames++;
+
+#ifdef TINFO_LATENCY
+        _frame_end = _fn_clock();
+        if (_frame_open)
+          latencyAdd(TINFO_LATENCY_FRAME, _frame_start);
+#endif
         
         // Call user callback if any
         if (_frame_updated && _fn_updated_frame)
@@ -704,6 +1069,10 @@ _State_e TInfo::process(char c)
         else if (_fn_new_frame)
           _fn_new_frame(me);
 
+#ifdef TINFO_LATENCY
+        latencyAdd(TINFO_LATENCY_CALLBACK, _frame_end);
+#endif
+
         #ifdef TI_Debug
           valuesDump();
         #endif
@@ -723,28 +1092,50 @@ _State_e TInfo::process(char c)
         TI_Debugln(F("TINFO_WAIT_STX"));
         _state = TINFO_WAIT_STX ;
       } 
+      _frame_open = false;
+      _resynced = false;
 
     break;
 
     // Start of group \n ?
     case  TINFO_SGR:
-      // Do nothing we'll work at end of group
-      // we can safely ignore this char
+      // We'll work at end of group, just keep when it started
+      // so reaction time to a group can be measured. In a bulk read
+      // it is when the read returned, not when the LF is decoded
+      _group_start = _rx_timed ? _rx_time : _fn_clock();
+
+      // Previous group never ended or was too long, drop it and go on
+      // with this one, the rest of the frame is still good
+      if (_state == TINFO_READY && (_recv_idx || _group_bad)) {
+        _stats.resync++;
+        _resynced = true;
+        clearBuffer();
+      }
+      _group_bad = false;
     break;
 
     // End of group \r ?
     case  TINFO_EGR:
       // Are we ready to process ?
       if (_state == TINFO_READY) {
-        // Store data recceived (we'll need it)
-        if ( _recv_idx < TINFO_BUFSIZE)
+        // Store data recceived (we'll need it), a too long
+        // group can't be good, buffer must end with a '\0'
+        if (_group_bad) {
+          // already counted, wait for next group
+        } else if ( _recv_idx < TINFO_BUFSIZE - 1) {
           _recv_buff[_recv_idx++]=c;
 
-        // clear the end of buffer (paranoia inside)
-        memset(&_recv_buff[_recv_idx], 0, TINFO_BUFSIZE-_recv_idx);
+          // clear the end of buffer (paranoia inside)
+          memset(&_recv_buff[_recv_idx], 0, TINFO_BUFSIZE-_recv_idx);
 
-        // check the group we've just received
-        checkLine(_recv_buff) ;
+          // check the group we've just received
+          checkLine(_recv_buff) ;
+#ifdef TINFO_LATENCY
+          latencyAdd(TINFO_LATENCY_GROUP, _group_start);
+#endif
+        } else {
+          groupOverflow();
+        }
 
         // Whatever error or not, we done
         clearBuffer();
@@ -757,14 +1148,197 @@ _State_e TInfo::process(char c)
       // Only in a ready state of course
       if (_state == TINFO_READY) {
         // If buffer is not full, Store data 
-        if ( _recv_idx < TINFO_BUFSIZE)
+        if (_group_bad)
+          ;
+        else if ( _recv_idx < TINFO_BUFSIZE)
           _recv_buff[_recv_idx++]=c;
         else
-          clearBuffer();
+          groupOverflow();
       }
     }
     break;
   }
+
+  return _state;
+}
+
+/* ======================================================================
+Function: appendData
+Purpose : store a run of group chars (no control char) in the buffer
+Input   : pointer on chars, number of chars
+Output  : -
+Comments: same result as calling process() for each char, but buffer
+          is filled by blocks instead of one switch per char
+====================================================================== */
+void TInfo::appendData(const char * buf, size_t len)
+{
+  _stats.bytes += len;
+
+  // Only in a ready state of course, and not in a too long group
+  if (_state != TINFO_READY || _group_bad)
+    return;
+
+  while (len) {
+    if ( _recv_idx < TINFO_BUFSIZE) {
+      size_t n = TINFO_BUFSIZE - _recv_idx;
+      if (n > len)
+        n = len;
+      len -= n;
+      // be sure 7 bits only
+      while (n--)
+        _recv_buff[_recv_idx++] = *buf++ & 0x7F;
+    } else {
+      // buffer full, rest of group is lost as in process()
+      groupOverflow();
+      return;
+    }
+  }
+}
+
+/* ======================================================================
+Function: groupOverflow
+Purpose : drop a group too long for the buffer
+Input   : -
+Output  : -
+Comments: next chars are ignored until next LF, the frame goes on
+====================================================================== */
+void TInfo::groupOverflow(void)
+{
+  _stats.overflow++;
+  clearBuffer();
+  _group_bad = true;
+}
+
+/* ======================================================================
+Function: process
+Purpose : teleinfo bulk processing of a received block of chars
+Input   : pointer on chars received, number of chars
+Output  : teleinfo global state
+Comments: used for bulk reading (capture file, serial read of several
+          bytes), data is not copied, only group chars are stored
+          control chars are found by SIMD kernels when available
+====================================================================== */
+_State_e TInfo::process(const char * buf, size_t len)
+{
+  const char * end = buf + len;
+  const char * p;
+
+  while (buf < end) {
+    // Find next control char, everything before belongs to a group
+    p = buf + tinfoScanControl(buf, end - buf, 0);
+
+    if (p > buf)
+      appendData(buf, p - buf);
+
+    // and let the state machine do the job for the control char
+    if (p < end)
+      process(*p++);
+
+    buf = p;
+  }
+
+  return _state;
+}
+
+/* ======================================================================
+Function: process
+Purpose : teleinfo bulk processing of chars read at a known time
+Input   : pointer on chars received, number of chars, clock when they
+          were read (serial read or drain)
+Output  : teleinfo global state
+Comments: groups starting in these chars get this time as groupStart(),
+          so clock - groupStart() in a data callback is the time from
+          the read to the decision, not only the decoding time
+====================================================================== */
+_State_e TInfo::process(const char * buf, size_t len, uint32_t received)
+{
+  _rx_time = received;
+  _rx_timed = true;
+  process(buf, len);
+  _rx_timed = false;
+
+  return _state;
+}
+
+/* ======================================================================
+Function: processBatch
+Purpose : teleinfo bulk processing of a whole buffer of frames
+Input   : pointer on chars received, number of chars
+Output  : teleinfo global state
+Comments: same result as process(), for offline decoding (capture file,
+          ticbatch). Control chars are found TINFO_BATCH_MARKS at a time,
+          then checksums of all groups between them are computed in one
+          pass of the buffer for both rules, instead of one loop per
+          group. A group started in a previous call is checked as usual
+====================================================================== */
+_State_e TInfo::processBatch(const char * buf, size_t len)
+{
+  _TInfoMark marks[TINFO_BATCH_MARKS];
+  _TInfoGroupSpan spans[TINFO_BATCH_MARKS];
+  char hist[TINFO_BATCH_MARKS];
+  char std[TINFO_BATCH_MARKS];
+  uint8_t span_of[TINFO_BATCH_MARKS]; // span of an EGR mark + 1, 0 if none
+  const char * end = buf + len;
+  const char * p;
+  const char * q;
+  size_t scanned;
+  uint16_t n, groups, i;
+
+  while (buf < end) {
+    n = tinfoScanMarks(buf, end - buf, 0, marks, TINFO_BATCH_MARKS, &scanned);
+
+    // Groups fully in this part, LF then CR with at least 4 chars between
+    groups = 0;
+    for (i = 0; i < n; i++) {
+      uint32_t lg = i ? marks[i].offset - marks[i-1].offset - 1 : 0;
+
+      span_of[i] = 0;
+      if ( i && marks[i].kind == TINFO_EGR && marks[i-1].kind == TINFO_SGR &&
+           lg >= 4 && lg < TINFO_BUFSIZE ) {
+        spans[groups].offset = marks[i-1].offset + 1;
+        spans[groups].len = lg - 1;
+        span_of[i] = ++groups;
+      }
+    }
+
+    tinfoChecksumBatch(buf, scanned, spans, groups, TINFO_CHECKSUM_HISTORIC, hist);
+    tinfoChecksumBatch(buf, scanned, spans, groups, TINFO_CHECKSUM_STANDARD, std);
+
+    // Let the state machine do the job, with the checksums already known
+    p = buf;
+    for (i = 0; i < n; i++) {
+      q = buf + marks[i].offset;
+      if (q > p)
+        appendData(p, q - p);
+
+      if (span_of[i]) {
+        uint8_t g = span_of[i] - 1;
+        char sep = q[-2] & 0x7F;
+        char sum = q[-1] & 0x7F;
+
+        // same order as groupMode()
+        if (sep == TINFO_SEP_STANDARD && std[g] == sum)
+          _batch_mode = TINFO_MODE_STANDARD;
+        else if (sep == TINFO_SEP_HISTORIC && hist[g] == sum)
+          _batch_mode = TINFO_MODE_HISTORIC;
+        else
+          _batch_mode = TINFO_MODE_AUTO;
+        _batch_len = spans[g].len + 1;
+        _batch_checked = true;
+      }
+
+      process(*q);
+      _batch_checked = false;
+      p = q + 1;
+    }
+
+    if (buf + scanned > p)
+      appendData(p, buf + scanned - p);
+
+    buf += scanned;
+  }
+
+  return _state;
 }
 
 
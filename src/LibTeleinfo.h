@@ -33,7 +33,7 @@
 #ifndef LibTeleinfo_h
 #define LibTeleinfo_h
 
-#ifdef __arm__
+#if defined(__arm__) || defined(RASPBERRY_PI)
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -54,6 +54,9 @@
 // Define this if you want library to be verbose
 //#define TI_DEBUG
 
+// Define this to measure time spent in each stage, from STX to export
+//#define TINFO_LATENCY
+
 // I prefix debug macro to be sure to use specific for THIS library
 // debugging, this should not interfere with main sketch or other 
 // libraries
@@ -87,14 +90,36 @@
 
 
 
+// Size of label, value and horodate (with ending '\0'). Values are 16
+// chars as historic ones, Standard mode values can be long (PJOUR+1 is
+// 98 chars) and need TINFO_VALUE_SIZE 100 in build flags, longer values
+// are not stored. Each of the TINFO_TABSIZE values takes 56 bytes plus
+// TINFO_VALUE_SIZE on a 32 bits MCU, a TInfo holds 3.6 KB of values with
+// 16 and 7.8 KB with 100. Linux builds have the RAM and take 100
+#define TINFO_NAME_SIZE   16
+#ifndef TINFO_VALUE_SIZE
+#ifdef RASPBERRY_PI
+#define TINFO_VALUE_SIZE  100
+#else
+#define TINFO_VALUE_SIZE  16
+#endif
+#endif
+#define TINFO_HORO_SIZE   14 // (H/E)AAMMDDHHMMSS
+
 // Linked list structure containing all values received
 // Will be allocated statically 
 typedef struct _ValueList ValueList;
 struct _ValueList 
 {
   ValueList *next;  // next element (for compatibility)
-  char name[16];    // LABEL of value name
-  char value[16];   // value 
+  char name[TINFO_NAME_SIZE];    // LABEL of value name
+  char value[TINFO_VALUE_SIZE];  // value 
+  char horodate[TINFO_HORO_SIZE];// horodate (Standard mode only)
+  uint32_t epoch;   // horodate in UTC epoch seconds, 0 if none
+  uint32_t added;   // clock when label was added (ms)
+  uint32_t seen;    // clock when label was last received (ms)
+  uint32_t changed; // clock when value last changed (ms)
+  uint16_t changes; // number of value changes since added
   uint8_t checksum; // checksum
   uint8_t flags;    // specific flags
   uint8_t free;		// checksum
@@ -110,6 +135,18 @@ enum _State_e {
   TINFO_READY     // We had STX AND ETX, So we're OK
 };
 
+// Teleinfo mode, set by user or detected from groups received
+enum _Mode_e {
+  TINFO_MODE_AUTO,      // Detect mode from groups received
+  TINFO_MODE_HISTORIC,  // 1200 bps, space separator
+  TINFO_MODE_STANDARD   // 9600 bps, TAB separator, horodate
+};
+
+// Auto detection : consecutive good groups needed to lock a mode
+// and consecutive bad groups to go back detecting
+#define TINFO_MODE_LOCK   2
+#define TINFO_MODE_UNLOCK 8
+
 // what we done with received value (also for callback flags)
 #define TINFO_FLAGS_NONE     0x00
 #define TINFO_FLAGS_NOTHING  0x01
@@ -118,36 +155,102 @@ enum _State_e {
 #define TINFO_FLAGS_UPDATED  0x08
 #define TINFO_FLAGS_ALERT    0x80 /* This will generate an alert */
 
+// Number of values stored in each TInfo object table
+// allocated with the object, so several objects can decode in parallel
+#define TINFO_TABSIZE  50
+
 // Local buffer for one line of teleinfo 
-// maximum size, I think it should be enought
-#define TINFO_BUFSIZE  64
+// maximum size, enought for Standard mode groups
+#define TINFO_BUFSIZE  128
+
+// Control chars found per pass of processBatch()
+#ifndef TINFO_BATCH_MARKS
+#define TINFO_BATCH_MARKS  64
+#endif
 
 // Teleinfo start and end of frame characters
 #define TINFO_STX 0x02
 #define TINFO_ETX 0x03 
 #define TINFO_SGR '\n' // start of group  
 #define TINFO_EGR '\r' // End of group    
+#define TINFO_SEP_HISTORIC ' '  // Historic mode separator
+#define TINFO_SEP_STANDARD 0x09 // Standard mode separator
+
+// Decoder counters, since TInfo was created
+typedef struct
+{
+  uint32_t bytes;     // chars received
+  uint32_t frames;    // frames complete
+  uint32_t aborted;   // frames started again before their end
+  uint32_t groups;    // good groups
+  uint32_t checksum;  // groups with bad checksum or separator
+  uint32_t overflow;  // groups too long for the buffer
+  uint32_t full;      // values lost, table full
+  uint32_t unknown;   // good checksum but bad label or fields
+  uint32_t resync;    // damaged groups dropped at next LF, frame kept
+  uint32_t recovered; // good groups after a resync in the same frame
+} TInfoStats;
+
+#ifdef TINFO_LATENCY
+// Stages measured, times are clock units (ms with default clock)
+enum _Latency_e {
+  TINFO_LATENCY_GROUP,    // SGR to group decoded (EGR)
+  TINFO_LATENCY_FRAME,    // STX to ETX
+  TINFO_LATENCY_CALLBACK, // ETX to frame callback returned
+  TINFO_LATENCY_EXPORT,   // ETX to exporter sent, see latencyExport()
+  TINFO_LATENCY_STAGES
+};
+
+// Histogram bucket n counts 2^(n-1) to 2^n-1, last one is all above
+#define TINFO_LATENCY_BUCKETS 16
+
+typedef struct
+{
+  uint16_t stage[TINFO_LATENCY_STAGES][TINFO_LATENCY_BUCKETS];
+} TInfoLatency;
+#endif
 
 class TInfo
 {
   public:
     TInfo();
     void          init();
+    void          setMode(_Mode_e mode);
+    _Mode_e       getMode(void);
     _State_e      process (char c);
+    _State_e      process (const char * buf, size_t len);
+    _State_e      process (const char * buf, size_t len, uint32_t received);
+    _State_e      processBatch (const char * buf, size_t len);
     void          attachADPS(void (*_fn_ADPS)(uint8_t phase));  
     void          attachData(void (*_fn_data)(ValueList * valueslist, uint8_t state));  
     void          attachNewFrame(void (*_fn_new_frame)(ValueList * valueslist));  
     void          attachUpdatedFrame(void (*_fn_updated_frame)(ValueList * valueslist));  
+    void          attachClock(uint32_t (*_fn_clock)(void));
     ValueList *   addCustomValue(char * name, char * value, uint8_t * flags);
     ValueList *   getList(void);
     uint8_t       valuesDump(void);
     char *        valueGet(char * name, char * value);
+    char *        valueGet(const char * name, char * value, size_t size);
     boolean       listDelete();
     unsigned char calcChecksum(char *etiquette, char *valeur) ;
+    boolean       isStale(ValueList * me, uint32_t age);
+    uint32_t      changeRate(ValueList * me);
+    uint32_t      groupStart(void);
+    void          getStats(TInfoStats * stats);
+    void          clearStats(void);
+#ifdef TINFO_LATENCY
+    void          getLatency(TInfoLatency * latency);
+    void          latencyExport(void);
+    size_t        latencyJSON(char * buf, size_t size);
+#endif
+    static _Mode_e groupMode(const char * group, uint8_t len);
+    static uint32_t horodateEpoch(const char * horodate);
 
   private:
     uint8_t       clearBuffer();
-    ValueList *   valueAdd (char * name, char * value, uint8_t checksum, uint8_t * flags);
+    void          appendData(const char * buf, size_t len);
+    void          groupOverflow(void);
+    ValueList *   valueAdd (char * name, char * value, char * horodate, uint8_t checksum, uint8_t * flags);
     boolean       valueRemove (char * name);
     boolean       valueRemoveFlagged(uint8_t flags);
     int           labelCount();
@@ -155,14 +258,38 @@ class TInfo
     ValueList *   checkLine(char * pline) ;
 
     _State_e  _state; // Teleinfo machine state
+    _Mode_e   _mode;  // Mode asked by user
+    _Mode_e   _mode_current; // Mode used to decode (detected if auto)
+    _Mode_e   _mode_detect;  // Mode of last good groups while detecting
+    uint8_t   _mode_good; // consecutive good groups in detected mode
+    uint8_t   _mode_bad;  // consecutive bad groups in current mode
     ValueList _valueslist;   // Linked list of teleinfo values
+    ValueList _ValuesTab[TINFO_TABSIZE]; // Static table of values, no malloc/free
+    int       _ValueItem;    // Index of last position used in table
     char      _recv_buff[TINFO_BUFSIZE]; // line receive buffer
     uint8_t   _recv_idx;  // index in receive buffer
     boolean   _frame_updated; // Data on the frame has been updated
+    uint32_t  _group_start;   // Time start of current group was received
+    uint32_t  _rx_time;       // Time chars given to bulk process() were read
+    boolean   _rx_timed;      // _rx_time is set, chars don't get the clock
+    boolean   _batch_checked; // group checksum already computed by processBatch()
+    _Mode_e   _batch_mode;    // mode of group from its batch checksum
+    uint8_t   _batch_len;     // length of group the batch checksum is for
+    boolean   _frame_open;    // STX received, waiting for ETX
+    boolean   _group_bad;     // group overflowed, ignored until next LF
+    boolean   _resynced;      // a group was dropped in this frame
+    TInfoStats _stats;        // Decoder counters
+#ifdef TINFO_LATENCY
+    void      latencyAdd(uint8_t stage, uint32_t since);
+    uint32_t  _frame_start;   // Time STX was received
+    uint32_t  _frame_end;     // Time ETX was received
+    TInfoLatency _latency;
+#endif
     void      (*_fn_ADPS)(uint8_t phase);
     void      (*_fn_data)(ValueList * valueslist, uint8_t state);
     void      (*_fn_new_frame)(ValueList * valueslist);
     void      (*_fn_updated_frame)(ValueList * valueslist);
+    uint32_t  (*_fn_clock)(void);
 
     //volatile uint8_t *dcport;
     //uint8_t dcpinmask;
@@ -0,0 +1,184 @@
+// **********************************************************************************
+// Teleinfo values aggregation
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#include "LibTeleinfoAggregate.h"
+
+// Aggregated by default, power, current and voltage of both modes
+static const char * const tinfo_aggregate_labels[] = {
+  "PAPP", "IINST", "SINSTS", "URMS1", "IRMS1"
+};
+
+/* ======================================================================
+Class   : TInfoAggregate
+Purpose : Constructor
+Input   : -
+Output  : -
+Comments: no label aggregated
+====================================================================== */
+TInfoAggregate::TInfoAggregate()
+{
+  memset(_labels, 0, sizeof(_labels));
+  _count = 0;
+}
+
+/* ======================================================================
+Function: init
+Purpose : aggregate default labels and start a new window
+Input   : -
+Output  : -
+Comments: other labels can be added with track()
+====================================================================== */
+void TInfoAggregate::init(void)
+{
+  for (uint8_t i = 0; i < sizeof(tinfo_aggregate_labels) / sizeof(tinfo_aggregate_labels[0]); i++)
+    track(tinfo_aggregate_labels[i]);
+
+  restart();
+}
+
+/* ======================================================================
+Function: find
+Purpose : find an aggregated label
+Input   : label name
+Output  : slot or -1 if label is not aggregated
+Comments: -
+====================================================================== */
+int8_t TInfoAggregate::find(const char * name)
+{
+  for (uint8_t i = 0; i < _count; i++) {
+    if (strcmp(_labels[i].name, name) == 0)
+      return i;
+  }
+  return -1;
+}
+
+/* ======================================================================
+Function: track
+Purpose : aggregate a label
+Input   : label name
+Output  : slot or -1 if all slots are used (TINFO_AGGREGATE_LABELS)
+Comments: label values must be numeric, others are ignored
+====================================================================== */
+int8_t TInfoAggregate::track(const char * name)
+{
+  int8_t slot = find(name);
+
+  if (slot >= 0)
+    return slot;
+
+  if (_count == TINFO_AGGREGATE_LABELS || strlen(name) >= TINFO_NAME_SIZE)
+    return -1;
+
+  slot = _count++;
+  memset(&_labels[slot], 0, sizeof(_TInfoAggregate));
+  strcpy(_labels[slot].name, name);
+  return slot;
+}
+
+/* ======================================================================
+Function: restart
+Purpose : start a new window
+Input   : -
+Output  : -
+Comments: call it once the window has been sent
+====================================================================== */
+void TInfoAggregate::restart(void)
+{
+  for (uint8_t i = 0; i < _count; i++) {
+    _labels[i].sum = 0;
+    _labels[i].count = 0;
+  }
+}
+
+/* ======================================================================
+Function: frame
+Purpose : add values of aggregated labels from a frame
+Input   : list head pointer on the values table (as given to frame
+          callbacks)
+Output  : -
+Comments: should be called from new and updated frame callbacks
+====================================================================== */
+void TInfoAggregate::frame(ValueList * me)
+{
+  _TInfoAggregate * a;
+  int8_t slot;
+  char * end;
+  long v;
+
+  while (me && me->next) {
+    me = me->next;
+
+    if (me->free || !*me->value)
+      continue;
+
+    slot = find(me->name);
+    if (slot < 0)
+      continue;
+
+    v = strtol(me->value, &end, 10);
+    if (*end != '\0')
+      continue;
+
+    a = &_labels[slot];
+    if (!a->count || v < a->min)
+      a->min = v;
+    if (!a->count || v > a->max)
+      a->max = v;
+    a->last = v;
+    a->sum += v;
+
+    // Window too long, keep the mean of what we have
+    if (a->count == 0xFFFF) {
+      a->sum -= a->sum / a->count;
+      a->count--;
+    }
+    a->count++;
+  }
+}
+
+/* ======================================================================
+Function: count
+Purpose : number of aggregated labels
+Input   : -
+Output  : labels, slots go from 0 to count-1
+Comments: -
+====================================================================== */
+uint8_t TInfoAggregate::count(void)
+{
+  return _count;
+}
+
+/* ======================================================================
+Function: get
+Purpose : aggregate of a label over current window
+Input   : slot
+Output  : aggregate, NULL if slot is not used
+Comments: count is 0 if the label has not been received in the window
+====================================================================== */
+_TInfoAggregate * TInfoAggregate::get(uint8_t slot)
+{
+  return slot < _count ? &_labels[slot] : NULL;
+}
+
+/* ======================================================================
+Function: mean
+Purpose : mean value of an aggregate
+Input   : aggregate
+Output  : mean, 0 if no value
+Comments: -
+====================================================================== */
+int32_t TInfoAggregate::mean(const _TInfoAggregate * a)
+{
+  return a->count ? (int32_t) (a->sum / a->count) : 0;
+}
@@ -0,0 +1,61 @@
+// **********************************************************************************
+// Teleinfo values aggregation include file
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// Running min, max, mean and last value of numeric labels over a window.
+// Every frame updates the window, the exporter reads it when it pushes and
+// restarts it, so peaks between two pushes are not lost. Use one object
+// per push period
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#ifndef LibTeleinfoAggregate_h
+#define LibTeleinfoAggregate_h
+
+#include "LibTeleinfo.h"
+
+// Labels that can be aggregated
+#ifndef TINFO_AGGREGATE_LABELS
+#define TINFO_AGGREGATE_LABELS 8
+#endif
+
+// One aggregated label
+typedef struct
+{
+  char     name[TINFO_NAME_SIZE];
+  int32_t  min;
+  int32_t  max;
+  int32_t  last;
+  int64_t  sum;
+  uint16_t count;   // values in window, 0 if none
+} _TInfoAggregate;
+
+class TInfoAggregate
+{
+  public:
+    TInfoAggregate();
+    void              init(void);
+    int8_t            track(const char * name);
+    void              frame(ValueList * me);
+    void              restart(void);
+    uint8_t           count(void);
+    _TInfoAggregate * get(uint8_t slot);
+
+    static int32_t    mean(const _TInfoAggregate * a);
+
+  private:
+    int8_t            find(const char * name);
+
+    _TInfoAggregate   _labels[TINFO_AGGREGATE_LABELS];
+    uint8_t           _count;
+};
+
+#endif
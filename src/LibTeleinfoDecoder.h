@@ -0,0 +1,199 @@
+// **********************************************************************************
+// Teleinfo group decoder specialized for each TIC mode
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// Historic and Standard groups only differ by their separator, checksum
+// rule, fields sizes, horodate and labels. These are constants of a traits
+// structure, so TInfoDecoder<TInfoHistoric> and TInfoDecoder<TInfoStandard>
+// are compiled with no test on the mode, sharing the same code
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#ifndef LibTeleinfoDecoder_h
+#define LibTeleinfoDecoder_h
+
+#include <stdint.h>
+#include <string.h>
+
+// One group split by the decoder, pointers are in the group buffer
+typedef struct
+{
+  char * name;      // label
+  char * horodate;  // horodate, NULL if none
+  char * value;     // value, can be empty with an horodate
+  char   checksum;  // checksum char received
+} _TInfoGroup;
+
+// Label raising an alert (overload on a phase)
+typedef struct
+{
+  const char * name;
+  int8_t       phase;
+} _TInfoAlert;
+
+// Historic mode, 1200 bps
+// LABEL SP VALUE SP CHECKSUM, checksum from label to value
+struct TInfoHistoric
+{
+  static constexpr char    sep         = ' ';
+  static constexpr bool    sumLastSep  = false;
+  static constexpr uint8_t labelMax    = 8;   // MOTDETAT
+  static constexpr uint8_t horodateMax = 0;   // no horodate
+  static constexpr uint8_t valueMax    = 12;  // ADCO
+  static constexpr uint8_t alertCount  = 4;
+
+  static const _TInfoAlert * alerts(void)
+  {
+    static const _TInfoAlert table[] = {
+      { "ADPS", 0 }, { "ADIR1", 1 }, { "ADIR2", 2 }, { "ADIR3", 3 }
+    };
+    return table;
+  }
+};
+
+// Standard mode, 9600 bps
+// LABEL TAB [HORODATE TAB] VALUE TAB CHECKSUM, checksum from label to
+// last TAB included
+struct TInfoStandard
+{
+  static constexpr char    sep         = 0x09;
+  static constexpr bool    sumLastSep  = true;
+  static constexpr uint8_t labelMax    = 8;   // SMAXSN-1
+  static constexpr uint8_t horodateMax = 13;  // (H/E)AAMMDDHHMMSS
+  static constexpr uint8_t valueMax    = 98;  // PJOUR+1
+  static constexpr uint8_t alertCount  = 0;   // overload is in STGE
+
+  static const _TInfoAlert * alerts(void)
+  {
+    return NULL;
+  }
+};
+
+template <class Traits>
+class TInfoDecoder
+{
+  public:
+    /* ======================================================================
+    Function: checksum
+    Purpose : calculate the checksum of a group
+    Input   : group chars between start and end of group (excluded)
+              number of chars (at least 4)
+    Output  : checksum char
+    Comments: -
+    ====================================================================== */
+    static char checksum(const char * group, uint8_t len)
+    {
+      uint8_t n = Traits::sumLastSep ? len - 1 : len - 2;
+      uint8_t sum = 0;
+
+      while (n--)
+        sum += *group++ & 0x7F;
+
+      return (sum & 0x3F) + 0x20;
+    }
+
+    /* ======================================================================
+    Function: check
+    Purpose : check group separator and checksum
+    Input   : group chars between start and end of group (excluded)
+              number of chars
+    Output  : true if group is good in this mode
+    Comments: -
+    ====================================================================== */
+    static bool check(const char * group, uint8_t len)
+    {
+      return len >= 4 && group[len-2] == Traits::sep &&
+             checksum(group, len) == group[len-1];
+    }
+
+    /* ======================================================================
+    Function: parse
+    Purpose : check a group and split it in label, horodate and value
+    Input   : group chars between start and end of group (excluded)
+              number of chars
+              group fields filled
+    Output  : true if group is good
+    Comments: separators are replaced by '\0' in the group
+    ====================================================================== */
+    static bool parse(char * group, uint8_t len, _TInfoGroup * g)
+    {
+      return check(group, len) && split(group, len, g);
+    }
+
+    /* ======================================================================
+    Function: split
+    Purpose : split a group already checked in label, horodate and value
+    Input   : group chars between start and end of group (excluded)
+              number of chars
+              group fields filled
+    Output  : true if fields are good
+    Comments: separators are replaced by '\0' in the group
+    ====================================================================== */
+    static bool split(char * group, uint8_t len, _TInfoGroup * g)
+    {
+      // 2 fields, 3 if there can be an horodate
+      const uint8_t seps = Traits::horodateMax ? 2 : 1;
+      char * fields[3];
+      uint8_t nsep = 0;
+      uint8_t i;
+
+      g->checksum = group[len-1];
+      len -= 2;
+      group[len] = '\0';
+      fields[0] = group;
+
+      for (i = 0; i < len; i++) {
+        if (group[i] == Traits::sep) {
+          if (nsep == seps)
+            return false;
+          group[i] = '\0';
+          fields[++nsep] = &group[i+1];
+        }
+      }
+
+      if (!nsep)
+        return false;
+
+      g->name = fields[0];
+      g->horodate = nsep == 2 ? fields[1] : NULL;
+      g->value = fields[nsep];
+
+      // Check fields sizes, value can only be empty with an horodate
+      if (!*g->name || strlen(g->name) > Traits::labelMax)
+        return false;
+      if (strlen(g->value) > Traits::valueMax)
+        return false;
+      if (g->horodate && strlen(g->horodate) > Traits::horodateMax)
+        return false;
+      if (!*g->value && !g->horodate)
+        return false;
+
+      return true;
+    }
+
+    /* ======================================================================
+    Function: alertPhase
+    Purpose : check if a label is an overload alert of this mode
+    Input   : label
+    Output  : phase (0 for single phase) or -1 if not an alert
+    Comments: -
+    ====================================================================== */
+    static int8_t alertPhase(const char * name)
+    {
+      for (uint8_t i = 0; i < Traits::alertCount; i++) {
+        if (strcmp(name, Traits::alerts()[i].name) == 0)
+          return Traits::alerts()[i].phase;
+      }
+      return -1;
+    }
+};
+
+#endif
@@ -0,0 +1,195 @@
+// **********************************************************************************
+// Teleinfo changed labels push
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#include "LibTeleinfoDelta.h"
+
+/* ======================================================================
+Class   : TInfoDelta
+Purpose : Constructor
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+TInfoDelta::TInfoDelta()
+{
+  _tinfo = NULL;
+  _seq = 0;
+  _len = 0;
+  _framed = false;
+  _frame_t = 0;
+  _msg[0] = '\0';
+}
+
+/* ======================================================================
+Function: init
+Purpose : set the decoder to read labels from
+Input   : TInfo object
+Output  : -
+Comments: numbers start again
+====================================================================== */
+void TInfoDelta::init(TInfo * tinfo)
+{
+  _tinfo = tinfo;
+  _seq = 0;
+  _len = 0;
+  _framed = false;
+  _frame_t = 0;
+  _msg[0] = '\0';
+}
+
+/* ======================================================================
+Function: append
+Purpose : add a string to a message
+Input   : buffer, its size, length used (updated), string
+Output  : false if it does not fit, length is then unchanged
+Comments: -
+====================================================================== */
+boolean TInfoDelta::append(char * buf, size_t size, size_t * len, const char * str)
+{
+  size_t n = strlen(str);
+
+  if (*len + n >= size)
+    return false;
+
+  memcpy(buf + *len, str, n + 1);
+  *len += n;
+  return true;
+}
+
+/* ======================================================================
+Function: appendString
+Purpose : add a JSON string to a message
+Input   : buffer, its size, length used (updated), string
+Output  : false if it does not fit, length is then unchanged
+Comments: quote and backslash are escaped, meter only sends printable
+====================================================================== */
+boolean TInfoDelta::appendString(char * buf, size_t size, size_t * len, const char * str)
+{
+  size_t n = *len;
+
+  if (n + 1 >= size)
+    return false;
+  buf[n++] = '"';
+
+  for (; *str; str++) {
+    if (*str == '"' || *str == '\\') {
+      if (n + 1 >= size)
+        return false;
+      buf[n++] = '\\';
+    }
+    if (n + 1 >= size)
+      return false;
+    buf[n++] = *str;
+  }
+
+  if (n + 1 >= size)
+    return false;
+  buf[n++] = '"';
+  buf[n] = '\0';
+  *len = n;
+  return true;
+}
+
+/* ======================================================================
+Function: render
+Purpose : serialize labels
+Input   : list, all labels or only added/updated ones, buffer, its size
+Output  : message length, 0 if no label or buffer too small
+Comments: labels that do not fit are skipped and "p":1 is added
+====================================================================== */
+size_t TInfoDelta::render(ValueList * me, boolean full, char * buf, size_t size)
+{
+  char head[32];
+  size_t len = 0;
+  size_t mark;
+  uint8_t count = 0;
+  boolean partial = false;
+
+  snprintf(head, sizeof(head), full ? "{\"s\":%lu,\"f\":1,\"v\":{" : "{\"s\":%lu,\"v\":{",
+           (unsigned long) _seq);
+  if (!append(buf, size, &len, head))
+    return 0;
+
+  for (; me; me = me->next) {
+    if (me->free || !*me->name)
+      continue;
+    // Flags stay as they were on labels missing from this frame, a label
+    // changed in the same ms as previous frame is sent again
+    if (!full && ( !(me->flags & (TINFO_FLAGS_ADDED | TINFO_FLAGS_UPDATED)) ||
+                   (_framed && (int32_t) (me->changed - _frame_t) < 0) ))
+      continue;
+
+    // Keep room for the end of message, an entry is written whole or not
+    mark = len;
+    if ( (count && !append(buf, size - 8, &len, ",")) ||
+         !appendString(buf, size - 8, &len, me->name) ||
+         !append(buf, size - 8, &len, ":") ||
+         (*me->horodate && !append(buf, size - 8, &len, "[")) ||
+         !appendString(buf, size - 8, &len, me->value) ||
+         (*me->horodate && (!append(buf, size - 8, &len, ",") ||
+                            !appendString(buf, size - 8, &len, me->horodate) ||
+                            !append(buf, size - 8, &len, "]"))) ) {
+      len = mark;
+      buf[len] = '\0';
+      partial = true;
+      continue;
+    }
+    count++;
+  }
+
+  if (!count && !partial && !full)
+    return 0;
+
+  append(buf, size, &len, partial ? "},\"p\":1}" : "}}");
+  return len;
+}
+
+/* ======================================================================
+Function: frame
+Purpose : serialize labels changed by a frame
+Input   : list given to frame callback, time (ms)
+Output  : message length, 0 if nothing changed
+Comments: call it from new/updated frame callbacks. Message stays until
+          next frame
+====================================================================== */
+size_t TInfoDelta::frame(ValueList * me, uint32_t t)
+{
+  _seq++;
+  _len = render(me, false, _msg, sizeof(_msg));
+  _frame_t = t;
+  _framed = true;
+
+  // Nothing to push, keep numbers without holes
+  if (!_len) {
+    _seq--;
+    _msg[0] = '\0';
+  }
+
+  return _len;
+}
+
+/* ======================================================================
+Function: snapshot
+Purpose : serialize all labels
+Input   : buffer and its size
+Output  : message length, 0 if buffer is too small
+Comments: numbered as last delta, next delta follows it
+====================================================================== */
+size_t TInfoDelta::snapshot(char * buf, size_t size)
+{
+  if (size < 16)
+    return 0;
+
+  return render(_tinfo ? _tinfo->getList() : NULL, true, buf, size);
+}
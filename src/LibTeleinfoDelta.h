@@ -0,0 +1,63 @@
+// **********************************************************************************
+// Teleinfo changed labels push include file
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// Serializes, once per frame, the labels added or updated by this frame in
+// a compact JSON message that can be sent as is to all live clients
+// (WebSocket on Wifinfo and raspjson). Messages are numbered, a client that
+// sees a hole in the numbers asks a snapshot of the whole table
+//
+//   delta    : {"s":12,"v":{"PAPP":"00420","SMAXSN":["07560","E230101120000"]}}
+//   snapshot : {"s":12,"f":1,"v":{...all labels...}}
+//
+// "p":1 is added when the buffer was too small for all labels, the client
+// should then ask a snapshot
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#ifndef LibTeleinfoDelta_h
+#define LibTeleinfoDelta_h
+
+#include "LibTeleinfo.h"
+
+// Delta message buffer, a frame of standard mode fits
+#ifndef TINFO_DELTA_SIZE
+#define TINFO_DELTA_SIZE  1536
+#endif
+
+// Text a client sends to get a snapshot
+#define TINFO_DELTA_ASK   "snapshot"
+
+class TInfoDelta
+{
+  public:
+    TInfoDelta();
+    void     init(TInfo * tinfo);
+    size_t   frame(ValueList * me, uint32_t t);
+    size_t   snapshot(char * buf, size_t size);
+    const char * message(void) { return _msg; }
+    size_t   length(void) { return _len; }
+    uint32_t seq(void) { return _seq; }
+
+  private:
+    size_t   render(ValueList * me, boolean full, char * buf, size_t size);
+    boolean  append(char * buf, size_t size, size_t * len, const char * str);
+    boolean  appendString(char * buf, size_t size, size_t * len, const char * str);
+
+    TInfo *  _tinfo;
+    uint32_t _seq;      // number of last delta
+    boolean  _framed;   // a frame has been serialized
+    uint32_t _frame_t;  // clock of last frame (ms)
+    size_t   _len;
+    char     _msg[TINFO_DELTA_SIZE];
+};
+
+#endif
@@ -0,0 +1,242 @@
+// **********************************************************************************
+// Teleinfo derived values
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#include "LibTeleinfoDerived.h"
+
+// Energy indexes in Wh, only one of them grows at a time so the sum
+// is the total energy whatever the tariff period is
+static const char * const tinfo_indexes[] = {
+  "BASE", "HCHC", "HCHP", "EJPHN", "EJPHPM",
+  "BBRHCJB", "BBRHPJB", "BBRHCJW", "BBRHPJW", "BBRHCJR", "BBRHPJR",
+  "EAST"
+};
+
+// Windows length and checkpoints step (ms)
+static const uint32_t tinfo_spans[TINFO_DERIVED_WINDOWS] = { 1000UL, 60000UL, 900000UL };
+static const uint32_t tinfo_steps[TINFO_DERIVED_WINDOWS] = { 0UL, 5000UL, 60000UL };
+
+/* ======================================================================
+Class   : TInfoDerived
+Purpose : Constructor
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+TInfoDerived::TInfoDerived()
+{
+  _tinfo = NULL;
+  reset();
+}
+
+/* ======================================================================
+Function: init
+Purpose : set the TInfo object where derived values are added
+Input   : TInfo object (NULL to only use power() and energy())
+Output  : -
+Comments: -
+====================================================================== */
+void TInfoDerived::init(TInfo * tinfo)
+{
+  _tinfo = tinfo;
+  reset();
+}
+
+/* ======================================================================
+Function: reset
+Purpose : forget all checkpoints
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+void TInfoDerived::reset(void)
+{
+  memset(_windows, 0, sizeof(_windows));
+  for (uint8_t i = 0; i < TINFO_DERIVED_WINDOWS; i++) {
+    _windows[i].span = tinfo_spans[i];
+    _windows[i].step = tinfo_steps[i];
+  }
+  _valid = false;
+}
+
+/* ======================================================================
+Function: frameEnergy
+Purpose : total of energy indexes of a frame
+Input   : list head pointer on the values table
+          total filled
+Output  : true if frame has at least one energy index
+Comments: -
+====================================================================== */
+boolean TInfoDerived::frameEnergy(ValueList * me, uint32_t * wh)
+{
+  boolean found = false;
+
+  *wh = 0;
+  while (me && me->next) {
+    me = me->next;
+
+    if (me->free)
+      continue;
+
+    for (uint8_t i = 0; i < sizeof(tinfo_indexes) / sizeof(tinfo_indexes[0]); i++) {
+      if (strcmp(me->name, tinfo_indexes[i]) == 0) {
+        *wh += strtoul(me->value, NULL, 10);
+        found = true;
+        break;
+      }
+    }
+  }
+
+  return found;
+}
+
+/* ======================================================================
+Function: windowAdd
+Purpose : add a checkpoint to a window
+Input   : window, time (ms), total energy (Wh)
+Output  : -
+Comments: checkpoints are at least step ms apart, the oldest are removed
+          as long as the next one is old enough to be the reference
+====================================================================== */
+void TInfoDerived::windowAdd(_TInfoWindow * w, uint32_t t, uint32_t wh)
+{
+  uint8_t head;
+
+  // Too close to the newest checkpoint
+  if (w->count) {
+    head = (w->tail + w->count - 1) % TINFO_DERIVED_POINTS;
+    if ((uint32_t) (t - w->points[head].t) < w->step)
+      return;
+  }
+
+  // Ring full, forget the oldest
+  if (w->count == TINFO_DERIVED_POINTS) {
+    w->tail = (w->tail + 1) % TINFO_DERIVED_POINTS;
+    w->count--;
+  }
+
+  head = (w->tail + w->count) % TINFO_DERIVED_POINTS;
+  w->points[head].t = t;
+  w->points[head].wh = wh;
+  w->count++;
+
+  // Keep as reference the newest checkpoint at least span old
+  while (w->count > 1) {
+    uint8_t next = (w->tail + 1) % TINFO_DERIVED_POINTS;
+    if ((uint32_t) (t - w->points[next].t) < w->span)
+      break;
+    w->tail = next;
+    w->count--;
+  }
+}
+
+/* ======================================================================
+Function: windowRef
+Purpose : reference checkpoint of a window
+Input   : window
+Output  : oldest checkpoint, NULL if window is empty
+Comments: -
+====================================================================== */
+_TInfoPoint * TInfoDerived::windowRef(_TInfoWindow * w)
+{
+  return w->count ? &w->points[w->tail] : NULL;
+}
+
+/* ======================================================================
+Function: frame
+Purpose : update windows with a new frame
+Input   : list head pointer on the values table (as given to frame
+          callbacks), frame time in ms from a monotonic clock
+Output  : true if frame had an energy index
+Comments: should be called from new and updated frame callbacks, before
+          sending the values so _PACT and _E15MIN are sent with them
+====================================================================== */
+boolean TInfoDerived::frame(ValueList * me, uint32_t t)
+{
+  uint32_t wh;
+  uint8_t flags;
+  char value[12];
+
+  if (!frameEnergy(me, &wh))
+    return false;
+
+  // Index went back (meter changed ?) start again
+  if (_valid && (int32_t) (wh - _last.wh) < 0)
+    reset();
+
+  _last.t = t;
+  _last.wh = wh;
+  _valid = true;
+
+  for (uint8_t i = 0; i < TINFO_DERIVED_WINDOWS; i++)
+    windowAdd(&_windows[i], t, wh);
+
+  if (_tinfo) {
+    if (power(TINFO_DERIVED_1MIN, &wh)) {
+      flags = TINFO_FLAGS_NONE;
+      sprintf(value, "%lu", (unsigned long) wh);
+      _tinfo->addCustomValue((char *) TINFO_DERIVED_PACT, value, &flags);
+    }
+    if (energy(TINFO_DERIVED_15MIN, &wh)) {
+      flags = TINFO_FLAGS_NONE;
+      sprintf(value, "%lu", (unsigned long) wh);
+      _tinfo->addCustomValue((char *) TINFO_DERIVED_E15MIN, value, &flags);
+    }
+  }
+
+  return true;
+}
+
+/* ======================================================================
+Function: energy
+Purpose : energy used over a window
+Input   : window (TINFO_DERIVED_xxx), energy filled (Wh)
+Output  : true if we have at least two checkpoints
+Comments: measured between the reference checkpoint and the last frame,
+          so over a little more than the window until it is full
+====================================================================== */
+boolean TInfoDerived::energy(uint8_t window, uint32_t * wh)
+{
+  _TInfoPoint * ref;
+
+  if (window >= TINFO_DERIVED_WINDOWS || !_valid)
+    return false;
+
+  ref = windowRef(&_windows[window]);
+  if (!ref || ref->t == _last.t)
+    return false;
+
+  *wh = _last.wh - ref->wh;
+  return true;
+}
+
+/* ======================================================================
+Function: power
+Purpose : mean active power over a window
+Input   : window (TINFO_DERIVED_xxx), power filled (W)
+Output  : true if we have at least two checkpoints
+Comments: Wh * 3600 * 1000 / ms
+====================================================================== */
+boolean TInfoDerived::power(uint8_t window, uint32_t * watts)
+{
+  _TInfoPoint * ref;
+  uint32_t dt;
+
+  if (!energy(window, watts))
+    return false;
+
+  ref = windowRef(&_windows[window]);
+  dt = _last.t - ref->t;
+  *watts = (uint32_t) ((uint64_t) *watts * 3600000ULL / dt);
+  return true;
+}
@@ -0,0 +1,78 @@
+// **********************************************************************************
+// Teleinfo derived values include file
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// Historic meters only give apparent power (PAPP), active power is computed
+// from energy indexes (BASE, HCHC, HCHP, EAST...) over sliding windows of
+// 1 s, 1 min and 15 min. Each window keeps a few checkpoints of the total
+// index, each frame costs a push and at most a few pops, no matter the
+// length of the window. Results are added to the values list as _PACT
+// (W over 1 min) and _E15MIN (Wh over 15 min)
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#ifndef LibTeleinfoDerived_h
+#define LibTeleinfoDerived_h
+
+#include "LibTeleinfo.h"
+
+// Windows computed
+#define TINFO_DERIVED_1S      0
+#define TINFO_DERIVED_1MIN    1
+#define TINFO_DERIVED_15MIN   2
+#define TINFO_DERIVED_WINDOWS 3
+
+// Checkpoints kept per window, window length / step + 2 at least
+#define TINFO_DERIVED_POINTS  20
+
+// Labels added to the values list
+#define TINFO_DERIVED_PACT    "_PACT"
+#define TINFO_DERIVED_E15MIN  "_E15MIN"
+
+// Total of energy indexes at a given time
+typedef struct
+{
+  uint32_t t;   // ms
+  uint32_t wh;  // Wh
+} _TInfoPoint;
+
+// One sliding window, ring of checkpoints from oldest (tail) to newest
+typedef struct
+{
+  uint32_t    span;   // window length (ms)
+  uint32_t    step;   // min time between two checkpoints (ms)
+  uint8_t     tail;   // oldest checkpoint
+  uint8_t     count;  // checkpoints in ring
+  _TInfoPoint points[TINFO_DERIVED_POINTS];
+} _TInfoWindow;
+
+class TInfoDerived
+{
+  public:
+    TInfoDerived();
+    void      init(TInfo * tinfo);
+    boolean   frame(ValueList * me, uint32_t t);
+    boolean   power(uint8_t window, uint32_t * watts);
+    boolean   energy(uint8_t window, uint32_t * wh);
+
+  private:
+    boolean   frameEnergy(ValueList * me, uint32_t * wh);
+    void      windowAdd(_TInfoWindow * w, uint32_t t, uint32_t wh);
+    _TInfoPoint * windowRef(_TInfoWindow * w);
+    void      reset(void);
+
+    TInfo *      _tinfo;
+    _TInfoPoint  _last;     // last frame total
+    boolean      _valid;    // _last has been set
+    _TInfoWindow _windows[TINFO_DERIVED_WINDOWS];
+};
+
+#endif
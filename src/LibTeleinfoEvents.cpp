@@ -0,0 +1,267 @@
+// **********************************************************************************
+// Teleinfo Server-Sent Events
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#include "LibTeleinfoEvents.h"
+
+/* ======================================================================
+Class   : TInfoEvents
+Purpose : Constructor
+Input   : -
+Output  : -
+Comments: no client
+====================================================================== */
+TInfoEvents::TInfoEvents()
+{
+  _fn_write = NULL;
+  _fn_close = NULL;
+  _evicted = 0;
+  for (uint8_t i = 0; i < TINFO_EVENTS_CLIENTS; i++) {
+    _clients[i].id = -1;
+    _clients[i].len = 0;
+  }
+}
+
+/* ======================================================================
+Function: init
+Purpose : set client write and close functions
+Input   : write function, returns chars taken now (0 if none) or -1 if
+          client is gone, it must not wait
+          close function
+Output  : -
+Comments: -
+====================================================================== */
+void TInfoEvents::init(int (*fn_write)(int id, const char * buf, size_t len), void (*fn_close)(int id))
+{
+  _fn_write = fn_write;
+  _fn_close = fn_close;
+}
+
+/* ======================================================================
+Function: add
+Purpose : add a client
+Input   : client id, stream header already sent
+Output  : false if TINFO_EVENTS_CLIENTS are connected
+Comments: caller closes the client if refused
+====================================================================== */
+boolean TInfoEvents::add(int id)
+{
+  for (uint8_t i = 0; i < TINFO_EVENTS_CLIENTS; i++) {
+    if (_clients[i].id < 0) {
+      _clients[i].id = id;
+      _clients[i].len = 0;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/* ======================================================================
+Function: remove
+Purpose : close a client
+Input   : client id
+Output  : -
+Comments: nothing done if unknown, for a slot the sketch reuses
+====================================================================== */
+void TInfoEvents::remove(int id)
+{
+  for (uint8_t i = 0; i < TINFO_EVENTS_CLIENTS; i++) {
+    if (_clients[i].id == id && id >= 0) {
+      if (_fn_close)
+        _fn_close(id);
+      _clients[i].id = -1;
+      _clients[i].len = 0;
+    }
+  }
+}
+
+/* ======================================================================
+Function: clients
+Purpose : clients connected
+Input   : -
+Output  : number of clients
+Comments: -
+====================================================================== */
+uint8_t TInfoEvents::clients(void)
+{
+  uint8_t n = 0;
+
+  for (uint8_t i = 0; i < TINFO_EVENTS_CLIENTS; i++)
+    if (_clients[i].id >= 0)
+      n++;
+
+  return n;
+}
+
+/* ======================================================================
+Function: evicted
+Purpose : clients closed because gone or too slow
+Input   : -
+Output  : count since start
+Comments: -
+====================================================================== */
+uint32_t TInfoEvents::evicted(void)
+{
+  return _evicted;
+}
+
+/* ======================================================================
+Function: evict
+Purpose : close a client
+Input   : client
+Output  : -
+Comments: -
+====================================================================== */
+void TInfoEvents::evict(_TInfoEventsClient * k)
+{
+  if (_fn_close)
+    _fn_close(k->id);
+  k->id = -1;
+  k->len = 0;
+  _evicted++;
+}
+
+/* ======================================================================
+Function: put
+Purpose : write chars to a client, queue what it can't take
+Input   : client, chars and their number
+Output  : false if client is gone or its queue is full
+Comments: queued chars are always written first
+====================================================================== */
+boolean TInfoEvents::put(_TInfoEventsClient * k, const char * buf, size_t len)
+{
+  int n;
+
+  if (!k->len && _fn_write) {
+    if ( (n = _fn_write(k->id, buf, len)) < 0 )
+      return false;
+    buf += n;
+    len -= n;
+  }
+
+  if (!len)
+    return true;
+
+  if (k->len + len > TINFO_EVENTS_QUEUE)
+    return false;
+
+  memcpy(k->queue + k->len, buf, len);
+  k->len += len;
+  return true;
+}
+
+/* ======================================================================
+Function: header
+Purpose : format event and id lines, and start of data line
+Input   : buffer, its size, event name, id (0 for none)
+Output  : header size
+Comments: -
+====================================================================== */
+size_t TInfoEvents::header(char * head, size_t size, const char * event, uint32_t seq)
+{
+  int n;
+
+  if (seq)
+    n = snprintf(head, size, "event: %s\nid: %lu\ndata: ", event, (unsigned long) seq);
+  else
+    n = snprintf(head, size, "event: %s\ndata: ", event);
+
+  return n < 0 || (size_t) n >= size ? 0 : n;
+}
+
+/* ======================================================================
+Function: event
+Purpose : send an event to a client
+Input   : client, formatted header and its size, data and its size
+Output  : false if client has been closed
+Comments: data must be a single line
+====================================================================== */
+boolean TInfoEvents::event(_TInfoEventsClient * k, const char * head, size_t hlen, const char * data, size_t len)
+{
+  if (put(k, head, hlen) && put(k, data, len) && put(k, "\n\n", 2))
+    return true;
+
+  evict(k);
+  return false;
+}
+
+/* ======================================================================
+Function: send
+Purpose : send an event to all clients
+Input   : event name, id (0 for none), data and its size
+Output  : -
+Comments: header is formatted once, data is not copied unless a client
+          can't take it now
+====================================================================== */
+void TInfoEvents::send(const char * event, uint32_t seq, const char * data, size_t len)
+{
+  char head[64];
+  size_t hlen = header(head, sizeof(head), event, seq);
+
+  if (!hlen)
+    return;
+
+  for (uint8_t i = 0; i < TINFO_EVENTS_CLIENTS; i++)
+    if (_clients[i].id >= 0)
+      this->event(&_clients[i], head, hlen, data, len);
+}
+
+/* ======================================================================
+Function: sendTo
+Purpose : send an event to one client
+Input   : client id, event name, id (0 for none), data and its size
+Output  : false if client has been closed or is unknown
+Comments: for the first event of a new client
+====================================================================== */
+boolean TInfoEvents::sendTo(int id, const char * event, uint32_t seq, const char * data, size_t len)
+{
+  char head[64];
+  size_t hlen = header(head, sizeof(head), event, seq);
+
+  for (uint8_t i = 0; i < TINFO_EVENTS_CLIENTS; i++)
+    if (_clients[i].id == id)
+      return hlen && this->event(&_clients[i], head, hlen, data, len);
+
+  return false;
+}
+
+/* ======================================================================
+Function: flush
+Purpose : write queued chars
+Input   : -
+Output  : -
+Comments: call it from main loop, never waits
+====================================================================== */
+void TInfoEvents::flush(void)
+{
+  _TInfoEventsClient * k;
+  int n;
+
+  if (!_fn_write)
+    return;
+
+  for (uint8_t i = 0; i < TINFO_EVENTS_CLIENTS; i++) {
+    k = &_clients[i];
+    if (k->id < 0 || !k->len)
+      continue;
+
+    if ( (n = _fn_write(k->id, k->queue, k->len)) < 0 ) {
+      evict(k);
+      continue;
+    }
+
+    k->len -= n;
+    memmove(k->queue, k->queue + n, k->len);
+  }
+}
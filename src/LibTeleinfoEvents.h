@@ -0,0 +1,86 @@
+// **********************************************************************************
+// Teleinfo Server-Sent Events include file
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// Sends text/event-stream events (frame, alert) to clients kept connected
+// by the web server. Writes never wait: what a client socket can't take now
+// stays in a queue of its own and is written by flush(), a client whose
+// queue would overflow is closed. Clients are ids given by the sketch
+// (socket on a host, slot of a WiFiClient table on the ESP), with its write
+// and close functions
+//
+//   event: frame
+//   id: 12
+//   data: {"s":12,"v":{"PAPP":"00420"}}
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#ifndef LibTeleinfoEvents_h
+#define LibTeleinfoEvents_h
+
+#include "LibTeleinfo.h"
+
+// Each client takes its queue plus 6 bytes in the object, 4.1 KB with 4
+// clients of 1024. An ESP8266 keeps 2 clients of 512 (1 KB), a queue
+// only holds what the socket could not take at once
+#ifndef TINFO_EVENTS_CLIENTS
+#ifdef ESP8266
+#define TINFO_EVENTS_CLIENTS  2
+#else
+#define TINFO_EVENTS_CLIENTS  4
+#endif
+#endif
+
+// Chars waiting for a client, a frame event fits
+#ifndef TINFO_EVENTS_QUEUE
+#ifdef ESP8266
+#define TINFO_EVENTS_QUEUE    512
+#else
+#define TINFO_EVENTS_QUEUE    1024
+#endif
+#endif
+
+#define TINFO_EVENTS_TYPE     "text/event-stream"
+
+// One client
+typedef struct
+{
+  int      id;      // -1 if free
+  uint16_t len;     // chars in queue
+  char     queue[TINFO_EVENTS_QUEUE];
+} _TInfoEventsClient;
+
+class TInfoEvents
+{
+  public:
+    TInfoEvents();
+    void     init(int (*fn_write)(int id, const char * buf, size_t len), void (*fn_close)(int id));
+    boolean  add(int id);
+    void     remove(int id);
+    void     send(const char * event, uint32_t seq, const char * data, size_t len);
+    boolean  sendTo(int id, const char * event, uint32_t seq, const char * data, size_t len);
+    void     flush(void);
+    uint8_t  clients(void);
+    uint32_t evicted(void);
+
+  private:
+    boolean  event(_TInfoEventsClient * k, const char * head, size_t hlen, const char * data, size_t len);
+    boolean  put(_TInfoEventsClient * k, const char * buf, size_t len);
+    void     evict(_TInfoEventsClient * k);
+    size_t   header(char * head, size_t size, const char * event, uint32_t seq);
+
+    int      (*_fn_write)(int id, const char * buf, size_t len);
+    void     (*_fn_close)(int id);
+    _TInfoEventsClient _clients[TINFO_EVENTS_CLIENTS];
+    uint32_t _evicted;  // clients closed, gone or too slow
+};
+
+#endif
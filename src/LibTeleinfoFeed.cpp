@@ -0,0 +1,197 @@
+// **********************************************************************************
+// Teleinfo multicast frame feed
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#include "LibTeleinfoFeed.h"
+
+/* ======================================================================
+Class   : TInfoFeed
+Purpose : Constructor
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+TInfoFeed::TInfoFeed()
+{
+  init();
+}
+
+/* ======================================================================
+Function: init
+Purpose : start numbers again
+Input   : -
+Output  : -
+Comments: receivers see a restart, not lost frames
+====================================================================== */
+void TInfoFeed::init(void)
+{
+  _seq = 0;
+  _len = 0;
+  _framed = false;
+  _frame_t = 0;
+}
+
+/* ======================================================================
+Function: frame
+Purpose : build datagram of a frame
+Input   : list given to frame callback, time (ms)
+Output  : datagram length
+Comments: call it from new/updated frame callbacks, every frame gets a
+          number even if nothing changed. Datagram stays until next frame
+====================================================================== */
+size_t TInfoFeed::frame(ValueList * me, uint32_t t)
+{
+  uint8_t * p = _buf + TINFO_FEED_HEAD;
+  uint8_t * end = _buf + sizeof(_buf);
+  uint64_t changed = 0;
+  uint8_t count = 0;
+  uint8_t flags = 0;
+  size_t n, v, h;
+  uint16_t size;
+
+  _seq++;
+  memset(_buf, 0, TINFO_FEED_HEAD);
+
+  for (; me; me = me->next) {
+    if (me->free || !*me->name)
+      continue;
+
+    // Meter field is NUL padded, not terminated when 12 chars long
+    if (!strcmp(me->name, "ADCO") || !strcmp(me->name, "ADSC")) {
+      v = strlen(me->value);
+      memset(_buf + 8, 0, TINFO_FEED_METER);
+      memcpy(_buf + 8, me->value, v < TINFO_FEED_METER ? v : TINFO_FEED_METER);
+    }
+
+    n = strlen(me->name);
+    v = strlen(me->value);
+    h = strlen(me->horodate);
+    if ( count >= TINFO_FEED_LABELS || p + n + v + (h ? h + 1 : 0) + 2 > end ) {
+      flags |= TINFO_FEED_PARTIAL;
+      continue;
+    }
+
+    // Same test as TInfoDelta, a label changed in the same ms as previous
+    // frame is flagged again
+    if ( (me->flags & (TINFO_FLAGS_ADDED | TINFO_FLAGS_UPDATED)) &&
+         !(_framed && (int32_t) (me->changed - _frame_t) < 0) )
+      changed |= (uint64_t) 1 << count;
+
+    memcpy(p, me->name, n);
+    p += n;
+    *p++ = '\t';
+    if (h) {
+      memcpy(p, me->horodate, h);
+      p += h;
+      *p++ = '\t';
+    }
+    memcpy(p, me->value, v);
+    p += v;
+    *p++ = '\n';
+    count++;
+  }
+
+  _frame_t = t;
+  _framed = true;
+
+  size = p - _buf - TINFO_FEED_HEAD;
+  _buf[0] = 'T';
+  _buf[1] = 'F';
+  _buf[2] = TINFO_FEED_VERSION;
+  _buf[3] = flags;
+  for (n = 0; n < 4; n++)
+    _buf[4 + n] = _seq >> (24 - 8 * n);
+  _buf[20] = count;
+  for (n = 0; n < 8; n++)
+    _buf[22 + n] = changed >> (56 - 8 * n);
+  _buf[30] = size >> 8;
+  _buf[31] = size;
+
+  _len = p - _buf;
+  return _len;
+}
+
+/* ======================================================================
+Function: parse
+Purpose : read header of a received datagram
+Input   : datagram, its size, header to fill
+Output  : false if not a feed datagram of this version
+Comments: labels point in datagram, read them with label()
+====================================================================== */
+boolean TInfoFeed::parse(const uint8_t * buf, size_t len, TInfoFeedFrame * f)
+{
+  uint8_t i;
+
+  if (len < TINFO_FEED_HEAD || buf[0] != 'T' || buf[1] != 'F' || buf[2] != TINFO_FEED_VERSION)
+    return false;
+
+  f->version = buf[2];
+  f->flags = buf[3];
+  f->seq = 0;
+  for (i = 0; i < 4; i++)
+    f->seq = (f->seq << 8) | buf[4 + i];
+  memcpy(f->meter, buf + 8, TINFO_FEED_METER);
+  f->meter[TINFO_FEED_METER] = '\0';
+  f->count = buf[20];
+  f->changed = 0;
+  for (i = 0; i < 8; i++)
+    f->changed = (f->changed << 8) | buf[22 + i];
+  f->size = (buf[30] << 8) | buf[31];
+  f->labels = (const char *) buf + TINFO_FEED_HEAD;
+
+  return f->size <= len - TINFO_FEED_HEAD;
+}
+
+/* ======================================================================
+Function: label
+Purpose : read next label of a received datagram
+Input   : header, position in labels (0 for first, updated), name, value
+          and horodate buffers of TINFO_NAME_SIZE, TINFO_VALUE_SIZE and
+          TINFO_HORO_SIZE
+Output  : false when no label remains or line is bad
+Comments: horodate is empty for labels without one
+====================================================================== */
+boolean TInfoFeed::label(const TInfoFeedFrame * f, uint16_t * pos, char * name, char * value, char * horodate)
+{
+  const char * p = f->labels + *pos;
+  const char * end = f->labels + f->size;
+  const char * eol = (const char *) memchr(p, '\n', end - p);
+  const char * tab1;
+  const char * tab2;
+
+  if (p >= end || !eol)
+    return false;
+
+  tab1 = (const char *) memchr(p, '\t', eol - p);
+  if (!tab1 || tab1 - p >= TINFO_NAME_SIZE)
+    return false;
+  tab2 = (const char *) memchr(tab1 + 1, '\t', eol - tab1 - 1);
+
+  memcpy(name, p, tab1 - p);
+  name[tab1 - p] = '\0';
+  *horodate = '\0';
+  if (tab2) {
+    if (tab2 - tab1 - 1 >= TINFO_HORO_SIZE)
+      return false;
+    memcpy(horodate, tab1 + 1, tab2 - tab1 - 1);
+    horodate[tab2 - tab1 - 1] = '\0';
+    tab1 = tab2;
+  }
+  if (eol - tab1 - 1 >= TINFO_VALUE_SIZE)
+    return false;
+  memcpy(value, tab1 + 1, eol - tab1 - 1);
+  value[eol - tab1 - 1] = '\0';
+
+  *pos = eol + 1 - f->labels;
+  return true;
+}
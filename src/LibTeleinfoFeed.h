@@ -0,0 +1,84 @@
+// **********************************************************************************
+// Teleinfo multicast frame feed include file
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// Builds, once per frame, a datagram with all labels of the table that the
+// sketch sends to a multicast group, any number of receivers can listen to
+// it for the cost of one send. Each datagram holds the whole table so a
+// receiver never needs an other one to be up to date, numbers let it count
+// the frames it lost. Integers are big endian
+//
+//   0  'T' 'F'        magic
+//   2  version        TINFO_FEED_VERSION
+//   3  flags          TINFO_FEED_PARTIAL
+//   4  seq            frame number, 1 for first frame after init
+//   8  meter          ADCO or ADSC, NUL padded (12 chars)
+//   20 count          labels in datagram
+//   21 0
+//   22 changed        bit n set if label n was added or updated by frame
+//   30 size           chars of labels
+//   32 labels         name HT [horodate HT] value LF, as sent by meter
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#ifndef LibTeleinfoFeed_h
+#define LibTeleinfoFeed_h
+
+#include "LibTeleinfo.h"
+
+// Datagram buffer, below ethernet MTU so it is never fragmented
+#ifndef TINFO_FEED_SIZE
+#define TINFO_FEED_SIZE     1400
+#endif
+
+#define TINFO_FEED_VERSION  1
+#define TINFO_FEED_HEAD     32  // header size
+#define TINFO_FEED_METER    12  // meter id size
+#define TINFO_FEED_LABELS   64  // labels in changed bitmap
+
+// Datagram flags
+#define TINFO_FEED_PARTIAL  0x01 // labels did not all fit
+
+// Header of a received datagram
+typedef struct
+{
+  uint8_t  version;
+  uint8_t  flags;
+  uint32_t seq;
+  char     meter[TINFO_FEED_METER+1];
+  uint8_t  count;
+  uint64_t changed;
+  const char * labels;  // in received buffer, not terminated
+  uint16_t size;
+} TInfoFeedFrame;
+
+class TInfoFeed
+{
+  public:
+    TInfoFeed();
+    void     init(void);
+    size_t   frame(ValueList * me, uint32_t t);
+    const uint8_t * data(void) { return _buf; }
+    size_t   length(void) { return _len; }
+    uint32_t seq(void) { return _seq; }
+
+    static boolean parse(const uint8_t * buf, size_t len, TInfoFeedFrame * f);
+    static boolean label(const TInfoFeedFrame * f, uint16_t * pos, char * name, char * value, char * horodate);
+
+  private:
+    uint32_t _seq;      // number of last datagram
+    boolean  _framed;   // a frame has been serialized
+    uint32_t _frame_t;  // clock of last frame (ms)
+    size_t   _len;
+    uint8_t  _buf[TINFO_FEED_SIZE];
+};
+
+#endif
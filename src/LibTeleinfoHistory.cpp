@@ -0,0 +1,348 @@
+// **********************************************************************************
+// Teleinfo values history
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#include "LibTeleinfoHistory.h"
+
+/* ======================================================================
+Class   : TInfoHistory
+Purpose : Constructor
+Input   : -
+Output  : -
+Comments: no label tracked
+====================================================================== */
+TInfoHistory::TInfoHistory()
+{
+  memset(_tracks, 0, sizeof(_tracks));
+  _count = 0;
+}
+
+/* ======================================================================
+Function: init
+Purpose : forget all values
+Input   : -
+Output  : -
+Comments: tracked labels are kept
+====================================================================== */
+void TInfoHistory::init(void)
+{
+  for (uint8_t i = 0; i < _count; i++) {
+    memset(&_tracks[i].frames, 0, sizeof(_TInfoRing));
+    memset(&_tracks[i].minutes, 0, sizeof(_TInfoRing));
+    _tracks[i].minute_t = 0;
+    _tracks[i].sum = 0;
+    _tracks[i].samples = 0;
+  }
+}
+
+/* ======================================================================
+Function: find
+Purpose : find a tracked label
+Input   : label name
+Output  : slot or -1 if label is not tracked
+Comments: -
+====================================================================== */
+int8_t TInfoHistory::find(const char * name)
+{
+  for (uint8_t i = 0; i < _count; i++) {
+    if (strcmp(_tracks[i].name, name) == 0)
+      return i;
+  }
+  return -1;
+}
+
+/* ======================================================================
+Function: track
+Purpose : keep history of a label
+Input   : label name
+Output  : slot or -1 if all slots are used (TINFO_HISTORY_LABELS)
+Comments: label values must be numeric, others are ignored
+====================================================================== */
+int8_t TInfoHistory::track(const char * name)
+{
+  int8_t slot = find(name);
+
+  if (slot >= 0)
+    return slot;
+
+  if (_count == TINFO_HISTORY_LABELS || strlen(name) >= TINFO_NAME_SIZE)
+    return -1;
+
+  slot = _count++;
+  memset(&_tracks[slot], 0, sizeof(_TInfoTrack));
+  strcpy(_tracks[slot].name, name);
+  return slot;
+}
+
+/* ======================================================================
+Function: push
+Purpose : add a value at the head of a ring
+Input   : ring, its deltas tables (dt NULL if no time is kept), size
+          value, time (ms), true if there is no value (gap)
+Output  : -
+Comments: a full ring forgets its oldest entry. A delta too large is
+          clamped, the next ones catch up the error
+====================================================================== */
+void TInfoHistory::push(_TInfoRing * r, int16_t * dv, uint16_t * dt, uint16_t size, int32_t v, uint32_t t, boolean gap)
+{
+  uint16_t head;
+  int32_t d;
+
+  // First entry, never a gap so first value is known
+  if (!r->count) {
+    if (gap)
+      return;
+    r->first = r->last = v;
+    r->first_t = r->last_t = t;
+    r->tail = 0;
+    r->count = 1;
+    dv[0] = 0;
+    if (dt)
+      dt[0] = 0;
+    return;
+  }
+
+  // Ring full, oldest entry is the next one
+  if (r->count == size) {
+    r->tail = (r->tail + 1) % size;
+    r->count--;
+    if (dv[r->tail] != TINFO_HISTORY_GAP)
+      r->first += dv[r->tail];
+    if (dt)
+      r->first_t += dt[r->tail];
+  }
+
+  head = (r->tail + r->count) % size;
+
+  if (gap) {
+    dv[head] = TINFO_HISTORY_GAP;
+  } else {
+    d = v - r->last;
+    if (d > TINFO_HISTORY_DELTA_MAX)
+      d = TINFO_HISTORY_DELTA_MAX;
+    else if (d < -TINFO_HISTORY_DELTA_MAX)
+      d = -TINFO_HISTORY_DELTA_MAX;
+    dv[head] = d;
+    r->last += d;
+  }
+
+  if (dt)
+    dt[head] = t - r->last_t;
+  r->last_t = t;
+  r->count++;
+}
+
+/* ======================================================================
+Function: sample
+Purpose : add a value of a tracked label
+Input   : slot, value, time (ms)
+Output  : -
+Comments: the minute mean is pushed with the first value of next minute,
+          minutes without any value are pushed as gaps
+====================================================================== */
+void TInfoHistory::sample(uint8_t slot, int32_t v, uint32_t t)
+{
+  _TInfoTrack * k = &_tracks[slot];
+  uint32_t elapsed;
+  uint32_t n;
+
+  // Long silence, frames time can't be kept as 16 bits deltas
+  if (k->frames.count && (uint32_t) (t - k->frames.last_t) > 0xFFFF)
+    k->frames.count = 0;
+
+  push(&k->frames, _frame_dv[slot], _frame_dt[slot], TINFO_HISTORY_FRAMES, v, t, false);
+
+  // Very first value
+  if (!k->samples && !k->minutes.count)
+    k->minute_t = t;
+
+  elapsed = t - k->minute_t;
+  if (elapsed >= TINFO_HISTORY_MINUTE) {
+    n = elapsed / TINFO_HISTORY_MINUTE;
+    k->minute_t += n * TINFO_HISTORY_MINUTE;
+
+    push(&k->minutes, _minute_dv[slot], NULL, TINFO_HISTORY_MINUTES, k->sum / k->samples, k->minute_t, false);
+
+    if (n > TINFO_HISTORY_MINUTES)
+      n = TINFO_HISTORY_MINUTES;
+    while (--n)
+      push(&k->minutes, _minute_dv[slot], NULL, TINFO_HISTORY_MINUTES, 0, k->minute_t, true);
+
+    k->sum = 0;
+    k->samples = 0;
+  }
+
+  k->sum += v;
+  k->samples++;
+}
+
+/* ======================================================================
+Function: frame
+Purpose : add values of tracked labels from a frame
+Input   : list head pointer on the values table (as given to frame
+          callbacks), frame time in ms from a monotonic clock
+Output  : -
+Comments: should be called from new and updated frame callbacks
+====================================================================== */
+void TInfoHistory::frame(ValueList * me, uint32_t t)
+{
+  int8_t slot;
+  char * end;
+  long v;
+
+  while (me && me->next) {
+    me = me->next;
+
+    if (me->free || !*me->value)
+      continue;
+
+    slot = find(me->name);
+    if (slot < 0)
+      continue;
+
+    v = strtol(me->value, &end, 10);
+    if (*end == '\0')
+      sample(slot, v, t);
+  }
+}
+
+/* ======================================================================
+Function: open
+Purpose : start streaming the history of a label
+Input   : label name, cursor filled
+Output  : false if label is not tracked
+Comments: -
+====================================================================== */
+boolean TInfoHistory::open(const char * name, _TInfoHistoryCursor * c)
+{
+  c->slot = find(name);
+  c->part = TINFO_HISTORY_HEAD;
+  c->index = 0;
+  return c->slot >= 0;
+}
+
+/* ======================================================================
+Function: renderItem
+Purpose : render next JSON item of a label history
+Input   : cursor, item buffer and its size
+Output  : false if history is done
+Comments: cursor is moved to next item
+====================================================================== */
+boolean TInfoHistory::renderItem(_TInfoHistoryCursor * c, char * item, size_t size)
+{
+  _TInfoTrack * k = &_tracks[c->slot];
+  int16_t dv;
+
+  switch (c->part) {
+    case TINFO_HISTORY_HEAD:
+      snprintf(item, size, "{\"label\":\"%s\",\"frames\":[", k->name);
+      c->part = TINFO_HISTORY_FRAME;
+      c->index = 0;
+      c->pos = k->frames.tail;
+      c->value = k->frames.first;
+      c->t = k->frames.first_t;
+      break;
+
+    // [time ms, value] from oldest
+    case TINFO_HISTORY_FRAME:
+      if (c->index == k->frames.count) {
+        c->part = TINFO_HISTORY_MINUTES_HEAD;
+        snprintf(item, size, "]");
+        break;
+      }
+      if (c->index) {
+        c->value += _frame_dv[c->slot][c->pos];
+        c->t += _frame_dt[c->slot][c->pos];
+      }
+      snprintf(item, size, "%s[%lu,%ld]", c->index ? "," : "",
+               (unsigned long) c->t, (long) c->value);
+      c->pos = (c->pos + 1) % TINFO_HISTORY_FRAMES;
+      c->index++;
+      break;
+
+    case TINFO_HISTORY_MINUTES_HEAD:
+      snprintf(item, size, ",\"minutes\":{\"start\":%lu,\"step\":%lu,\"values\":[",
+               (unsigned long) (k->minutes.last_t - k->minutes.count * TINFO_HISTORY_MINUTE),
+               (unsigned long) TINFO_HISTORY_MINUTE);
+      c->part = TINFO_HISTORY_MINUTE_VALUE;
+      c->index = 0;
+      c->pos = k->minutes.tail;
+      c->value = k->minutes.first;
+      break;
+
+    // Means from oldest, null for minutes without frame
+    case TINFO_HISTORY_MINUTE_VALUE:
+      if (c->index == k->minutes.count) {
+        c->part = TINFO_HISTORY_TAIL;
+        snprintf(item, size, "]}");
+        break;
+      }
+      dv = _minute_dv[c->slot][c->pos];
+      if (c->index && dv != TINFO_HISTORY_GAP)
+        c->value += dv;
+      if (dv == TINFO_HISTORY_GAP)
+        snprintf(item, size, "%snull", c->index ? "," : "");
+      else
+        snprintf(item, size, "%s%ld", c->index ? "," : "", (long) c->value);
+      c->pos = (c->pos + 1) % TINFO_HISTORY_MINUTES;
+      c->index++;
+      break;
+
+    case TINFO_HISTORY_TAIL:
+      snprintf(item, size, "}");
+      c->part = TINFO_HISTORY_DONE;
+      break;
+
+    default:
+      return false;
+  }
+
+  return true;
+}
+
+/* ======================================================================
+Function: render
+Purpose : render the history of a label in JSON, a buffer at a time
+Input   : cursor set by open(), buffer and its size
+Output  : number of chars written, 0 when history is done
+Comments: call it until it returns 0 and send each buffer, so the whole
+          history never needs to be in memory
+====================================================================== */
+size_t TInfoHistory::render(_TInfoHistoryCursor * c, char * buf, size_t size)
+{
+  _TInfoHistoryCursor next;
+  char item[64];
+  size_t len = 0;
+  size_t n;
+
+  if (c->slot < 0 || !size)
+    return 0;
+
+  for (;;) {
+    next = *c;
+    if (!renderItem(&next, item, sizeof(item)))
+      break;
+
+    // Keep item for next buffer
+    n = strlen(item);
+    if (len + n >= size)
+      break;
+
+    memcpy(buf + len, item, n);
+    len += n;
+    *c = next;
+  }
+
+  buf[len] = '\0';
+  return len;
+}
@@ -0,0 +1,126 @@
+// **********************************************************************************
+// Teleinfo values history include file
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// Keeps the last values of a few numeric labels (PAPP, SINSTS...) for charts
+// on the device. Each label has a ring of every frame value (~10 min) and a
+// ring of one minute means (24 h). Values are stored as 16 bits deltas from
+// the previous one, all rings are in the object so nothing is allocated
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#ifndef LibTeleinfoHistory_h
+#define LibTeleinfoHistory_h
+
+#include "LibTeleinfo.h"
+
+// Each tracked label takes 70 bytes plus 4 bytes per frame and 2 bytes
+// per minute kept, all in the object. With 2 labels the defaults hold
+// 9.1 KB (10 min of frames, 24 h of minutes), too much beside WiFi on an
+// ESP8266 which keeps 3.2 KB (5 min of frames, 6 h of minutes). Build
+// flags can set other sizes
+
+// Labels that can be tracked
+#ifndef TINFO_HISTORY_LABELS
+#define TINFO_HISTORY_LABELS    2
+#endif
+
+// Frames values kept per label, about 10 min (5 min on ESP8266)
+#ifndef TINFO_HISTORY_FRAMES
+#ifdef ESP8266
+#define TINFO_HISTORY_FRAMES    200
+#else
+#define TINFO_HISTORY_FRAMES    400
+#endif
+#endif
+
+// One minute means kept per label, 24 h (6 h on ESP8266)
+#ifndef TINFO_HISTORY_MINUTES
+#ifdef ESP8266
+#define TINFO_HISTORY_MINUTES   360
+#else
+#define TINFO_HISTORY_MINUTES   1440
+#endif
+#endif
+
+#define TINFO_HISTORY_MINUTE    60000UL   // ms
+#define TINFO_HISTORY_GAP       INT16_MIN // no frame during this minute
+#define TINFO_HISTORY_DELTA_MAX 32767
+
+// Streaming parts
+enum _History_e {
+  TINFO_HISTORY_HEAD,
+  TINFO_HISTORY_FRAME,
+  TINFO_HISTORY_MINUTES_HEAD,
+  TINFO_HISTORY_MINUTE_VALUE,
+  TINFO_HISTORY_TAIL,
+  TINFO_HISTORY_DONE
+};
+
+// Ring of deltas, values of oldest and newest are kept in full
+typedef struct
+{
+  int32_t  first;    // oldest value
+  int32_t  last;     // newest value
+  uint32_t first_t;  // oldest time (ms)
+  uint32_t last_t;   // newest time (ms)
+  uint16_t tail;     // oldest entry
+  uint16_t count;    // entries in ring
+} _TInfoRing;
+
+// One tracked label
+typedef struct
+{
+  char       name[TINFO_NAME_SIZE];
+  _TInfoRing frames;
+  _TInfoRing minutes;
+  uint32_t   minute_t;  // current minute start (ms)
+  int64_t    sum;       // current minute values total
+  uint16_t   samples;   // current minute values
+} _TInfoTrack;
+
+// Position when streaming a label history
+typedef struct
+{
+  int8_t     slot;
+  _History_e part;
+  uint16_t   index;   // entries sent in current part
+  uint16_t   pos;     // ring position of next entry
+  int32_t    value;   // value of last entry sent
+  uint32_t   t;       // time of last entry sent
+} _TInfoHistoryCursor;
+
+class TInfoHistory
+{
+  public:
+    TInfoHistory();
+    void     init(void);
+    int8_t   track(const char * name);
+    int8_t   find(const char * name);
+    void     frame(ValueList * me, uint32_t t);
+    boolean  open(const char * name, _TInfoHistoryCursor * c);
+    size_t   render(_TInfoHistoryCursor * c, char * buf, size_t size);
+
+  private:
+    void     push(_TInfoRing * r, int16_t * dv, uint16_t * dt, uint16_t size, int32_t v, uint32_t t, boolean gap);
+    void     sample(uint8_t slot, int32_t v, uint32_t t);
+    boolean  renderItem(_TInfoHistoryCursor * c, char * item, size_t size);
+
+    _TInfoTrack _tracks[TINFO_HISTORY_LABELS];
+    uint8_t     _count;
+
+    // Rings storage, deltas from previous entry
+    int16_t     _frame_dv[TINFO_HISTORY_LABELS][TINFO_HISTORY_FRAMES];
+    uint16_t    _frame_dt[TINFO_HISTORY_LABELS][TINFO_HISTORY_FRAMES];
+    int16_t     _minute_dv[TINFO_HISTORY_LABELS][TINFO_HISTORY_MINUTES];
+};
+
+#endif
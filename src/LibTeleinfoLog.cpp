@@ -0,0 +1,299 @@
+// **********************************************************************************
+// Teleinfo sketch log transport
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#include "LibTeleinfoLog.h"
+
+/* ======================================================================
+Class   : TInfoLog
+Purpose : Constructor
+Input   : -
+Output  : -
+Comments: nothing is sent until init()
+====================================================================== */
+TInfoLog::TInfoLog()
+{
+  _fn_clock = NULL;
+  _fn_send = NULL;
+  _interval = 0;
+  _rate = 0;
+  _burst = 0;
+  _tokens = 0;
+  _refill = 0;
+  clear();
+  memset(&_stats, 0, sizeof(_stats));
+}
+
+/* ======================================================================
+Function: init
+Purpose : set clock, send function and flush interval
+Input   : clock in ms (millis() on Arduino)
+          function sending one datagram, buffer is NULL terminated,
+          returns false if it could not be sent
+          ms between two datagrams
+Output  : -
+Comments: ring and counters are cleared, no rate limit
+====================================================================== */
+void TInfoLog::init(uint32_t (*fn_clock)(void), boolean (*fn_send)(const char * buf, size_t len), uint32_t interval)
+{
+  _fn_clock = fn_clock;
+  _fn_send = fn_send;
+  _interval = interval;
+  _rate = 0;
+  clear();
+  memset(&_stats, 0, sizeof(_stats));
+}
+
+/* ======================================================================
+Function: setRate
+Purpose : limit the lines accepted
+Input   : lines per second, 0 for no limit
+          lines accepted at once after a quiet time
+Output  : -
+Comments: start lines of a sketch should fit in burst
+====================================================================== */
+void TInfoLog::setRate(uint16_t rate, uint16_t burst)
+{
+  _rate = rate;
+  _burst = burst;
+  _tokens = burst;
+  _refill = _fn_clock ? _fn_clock() : 0;
+}
+
+/* ======================================================================
+Function: clear
+Purpose : empty the ring
+Input   : -
+Output  : -
+Comments: counters are kept
+====================================================================== */
+void TInfoLog::clear(void)
+{
+  _head = 0;
+  _tail = 0;
+  _used = 0;
+  _open = 0;
+  _lines = 0;
+  _dropping = false;
+  _cut = false;
+  _has_sent = false;
+}
+
+/* ======================================================================
+Function: getStats
+Purpose : get counters
+Input   : counters filled
+Output  : -
+Comments: -
+====================================================================== */
+void TInfoLog::getStats(TInfoLogStats * stats)
+{
+  *stats = _stats;
+}
+
+/* ======================================================================
+Function: pending
+Purpose : lines waiting to be sent
+Input   : -
+Output  : ended lines in ring
+Comments: -
+====================================================================== */
+uint16_t TInfoLog::pending(void)
+{
+  return _lines;
+}
+
+/* ======================================================================
+Function: token
+Purpose : take a line from rate limit
+Input   : -
+Output  : false if line is over the rate
+Comments: tokens are added at rate per second, up to burst
+====================================================================== */
+boolean TInfoLog::token(void)
+{
+  uint32_t now;
+  uint32_t add;
+
+  if (!_rate || !_fn_clock)
+    return true;
+
+  now = _fn_clock();
+  add = (uint32_t) ((uint64_t) (now - _refill) * _rate / 1000);
+  if (add) {
+    if ((uint32_t) _tokens + add >= _burst) {
+      _tokens = _burst;
+      _refill = now;
+    } else {
+      _tokens += add;
+      _refill += (uint32_t) ((uint64_t) add * 1000 / _rate);
+    }
+  }
+
+  if (!_tokens)
+    return false;
+
+  _tokens--;
+  return true;
+}
+
+/* ======================================================================
+Function: rollback
+Purpose : remove current line from ring
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+void TInfoLog::rollback(void)
+{
+  _head = (_head + TINFO_LOG_SIZE - _open) % TINFO_LOG_SIZE;
+  _used -= _open;
+  _open = 0;
+  _cut = false;
+}
+
+/* ======================================================================
+Function: write
+Purpose : add a char to current line
+Input   : char
+Output  : -
+Comments: LF ends the line, other control chars are sent as space,
+          empty lines are ignored
+====================================================================== */
+void TInfoLog::write(char c)
+{
+  // Line lost, skip until its end
+  if (_dropping) {
+    if (c == '\n')
+      _dropping = false;
+    return;
+  }
+
+  if (c == '\n') {
+    if (!_open)
+      return;
+
+    if (!token()) {
+      _stats.limited++;
+      rollback();
+      return;
+    }
+
+    // LF is kept in ring as line separator, its place is always free
+    _ring[_head] = '\n';
+    _head = (_head + 1) % TINFO_LOG_SIZE;
+    _used++;
+    if (_cut)
+      _stats.truncated++;
+    _open = 0;
+    _cut = false;
+    _lines++;
+    _stats.lines++;
+    return;
+  }
+
+  if (_open >= TINFO_LOG_LINE) {
+    _cut = true;
+    return;
+  }
+
+  // Keep a place for the LF
+  if (_used + 2 > TINFO_LOG_SIZE) {
+    _stats.dropped++;
+    rollback();
+    _dropping = true;
+    return;
+  }
+
+  if ((uint8_t) c < ' ')
+    c = ' ';
+
+  _ring[_head] = c;
+  _head = (_head + 1) % TINFO_LOG_SIZE;
+  _used++;
+  _open++;
+}
+
+/* ======================================================================
+Function: write
+Purpose : add a string to current line
+Input   : string, may contain several lines
+Output  : -
+Comments: never waits, chars are only copied
+====================================================================== */
+void TInfoLog::write(const char * msg)
+{
+  while (*msg)
+    write(*msg++);
+}
+
+/* ======================================================================
+Function: flush
+Purpose : send a datagram with the oldest lines
+Input   : -
+Output  : payload size sent, 0 if nothing was sent
+Comments: at most one datagram per interval, lines are separated by LF,
+          they stay in ring if the send function fails
+====================================================================== */
+size_t TInfoLog::flush(void)
+{
+  uint32_t now;
+  uint16_t pos;
+  uint16_t len = 0;
+  uint16_t line;
+  uint16_t n;
+  uint16_t lines = 0;
+
+  if (!_lines || !_fn_send)
+    return 0;
+
+  now = _fn_clock ? _fn_clock() : 0;
+  if (_has_sent && (uint32_t) (now - _sent) < _interval)
+    return 0;
+
+  // Whole lines while they fit, a line always fits alone
+  pos = _tail;
+  while (lines < _lines) {
+    line = 0;
+    while (_ring[(pos + line) % TINFO_LOG_SIZE] != '\n')
+      line++;
+
+    n = len ? len + 1 + line : line;
+    if (n > TINFO_LOG_BATCH - 1)
+      break;
+
+    if (len)
+      _batch[len++] = '\n';
+    for (uint16_t i = 0; i < line; i++)
+      _batch[len++] = _ring[(pos + i) % TINFO_LOG_SIZE];
+
+    pos = (pos + line + 1) % TINFO_LOG_SIZE;
+    lines++;
+  }
+  _batch[len] = '\0';
+
+  _sent = now;
+  _has_sent = true;
+
+  if (!_fn_send(_batch, len)) {
+    _stats.errors++;
+    return 0;
+  }
+
+  _used -= (pos + TINFO_LOG_SIZE - _tail) % TINFO_LOG_SIZE;
+  _tail = pos;
+  _lines -= lines;
+  _stats.datagrams++;
+  _stats.bytes += len;
+  return len;
+}
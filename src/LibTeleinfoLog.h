@@ -0,0 +1,89 @@
+// **********************************************************************************
+// Teleinfo sketch log transport include file
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// Debug lines are copied in a fixed ring and sent later, several lines per
+// datagram, by flush() called from the sketch loop. Writing never waits nor
+// allocates: when the ring is full or lines come faster than the rate limit
+// the new line is dropped and counted. The clock and the send function are
+// given by the sketch (syslog over WiFiUDP on the ESP, a UDP socket on a host)
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#ifndef LibTeleinfoLog_h
+#define LibTeleinfoLog_h
+
+#include "LibTeleinfo.h"
+
+// Ring of lines waiting to be sent (chars)
+#ifndef TINFO_LOG_SIZE
+#define TINFO_LOG_SIZE    2048
+#endif
+
+// Datagram payload, several lines separated by LF (chars)
+#ifndef TINFO_LOG_BATCH
+#define TINFO_LOG_BATCH   480
+#endif
+
+// Longer lines are truncated so a line always fits in a datagram
+#define TINFO_LOG_LINE    (TINFO_LOG_BATCH - 1)
+
+// Counters
+typedef struct
+{
+  uint32_t lines;       // lines accepted in the ring
+  uint32_t datagrams;   // datagrams sent
+  uint32_t bytes;       // payload bytes sent
+  uint32_t dropped;     // lines lost, ring full
+  uint32_t limited;     // lines lost, rate limit
+  uint32_t truncated;   // lines cut to TINFO_LOG_LINE
+  uint32_t errors;      // send failed, lines kept for next flush
+} TInfoLogStats;
+
+class TInfoLog
+{
+  public:
+    TInfoLog();
+    void     init(uint32_t (*fn_clock)(void), boolean (*fn_send)(const char * buf, size_t len), uint32_t interval);
+    void     setRate(uint16_t rate, uint16_t burst);
+    void     write(const char * msg);
+    void     write(char c);
+    size_t   flush(void);
+    uint16_t pending(void);
+    void     clear(void);
+    void     getStats(TInfoLogStats * stats);
+
+  private:
+    boolean  token(void);
+    void     rollback(void);
+
+    uint32_t (*_fn_clock)(void);
+    boolean  (*_fn_send)(const char * buf, size_t len);
+    char     _ring[TINFO_LOG_SIZE];
+    char     _batch[TINFO_LOG_BATCH];
+    uint16_t _head;       // next char written
+    uint16_t _tail;       // next char sent
+    uint16_t _used;       // chars in ring, current line included
+    uint16_t _open;       // chars of current line, not ended by LF yet
+    uint16_t _lines;      // ended lines in ring
+    boolean  _dropping;   // current line is lost, wait for its LF
+    boolean  _cut;        // current line has been truncated
+    uint32_t _interval;   // ms between two datagrams
+    uint32_t _sent;       // clock of last datagram
+    boolean  _has_sent;   // _sent is set
+    uint16_t _rate;       // lines per second, 0 for no limit
+    uint16_t _burst;      // lines that can be sent at once
+    uint16_t _tokens;     // lines that can be accepted now
+    uint32_t _refill;     // clock tokens have been added up to
+    TInfoLogStats _stats;
+};
+
+#endif
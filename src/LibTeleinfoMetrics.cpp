@@ -0,0 +1,262 @@
+// **********************************************************************************
+// Teleinfo OpenMetrics
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#include "LibTeleinfoMetrics.h"
+#include <stddef.h>
+
+// Decoder counters, in TInfoStats order
+static const struct
+{
+  const char * name;
+  const char * help;
+  size_t       offset;
+} metrics_stats[] = {
+  { "teleinfo_bytes",          "Chars received",                         offsetof(TInfoStats, bytes)    },
+  { "teleinfo_frames",         "Frames complete",                        offsetof(TInfoStats, frames)   },
+  { "teleinfo_frames_aborted", "Frames started again before their end",  offsetof(TInfoStats, aborted)  },
+  { "teleinfo_groups",         "Good groups",                            offsetof(TInfoStats, groups)   },
+  { "teleinfo_checksum_errors","Groups with bad checksum",               offsetof(TInfoStats, checksum) },
+  { "teleinfo_overflows",      "Groups too long for the buffer",         offsetof(TInfoStats, overflow) },
+  { "teleinfo_table_full",     "Labels lost, table full",                offsetof(TInfoStats, full)     },
+  { "teleinfo_unknown_groups", "Good checksum but bad label or fields",  offsetof(TInfoStats, unknown)  },
+  { "teleinfo_resyncs",        "Damaged groups dropped at next LF",      offsetof(TInfoStats, resync)   },
+  { "teleinfo_recovered_groups","Good groups after a resync in a frame", offsetof(TInfoStats, recovered)},
+};
+
+#define METRICS_STATS (sizeof(metrics_stats) / sizeof(metrics_stats[0]))
+
+/* ======================================================================
+Class   : TInfoMetrics
+Purpose : Constructor
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+TInfoMetrics::TInfoMetrics()
+{
+  _tinfo = NULL;
+  _framed = false;
+  _frame_t = 0;
+  _loops = 0;
+  _loop_sum = 0;
+  _loop_max = 0;
+}
+
+/* ======================================================================
+Function: init
+Purpose : set the decoder to read labels and counters from
+Input   : TInfo object
+Output  : -
+Comments: -
+====================================================================== */
+void TInfoMetrics::init(TInfo * tinfo)
+{
+  _tinfo = tinfo;
+  _framed = false;
+  _loops = 0;
+  _loop_sum = 0;
+  _loop_max = 0;
+}
+
+/* ======================================================================
+Function: frame
+Purpose : note a frame has been received
+Input   : time (ms)
+Output  : -
+Comments: should be called from new and updated frame callbacks
+====================================================================== */
+void TInfoMetrics::frame(uint32_t t)
+{
+  _frame_t = t;
+  _framed = true;
+}
+
+/* ======================================================================
+Function: loop
+Purpose : count the duration of a main loop
+Input   : duration (us)
+Output  : -
+Comments: max is the one since last scrape
+====================================================================== */
+void TInfoMetrics::loop(uint32_t us)
+{
+  _loops++;
+  _loop_sum += us;
+  if (us > _loop_max)
+    _loop_max = us;
+}
+
+/* ======================================================================
+Function: open
+Purpose : start streaming metrics
+Input   : cursor filled, time of the scrape (ms)
+Output  : -
+Comments: counters are taken now so a scrape is consistent, loop max
+          starts again for next scrape
+====================================================================== */
+void TInfoMetrics::open(_TInfoMetricsCursor * c, uint32_t now)
+{
+  c->part = TINFO_METRICS_STATS;
+  c->index = 0;
+  c->me = _tinfo ? _tinfo->getList() : NULL;
+  c->now = now;
+  c->loops = _loops;
+  c->loop_sum = _loop_sum;
+  c->loop_max = _loop_max;
+
+  if (_tinfo)
+    _tinfo->getStats(&c->stats);
+  else
+    memset(&c->stats, 0, sizeof(c->stats));
+
+  _loop_max = 0;
+}
+
+/* ======================================================================
+Function: number
+Purpose : check a label value is a number that fits a gauge
+Input   : value, number filled
+Output  : true if value is only digits
+Comments: meter ids (12 digits) are not numbers there
+====================================================================== */
+boolean TInfoMetrics::number(const char * value, unsigned long * v)
+{
+  const char * p = value;
+
+  while (*p >= '0' && *p <= '9')
+    p++;
+
+  if (p == value || *p || p - value > 10)
+    return false;
+
+  *v = strtoul(value, NULL, 10);
+  return true;
+}
+
+/* ======================================================================
+Function: renderItem
+Purpose : render next metric
+Input   : cursor, item buffer and its size
+Output  : false if metrics are done
+Comments: cursor is moved to next item, an empty item is possible
+====================================================================== */
+boolean TInfoMetrics::renderItem(_TInfoMetricsCursor * c, char * item, size_t size)
+{
+  ValueList * me;
+  unsigned long v;
+  uint32_t age;
+
+  *item = '\0';
+
+  switch (c->part) {
+    case TINFO_METRICS_STATS:
+      snprintf(item, size, "# TYPE %s counter\n# HELP %s %s\n%s_total %lu\n",
+               metrics_stats[c->index].name,
+               metrics_stats[c->index].name, metrics_stats[c->index].help,
+               metrics_stats[c->index].name,
+               (unsigned long) *(const uint32_t *) ((const char *) &c->stats + metrics_stats[c->index].offset));
+      if (++c->index == METRICS_STATS)
+        c->part = TINFO_METRICS_FRAME;
+      break;
+
+    // Family without sample until first frame
+    case TINFO_METRICS_FRAME:
+      age = c->now - _frame_t;
+      if (_framed)
+        snprintf(item, size, "# TYPE teleinfo_frame_age_seconds gauge\n"
+                             "teleinfo_frame_age_seconds %lu.%03lu\n",
+                 (unsigned long) (age / 1000), (unsigned long) (age % 1000));
+      else
+        snprintf(item, size, "# TYPE teleinfo_frame_age_seconds gauge\n");
+      c->part = TINFO_METRICS_LOOP;
+      break;
+
+    case TINFO_METRICS_LOOP:
+      if (c->loops)
+        snprintf(item, size, "# TYPE teleinfo_loop_seconds summary\n"
+                             "teleinfo_loop_seconds_count %lu\n"
+                             "teleinfo_loop_seconds_sum %lu.%06lu\n"
+                             "# TYPE teleinfo_loop_max_seconds gauge\n"
+                             "teleinfo_loop_max_seconds %lu.%06lu\n",
+                 (unsigned long) c->loops,
+                 (unsigned long) (c->loop_sum / 1000000), (unsigned long) (c->loop_sum % 1000000),
+                 (unsigned long) (c->loop_max / 1000000), (unsigned long) (c->loop_max % 1000000));
+      c->part = TINFO_METRICS_VALUES_HEAD;
+      break;
+
+    case TINFO_METRICS_VALUES_HEAD:
+      snprintf(item, size, "# TYPE teleinfo_value gauge\n"
+                           "# HELP teleinfo_value Numeric value of a label\n");
+      c->part = TINFO_METRICS_VALUE;
+      break;
+
+    // Only numeric ones, one label per item
+    case TINFO_METRICS_VALUE:
+      me = c->me;
+      if (!me) {
+        c->part = TINFO_METRICS_EOF;
+        break;
+      }
+      c->me = me->next;
+      if (!me->free && *me->name && number(me->value, &v))
+        snprintf(item, size, "teleinfo_value{label=\"%s\"} %lu\n", me->name, v);
+      break;
+
+    case TINFO_METRICS_EOF:
+      snprintf(item, size, "# EOF\n");
+      c->part = TINFO_METRICS_DONE;
+      break;
+
+    default:
+      return false;
+  }
+
+  return true;
+}
+
+/* ======================================================================
+Function: render
+Purpose : render metrics, a buffer at a time
+Input   : cursor set by open(), buffer and its size
+Output  : number of chars written, 0 when metrics are done
+Comments: call it until it returns 0 and send each buffer
+====================================================================== */
+size_t TInfoMetrics::render(_TInfoMetricsCursor * c, char * buf, size_t size)
+{
+  _TInfoMetricsCursor next;
+  char item[256];
+  size_t len = 0;
+  size_t n;
+
+  if (!size)
+    return 0;
+
+  for (;;) {
+    next = *c;
+    if (!renderItem(&next, item, sizeof(item)))
+      break;
+
+    // Keep item for next buffer
+    n = strlen(item);
+    if (len + n >= size)
+      break;
+
+    memcpy(buf + len, item, n);
+    len += n;
+    *c = next;
+  }
+
+  buf[len] = '\0';
+  return len;
+}
@@ -0,0 +1,73 @@
+// **********************************************************************************
+// Teleinfo OpenMetrics include file
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// Renders decoder counters, numeric labels, age of last frame and loop
+// timings in OpenMetrics text format (Prometheus /metrics). Labels are read
+// straight from the TInfo table and written in the caller buffer, a buffer
+// at a time, so nothing is allocated whatever the number of labels
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#ifndef LibTeleinfoMetrics_h
+#define LibTeleinfoMetrics_h
+
+#include "LibTeleinfo.h"
+
+#define TINFO_METRICS_TYPE  "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+// Streaming parts
+enum _Metrics_e {
+  TINFO_METRICS_STATS,
+  TINFO_METRICS_FRAME,
+  TINFO_METRICS_LOOP,
+  TINFO_METRICS_VALUES_HEAD,
+  TINFO_METRICS_VALUE,
+  TINFO_METRICS_EOF,
+  TINFO_METRICS_DONE
+};
+
+// Position when streaming metrics
+typedef struct
+{
+  _Metrics_e  part;
+  uint8_t     index;    // counter sent in current part
+  ValueList * me;       // next label to send
+  uint32_t    now;      // time of the scrape (ms)
+  TInfoStats  stats;    // counters at the time of the scrape
+  uint32_t    loops;    // loop timings at the time of the scrape
+  uint64_t    loop_sum; // us
+  uint32_t    loop_max; // us
+} _TInfoMetricsCursor;
+
+class TInfoMetrics
+{
+  public:
+    TInfoMetrics();
+    void     init(TInfo * tinfo);
+    void     frame(uint32_t t);
+    void     loop(uint32_t us);
+    void     open(_TInfoMetricsCursor * c, uint32_t now);
+    size_t   render(_TInfoMetricsCursor * c, char * buf, size_t size);
+
+  private:
+    boolean  renderItem(_TInfoMetricsCursor * c, char * item, size_t size);
+    boolean  number(const char * value, unsigned long * v);
+
+    TInfo *  _tinfo;
+    boolean  _framed;       // a frame has been received
+    uint32_t _frame_t;      // last frame (ms)
+    uint32_t _loops;        // loops timed
+    uint64_t _loop_sum;     // us
+    uint32_t _loop_max;     // us, since last scrape
+};
+
+#endif
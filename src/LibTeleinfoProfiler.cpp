@@ -0,0 +1,234 @@
+// **********************************************************************************
+// Teleinfo sketch main loop profiler
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#include "LibTeleinfoProfiler.h"
+
+/* ======================================================================
+Class   : TInfoProfiler
+Purpose : Constructor
+Input   : -
+Output  : -
+Comments: no task, no clock
+====================================================================== */
+TInfoProfiler::TInfoProfiler()
+{
+  _fn_clock = NULL;
+  _count = 0;
+  _fill = 0;
+  clear();
+}
+
+/* ======================================================================
+Function: init
+Purpose : set line speed, receive buffer and clock
+Input   : serial speed (bps), receive buffer size (chars),
+          clock in us (micros() on Arduino)
+Output  : -
+Comments: tasks are removed
+====================================================================== */
+void TInfoProfiler::init(uint32_t baud, uint16_t rxsize, uint32_t (*fn_clock)(void))
+{
+  _fn_clock = fn_clock;
+  _count = 0;
+  _fill = baud ? (uint32_t) ((uint64_t) rxsize * TINFO_PROFILE_CHAR_BITS * 1000000UL / baud) : 0;
+  clear();
+}
+
+/* ======================================================================
+Function: clear
+Purpose : reset all times
+Input   : -
+Output  : -
+Comments: tasks are kept
+====================================================================== */
+void TInfoProfiler::clear(void)
+{
+  for (uint8_t i = 0; i < TINFO_PROFILE_TASKS; i++) {
+    _tasks[i].count = 0;
+    _tasks[i].max = 0;
+    _tasks[i].total = 0;
+  }
+  _draining = false;
+  _gap_max = 0;
+  _overflows = 0;
+}
+
+/* ======================================================================
+Function: task
+Purpose : add a task to time
+Input   : task name (must stay in memory)
+Output  : task id, -1 if TINFO_PROFILE_TASKS are used
+Comments: -
+====================================================================== */
+int8_t TInfoProfiler::task(const char * name)
+{
+  if (_count >= TINFO_PROFILE_TASKS)
+    return -1;
+
+  _tasks[_count].name = name;
+  _tasks[_count].count = 0;
+  _tasks[_count].max = 0;
+  _tasks[_count].total = 0;
+  return _count++;
+}
+
+/* ======================================================================
+Function: begin
+Purpose : a task starts
+Input   : task id
+Output  : -
+Comments: -
+====================================================================== */
+void TInfoProfiler::begin(int8_t task)
+{
+  if (task >= 0 && task < _count && _fn_clock)
+    _start[task] = _fn_clock();
+}
+
+/* ======================================================================
+Function: end
+Purpose : a task ends, count its time
+Input   : task id
+Output  : -
+Comments: -
+====================================================================== */
+void TInfoProfiler::end(int8_t task)
+{
+  _TInfoProfileTask * k;
+  uint32_t t;
+
+  if (task < 0 || task >= _count || !_fn_clock)
+    return;
+
+  k = &_tasks[task];
+  t = _fn_clock() - _start[task];
+  k->count++;
+  k->total += t;
+  if (t > k->max)
+    k->max = t;
+}
+
+/* ======================================================================
+Function: drain
+Purpose : note the serial receive buffer is empty
+Input   : -
+Output  : -
+Comments: call it each time the sketch sees no char available, the time
+          since previous call is how long chars have been waiting
+====================================================================== */
+void TInfoProfiler::drain(void)
+{
+  uint32_t now;
+  uint32_t gap;
+
+  if (!_fn_clock)
+    return;
+
+  now = _fn_clock();
+  if (_draining) {
+    gap = now - _drained;
+    if (gap > _gap_max)
+      _gap_max = gap;
+    if (_fill && gap > _fill)
+      _overflows++;
+  }
+
+  _drained = now;
+  _draining = true;
+}
+
+/* ======================================================================
+Function: overflow
+Purpose : receive buffer may have overflowed
+Input   : -
+Output  : true if a gap was longer than buffer fill time
+Comments: the meter does not always send, so it is a possibility only
+====================================================================== */
+boolean TInfoProfiler::overflow(void)
+{
+  return _overflows != 0;
+}
+
+/* ======================================================================
+Function: gapMax
+Purpose : longest time between two empty receive buffer
+Input   : -
+Output  : us
+Comments: -
+====================================================================== */
+uint32_t TInfoProfiler::gapMax(void)
+{
+  return _gap_max;
+}
+
+/* ======================================================================
+Function: fillTime
+Purpose : time to fill the receive buffer at line speed
+Input   : -
+Output  : us
+Comments: -
+====================================================================== */
+uint32_t TInfoProfiler::fillTime(void)
+{
+  return _fill;
+}
+
+/* ======================================================================
+Function: get
+Purpose : times of a task
+Input   : task id
+Output  : task times or NULL
+Comments: -
+====================================================================== */
+_TInfoProfileTask * TInfoProfiler::get(int8_t task)
+{
+  return task >= 0 && task < _count ? &_tasks[task] : NULL;
+}
+
+/* ======================================================================
+Function: json
+Purpose : render times in JSON
+Input   : buffer and its size
+Output  : number of chars written, 0 if buffer is too small
+Comments: {"gap_max":us,"fill":us,"overflows":n,"tasks":{"name":
+          {"count":n,"max":us,"avg":us},...}}
+====================================================================== */
+size_t TInfoProfiler::json(char * buf, size_t size)
+{
+  _TInfoProfileTask * k;
+  size_t len;
+  int n;
+
+  n = snprintf(buf, size, "{\"gap_max\":%lu,\"fill\":%lu,\"overflows\":%lu,\"tasks\":{",
+               (unsigned long) _gap_max, (unsigned long) _fill, (unsigned long) _overflows);
+  if (n < 0 || (size_t) n >= size)
+    return 0;
+  len = n;
+
+  for (uint8_t i = 0; i < _count; i++) {
+    k = &_tasks[i];
+    n = snprintf(buf + len, size - len, "%s\"%s\":{\"count\":%lu,\"max\":%lu,\"avg\":%lu}",
+                 i ? "," : "", k->name, (unsigned long) k->count, (unsigned long) k->max,
+                 (unsigned long) (k->count ? k->total / k->count : 0));
+    if (n < 0 || (size_t) n >= size - len)
+      return 0;
+    len += n;
+  }
+
+  n = snprintf(buf + len, size - len, "}}");
+  if (n < 0 || (size_t) n >= size - len)
+    return 0;
+
+  return len + n;
+}
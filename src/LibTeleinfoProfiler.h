@@ -0,0 +1,71 @@
+// **********************************************************************************
+// Teleinfo sketch main loop profiler include file
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// Times the tasks of a sketch loop (web server, posts, teleinfo...) and the
+// gaps between two moments the serial receive buffer was empty. A gap longer
+// than the time the meter needs to fill the buffer means chars may have been
+// lost. The clock is given by the sketch (micros() on the ESP), so the
+// profiler can run on a host with a fake clock
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#ifndef LibTeleinfoProfiler_h
+#define LibTeleinfoProfiler_h
+
+#include "LibTeleinfo.h"
+
+// Tasks that can be timed
+#ifndef TINFO_PROFILE_TASKS
+#define TINFO_PROFILE_TASKS   8
+#endif
+
+// Bits of a teleinfo char, 7E1 : start, 7 data, parity, stop
+#define TINFO_PROFILE_CHAR_BITS 10
+
+// One task times
+typedef struct
+{
+  const char * name;
+  uint32_t     count;
+  uint32_t     max;     // us
+  uint64_t     total;   // us
+} _TInfoProfileTask;
+
+class TInfoProfiler
+{
+  public:
+    TInfoProfiler();
+    void     init(uint32_t baud, uint16_t rxsize, uint32_t (*fn_clock)(void));
+    int8_t   task(const char * name);
+    void     begin(int8_t task);
+    void     end(int8_t task);
+    void     drain(void);
+    boolean  overflow(void);
+    uint32_t gapMax(void);
+    uint32_t fillTime(void);
+    _TInfoProfileTask * get(int8_t task);
+    size_t   json(char * buf, size_t size);
+    void     clear(void);
+
+  private:
+    uint32_t (*_fn_clock)(void);
+    _TInfoProfileTask _tasks[TINFO_PROFILE_TASKS];
+    uint32_t _start[TINFO_PROFILE_TASKS];
+    uint8_t  _count;
+    uint32_t _fill;       // us to fill receive buffer at line speed
+    uint32_t _drained;    // last time receive buffer was empty (us)
+    boolean  _draining;   // _drained is set
+    uint32_t _gap_max;    // us
+    uint32_t _overflows;  // gaps longer than _fill
+};
+
+#endif
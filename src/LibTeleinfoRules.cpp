@@ -0,0 +1,252 @@
+// **********************************************************************************
+// Teleinfo rules engine
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#include "LibTeleinfoRules.h"
+
+/* ======================================================================
+Class   : TInfoRules
+Purpose : Constructor
+Input   : -
+Output  : -
+Comments: no rule
+====================================================================== */
+TInfoRules::TInfoRules()
+{
+  _rules = NULL;
+  _count = 0;
+  _nlinks = 0;
+  _pending = 0;
+  _fn_rule = NULL;
+  memset(_buckets, 0, sizeof(_buckets));
+}
+
+/* ======================================================================
+Function: init
+Purpose : set the rules table and index it by labels
+Input   : rules table (must stay in memory), number of rules
+          callback when a rule becomes active or is released
+Output  : rules used, at most TINFO_RULES_MAX
+Comments: -
+====================================================================== */
+uint8_t TInfoRules::init(const _TInfoRule * rules, uint8_t count, void (*fn_rule)(uint8_t rule, boolean active))
+{
+  if (count > TINFO_RULES_MAX)
+    count = TINFO_RULES_MAX;
+
+  _rules = rules;
+  _count = count;
+  _fn_rule = fn_rule;
+  _nlinks = 0;
+  _pending = 0;
+  memset(_buckets, 0, sizeof(_buckets));
+  memset(_states, 0, sizeof(_states));
+
+  for (uint8_t i = 0; i < _count; i++) {
+    link(_rules[i].name, i, false);
+    if (_rules[i].ref)
+      link(_rules[i].ref, i, true);
+  }
+
+  return _count;
+}
+
+/* ======================================================================
+Function: hash
+Purpose : index bucket of a label
+Input   : label name
+Output  : bucket
+Comments: -
+====================================================================== */
+uint8_t TInfoRules::hash(const char * name)
+{
+  uint8_t h = 0;
+
+  while (*name)
+    h = h * 31 + *name++;
+
+  return h & (TINFO_RULES_HASH - 1);
+}
+
+/* ======================================================================
+Function: link
+Purpose : add a rule to the index of a label
+Input   : label name, rule, true if label is the rule ref label
+Output  : -
+Comments: -
+====================================================================== */
+void TInfoRules::link(const char * name, uint8_t rule, uint8_t ref)
+{
+  uint8_t h = hash(name);
+
+  _links[_nlinks].rule = rule;
+  _links[_nlinks].ref = ref;
+  _links[_nlinks].next = _buckets[h];
+  _buckets[h] = ++_nlinks;
+}
+
+/* ======================================================================
+Function: fire
+Purpose : change the state of a rule and advertise it
+Input   : rule, new state
+Output  : -
+Comments: callback is only called when rule becomes active or released
+====================================================================== */
+void TInfoRules::fire(uint8_t rule, uint8_t state)
+{
+  uint8_t old = _states[rule].state;
+
+  _states[rule].state = state;
+
+  if (state == TINFO_RULE_PENDING)
+    _pending |= 1UL << rule;
+  else
+    _pending &= ~(1UL << rule);
+
+  if (_fn_rule) {
+    if (state == TINFO_RULE_ACTIVE)
+      _fn_rule(rule, true);
+    else if (old == TINFO_RULE_ACTIVE && state == TINFO_RULE_IDLE)
+      _fn_rule(rule, false);
+  }
+}
+
+/* ======================================================================
+Function: evaluate
+Purpose : check a threshold rule with its last values
+Input   : rule, time (ms)
+Output  : -
+Comments: -
+====================================================================== */
+void TInfoRules::evaluate(uint8_t rule, uint32_t t)
+{
+  const _TInfoRule * r = &_rules[rule];
+  _TInfoRuleState * s = &_states[rule];
+  int32_t limit;
+  boolean cond;
+
+  if (!(s->known & TINFO_RULE_KNOWN_VALUE))
+    return;
+  if (r->ref && !(s->known & TINFO_RULE_KNOWN_REF))
+    return;
+
+  limit = r->ref ? (int32_t) ((int64_t) s->ref * r->threshold / 1000) : r->threshold;
+
+  // Once true, condition stays true until hysteresis is passed
+  if (s->state == TINFO_RULE_IDLE) {
+    cond = r->op == TINFO_RULE_ABOVE ? s->value > limit : s->value < limit;
+  } else {
+    cond = r->op == TINFO_RULE_ABOVE ? s->value > limit - r->hysteresis
+                                     : s->value < limit + r->hysteresis;
+  }
+
+  if (!cond) {
+    if (s->state != TINFO_RULE_IDLE)
+      fire(rule, TINFO_RULE_IDLE);
+  } else if (s->state == TINFO_RULE_IDLE) {
+    s->since = t;
+    fire(rule, r->duration ? TINFO_RULE_PENDING : TINFO_RULE_ACTIVE);
+  } else if (s->state == TINFO_RULE_PENDING && (uint32_t) (t - s->since) >= r->duration) {
+    fire(rule, TINFO_RULE_ACTIVE);
+  }
+}
+
+/* ======================================================================
+Function: data
+Purpose : evaluate rules of a new or changed label
+Input   : label value, flags, time (ms) from a monotonic clock
+Output  : -
+Comments: should be called from the data callback set with
+          TInfo::attachData(), only rules using this label are evaluated
+====================================================================== */
+void TInfoRules::data(ValueList * me, uint8_t flags, uint32_t t)
+{
+  const _TInfoRule * r;
+  _TInfoRuleState * s;
+  _TInfoRuleLink * l;
+  uint8_t next;
+  char * end;
+  long v;
+  boolean number;
+
+  if (!me || !_count)
+    return;
+
+  v = strtol(me->value, &end, 10);
+  number = *me->value && *end == '\0';
+
+  for (next = _buckets[hash(me->name)]; next; next = l->next) {
+    l = &_links[next - 1];
+    r = &_rules[l->rule];
+    s = &_states[l->rule];
+
+    if (strcmp(l->ref ? r->ref : r->name, me->name))
+      continue;
+
+    // Any value change, first one is not a change
+    if (r->op == TINFO_RULE_CHANGED) {
+      if ((flags & TINFO_FLAGS_UPDATED) && _fn_rule)
+        _fn_rule(l->rule, true);
+      continue;
+    }
+
+    if (!number)
+      continue;
+
+    if (l->ref) {
+      s->ref = v;
+      s->known |= TINFO_RULE_KNOWN_REF;
+    } else {
+      s->value = v;
+      s->known |= TINFO_RULE_KNOWN_VALUE;
+    }
+
+    evaluate(l->rule, t);
+  }
+}
+
+/* ======================================================================
+Function: tick
+Purpose : activate rules whose condition lasted long enough
+Input   : time (ms) from a monotonic clock
+Output  : -
+Comments: should be called often (each second) since a steady label is
+          not sent to data() again
+====================================================================== */
+void TInfoRules::tick(uint32_t t)
+{
+  uint32_t pending = _pending;
+  uint8_t rule;
+
+  while (pending) {
+    // Lowest pending rule
+    for (rule = 0; !(pending & (1UL << rule)); rule++)
+      ;
+    pending &= ~(1UL << rule);
+
+    if ((uint32_t) (t - _states[rule].since) >= _rules[rule].duration)
+      fire(rule, TINFO_RULE_ACTIVE);
+  }
+}
+
+/* ======================================================================
+Function: state
+Purpose : current state of a rule
+Input   : rule
+Output  : TINFO_RULE_IDLE, TINFO_RULE_PENDING or TINFO_RULE_ACTIVE
+Comments: -
+====================================================================== */
+uint8_t TInfoRules::state(uint8_t rule)
+{
+  return rule < _count ? _states[rule].state : TINFO_RULE_IDLE;
+}
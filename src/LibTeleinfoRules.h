@@ -0,0 +1,105 @@
+// **********************************************************************************
+// Teleinfo rules engine include file
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// Rules are a constant table given by the sketch, such as "IINST above 90%
+// of ISOUSC for 5 s" or "PTEC changed". Rules are indexed by the labels
+// they use, so each changed label only evaluates its own rules, and tick()
+// only looks at rules waiting for their duration
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#ifndef LibTeleinfoRules_h
+#define LibTeleinfoRules_h
+
+#include "LibTeleinfo.h"
+
+// Rules in a table, pending ones are bits of a 32 bits mask
+#ifndef TINFO_RULES_MAX
+#define TINFO_RULES_MAX   16
+#endif
+#if TINFO_RULES_MAX > 32
+#error "TINFO_RULES_MAX can't be more than 32"
+#endif
+
+// Labels index buckets, power of 2
+#define TINFO_RULES_HASH  16
+
+// Rule comparators
+#define TINFO_RULE_ABOVE    0   // value > threshold
+#define TINFO_RULE_BELOW    1   // value < threshold
+#define TINFO_RULE_CHANGED  2   // value changed, threshold is not used
+
+// Rule states
+#define TINFO_RULE_IDLE     0
+#define TINFO_RULE_PENDING  1   // condition true, waiting for duration
+#define TINFO_RULE_ACTIVE   2
+
+// One rule, threshold is absolute, or in 1/1000 of the ref label value
+// Once active, it is released when value goes back past the threshold by
+// hysteresis. Duration is the time condition must be true to activate
+typedef struct
+{
+  const char * name;        // label tested
+  uint8_t      op;          // TINFO_RULE_xxx
+  int32_t      threshold;
+  const char * ref;         // NULL or label the threshold is relative to
+  int32_t      hysteresis;
+  uint32_t     duration;    // ms
+} _TInfoRule;
+
+// Rule state
+typedef struct
+{
+  int32_t  value;     // last value of label
+  int32_t  ref;       // last value of ref label
+  uint32_t since;     // condition true since (ms)
+  uint8_t  state;     // TINFO_RULE_xxx state
+  uint8_t  known;     // TINFO_RULE_KNOWN_xxx
+} _TInfoRuleState;
+
+#define TINFO_RULE_KNOWN_VALUE  0x01
+#define TINFO_RULE_KNOWN_REF    0x02
+
+// Label index entry, chained per bucket
+typedef struct
+{
+  uint8_t rule;
+  uint8_t next;     // next entry + 1, 0 for end of chain
+  uint8_t ref;      // true if label is the rule ref label
+} _TInfoRuleLink;
+
+class TInfoRules
+{
+  public:
+    TInfoRules();
+    uint8_t  init(const _TInfoRule * rules, uint8_t count, void (*fn_rule)(uint8_t rule, boolean active));
+    void     data(ValueList * me, uint8_t flags, uint32_t t);
+    void     tick(uint32_t t);
+    uint8_t  state(uint8_t rule);
+
+  private:
+    uint8_t  hash(const char * name);
+    void     link(const char * name, uint8_t rule, uint8_t ref);
+    void     evaluate(uint8_t rule, uint32_t t);
+    void     fire(uint8_t rule, uint8_t state);
+
+    const _TInfoRule * _rules;
+    uint8_t            _count;
+    _TInfoRuleState    _states[TINFO_RULES_MAX];
+    uint8_t            _buckets[TINFO_RULES_HASH];   // first entry + 1
+    _TInfoRuleLink     _links[TINFO_RULES_MAX * 2];
+    uint8_t            _nlinks;
+    uint32_t           _pending;                      // rules waiting
+    void             (*_fn_rule)(uint8_t rule, boolean active);
+};
+
+#endif
@@ -0,0 +1,589 @@
+// **********************************************************************************
+// Teleinfo control chars scanning
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// All chars are compared on 7 bits, as TInfo::process() does
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#include "LibTeleinfoScan.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define TINFO_SCAN_AVX2
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define TINFO_SCAN_NEON
+#endif
+
+// Prefix sums of a buffer block, for checksums of many groups
+#define TINFO_SCAN_BLOCK  256
+
+typedef size_t   (*_TInfoScanFn)(const char * buf, size_t len, char sep);
+typedef uint32_t (*_TInfoSumFn)(const char * buf, size_t len, size_t room);
+typedef void     (*_TInfoPrefixFn)(const char * buf, size_t len, uint8_t * pre);
+
+// Kernels for a CPU feature
+typedef struct
+{
+  const char *   name;
+  boolean        (*usable)(void);  // NULL if always usable
+  _TInfoScanFn   scan;
+  _TInfoSumFn    sum;
+  _TInfoPrefixFn prefix;
+} _TInfoKernel;
+
+// Kernel forced by tinfoScanSelect(), NULL for best one
+static const _TInfoKernel * _kernel_forced = NULL;
+
+/* ======================================================================
+Function: tinfoScanScalar
+Purpose : find first control char one byte at a time
+Input   : buffer, length, separator (never 0 there)
+Output  : offset of first control char, len if none
+Comments: reference version, all other kernels must give same result
+====================================================================== */
+static size_t tinfoScanScalar(const char * buf, size_t len, char sep)
+{
+  size_t i;
+  char c;
+
+  for (i = 0; i < len; i++) {
+    c = buf[i] & 0x7F;
+    if (c == TINFO_STX || c == TINFO_ETX || c == TINFO_SGR || c == TINFO_EGR || c == sep)
+      break;
+  }
+  return i;
+}
+
+/* ======================================================================
+Function: tinfoSumScalar
+Purpose : sum of 7 bits chars of a group one byte at a time
+Input   : buffer, length to sum, readable bytes from buf (not used, only
+          len bytes are read)
+Output  : sum of chars
+Comments: reference version, all other kernels must give same result
+====================================================================== */
+static uint32_t tinfoSumScalar(const char * buf, size_t len, size_t)
+{
+  uint32_t sum = 0;
+
+  while (len--)
+    sum += *buf++ & 0x7F;
+
+  return sum;
+}
+
+/* ======================================================================
+Function: tinfoPrefixScalar
+Purpose : running sum of 7 bits chars of a block one byte at a time
+Input   : buffer, length, table of len+1 sums, pre[0] is sum before block
+Output  : -
+Comments: pre[i] is sum of chars before buf[i] modulo 256, enough for a
+          checksum that keeps 6 bits. Reference version
+====================================================================== */
+static void tinfoPrefixScalar(const char * buf, size_t len, uint8_t * pre)
+{
+  for (size_t i = 0; i < len; i++)
+    pre[i+1] = pre[i] + (buf[i] & 0x7F);
+}
+
+#if defined(__SSE2__)
+/* ======================================================================
+Function: tinfoPrefixSSE2
+Purpose : running sum of 7 bits chars of a block 16 bytes at a time
+Input   : buffer, length, table of len+1 sums, pre[0] is sum before block
+Output  : -
+Comments: in register scan, each byte gets the sum of the 1, 2, 4 then 8
+          bytes before it, plus the sum before these 16 bytes
+====================================================================== */
+static void tinfoPrefixSSE2(const char * buf, size_t len, uint8_t * pre)
+{
+  const __m128i mask = _mm_set1_epi8(0x7F);
+  size_t i = 0;
+
+  for ( ; i + 16 <= len; i += 16) {
+    __m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i *) (buf + i)), mask);
+    v = _mm_add_epi8(v, _mm_slli_si128(v, 1));
+    v = _mm_add_epi8(v, _mm_slli_si128(v, 2));
+    v = _mm_add_epi8(v, _mm_slli_si128(v, 4));
+    v = _mm_add_epi8(v, _mm_slli_si128(v, 8));
+    v = _mm_add_epi8(v, _mm_set1_epi8((char) pre[i]));
+    _mm_storeu_si128((__m128i *) (pre + i + 1), v);
+  }
+
+  tinfoPrefixScalar(buf + i, len - i, pre + i);
+}
+
+/* ======================================================================
+Function: tinfoSumSSE2
+Purpose : sum of 7 bits chars of a group 16 bytes at a time
+Input   : buffer, length to sum, readable bytes from buf (>= len)
+Output  : sum of chars
+Comments: psadbw against zero gives the horizontal sum of 8 bytes, last
+          block is masked to the group length if it can be read
+====================================================================== */
+static uint32_t tinfoSumSSE2(const char * buf, size_t len, size_t room)
+{
+  const __m128i mask = _mm_set1_epi8(0x7F);
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i iota = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+  __m128i acc = zero;
+  size_t i = 0;
+
+  for ( ; i + 16 <= len; i += 16) {
+    __m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i *) (buf + i)), mask);
+    acc = _mm_add_epi64(acc, _mm_sad_epu8(v, zero));
+  }
+
+  if (i < len) {
+    if (i + 16 > room)
+      return tinfoSumScalar(buf + i, len - i, room - i) + _mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+
+    // keep only the bytes of the group
+    __m128i keep = _mm_cmplt_epi8(iota, _mm_set1_epi8((char) (len - i)));
+    __m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i *) (buf + i)), _mm_and_si128(mask, keep));
+    acc = _mm_add_epi64(acc, _mm_sad_epu8(v, zero));
+  }
+
+  return _mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+}
+
+/* ======================================================================
+Function: tinfoScanSSE2
+Purpose : find first control char 16 bytes at a time
+Input   : buffer, length, separator
+Output  : offset of first control char, len if none
+Comments: -
+====================================================================== */
+static size_t tinfoScanSSE2(const char * buf, size_t len, char sep)
+{
+  const __m128i mask = _mm_set1_epi8(0x7F);
+  const __m128i stx  = _mm_set1_epi8(TINFO_STX);
+  const __m128i etx  = _mm_set1_epi8(TINFO_ETX);
+  const __m128i sgr  = _mm_set1_epi8(TINFO_SGR);
+  const __m128i egr  = _mm_set1_epi8(TINFO_EGR);
+  const __m128i vsep = _mm_set1_epi8(sep);
+  size_t i = 0;
+
+  for ( ; i + 16 <= len; i += 16) {
+    __m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i *) (buf + i)), mask);
+    __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, stx), _mm_cmpeq_epi8(v, etx)),
+                             _mm_or_si128(_mm_cmpeq_epi8(v, sgr), _mm_cmpeq_epi8(v, egr)));
+    int bits = _mm_movemask_epi8(_mm_or_si128(m, _mm_cmpeq_epi8(v, vsep)));
+
+    if (bits)
+      return i + __builtin_ctz(bits);
+  }
+  return i + tinfoScanScalar(buf + i, len - i, sep);
+}
+#endif
+
+#ifdef TINFO_SCAN_AVX2
+/* ======================================================================
+Function: tinfoScanAVX2
+Purpose : find first control char 32 bytes at a time
+Input   : buffer, length, separator
+Output  : offset of first control char, len if none
+Comments: only called if CPU has AVX2
+====================================================================== */
+__attribute__((target("avx2")))
+static size_t tinfoScanAVX2(const char * buf, size_t len, char sep)
+{
+  const __m256i mask = _mm256_set1_epi8(0x7F);
+  const __m256i stx  = _mm256_set1_epi8(TINFO_STX);
+  const __m256i etx  = _mm256_set1_epi8(TINFO_ETX);
+  const __m256i sgr  = _mm256_set1_epi8(TINFO_SGR);
+  const __m256i egr  = _mm256_set1_epi8(TINFO_EGR);
+  const __m256i vsep = _mm256_set1_epi8(sep);
+  size_t i = 0;
+
+  for ( ; i + 32 <= len; i += 32) {
+    __m256i v = _mm256_and_si256(_mm256_loadu_si256((const __m256i *) (buf + i)), mask);
+    __m256i m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, stx), _mm256_cmpeq_epi8(v, etx)),
+                                _mm256_or_si256(_mm256_cmpeq_epi8(v, sgr), _mm256_cmpeq_epi8(v, egr)));
+    uint32_t bits = (uint32_t) _mm256_movemask_epi8(_mm256_or_si256(m, _mm256_cmpeq_epi8(v, vsep)));
+
+    if (bits)
+      return i + __builtin_ctz(bits);
+  }
+  return i + tinfoScanScalar(buf + i, len - i, sep);
+}
+#endif
+
+#ifdef TINFO_SCAN_AVX2
+/* ======================================================================
+Function: tinfoSumAVX2
+Purpose : sum of 7 bits chars of a group 32 bytes at a time
+Input   : buffer, length to sum, readable bytes from buf (>= len)
+Output  : sum of chars
+Comments: only called if CPU has AVX2
+====================================================================== */
+__attribute__((target("avx2")))
+static uint32_t tinfoSumAVX2(const char * buf, size_t len, size_t room)
+{
+  const __m256i mask = _mm256_set1_epi8(0x7F);
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i iota = _mm256_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+                                        16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31);
+  __m256i acc = zero;
+  __m128i sum;
+  uint32_t tail = 0;
+  size_t i = 0;
+
+  for ( ; i + 32 <= len; i += 32) {
+    __m256i v = _mm256_and_si256(_mm256_loadu_si256((const __m256i *) (buf + i)), mask);
+    acc = _mm256_add_epi64(acc, _mm256_sad_epu8(v, zero));
+  }
+
+  if (i < len) {
+    if (i + 32 > room) {
+      tail = tinfoSumScalar(buf + i, len - i, room - i);
+    } else {
+      // keep only the bytes of the group
+      __m256i keep = _mm256_cmpgt_epi8(_mm256_set1_epi8((char) (len - i)), iota);
+      __m256i v = _mm256_and_si256(_mm256_loadu_si256((const __m256i *) (buf + i)), _mm256_and_si256(mask, keep));
+      acc = _mm256_add_epi64(acc, _mm256_sad_epu8(v, zero));
+    }
+  }
+
+  sum = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+  return tail + _mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(sum, 8));
+}
+#endif
+
+#ifdef TINFO_SCAN_NEON
+/* ======================================================================
+Function: tinfoPrefixNEON
+Purpose : running sum of 7 bits chars of a block 16 bytes at a time
+Input   : buffer, length, table of len+1 sums, pre[0] is sum before block
+Output  : -
+Comments: same scan as SSE2, vext with zero shifts bytes up
+====================================================================== */
+static void tinfoPrefixNEON(const char * buf, size_t len, uint8_t * pre)
+{
+  const uint8x16_t mask = vdupq_n_u8(0x7F);
+  const uint8x16_t zero = vdupq_n_u8(0);
+  size_t i = 0;
+
+  for ( ; i + 16 <= len; i += 16) {
+    uint8x16_t v = vandq_u8(vld1q_u8((const uint8_t *) (buf + i)), mask);
+    v = vaddq_u8(v, vextq_u8(zero, v, 15));
+    v = vaddq_u8(v, vextq_u8(zero, v, 14));
+    v = vaddq_u8(v, vextq_u8(zero, v, 12));
+    v = vaddq_u8(v, vextq_u8(zero, v, 8));
+    v = vaddq_u8(v, vdupq_n_u8(pre[i]));
+    vst1q_u8(pre + i + 1, v);
+  }
+
+  tinfoPrefixScalar(buf + i, len - i, pre + i);
+}
+
+/* ======================================================================
+Function: tinfoSumNEON
+Purpose : sum of 7 bits chars of a group 16 bytes at a time
+Input   : buffer, length to sum, readable bytes from buf (>= len)
+Output  : sum of chars
+Comments: pairwise widening adds, tail is done in scalar
+====================================================================== */
+static uint32_t tinfoSumNEON(const char * buf, size_t len, size_t room)
+{
+  const uint8x16_t mask = vdupq_n_u8(0x7F);
+  uint32x4_t acc = vdupq_n_u32(0);
+  uint32x2_t r;
+  size_t i = 0;
+
+  for ( ; i + 16 <= len; i += 16) {
+    uint8x16_t v = vandq_u8(vld1q_u8((const uint8_t *) (buf + i)), mask);
+    acc = vpadalq_u16(acc, vpaddlq_u8(v));
+  }
+
+  r = vadd_u32(vget_low_u32(acc), vget_high_u32(acc));
+  r = vpadd_u32(r, r);
+  return vget_lane_u32(r, 0) + tinfoSumScalar(buf + i, len - i, room - i);
+}
+
+/* ======================================================================
+Function: tinfoScanNEON
+Purpose : find first control char 16 bytes at a time
+Input   : buffer, length, separator
+Output  : offset of first control char, len if none
+Comments: NEON has no movemask, block with a match is finished in scalar
+====================================================================== */
+static size_t tinfoScanNEON(const char * buf, size_t len, char sep)
+{
+  const uint8x16_t mask = vdupq_n_u8(0x7F);
+  const uint8x16_t stx  = vdupq_n_u8(TINFO_STX);
+  const uint8x16_t etx  = vdupq_n_u8(TINFO_ETX);
+  const uint8x16_t sgr  = vdupq_n_u8(TINFO_SGR);
+  const uint8x16_t egr  = vdupq_n_u8(TINFO_EGR);
+  const uint8x16_t vsep = vdupq_n_u8((uint8_t) sep);
+  size_t i = 0;
+
+  for ( ; i + 16 <= len; i += 16) {
+    uint8x16_t v = vandq_u8(vld1q_u8((const uint8_t *) (buf + i)), mask);
+    uint8x16_t m = vorrq_u8(vorrq_u8(vceqq_u8(v, stx), vceqq_u8(v, etx)),
+                            vorrq_u8(vceqq_u8(v, sgr), vceqq_u8(v, egr)));
+    m = vorrq_u8(m, vceqq_u8(v, vsep));
+
+    // any byte set ? (works on ARMv7 and ARMv8)
+    uint8x8_t r = vorr_u8(vget_low_u8(m), vget_high_u8(m));
+    r = vpmax_u8(r, r);
+    r = vpmax_u8(r, r);
+    r = vpmax_u8(r, r);
+    if (vget_lane_u8(r, 0))
+      return i + tinfoScanScalar(buf + i, 16, sep);
+  }
+  return i + tinfoScanScalar(buf + i, len - i, sep);
+}
+#endif
+
+#ifdef TINFO_SCAN_AVX2
+/* ======================================================================
+Function: tinfoAVX2Usable
+Purpose : tell if CPU has AVX2
+Input   : -
+Output  : true if AVX2 kernels can run
+Comments: -
+====================================================================== */
+static boolean tinfoAVX2Usable(void)
+{
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+}
+#endif
+
+// Kernels built in, best last. Prefix sums stay on 16 bytes with AVX2,
+// lanes of 32 bytes don't shift across
+static const _TInfoKernel _kernels[] =
+{
+  { "scalar", NULL, tinfoScanScalar, tinfoSumScalar, tinfoPrefixScalar },
+#if defined(__SSE2__)
+  { "sse2", NULL, tinfoScanSSE2, tinfoSumSSE2, tinfoPrefixSSE2 },
+#endif
+#if defined(TINFO_SCAN_AVX2) && defined(__SSE2__)
+  { "avx2", tinfoAVX2Usable, tinfoScanAVX2, tinfoSumAVX2, tinfoPrefixSSE2 },
+#elif defined(TINFO_SCAN_AVX2)
+  { "avx2", tinfoAVX2Usable, tinfoScanAVX2, tinfoSumAVX2, tinfoPrefixScalar },
+#endif
+#ifdef TINFO_SCAN_NEON
+  { "neon", NULL, tinfoScanNEON, tinfoSumNEON, tinfoPrefixNEON },
+#endif
+};
+
+#define TINFO_KERNELS (sizeof(_kernels) / sizeof(_kernels[0]))
+
+/* ======================================================================
+Function: tinfoKernelBest
+Purpose : select best kernels for this CPU
+Input   : -
+Output  : kernels
+Comments: -
+====================================================================== */
+static const _TInfoKernel * tinfoKernelBest(void)
+{
+  uint8_t i = TINFO_KERNELS;
+
+  while (--i && _kernels[i].usable && !_kernels[i].usable())
+    ;
+
+  return &_kernels[i];
+}
+
+/* ======================================================================
+Function: tinfoKernel
+Purpose : get kernels to use
+Input   : -
+Output  : kernels
+Comments: best ones are selected on first call whatever the thread, a
+          local static is initialized once and other threads calling at
+          the same time wait for it (as pthread_once)
+====================================================================== */
+static const _TInfoKernel * tinfoKernel(void)
+{
+  static const _TInfoKernel * best = tinfoKernelBest();
+
+  return _kernel_forced ? _kernel_forced : best;
+}
+
+/* ======================================================================
+Function: tinfoPrefixAt
+Purpose : running sum of a buffer at a position
+Input   : prefix sums kernel, buffer, its length, position (<= length),
+          block of prefix sums and its offset and length in buffer (updated)
+Output  : sum of chars before position, modulo 256
+Comments: block only moves forward, each char is summed once
+====================================================================== */
+static uint8_t tinfoPrefixAt(_TInfoPrefixFn prefix, const char * buf, size_t len,
+                             size_t pos, uint8_t * pre, size_t * blk, size_t * blen)
+{
+  while (pos > *blk + *blen) {
+    pre[0] = pre[*blen];
+    *blk += *blen;
+    *blen = len - *blk < TINFO_SCAN_BLOCK ? len - *blk : TINFO_SCAN_BLOCK;
+    prefix(buf + *blk, *blen, pre);
+  }
+
+  return pre[pos - *blk];
+}
+
+/* ======================================================================
+Function: tinfoScanControl
+Purpose : find first control char (STX, ETX, SGR, EGR or separator)
+Input   : buffer, length, separator (0 for no separator)
+Output  : offset of first control char, len if none
+Comments: -
+====================================================================== */
+size_t tinfoScanControl(const char * buf, size_t len, char sep)
+{
+  // no separator wanted, search STX twice instead
+  if (!sep)
+    sep = TINFO_STX;
+
+  return tinfoKernel()->scan(buf, len, sep & 0x7F);
+}
+
+/* ======================================================================
+Function: tinfoScanMarks
+Purpose : get positions of all control chars of a buffer
+Input   : buffer, length, separator (0 for no separator)
+          table of marks to fill and its size
+          pointer on number of bytes scanned (can be NULL)
+Output  : number of marks filled
+Comments: if table is full, scan stops after the last mark, call again
+          from buf + scanned to continue
+====================================================================== */
+uint16_t tinfoScanMarks(const char * buf, size_t len, char sep,
+                        _TInfoMark * marks, uint16_t max, size_t * scanned)
+{
+  size_t pos = 0;
+  uint16_t n = 0;
+
+  while (pos < len && n < max) {
+    pos += tinfoScanControl(buf + pos, len - pos, sep);
+    if (pos >= len)
+      break;
+
+    marks[n].offset = pos;
+    marks[n].kind = buf[pos] & 0x7F;
+    n++;
+    pos++;
+  }
+
+  if (scanned)
+    *scanned = pos < len ? pos : len;
+
+  return n;
+}
+
+/* ======================================================================
+Function: tinfoChecksumBatch
+Purpose : validate checksum of several groups of a buffer
+Input   : buffer and its length
+          table of groups and number of groups
+          checksum rule (TINFO_CHECKSUM_HISTORIC or TINFO_CHECKSUM_STANDARD)
+          table where computed checksums are stored (can be NULL)
+Output  : number of groups with a good checksum
+Comments: checksum is (sum & 0x3F) + 0x20, same as TInfo::calcChecksum()
+          for historic mode, where sum includes the space between label
+          and value but not the one before checksum. Groups out of the
+          buffer get a 0 checksum
+          Buffer is summed once whatever the number of groups: running
+          sums are computed by blocks and a group sum is the difference
+          of the running sums at its ends. Groups must be sorted and not
+          overlap for that, others are summed alone
+====================================================================== */
+uint16_t tinfoChecksumBatch(const char * buf, size_t len,
+                            const _TInfoGroupSpan * groups, uint16_t n,
+                            uint8_t rule, char * sums)
+{
+  const _TInfoKernel * k = tinfoKernel();
+  uint8_t pre[TINFO_SCAN_BLOCK + 1];
+  size_t blk = 0;   // offset in buffer of pre[0]
+  size_t blen = 0;  // chars summed in pre
+  uint16_t good = 0;
+  uint8_t first;
+
+  pre[0] = 0;
+
+  for (uint16_t i = 0; i < n; i++) {
+    size_t start = groups[i].offset;
+    size_t lg = groups[i].len;
+    char sum = 0;
+
+    // we need at least label, separator and checksum char in buffer
+    if (lg >= 2 && start + lg < len) {
+      // historic checksum does not include last separator
+      if (rule == TINFO_CHECKSUM_HISTORIC)
+        lg--;
+
+      if (start >= blk) {
+        first = tinfoPrefixAt(k->prefix, buf, len, start, pre, &blk, &blen);
+        sum = tinfoPrefixAt(k->prefix, buf, len, start + lg, pre, &blk, &blen) - first;
+      } else {
+        sum = k->sum(buf + start, lg, len - start);
+      }
+      sum = (sum & 0x3F) + 0x20;
+
+      if (sum == (buf[start + groups[i].len] & 0x7F))
+        good++;
+    }
+
+    if (sums)
+      sums[i] = sum;
+  }
+
+  return good;
+}
+
+/* ======================================================================
+Function: tinfoScanKernel
+Purpose : get name of the kernel selected for this CPU
+Input   : -
+Output  : kernel name
+Comments: -
+====================================================================== */
+const char * tinfoScanKernel(void)
+{
+  return tinfoKernel()->name;
+}
+
+/* ======================================================================
+Function: tinfoScanSelect
+Purpose : force kernels, to compare them in tests
+Input   : kernel name, NULL for best one
+Output  : false if kernel is not built in or CPU can't run it
+Comments: not thread safe, call it before any decoding starts
+====================================================================== */
+boolean tinfoScanSelect(const char * name)
+{
+  if (!name) {
+    _kernel_forced = NULL;
+    return true;
+  }
+
+  for (uint8_t i = 0; i < TINFO_KERNELS; i++) {
+    if (!strcmp(_kernels[i].name, name)) {
+      if (_kernels[i].usable && !_kernels[i].usable())
+        return false;
+      _kernel_forced = &_kernels[i];
+      return true;
+    }
+  }
+
+  return false;
+}
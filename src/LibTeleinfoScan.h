@@ -0,0 +1,70 @@
+// **********************************************************************************
+// Teleinfo control chars scanning include file
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// Find STX, ETX, SGR, EGR and separator chars in a raw buffer, several
+// bytes at a time when the CPU can (SSE2/AVX2 on PC, NEON on Raspberry PI)
+// The kernel is selected on first call, a scalar version is always there
+// and gives exactly the same result
+// Checksums of groups found can also be validated in batch, the buffer is
+// summed once (16 running sums per instruction) for all groups
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#ifndef LibTeleinfoScan_h
+#define LibTeleinfoScan_h
+
+#include "LibTeleinfo.h"
+
+// Checksum rules
+#define TINFO_CHECKSUM_HISTORIC 0 // label to value, last separator excluded
+#define TINFO_CHECKSUM_STANDARD 1 // label to last separator included
+
+// One group of a buffer to validate
+typedef struct
+{
+  uint32_t offset;  // offset of first label char from start of buffer
+  uint16_t len;     // length from label up to last separator included,
+                    // checksum char is at offset + len
+} _TInfoGroupSpan;
+
+// One control char position found in a buffer
+typedef struct
+{
+  uint32_t offset;  // offset from start of buffer
+  char     kind;    // control char found (7 bits)
+} _TInfoMark;
+
+// Offset of first control char or separator, or len if none
+// sep = 0 to find only frame and group control chars
+size_t       tinfoScanControl(const char * buf, size_t len, char sep);
+
+// Fill table with control chars positions, return number of marks,
+// scanned is set to number of bytes scanned (less than len if table full)
+uint16_t     tinfoScanMarks(const char * buf, size_t len, char sep,
+                            _TInfoMark * marks, uint16_t max, size_t * scanned);
+
+// Compute checksum of n groups of a buffer with given rule, computed
+// checksums are stored in sums (can be NULL), return the number of groups
+// where the checksum char received matches the computed one
+uint16_t     tinfoChecksumBatch(const char * buf, size_t len,
+                                const _TInfoGroupSpan * groups, uint16_t n,
+                                uint8_t rule, char * sums);
+
+// Name of the kernel used ("scalar", "sse2", "avx2", "neon"), best one
+// for the CPU is selected once on first use, from any thread
+const char * tinfoScanKernel(void);
+
+// Force a kernel by its name (NULL for best one), false if not usable on
+// this CPU. For tests only, not thread safe
+boolean      tinfoScanSelect(const char * name);
+
+#endif
@@ -0,0 +1,195 @@
+// **********************************************************************************
+// Teleinfo sketch cooperative scheduler
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#include "LibTeleinfoScheduler.h"
+
+/* ======================================================================
+Class   : TInfoScheduler
+Purpose : Constructor
+Input   : -
+Output  : -
+Comments: no task
+====================================================================== */
+TInfoScheduler::TInfoScheduler()
+{
+  _fn_clock = NULL;
+  _fn_drain = NULL;
+  _count = 0;
+}
+
+/* ======================================================================
+Function: init
+Purpose : set clock and drain function
+Input   : clock in ms (millis() on Arduino)
+          function reading all chars received, or NULL
+Output  : -
+Comments: tasks are removed
+====================================================================== */
+void TInfoScheduler::init(uint32_t (*fn_clock)(void), void (*fn_drain)(void))
+{
+  _fn_clock = fn_clock;
+  _fn_drain = fn_drain;
+  _count = 0;
+}
+
+/* ======================================================================
+Function: add
+Purpose : add a task
+Input   : name (must stay in memory), function
+          deadline, ms after post the task should have run
+          budget, ms the task is expected to take
+Output  : task id, -1 if TINFO_SCHED_TASKS are used
+Comments: -
+====================================================================== */
+int8_t TInfoScheduler::add(const char * name, void (*fn)(void), uint32_t deadline, uint32_t budget)
+{
+  _TInfoTask * k;
+
+  if (_count >= TINFO_SCHED_TASKS || !fn)
+    return -1;
+
+  k = &_tasks[_count];
+  memset(k, 0, sizeof(_TInfoTask));
+  k->name = name;
+  k->fn = fn;
+  k->deadline = deadline;
+  k->budget = budget;
+  return _count++;
+}
+
+/* ======================================================================
+Function: post
+Purpose : ask a task to run
+Input   : task id
+Output  : -
+Comments: short, can be called from a ticker callback. Posting a task
+          already pending keeps its first deadline. due is written before
+          pending so run() never sees a pending task with an old due
+====================================================================== */
+void TInfoScheduler::post(int8_t task)
+{
+  _TInfoTask * k;
+
+  if (task < 0 || task >= _count || !_fn_clock)
+    return;
+
+  k = &_tasks[task];
+  if (!k->pending) {
+    k->due = _fn_clock() + k->deadline;
+    k->pending = true;
+  }
+}
+
+/* ======================================================================
+Function: pending
+Purpose : task is waiting to run
+Input   : task id
+Output  : true if posted and not run yet
+Comments: -
+====================================================================== */
+boolean TInfoScheduler::pending(int8_t task)
+{
+  return task >= 0 && task < _count && _tasks[task].pending;
+}
+
+/* ======================================================================
+Function: next
+Purpose : pending task with earliest deadline
+Input   : -
+Output  : task id, -1 if none
+Comments: -
+====================================================================== */
+int8_t TInfoScheduler::next(void)
+{
+  int8_t best = -1;
+
+  for (uint8_t i = 0; i < _count; i++) {
+    if (!_tasks[i].pending)
+      continue;
+    if (best < 0 || (int32_t) (_tasks[i].due - _tasks[best].due) < 0)
+      best = i;
+  }
+
+  return best;
+}
+
+/* ======================================================================
+Function: run
+Purpose : run pending tasks for at most a time
+Input   : ms that can be used
+Output  : number of tasks run
+Comments: first task is always run, next ones only if their budget fits
+          in the time left or if their deadline is passed, so there is
+          one long task per call, with serial drained before and after
+====================================================================== */
+uint8_t TInfoScheduler::run(uint32_t budget)
+{
+  _TInfoTask * k;
+  uint32_t start;
+  uint32_t now;
+  uint32_t t;
+  uint8_t runs = 0;
+  int8_t task;
+
+  if (_fn_drain)
+    _fn_drain();
+
+  if (!_fn_clock)
+    return 0;
+
+  start = _fn_clock();
+
+  while ( (task = next()) >= 0 ) {
+    k = &_tasks[task];
+    now = _fn_clock();
+
+    // First task always runs, next ones if they fit or are late
+    if (runs && (uint32_t) (now - start) + k->budget > budget && (int32_t) (now - k->due) < 0)
+      break;
+
+    if ((int32_t) (now - k->due) > 0)
+      k->late++;
+
+    // Pending is cleared first so the task can post itself again, a
+    // post coming between here and fn() is served by this run
+    k->pending = false;
+    k->fn();
+    k->runs++;
+
+    t = _fn_clock() - now;
+    if (t > k->budget)
+      k->overrun++;
+    runs++;
+
+    if (_fn_drain)
+      _fn_drain();
+
+    if ((uint32_t) (_fn_clock() - start) >= budget)
+      break;
+  }
+
+  return runs;
+}
+
+/* ======================================================================
+Function: get
+Purpose : counters of a task
+Input   : task id
+Output  : task or NULL
+Comments: -
+====================================================================== */
+_TInfoTask * TInfoScheduler::get(int8_t task)
+{
+  return task >= 0 && task < _count ? &_tasks[task] : NULL;
+}
@@ -0,0 +1,65 @@
+// **********************************************************************************
+// Teleinfo sketch cooperative scheduler include file
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// Runs the tasks posted by tickers (posts, 1 s job...) from the sketch loop,
+// earliest deadline first, as long as they fit in the time given to run().
+// The drain function (serial to TInfo) is called before and after each task
+// so received chars never wait more than one task. Tasks are not stopped,
+// a task longer than its budget is only counted
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#ifndef LibTeleinfoScheduler_h
+#define LibTeleinfoScheduler_h
+
+#include "LibTeleinfo.h"
+
+#ifndef TINFO_SCHED_TASKS
+#define TINFO_SCHED_TASKS   8
+#endif
+
+// One task
+typedef struct
+{
+  const char * name;
+  void       (*fn)(void);
+  uint32_t     deadline;  // ms after post it should have run
+  uint32_t     budget;    // ms it is expected to take
+  // set by post() from ticker callbacks, read and cleared by run()
+  volatile uint32_t due;  // clock it should have run (ms)
+  volatile boolean pending; // posted, not run yet
+  uint32_t     runs;
+  uint32_t     late;      // runs after deadline
+  uint32_t     overrun;   // runs longer than budget
+} _TInfoTask;
+
+class TInfoScheduler
+{
+  public:
+    TInfoScheduler();
+    void     init(uint32_t (*fn_clock)(void), void (*fn_drain)(void));
+    int8_t   add(const char * name, void (*fn)(void), uint32_t deadline, uint32_t budget);
+    void     post(int8_t task);
+    boolean  pending(int8_t task);
+    uint8_t  run(uint32_t budget);
+    _TInfoTask * get(int8_t task);
+
+  private:
+    int8_t   next(void);
+
+    uint32_t (*_fn_clock)(void);
+    void     (*_fn_drain)(void);
+    _TInfoTask _tasks[TINFO_SCHED_TASKS];
+    uint8_t  _count;
+};
+
+#endif
@@ -0,0 +1,234 @@
+// **********************************************************************************
+// Teleinfo load shedding
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#include "LibTeleinfoShedder.h"
+
+/* ======================================================================
+Class   : TInfoShedder
+Purpose : Constructor
+Input   : -
+Output  : -
+Comments: no load
+====================================================================== */
+TInfoShedder::TInfoShedder()
+{
+  _tinfo = NULL;
+  _output = NULL;
+  _loads = 0;
+  memset(&_config, 0, sizeof(_config));
+  memset(_latency, 0, sizeof(_latency));
+}
+
+/* ======================================================================
+Function: init
+Purpose : set outputs and policy, switch all loads on
+Input   : TInfo object (for group reception time, can be NULL)
+          outputs, number of loads (TINFO_SHED_LOADS max), policy
+Output  : -
+Comments: load n is shed before load n+1 and restored after it
+====================================================================== */
+void TInfoShedder::init(TInfo * tinfo, TInfoOutput * output, uint8_t loads, const _TInfoShedConfig * config)
+{
+  _tinfo = tinfo;
+  _output = output;
+  _loads = loads > TINFO_SHED_LOADS ? TINFO_SHED_LOADS : loads;
+  _config = *config;
+  _shed = 0;
+  _alert = false;
+  _below = false;
+  _last_shed = 0;
+  _isousc = 0;
+  _sinsts = 0;
+  _pref = 0;
+  memset(_current, 0, sizeof(_current));
+  memset(_latency, 0, sizeof(_latency));
+
+  for (uint8_t i = 0; i < _loads; i++)
+    _output->set(i, true);
+}
+
+/* ======================================================================
+Function: load
+Purpose : current load
+Input   : -
+Output  : load in 1/1000 of subscribed current or power, the highest
+Comments: 0 until subscribed current or power has been received
+====================================================================== */
+uint16_t TInfoShedder::load(void)
+{
+  int32_t l = 0;
+  int32_t r;
+
+  if (_isousc > 0) {
+    for (uint8_t i = 0; i < 4; i++) {
+      r = _current[i] * 1000 / _isousc;
+      if (r > l)
+        l = r;
+    }
+  }
+
+  // VA against kVA
+  if (_pref > 0) {
+    r = _sinsts / _pref;
+    if (r > l)
+      l = r;
+  }
+
+  return l > 0xFFFF ? 0xFFFF : l;
+}
+
+/* ======================================================================
+Function: latencyAdd
+Purpose : count a reaction time in the histogram
+Input   : reaction time (ms)
+Output  : -
+Comments: -
+====================================================================== */
+void TInfoShedder::latencyAdd(uint32_t ms)
+{
+  uint8_t bucket = 0;
+
+  while (ms && bucket < TINFO_SHED_LATENCY - 1) {
+    ms >>= 1;
+    bucket++;
+  }
+
+  if (_latency[bucket] < 0xFFFF)
+    _latency[bucket]++;
+}
+
+/* ======================================================================
+Function: control
+Purpose : shed or restore a load
+Input   : time (ms), true if called for a group just received, time
+          the group was read (ms)
+Output  : -
+Comments: one load at a time, settle time between two sheds so the
+          meter can see the new load
+====================================================================== */
+void TInfoShedder::control(uint32_t t, boolean fromGroup, uint32_t received)
+{
+  uint16_t l = load();
+
+  if (_alert || l >= _config.high) {
+    _below = false;
+    _alert = false;
+
+    if (_shed < _loads && (!_shed || (uint32_t) (t - _last_shed) >= _config.settle)) {
+      _output->set(_shed++, false);
+      _last_shed = t;
+
+      // Time from read of the group to the decision
+      if (fromGroup)
+        latencyAdd(t - received);
+    }
+  } else if (l < _config.low && _shed) {
+    if (!_below) {
+      _below = true;
+      _below_since = t;
+    } else if ((uint32_t) (t - _below_since) >= _config.restore) {
+      _output->set(--_shed, true);
+      _below_since = t;
+    }
+  } else {
+    _below = false;
+  }
+}
+
+/* ======================================================================
+Function: data
+Purpose : update load with a new or changed label
+Input   : label value, flags given to the data callback, time (ms)
+          from the TInfo clock
+Output  : -
+Comments: should be called from the data callback set with
+          TInfo::attachData(), so the decision is taken when the group
+          is received, not at end of frame
+====================================================================== */
+void TInfoShedder::data(ValueList * me, uint8_t flags, uint32_t t)
+{
+  const char * n;
+  char * end;
+  long v;
+  uint32_t received;
+
+  if (!me || !_loads)
+    return;
+
+  n = me->name;
+  received = _tinfo ? _tinfo->groupStart() : t;
+
+  // Overload alert, whatever the value
+  if ((flags & TINFO_FLAGS_ALERT) || !strcmp(n, "ADPS") || !strncmp(n, "ADIR", 4)) {
+    _alert = true;
+    control(t, true, received);
+    return;
+  }
+
+  v = strtol(me->value, &end, 10);
+  if (!*me->value || *end)
+    return;
+
+  if (!strcmp(n, "IINST"))
+    _current[0] = v;
+  else if (!strncmp(n, "IINST", 5) && n[5] >= '1' && n[5] <= '3' && !n[6])
+    _current[n[5] - '0'] = v;
+  else if (!strcmp(n, "SINSTS"))
+    _sinsts = v;
+  else if (!strcmp(n, "ISOUSC"))
+    _isousc = v;
+  else if (!strcmp(n, "PREF"))
+    _pref = v;
+  else
+    return;
+
+  control(t, true, received);
+}
+
+/* ======================================================================
+Function: tick
+Purpose : restore loads when load stays low
+Input   : time (ms) from the TInfo clock
+Output  : -
+Comments: should be called often (each second), IINST may not change
+====================================================================== */
+void TInfoShedder::tick(uint32_t t)
+{
+  if (_loads)
+    control(t, false, t);
+}
+
+/* ======================================================================
+Function: shed
+Purpose : number of loads shed
+Input   : -
+Output  : loads 0 to shed()-1 are off
+Comments: -
+====================================================================== */
+uint8_t TInfoShedder::shed(void)
+{
+  return _shed;
+}
+
+/* ======================================================================
+Function: latency
+Purpose : reaction time histogram
+Input   : bucket 0 to TINFO_SHED_LATENCY-1
+Output  : loads shed with a reaction time of 2^(bucket-1) to 2^bucket-1 ms
+Comments: bucket 0 is less than 1 ms, last one is all above
+====================================================================== */
+uint16_t TInfoShedder::latency(uint8_t bucket)
+{
+  return bucket < TINFO_SHED_LATENCY ? _latency[bucket] : 0;
+}
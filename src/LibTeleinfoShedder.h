@@ -0,0 +1,87 @@
+// **********************************************************************************
+// Teleinfo load shedding include file
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo ou use , see my blog
+// http://hallard.me/category/tinfo
+//
+// Sheds loads (heaters...) before the breaker trips. Load is computed from
+// IINST/IINSTn against ISOUSC and SINSTS against PREF as soon as their group
+// is received, ADPS/ADIRn shed at once. Loads are outputs 0 to n-1, output
+// 0 is shed first and restored last: there is no priority field, the load
+// index is the priority, wire the least needed load on output 0. Outputs
+// are driven through the TInfoOutput interface so the shedder can run on a
+// host without GPIO
+//
+// Reaction times are measured from TInfo::groupStart(), chars must be given
+// to TInfo::process(buf, len, received) with their read time for them to
+// include the wait in the serial buffer
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#ifndef LibTeleinfoShedder_h
+#define LibTeleinfoShedder_h
+
+#include "LibTeleinfo.h"
+
+#ifndef TINFO_SHED_LOADS
+#define TINFO_SHED_LOADS    8
+#endif
+
+// Reaction time histogram, bucket n counts 2^(n-1) to 2^n-1 ms
+#define TINFO_SHED_LATENCY  16
+
+// Shedding policy
+typedef struct
+{
+  uint16_t high;      // shed when load above (1/1000 of subscribed)
+  uint16_t low;       // restore when load below (1/1000 of subscribed)
+  uint32_t settle;    // ms between two loads shed
+  uint32_t restore;   // ms below low before restoring a load
+} _TInfoShedConfig;
+
+// Outputs driving the loads
+class TInfoOutput
+{
+  public:
+    virtual ~TInfoOutput() {}
+    virtual void set(uint8_t load, boolean on) = 0;
+};
+
+class TInfoShedder
+{
+  public:
+    TInfoShedder();
+    void      init(TInfo * tinfo, TInfoOutput * output, uint8_t loads, const _TInfoShedConfig * config);
+    void      data(ValueList * me, uint8_t flags, uint32_t t);
+    void      tick(uint32_t t);
+    uint8_t   shed(void);
+    uint16_t  load(void);
+    uint16_t  latency(uint8_t bucket);
+
+  private:
+    void      control(uint32_t t, boolean fromGroup, uint32_t received);
+    void      latencyAdd(uint32_t ms);
+
+    TInfo *          _tinfo;
+    TInfoOutput *    _output;
+    _TInfoShedConfig _config;
+    uint8_t          _loads;
+    uint8_t          _shed;          // loads shed, 0 to _shed-1 are off
+    boolean          _alert;         // ADPS received
+    uint32_t         _last_shed;     // ms
+    uint32_t         _below_since;   // ms, load below low since
+    boolean          _below;
+    int32_t          _current[4];    // IINST, IINST1 to 3 (A)
+    int32_t          _isousc;        // A
+    int32_t          _sinsts;        // VA
+    int32_t          _pref;          // kVA
+    uint16_t         _latency[TINFO_SHED_LATENCY];
+};
+
+#endif
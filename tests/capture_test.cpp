@@ -0,0 +1,174 @@
+// **********************************************************************************
+// Raspberry PI raw capture split test
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo or use, see my blog
+// https://hallard.me/category/tinfo
+//
+// Writes captures with damaged groups to a file, decodes them whole and
+// split in parts the way ticbatch does, each part primed by its own TInfo
+// object, and checks both decodes give the same frames with the same
+// values
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+#include "tinfotest.h"
+#include "../examples/Raspberry_JSON/capture.h"
+#include <unistd.h>
+
+#define CAPTURE_SIZE (64 * 1024)
+
+static char g_path[] = "/tmp/capture_testXXXXXX";
+static char * g_out;
+static size_t g_out_size;
+static boolean g_write;
+
+/* ======================================================================
+Function: FrameCallback
+Purpose : write a decoded frame in the output buffer
+Input   : list head pointer on the values table
+Output  : -
+Comments: values are written in label order, as ticbatch does
+====================================================================== */
+void FrameCallback(ValueList * me)
+{
+  ValueList * sorted[TINFO_TABSIZE];
+  int n = 0;
+
+  if (!g_write || !me)
+    return;
+
+  while (me->next && n < TINFO_TABSIZE) {
+    int i;
+
+    me = me->next;
+    if (me->free || !*me->value)
+      continue;
+
+    for (i = n; i > 0 && strcmp(sorted[i - 1]->name, me->name) > 0; i--)
+      sorted[i] = sorted[i - 1];
+    sorted[i] = me;
+    n++;
+  }
+
+  for (int i = 0; i < n; i++)
+    g_out_size += sprintf(g_out + g_out_size, "%s=%s/%s ", sorted[i]->name,
+                          sorted[i]->value, sorted[i]->horodate);
+  g_out[g_out_size++] = '\n';
+}
+
+/* ======================================================================
+Function: captureWrite
+Purpose : write a capture file of meter frames
+Input   : true for Standard mode, one group in bad is damaged, seed
+Output  : false on error
+Comments: -
+====================================================================== */
+bool captureWrite(bool standard, int bad, unsigned seed)
+{
+  static char buf[CAPTURE_SIZE];
+  size_t len = testFrames(buf, sizeof(buf), standard, bad, seed);
+  FILE * f = fopen(g_path, "wb");
+
+  if (!f)
+    return false;
+
+  if (fwrite(buf, 1, len, f) != len) {
+    fclose(f);
+    return false;
+  }
+
+  return fclose(f) == 0;
+}
+
+/* ======================================================================
+Function: testSplit
+Purpose : split decode gives the frames of whole decode
+Input   : true for Standard mode, one group in bad is damaged, seed
+Output  : -
+Comments: parts from one frame each to a few ones
+====================================================================== */
+void testSplit(bool standard, int bad, unsigned seed)
+{
+  TInfoCapture capture;
+  _CapturePart parts[1024];
+  TInfoStats stats;
+  char * whole;
+  size_t whole_size;
+
+  CHECK(captureWrite(standard, bad, seed));
+  CHECK(capture.open(g_path));
+
+  // output is much smaller than the capture
+  g_out = (char *) malloc(CAPTURE_SIZE * 8);
+  whole = (char *) malloc(CAPTURE_SIZE * 8);
+  if (!g_out || !whole)
+    exit(EXIT_FAILURE);
+
+  TInfo * tinfo = new TInfo();
+  tinfo->init();
+  tinfo->attachNewFrame(FrameCallback);
+  tinfo->attachUpdatedFrame(FrameCallback);
+
+  g_out_size = 0;
+  g_write = true;
+  capture.decode(*tinfo);
+  memcpy(whole, g_out, g_out_size);
+  whole_size = g_out_size;
+
+  tinfo->getStats(&stats);
+  CHECK(stats.frames > 100);
+  CHECK(!bad || stats.checksum + stats.resync > 0);
+  delete tinfo;
+
+  for (uint16_t nparts = 2; nparts <= 1024; nparts *= 4) {
+    uint16_t n = capture.split(nparts, parts);
+
+    CHECK(n > 1 && n <= nparts);
+    g_out_size = 0;
+
+    for (uint16_t i = 0; i < n; i++) {
+      tinfo = new TInfo();
+      tinfo->attachNewFrame(FrameCallback);
+      tinfo->attachUpdatedFrame(FrameCallback);
+
+      g_write = false;
+      capture.prime(*tinfo, parts[i]);
+      g_write = true;
+      tinfo->processBatch(parts[i].data, parts[i].size);
+      delete tinfo;
+
+      CHECK(parts[i].data == capture.data() || (*parts[i].data & 0x7F) == TINFO_STX);
+    }
+
+    CHECK(g_out_size == whole_size && !memcmp(g_out, whole, whole_size));
+  }
+
+  capture.close();
+  free(g_out);
+  free(whole);
+}
+
+int main(void)
+{
+  int fd = mkstemp(g_path);
+
+  if (fd < 0) {
+    perror("capture_test: mkstemp");
+    return EXIT_FAILURE;
+  }
+  close(fd);
+
+  testSplit(false, 0, 1);
+  testSplit(false, 5, 2);
+  testSplit(true, 5, 3);
+  testSplit(true, 3, 4);
+  testSplit(false, 2, 5);
+
+  unlink(g_path);
+  return testDone("capture_test");
+}
@@ -0,0 +1,198 @@
+// **********************************************************************************
+// LibTeleinfo batch checksum test
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo or use, see my blog
+// https://hallard.me/category/tinfo
+//
+// Checks tinfoChecksumBatch() gives bit for bit the checksum of
+// TInfoDecoder and TInfo::calcChecksum() for groups in any order, length
+// and position in buffer, and that TInfo::processBatch() decodes frames
+// as the char by char process()
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+#include "tinfotest.h"
+#include "../src/LibTeleinfoDecoder.h"
+#include "../src/LibTeleinfoScan.h"
+
+#define TEST_GROUPS 32
+
+/* ======================================================================
+Function: checkSpans
+Purpose : compare batch checksums of groups with decoder ones
+Input   : buffer, length, groups, number of groups
+Output  : -
+Comments: -
+====================================================================== */
+void checkSpans(const char * buf, size_t len, const _TInfoGroupSpan * groups, uint16_t n)
+{
+  char hist[TEST_GROUPS];
+  char std[TEST_GROUPS];
+  uint16_t good_hist = tinfoChecksumBatch(buf, len, groups, n, TINFO_CHECKSUM_HISTORIC, hist);
+  uint16_t good_std = tinfoChecksumBatch(buf, len, groups, n, TINFO_CHECKSUM_STANDARD, std);
+  uint16_t ref_hist = 0;
+  uint16_t ref_std = 0;
+
+  for (uint16_t i = 0; i < n; i++) {
+    const char * g = buf + groups[i].offset;
+    uint16_t lg = groups[i].len;
+
+    // out of buffer or too short
+    if (lg < 2 || groups[i].offset + lg >= len) {
+      CHECK(hist[i] == 0 && std[i] == 0);
+      continue;
+    }
+
+    // decoder takes group with its checksum char, up to 255 chars
+    if (lg < 255) {
+      CHECK(hist[i] == TInfoDecoder<TInfoHistoric>::checksum(g, lg + 1));
+      CHECK(std[i] == TInfoDecoder<TInfoStandard>::checksum(g, lg + 1));
+    } else {
+      uint8_t sum = 0;
+      for (uint16_t j = 0; j < lg - 1; j++)
+        sum += g[j] & 0x7F;
+      CHECK(hist[i] == (sum & 0x3F) + 0x20);
+      sum += g[lg - 1] & 0x7F;
+      CHECK(std[i] == (sum & 0x3F) + 0x20);
+    }
+    ref_hist += hist[i] == (g[lg] & 0x7F);
+    ref_std += std[i] == (g[lg] & 0x7F);
+  }
+
+  CHECK(good_hist == ref_hist);
+  CHECK(good_std == ref_std);
+}
+
+/* ======================================================================
+Function: testRandom
+Purpose : random buffers and groups, sorted or not, overlapping or not
+Input   : -
+Output  : -
+Comments: groups longer than 256 chars cross prefix sums blocks
+====================================================================== */
+void testRandom(void)
+{
+  static char buf[4096];
+  _TInfoGroupSpan groups[TEST_GROUPS];
+  size_t len, pos;
+  uint16_t n;
+
+  srand(1);
+  for (int it = 0; it < 5000; it++) {
+    len = 1 + rand() % sizeof(buf);
+    for (size_t i = 0; i < len; i++)
+      buf[i] = rand();
+
+    // sorted groups one after the other, as processBatch() gives them
+    pos = rand() % 16;
+    for (n = 0; n < TEST_GROUPS && pos < len; n++) {
+      groups[n].offset = pos;
+      groups[n].len = rand() % 2 ? rand() % 250 : rand() % 600;
+      pos += groups[n].len + 1 + rand() % 8;
+    }
+    checkSpans(buf, len, groups, n);
+
+    // any order, some out of buffer
+    for (n = 0; n < TEST_GROUPS; n++) {
+      groups[n].offset = rand() % (len + 4);
+      groups[n].len = rand() % 250;
+    }
+    checkSpans(buf, len, groups, n);
+  }
+}
+
+/* ======================================================================
+Function: testHistoric
+Purpose : real historic groups against calcChecksum()
+Input   : -
+Output  : -
+Comments: calcChecksum() sums label, a space and value
+====================================================================== */
+void testHistoric(void)
+{
+  static const char * groups[][2] = {
+    { "ADCO", "021728123456" }, { "OPTARIF", "HC.." }, { "ISOUSC", "45" },
+    { "HCHC", "016541289" }, { "PTEC", "HP.." }, { "IINST", "002" },
+    { "IMAX", "040" }, { "PAPP", "00430" }, { "HHPHC", "D" },
+    { "MOTDETAT", "000000" }, { "ADPS", "046" }
+  };
+  TInfo tinfo;
+  char buf[1024];
+  _TInfoGroupSpan spans[TEST_GROUPS];
+  char sums[TEST_GROUPS];
+  char label[TINFO_NAME_SIZE];
+  char value[TINFO_VALUE_SIZE];
+  size_t pos = 0;
+  uint16_t n = sizeof(groups) / sizeof(groups[0]);
+
+  for (uint16_t i = 0; i < n; i++) {
+    spans[i].offset = pos + 1;
+    testGroup(buf, &pos, groups[i][0], NULL, groups[i][1], false);
+    spans[i].len = pos - spans[i].offset - 2;
+  }
+
+  CHECK(tinfoChecksumBatch(buf, pos, spans, n, TINFO_CHECKSUM_HISTORIC, sums) == n);
+  for (uint16_t i = 0; i < n; i++) {
+    strcpy(label, groups[i][0]);
+    strcpy(value, groups[i][1]);
+    CHECK((unsigned char) sums[i] == tinfo.calcChecksum(label, value));
+  }
+}
+
+/* ======================================================================
+Function: testDecode
+Purpose : processBatch() against process() char by char
+Input   : -
+Output  : -
+Comments: good and damaged frames, whole buffer or pieces so groups
+          are cut between two calls
+====================================================================== */
+void testDecode(void)
+{
+  static char buf[64 * 1024];
+  size_t len, pos, n;
+
+  for (int standard = 0; standard < 2; standard++) {
+    for (int bad = 0; bad < 20; bad += 3) {
+      TInfo ref;
+      TInfo whole;
+      TInfo parts;
+
+      ref.init();
+      whole.init();
+      parts.init();
+
+      len = testFrames(buf, sizeof(buf), standard, bad, bad + 1);
+
+      for (size_t i = 0; i < len; i++)
+        ref.process(buf[i]);
+
+      whole.processBatch(buf, len);
+
+      srand(bad);
+      for (pos = 0; pos < len; pos += n) {
+        n = 1 + rand() % 700;
+        if (n > len - pos)
+          n = len - pos;
+        parts.processBatch(buf + pos, n);
+      }
+
+      testSameDecode(ref, whole);
+      testSameDecode(ref, parts);
+    }
+  }
+}
+
+int main(void)
+{
+  testRandom();
+  testHistoric();
+  testDecode();
+
+  return testDone("checksum_test");
+}
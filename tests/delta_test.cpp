@@ -0,0 +1,404 @@
+// **********************************************************************************
+// LibTeleinfo changed labels push test
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo or use, see my blog
+// https://hallard.me/category/tinfo
+//
+// Decodes frames with TInfo and checks the messages TInfoDelta makes of
+// them, then runs the raspjson WebSocket server in this program with two
+// clients on the loopback: handshake, snapshot on connect and on demand,
+// the same delta to all clients after each frame, ping and close. The
+// frame callback and /ws handler are the raspjson ones
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+#include "tinfotest.h"
+#include "../src/LibTeleinfoDelta.h"
+#include "../examples/Raspberry_JSON/httpserver.h"
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// RFC 6455 handshake example
+#define WS_KEY      "dGhlIHNhbXBsZSBub25jZQ=="
+#define WS_ACCEPT   "s3pPLMBiTxaQ9kYGzzhZRbK+xOo="
+
+static uint32_t g_now;
+static TInfo g_tinfo;
+static TInfoDelta g_delta;
+static TInfoHttp g_http;
+static size_t g_pushed;
+
+/* ======================================================================
+Function: fakeClock
+Purpose : clock given to TInfo and delta
+Input   : -
+Output  : time set by the test (ms)
+Comments: -
+====================================================================== */
+uint32_t fakeClock(void)
+{
+  return g_now;
+}
+
+/* ======================================================================
+Function: pushFrame
+Purpose : frame callback, as raspjson one
+Input   : linked list pointer on the concerned data
+Output  : -
+Comments: -
+====================================================================== */
+void pushFrame(ValueList * me)
+{
+  if ( !(g_pushed = g_delta.frame(me, g_now)) )
+    return;
+
+  if (g_http.clients())
+    g_http.broadcast(g_delta.message(), g_delta.length());
+}
+
+/* ======================================================================
+Function: LiveHandler
+Purpose : WebSocket handler, as raspjson one
+Input   : client socket, text received (NULL when it connects)
+Output  : -
+Comments: -
+====================================================================== */
+void LiveHandler(int fd, const char * msg)
+{
+  static char buffer[TINFO_DELTA_SIZE * 2];
+  size_t n;
+
+  if (msg && strcmp(msg, TINFO_DELTA_ASK))
+    return;
+
+  if ( (n = g_delta.snapshot(buffer, sizeof(buffer))) )
+    TInfoHttp::wsSend(fd, buffer, n);
+}
+
+/* ======================================================================
+Function: sendFrame
+Purpose : decode a frame, one second after previous one
+Input   : true for Standard mode, labels and values, NULL terminated,
+          a value "E230101120000|07560" has a horodate
+Output  : -
+Comments: -
+====================================================================== */
+void sendFrame(bool standard, const char * const * groups)
+{
+  char buf[1024];
+  char horodate[TINFO_HORO_SIZE];
+  const char * value;
+  size_t pos = 0;
+
+  buf[pos++] = TINFO_STX;
+  for (; *groups; groups += 2) {
+    value = strchr(groups[1], '|');
+    if (value) {
+      snprintf(horodate, sizeof(horodate), "%.*s", (int) (value - groups[1]), groups[1]);
+      testGroup(buf, &pos, groups[0], horodate, value + 1, standard);
+    } else {
+      testGroup(buf, &pos, groups[0], NULL, groups[1], standard);
+    }
+  }
+  buf[pos++] = TINFO_ETX;
+
+  g_now += 1000;
+  g_pushed = 0;
+  g_tinfo.process(buf, pos);
+}
+
+/* ======================================================================
+Function: testMessages
+Purpose : delta and snapshot messages of historic frames
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+void testMessages(void)
+{
+  static const char * const first[] = { "ADCO", "021728123456", "PAPP", "00430", "HCHC", "016541289", NULL };
+  static const char * const papp[] = { "ADCO", "021728123456", "PAPP", "00520", "HCHC", "016541289", NULL };
+  static const char * const both[] = { "ADCO", "021728123456", "PAPP", "00610", "HCHC", "016541290", NULL };
+  char buf[TINFO_DELTA_SIZE];
+
+  g_tinfo.init();
+  g_delta.init(&g_tinfo);
+
+  // First frame after init only syncs decoder
+  sendFrame(false, first);
+  CHECK(!g_pushed && g_delta.seq() == 0);
+
+  // Nothing decoded yet, snapshot has no label
+  CHECK(g_delta.snapshot(buf, sizeof(buf)) > 0 && !strcmp(buf, "{\"s\":0,\"f\":1,\"v\":{}}"));
+  CHECK(g_delta.snapshot(buf, 15) == 0);
+
+  sendFrame(false, first);
+  CHECK(g_pushed && g_delta.seq() == 1);
+  CHECK(!strcmp(g_delta.message(), "{\"s\":1,\"v\":{\"ADCO\":\"021728123456\",\"PAPP\":\"00430\",\"HCHC\":\"016541289\"}}"));
+  CHECK(g_delta.length() == strlen(g_delta.message()));
+
+  // Same frame, nothing to push and no hole in numbers
+  sendFrame(false, first);
+  CHECK(!g_pushed && g_delta.seq() == 1 && g_delta.length() == 0);
+
+  sendFrame(false, papp);
+  CHECK(g_pushed && g_delta.seq() == 2);
+  CHECK(!strcmp(g_delta.message(), "{\"s\":2,\"v\":{\"PAPP\":\"00520\"}}"));
+
+  sendFrame(false, both);
+  CHECK(g_pushed && g_delta.seq() == 3);
+  CHECK(!strcmp(g_delta.message(), "{\"s\":3,\"v\":{\"PAPP\":\"00610\",\"HCHC\":\"016541290\"}}"));
+
+  // Snapshot is numbered as last delta
+  CHECK(g_delta.snapshot(buf, sizeof(buf)) == strlen(buf));
+  CHECK(!strcmp(buf, "{\"s\":3,\"f\":1,\"v\":{\"ADCO\":\"021728123456\",\"PAPP\":\"00610\",\"HCHC\":\"016541290\"}}"));
+
+  // Too small buffer gives a partial snapshot
+  CHECK(g_delta.snapshot(buf, 48) > 0);
+  CHECK(!strcmp(buf, "{\"s\":3,\"f\":1,\"v\":{\"ADCO\":\"021728123456\"},\"p\":1}"));
+
+  // Numbers start again
+  g_delta.init(&g_tinfo);
+  CHECK(g_delta.seq() == 0);
+  sendFrame(false, papp);
+  CHECK(g_pushed && g_delta.seq() == 1);
+}
+
+/* ======================================================================
+Function: wsConnect
+Purpose : open a WebSocket to the server
+Input   : port
+Output  : client socket, -1 on error
+Comments: server is run between request and answer, answer is read up
+          to its end so frames stay in socket
+====================================================================== */
+int wsConnect(int port)
+{
+  static const char request[] =
+    "GET /ws HTTP/1.1\r\nHost: localhost\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+    "Sec-WebSocket-Key: " WS_KEY "\r\nSec-WebSocket-Version: 13\r\n\r\n";
+  struct sockaddr_in addr;
+  struct timeval tv = { 0, 500000 };
+  char answer[512];
+  size_t len = 0;
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+  if ( connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+       write(fd, request, sizeof(request) - 1) != sizeof(request) - 1 ) {
+    close(fd);
+    return -1;
+  }
+
+  g_http.handle();
+
+  while (len < sizeof(answer) - 1 && recv(fd, answer + len, 1, 0) == 1) {
+    answer[++len] = '\0';
+    if (len >= 4 && !strcmp(answer + len - 4, "\r\n\r\n"))
+      break;
+  }
+  answer[len] = '\0';
+
+  CHECK(!strncmp(answer, "HTTP/1.1 101 ", 13));
+  CHECK(strstr(answer, "\r\nSec-WebSocket-Accept: " WS_ACCEPT "\r\n") != NULL);
+
+  return fd;
+}
+
+/* ======================================================================
+Function: wsRead
+Purpose : read a server frame
+Input   : client socket, opcode filled, buffer and its size
+Output  : payload length, -1 if none came or frame is bad
+Comments: server frames are never masked, payload is NULL terminated
+====================================================================== */
+ssize_t wsRead(int fd, uint8_t * opcode, char * buf, size_t size)
+{
+  uint8_t head[4];
+  size_t len;
+  size_t got = 0;
+  ssize_t n;
+
+  if (recv(fd, head, 2, MSG_WAITALL) != 2 || (head[1] & 0x80) || (head[0] & 0x80) == 0)
+    return -1;
+
+  *opcode = head[0] & 0x0F;
+  len = head[1] & 0x7F;
+  if (len == 126) {
+    if (recv(fd, head + 2, 2, MSG_WAITALL) != 2)
+      return -1;
+    len = (size_t) head[2] << 8 | head[3];
+  } else if (len == 127) {
+    return -1;
+  }
+
+  if (len >= size)
+    return -1;
+
+  while (got < len && (n = recv(fd, buf + got, len - got, 0)) > 0)
+    got += n;
+  if (got < len)
+    return -1;
+
+  buf[len] = '\0';
+  return len;
+}
+
+/* ======================================================================
+Function: wsWrite
+Purpose : send a client frame
+Input   : client socket, opcode, payload
+Output  : false on error
+Comments: client frames are masked, short payloads only
+====================================================================== */
+bool wsWrite(int fd, uint8_t opcode, const char * msg)
+{
+  uint8_t frame[6 + 125];
+  size_t len = strlen(msg);
+
+  frame[0] = 0x80 | opcode;
+  frame[1] = 0x80 | len;
+  memcpy(frame + 2, "\x12\x34\x56\x78", 4);
+  for (size_t i = 0; i < len; i++)
+    frame[6 + i] = msg[i] ^ frame[2 + i % 4];
+
+  return write(fd, frame, 6 + len) == (ssize_t) (6 + len);
+}
+
+/* ======================================================================
+Function: wsServe
+Purpose : run the server until a client has something to read
+Input   : client socket
+Output  : false if nothing came in 1 s
+Comments: a client frame may reach the server in several pieces
+====================================================================== */
+bool wsServe(int fd)
+{
+  struct pollfd p = { fd, POLLIN, 0 };
+
+  for (int i = 0; i < 50; i++) {
+    g_http.handle();
+    if (poll(&p, 1, 20) > 0)
+      return true;
+  }
+  return false;
+}
+
+/* ======================================================================
+Function: testProtocol
+Purpose : Standard mode frames pushed to two WebSocket clients
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+void testProtocol(void)
+{
+  static const char * const first[] = { "ADSC", "041876543210", "SINSTS", "00420", "SMAXSN", "E230101120000|07560", NULL };
+  static const char * const smax[] = { "ADSC", "041876543210", "SINSTS", "00420", "SMAXSN", "E230101124500|07890", NULL };
+  static const char * const sinsts[] = { "ADSC", "041876543210", "SINSTS", "01250", "SMAXSN", "E230101124500|07890", NULL };
+  struct sockaddr_in addr;
+  socklen_t len = sizeof(addr);
+  char buf[TINFO_DELTA_SIZE * 2];
+  char other[TINFO_DELTA_SIZE * 2];
+  uint8_t opcode;
+  int a, b;
+
+  g_tinfo.init();
+  g_delta.init(&g_tinfo);
+  sendFrame(true, first);
+
+  // Any free port
+  CHECK(g_http.begin(0));
+  CHECK(getsockname(g_http.fd(), (struct sockaddr *) &addr, &len) == 0);
+  g_http.websocket("/ws", LiveHandler);
+
+  sendFrame(true, first);
+  CHECK(g_pushed && g_delta.seq() == 1);
+
+  // Snapshot when connecting
+  a = wsConnect(ntohs(addr.sin_port));
+  CHECK(a >= 0 && g_http.clients() == 1);
+  CHECK(wsRead(a, &opcode, buf, sizeof(buf)) > 0 && opcode == 0x1);
+  CHECK(!strcmp(buf, "{\"s\":1,\"f\":1,\"v\":{\"ADSC\":\"041876543210\",\"SINSTS\":\"00420\","
+                     "\"SMAXSN\":[\"07560\",\"E230101120000\"]}}"));
+
+  b = wsConnect(ntohs(addr.sin_port));
+  CHECK(b >= 0 && g_http.clients() == 2);
+  CHECK(wsRead(b, &opcode, other, sizeof(other)) > 0 && !strcmp(buf, other));
+
+  // Same delta to both clients
+  sendFrame(true, smax);
+  CHECK(g_pushed && g_delta.seq() == 2);
+  CHECK(wsRead(a, &opcode, buf, sizeof(buf)) > 0 && opcode == 0x1);
+  CHECK(!strcmp(buf, "{\"s\":2,\"v\":{\"SMAXSN\":[\"07890\",\"E230101124500\"]}}"));
+  CHECK(wsRead(b, &opcode, other, sizeof(other)) > 0 && !strcmp(buf, other));
+
+  // Nothing changed, nothing pushed
+  sendFrame(true, smax);
+  CHECK(!g_pushed);
+
+  sendFrame(true, sinsts);
+  CHECK(wsRead(a, &opcode, buf, sizeof(buf)) > 0);
+  CHECK(!strcmp(buf, "{\"s\":3,\"v\":{\"SINSTS\":\"01250\"}}"));
+  CHECK(wsRead(b, &opcode, other, sizeof(other)) > 0 && !strcmp(buf, other));
+
+  // Snapshot on demand to the client asking only, other texts ignored
+  CHECK(wsWrite(b, 0x1, "hello"));
+  CHECK(wsWrite(b, 0x1, TINFO_DELTA_ASK));
+  CHECK(wsServe(b));
+  CHECK(wsRead(b, &opcode, buf, sizeof(buf)) > 0 && opcode == 0x1);
+  CHECK(!strcmp(buf, "{\"s\":3,\"f\":1,\"v\":{\"ADSC\":\"041876543210\",\"SINSTS\":\"01250\","
+                     "\"SMAXSN\":[\"07890\",\"E230101124500\"]}}"));
+
+  // Ping is answered with same data
+  CHECK(wsWrite(a, 0x9, "ping!"));
+  CHECK(wsServe(a));
+  CHECK(wsRead(a, &opcode, buf, sizeof(buf)) == 5 && opcode == 0xA && !strcmp(buf, "ping!"));
+
+  // Close is answered, client is dropped and next frame goes to other one
+  CHECK(wsWrite(a, 0x8, "\x03\xe8"));
+  CHECK(wsServe(a));
+  CHECK(wsRead(a, &opcode, buf, sizeof(buf)) == 2 && opcode == 0x8);
+  CHECK(g_http.clients() == 1);
+
+  sendFrame(true, first);
+  CHECK(wsRead(b, &opcode, buf, sizeof(buf)) > 0);
+  CHECK(!strcmp(buf, "{\"s\":4,\"v\":{\"SINSTS\":\"00420\",\"SMAXSN\":[\"07560\",\"E230101120000\"]}}"));
+
+  // Client gone without close
+  close(b);
+  for (int i = 0; i < 50 && g_http.clients(); i++) {
+    g_http.handle();
+    usleep(20000);
+  }
+  CHECK(g_http.clients() == 0);
+
+  close(a);
+  g_http.close();
+}
+
+int main(void)
+{
+  g_tinfo.attachClock(fakeClock);
+  g_tinfo.attachNewFrame(pushFrame);
+  g_tinfo.attachUpdatedFrame(pushFrame);
+
+  testMessages();
+  testProtocol();
+
+  return testDone("delta_test");
+}
@@ -0,0 +1,286 @@
+// **********************************************************************************
+// Raspberry PI frame feed receiver test
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo or use, see my blog
+// https://hallard.me/category/tinfo
+//
+// Builds TInfoFeed datagrams of a small table, parses them and gives them
+// to TInfoFeedReceiver::track() dropped, out of order, twice or after a
+// sender restart. Checks frames lost, late, duplicate and restarts counted
+// for each meter, the 32 frames window and numbers starting again at 1
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+#include "tinfotest.h"
+#include "../src/LibTeleinfoFeed.h"
+#include "../examples/Raspberry_JSON/feedrecv.h"
+
+#define FEED_FRAMES 64
+
+static uint8_t g_sent[FEED_FRAMES + 1][TINFO_FEED_SIZE];
+static size_t g_len[FEED_FRAMES + 1];
+
+/* ======================================================================
+Function: feedBuild
+Purpose : build datagrams 1 to FEED_FRAMES of a meter
+Input   : meter id
+Output  : -
+Comments: table holds the meter id and PAPP, datagram n is in g_sent[n]
+====================================================================== */
+void feedBuild(const char * meter)
+{
+  ValueList values[3];
+  TInfoFeedFrame f;
+  TInfoFeed feed;
+
+  memset(values, 0, sizeof(values));
+  values[0].next = &values[1];
+  values[1].next = &values[2];
+  strcpy(values[1].name, "ADCO");
+  strcpy(values[1].value, meter);
+  strcpy(values[2].name, "PAPP");
+
+  feed.init();
+  for (uint32_t i = 1; i <= FEED_FRAMES; i++) {
+    sprintf(values[2].value, "%05u", (unsigned) i * 10);
+    g_len[i] = feed.frame(values, i * 1000);
+    memcpy(g_sent[i], feed.data(), g_len[i]);
+
+    CHECK(TInfoFeed::parse(g_sent[i], g_len[i], &f));
+    CHECK(f.seq == i && !strcmp(f.meter, meter) && f.count == 2);
+  }
+}
+
+/* ======================================================================
+Function: deliver
+Purpose : give a built datagram to the receiver
+Input   : receiver, datagram number, number to put in it (0 to keep it)
+Output  : frames lost before it
+Comments: -
+====================================================================== */
+uint32_t deliver(TInfoFeedReceiver & r, uint32_t n, uint32_t seq = 0)
+{
+  uint8_t buf[TINFO_FEED_SIZE];
+  TInfoFeedFrame f;
+
+  memcpy(buf, g_sent[n], g_len[n]);
+  for (uint8_t i = 0; seq && i < 4; i++)
+    buf[4 + i] = seq >> (24 - 8 * i);
+
+  if (!TInfoFeed::parse(buf, g_len[n], &f))
+    return 0xFFFFFFFF;
+  return r.track(&f);
+}
+
+/* ======================================================================
+Function: testOrder
+Purpose : datagrams in order, none lost
+Input   : -
+Output  : -
+Comments: first datagram of a meter is not a loss whatever its number
+====================================================================== */
+void testOrder(void)
+{
+  TInfoFeedReceiver r;
+  const _TFeedMeter * m;
+
+  feedBuild("021728123456");
+  CHECK(deliver(r, 7) == 0);
+  for (uint32_t i = 8; i <= 12; i++)
+    CHECK(deliver(r, i) == 0);
+
+  m = r.meter(0);
+  CHECK(m && !strcmp(m->meter, "021728123456"));
+  CHECK(m->received == 6 && m->last == 12 && m->window == 0x3F);
+  CHECK(!m->lost && !m->late && !m->duplicate && !m->restarts);
+  CHECK(r.meter(1) == NULL);
+}
+
+/* ======================================================================
+Function: testLost
+Purpose : dropped, late and duplicate datagrams
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+void testLost(void)
+{
+  TInfoFeedReceiver r;
+  const _TFeedMeter * m;
+
+  feedBuild("021728123456");
+  CHECK(deliver(r, 1) == 0);
+  CHECK(deliver(r, 2) == 0);
+  CHECK(deliver(r, 5) == 2);
+  m = r.meter(0);
+  CHECK(m->lost == 2 && m->last == 5 && m->window == 0x19);
+
+  // Late one is no more lost, counted once
+  CHECK(deliver(r, 3) == 0);
+  CHECK(m->late == 1 && m->lost == 1 && m->last == 5);
+  CHECK(deliver(r, 3) == 0);
+  CHECK(m->late == 1 && m->duplicate == 1 && m->lost == 1);
+
+  // Last one and an old one again
+  CHECK(deliver(r, 5) == 0);
+  CHECK(deliver(r, 2) == 0);
+  CHECK(m->duplicate == 3);
+
+  CHECK(deliver(r, 4) == 0);
+  CHECK(deliver(r, 4) == 0);
+  CHECK(m->late == 2 && m->duplicate == 4 && m->lost == 0);
+  CHECK(m->received == 9 && m->window == 0x1F && !m->restarts);
+
+  CHECK(deliver(r, 6) == 0);
+  CHECK(m->last == 6 && m->lost == 0);
+
+  // 1 still in window is a duplicate, not a restart
+  CHECK(deliver(r, 1) == 0);
+  CHECK(m->duplicate == 5 && !m->restarts && m->last == 6);
+}
+
+/* ======================================================================
+Function: testWindow
+Purpose : late datagrams in and out of the 32 frames window
+Input   : -
+Output  : -
+Comments: a late one out of the window can't be told from a duplicate,
+          it is counted late each time
+====================================================================== */
+void testWindow(void)
+{
+  TInfoFeedReceiver r;
+  const _TFeedMeter * m;
+
+  feedBuild("021728123456");
+  CHECK(deliver(r, 1) == 0);
+  CHECK(deliver(r, 40) == 38);
+  m = r.meter(0);
+  CHECK(m->lost == 38 && m->window == 1);
+
+  // 31 frames back is the oldest in window
+  CHECK(deliver(r, 9) == 0);
+  CHECK(m->late == 1 && m->lost == 37 && m->window == 0x80000001);
+  CHECK(deliver(r, 9) == 0);
+  CHECK(m->late == 1 && m->duplicate == 1);
+
+  // 32 frames back is out of it
+  CHECK(deliver(r, 8) == 0);
+  CHECK(deliver(r, 8) == 0);
+  CHECK(m->late == 3 && m->duplicate == 1 && m->lost == 35);
+
+  // Window moves, 9 is out of it now
+  CHECK(deliver(r, 41) == 0);
+  CHECK(m->window == 3);
+  CHECK(deliver(r, 9) == 0);
+  CHECK(m->late == 4 && m->duplicate == 1 && m->lost == 34);
+
+  // Jump of 32 or more clears the window
+  CHECK(deliver(r, 41, 41 + 32) == 31);
+  CHECK(m->window == 1 && m->last == 73 && m->lost == 65);
+  CHECK(!m->restarts);
+}
+
+/* ======================================================================
+Function: testRestart
+Purpose : sender numbers starting again
+Input   : -
+Output  : -
+Comments: 1 is a restart, even just after a number wrap, unless it is
+          still in the window (duplicate). A number far before the last
+          one is a restart, not a late datagram
+====================================================================== */
+void testRestart(void)
+{
+  TInfoFeedReceiver r;
+  const _TFeedMeter * m;
+
+  feedBuild("021728123456");
+  for (uint32_t i = 1; i <= 40; i++)
+    CHECK(deliver(r, i) == 0);
+  m = r.meter(0);
+
+  // Sender init, its numbers start at 1 again
+  feedBuild("021728123456");
+  CHECK(deliver(r, 1) == 0);
+  CHECK(m->restarts == 1 && m->last == 1 && m->window == 1);
+  CHECK(deliver(r, 2) == 0);
+  CHECK(deliver(r, 3) == 0);
+  CHECK(m->lost == 0 && m->late == 0 && m->duplicate == 0);
+
+  // Far before last one
+  CHECK(deliver(r, 4, 5000) == 4996);
+  CHECK(deliver(r, 10) == 0);
+  CHECK(m->restarts == 2 && m->last == 10 && m->lost == 4996 && !m->late);
+  CHECK(deliver(r, 11) == 0);
+
+  // Just in late range
+  CHECK(deliver(r, 12, 11 + TFEED_LATE_WINDOW) == TFEED_LATE_WINDOW - 1);
+  CHECK(deliver(r, 12) == 0);
+  CHECK(m->late == 1 && m->restarts == 2);
+  CHECK(deliver(r, 11) == 0);
+  CHECK(m->restarts == 3 && m->last == 11);
+
+  CHECK(m->lost == 4996 + TFEED_LATE_WINDOW - 2 && m->late == 1);
+
+  // Number 1 after a wrap is a restart, not a loss
+  TInfoFeedReceiver w;
+  CHECK(deliver(w, 5, 0xFFFFFFF0) == 0);
+  CHECK(deliver(w, 1) == 0);
+  m = w.meter(0);
+  CHECK(m->restarts == 1 && m->last == 1 && m->lost == 0);
+  CHECK(deliver(w, 2) == 0);
+  CHECK(m->lost == 0 && m->received == 3);
+}
+
+/* ======================================================================
+Function: testMeters
+Purpose : each meter has its own numbers
+Input   : -
+Output  : -
+Comments: meters after TFEED_METERS are not followed
+====================================================================== */
+void testMeters(void)
+{
+  TInfoFeedReceiver r;
+  char meter[16];
+
+  feedBuild("021728123456");
+  CHECK(deliver(r, 1) == 0);
+  CHECK(deliver(r, 2) == 0);
+  feedBuild("041661123456");
+  CHECK(deliver(r, 7) == 0);
+  CHECK(deliver(r, 8) == 0);
+  feedBuild("021728123456");
+  CHECK(deliver(r, 5) == 2);
+  feedBuild("041661123456");
+  CHECK(deliver(r, 9) == 0);
+
+  CHECK(r.meter(0)->lost == 2 && r.meter(0)->last == 5);
+  CHECK(r.meter(1)->lost == 0 && r.meter(1)->last == 9 && r.meter(1)->received == 3);
+
+  for (uint8_t i = 2; i <= TFEED_METERS; i++) {
+    sprintf(meter, "0000000000%02u", i);
+    feedBuild(meter);
+    CHECK(deliver(r, 1) == 0);
+    CHECK(deliver(r, 3) == (i < TFEED_METERS ? 1u : 0u));
+  }
+  CHECK(r.meter(TFEED_METERS - 1) && r.meter(TFEED_METERS - 1)->lost == 1);
+  CHECK(r.meters() == TFEED_METERS);
+}
+
+int main(void)
+{
+  testOrder();
+  testLost();
+  testWindow();
+  testRestart();
+  testMeters();
+
+  return testDone("feed_test");
+}
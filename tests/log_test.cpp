@@ -0,0 +1,346 @@
+// **********************************************************************************
+// LibTeleinfo log transport test
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo or use, see my blog
+// https://hallard.me/category/tinfo
+//
+// Sends TInfoLog datagrams through a UDP socket to another one on the
+// loopback and checks what arrives: lines batched by datagram, flush
+// interval, long lines, full ring, rate limit and failed sends. The clock
+// is moved by the test
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+#include "tinfotest.h"
+#include "../src/LibTeleinfoLog.h"
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+static uint32_t g_now;
+static int g_tx = -1;
+static int g_rx = -1;
+static struct sockaddr_in g_addr;
+static bool g_fail;
+
+/* ======================================================================
+Function: fakeClock
+Purpose : clock given to the log
+Input   : -
+Output  : time set by the test (ms)
+Comments: -
+====================================================================== */
+uint32_t fakeClock(void)
+{
+  return g_now;
+}
+
+/* ======================================================================
+Function: udpSend
+Purpose : send function given to the log
+Input   : datagram and its length
+Output  : false if sending fails or test asks it to fail
+Comments: -
+====================================================================== */
+boolean udpSend(const char * buf, size_t len)
+{
+  if (g_fail)
+    return false;
+
+  return sendto(g_tx, buf, len, 0, (struct sockaddr *) &g_addr, sizeof(g_addr)) == (ssize_t) len;
+}
+
+/* ======================================================================
+Function: udpOpen
+Purpose : open sending and receiving sockets on loopback
+Input   : -
+Output  : false on error
+Comments: receive waits 200 ms at most
+====================================================================== */
+bool udpOpen(void)
+{
+  struct timeval tv = { 0, 200000 };
+  socklen_t len = sizeof(g_addr);
+
+  g_rx = socket(AF_INET, SOCK_DGRAM, 0);
+  g_tx = socket(AF_INET, SOCK_DGRAM, 0);
+  if (g_rx < 0 || g_tx < 0)
+    return false;
+
+  memset(&g_addr, 0, sizeof(g_addr));
+  g_addr.sin_family = AF_INET;
+  g_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if ( bind(g_rx, (struct sockaddr *) &g_addr, sizeof(g_addr)) < 0 ||
+       getsockname(g_rx, (struct sockaddr *) &g_addr, &len) < 0 )
+    return false;
+
+  return setsockopt(g_rx, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == 0;
+}
+
+/* ======================================================================
+Function: udpReceive
+Purpose : read next datagram
+Input   : buffer and its size
+Output  : datagram length, -1 if none came
+Comments: buffer is NULL terminated
+====================================================================== */
+ssize_t udpReceive(char * buf, size_t size)
+{
+  ssize_t n = recv(g_rx, buf, size - 1, 0);
+
+  buf[n > 0 ? n : 0] = '\0';
+  return n;
+}
+
+/* ======================================================================
+Function: testBatch
+Purpose : lines batched in one datagram, at most one per interval
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+void testBatch(void)
+{
+  TInfoLog log;
+  TInfoLogStats stats;
+  char buf[TINFO_LOG_BATCH + 16];
+
+  g_now = 1000;
+  log.init(fakeClock, udpSend, 500);
+  CHECK(log.flush() == 0);
+
+  log.write("first line\n");
+  log.write("second");
+  log.write(' ');
+  log.write("line\n\n\nthird\tline\r\n");
+  log.write("not ended");
+  CHECK(log.pending() == 3);
+
+  CHECK(log.flush() == 34);
+  CHECK(udpReceive(buf, sizeof(buf)) == 34);
+  CHECK(!strcmp(buf, "first line\nsecond line\nthird line "));
+  CHECK(log.pending() == 0);
+
+  // Line ended after, interval not passed
+  log.write(" yet\n");
+  CHECK(log.pending() == 1);
+  g_now += 499;
+  CHECK(log.flush() == 0);
+  g_now += 1;
+  CHECK(log.flush() == 13);
+  CHECK(udpReceive(buf, sizeof(buf)) == 13 && !strcmp(buf, "not ended yet"));
+
+  // Nothing more on the socket
+  CHECK(udpReceive(buf, sizeof(buf)) < 0);
+
+  log.getStats(&stats);
+  CHECK(stats.lines == 4 && stats.datagrams == 2 && stats.bytes == 47);
+  CHECK(!stats.dropped && !stats.limited && !stats.truncated && !stats.errors);
+}
+
+/* ======================================================================
+Function: testLong
+Purpose : long lines are truncated, datagrams never exceed batch size
+Input   : -
+Output  : -
+Comments: lines are numbered to check none is lost nor cut between two
+          datagrams
+====================================================================== */
+void testLong(void)
+{
+  TInfoLog log;
+  TInfoLogStats stats;
+  char buf[TINFO_LOG_BATCH + 16];
+  char line[TINFO_LOG_BATCH * 2];
+  char text[200];
+  ssize_t n;
+  int next = 0;
+  int lines = 0;
+
+  g_now = 0;
+  log.init(fakeClock, udpSend, 0);
+
+  memset(line, 'x', sizeof(line) - 2);
+  line[sizeof(line) - 2] = '\n';
+  line[sizeof(line) - 1] = '\0';
+  log.write(line);
+  CHECK(log.flush() == TINFO_LOG_LINE);
+  CHECK(udpReceive(buf, sizeof(buf)) == TINFO_LOG_LINE);
+  CHECK(strspn(buf, "x") == TINFO_LOG_LINE);
+
+  // Lines of growing length, as many as the ring takes
+  memset(text, 'y', sizeof(text) - 1);
+  text[sizeof(text) - 1] = '\0';
+  for (int i = 0; i < 60; i++) {
+    snprintf(line, sizeof(line), "%03d %.*s\n", i, i * 3, text);
+    log.write(line);
+  }
+  log.getStats(&stats);
+  lines = stats.lines - 1;
+  CHECK(lines > 10);
+
+  while (log.pending()) {
+    CHECK(log.flush() > 0);
+    n = udpReceive(buf, sizeof(buf));
+    CHECK(n > 0 && n <= TINFO_LOG_BATCH - 1);
+
+    for (char * p = strtok(buf, "\n"); p; p = strtok(NULL, "\n")) {
+      CHECK(atoi(p) == next);
+      CHECK(strlen(p) == (size_t) 4 + next * 3);
+      next++;
+    }
+  }
+  CHECK(next == lines);
+
+  log.getStats(&stats);
+  CHECK(stats.truncated == 1);
+  CHECK(stats.dropped == (uint32_t) 60 - lines);
+}
+
+/* ======================================================================
+Function: testFull
+Purpose : full ring drops new lines, never a part of one
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+void testFull(void)
+{
+  TInfoLog log;
+  TInfoLogStats stats;
+  char buf[TINFO_LOG_BATCH + 16];
+  char line[64];
+  int sent;
+  int got = 0;
+
+  g_now = 0;
+  log.init(fakeClock, udpSend, 100);
+
+  for (sent = 0; sent < 1000; sent++) {
+    snprintf(line, sizeof(line), "line %04d of a full ring\n", sent);
+    log.write(line);
+  }
+  log.getStats(&stats);
+  CHECK(stats.lines + stats.dropped == 1000);
+  CHECK(stats.lines == TINFO_LOG_SIZE / 25);
+
+  // One datagram each 100 ms, oldest lines first
+  while (log.pending()) {
+    CHECK(log.flush() > 0);
+    CHECK(log.flush() == 0);
+    g_now += 100;
+    CHECK(udpReceive(buf, sizeof(buf)) > 0);
+    for (char * p = strtok(buf, "\n"); p; p = strtok(NULL, "\n")) {
+      snprintf(line, sizeof(line), "line %04d of a full ring", got++);
+      CHECK(!strcmp(p, line));
+    }
+  }
+  CHECK(got == (int) stats.lines);
+
+  // Room again
+  log.write("after\n");
+  CHECK(log.flush() == 5);
+  CHECK(udpReceive(buf, sizeof(buf)) == 5 && !strcmp(buf, "after"));
+}
+
+/* ======================================================================
+Function: testRate
+Purpose : rate limit with burst
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+void testRate(void)
+{
+  TInfoLog log;
+  TInfoLogStats stats;
+  char buf[TINFO_LOG_BATCH + 16];
+
+  g_now = 10000;
+  log.init(fakeClock, udpSend, 0);
+  log.setRate(2, 3);
+
+  for (int i = 0; i < 10; i++)
+    log.write("burst\n");
+  CHECK(log.pending() == 3);
+
+  // 2 lines per second
+  g_now += 499;
+  log.write("early\n");
+  g_now += 1;
+  log.write("half\n");
+  log.write("too soon\n");
+  g_now += 500;
+  log.write("second\n");
+  CHECK(log.pending() == 5);
+
+  // A quiet time gives burst, not more
+  g_now += 60000;
+  for (int i = 0; i < 5; i++)
+    log.write("later\n");
+  CHECK(log.pending() == 8);
+
+  log.getStats(&stats);
+  CHECK(stats.lines == 8 && stats.limited == 11);
+
+  CHECK(log.flush() > 0);
+  CHECK(udpReceive(buf, sizeof(buf)) > 0);
+  CHECK(!strcmp(buf, "burst\nburst\nburst\nhalf\nsecond\nlater\nlater\nlater"));
+}
+
+/* ======================================================================
+Function: testFail
+Purpose : lines stay in ring when sending fails
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+void testFail(void)
+{
+  TInfoLog log;
+  TInfoLogStats stats;
+  char buf[TINFO_LOG_BATCH + 16];
+
+  g_now = 0;
+  log.init(fakeClock, udpSend, 1000);
+  log.write("kept\n");
+
+  g_fail = true;
+  CHECK(log.flush() == 0);
+  CHECK(log.pending() == 1);
+  g_fail = false;
+
+  // Failed send waits the interval too
+  CHECK(log.flush() == 0);
+  g_now += 1000;
+  CHECK(log.flush() == 4);
+  CHECK(udpReceive(buf, sizeof(buf)) == 4 && !strcmp(buf, "kept"));
+
+  log.getStats(&stats);
+  CHECK(stats.errors == 1 && stats.datagrams == 1);
+}
+
+int main(void)
+{
+  if (!udpOpen()) {
+    perror("log_test: socket");
+    return EXIT_FAILURE;
+  }
+
+  testBatch();
+  testLong();
+  testFull();
+  testRate();
+  testFail();
+
+  close(g_tx);
+  close(g_rx);
+  return testDone("log_test");
+}
@@ -0,0 +1,294 @@
+// **********************************************************************************
+// raspjson serial speed detection test
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo or use, see my blog
+// https://hallard.me/category/tinfo
+//
+// Runs raspjson on the slave side of a pty pair, the test is the meter on
+// the master side: it reads the speed raspjson set on the slave and sends
+// Standard mode frames at 9600 bps, garbage at any other speed. Checks
+// /metrics answers while no meter answers, the speed is found and frames
+// are decoded, and a speed that can't be set stops raspjson
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+#include "tinfotest.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define RASPJSON  "../examples/Raspberry_JSON/raspjson"
+
+/* ======================================================================
+Function: freePort
+Purpose : find a free TCP port for raspjson server
+Input   : -
+Output  : port number
+Comments: -
+====================================================================== */
+int freePort(void)
+{
+  struct sockaddr_in addr;
+  socklen_t len = sizeof(addr);
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  int port;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  bind(fd, (struct sockaddr *) &addr, sizeof(addr));
+  getsockname(fd, (struct sockaddr *) &addr, &len);
+  port = ntohs(addr.sin_port);
+  close(fd);
+
+  return port;
+}
+
+/* ======================================================================
+Function: scrape
+Purpose : GET /metrics
+Input   : port, max time to wait for the answer (ms)
+Output  : true if server answered 200 in time
+Comments: -
+====================================================================== */
+bool scrape(int port, int timeout)
+{
+  static const char request[] = "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n";
+  struct sockaddr_in addr;
+  struct timeval tv = { timeout / 1000, (timeout % 1000) * 1000 };
+  char answer[64];
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  bool ok = false;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+  if ( connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0 &&
+       write(fd, request, sizeof(request) - 1) == sizeof(request) - 1 &&
+       read(fd, answer, sizeof(answer)) >= 12 )
+    ok = !strncmp(answer, "HTTP/1.1 200", 12);
+
+  close(fd);
+  return ok;
+}
+
+/* ======================================================================
+Function: run
+Purpose : start raspjson with its output in a pipe
+Input   : arguments, pid filled
+Output  : read side of the pipe, not blocking
+Comments: -
+====================================================================== */
+int run(const char * const argv[], pid_t * pid)
+{
+  int out[2];
+
+  if (pipe(out) < 0)
+    return -1;
+
+  if ( (*pid = fork()) == 0 ) {
+    dup2(out[1], STDOUT_FILENO);
+    dup2(out[1], STDERR_FILENO);
+    close(out[0]);
+    execv(argv[0], (char * const *) argv);
+    _exit(127);
+  }
+
+  close(out[1]);
+  fcntl(out[0], F_SETFL, O_NONBLOCK);
+  return out[0];
+}
+
+/* ======================================================================
+Function: finish
+Purpose : wait for raspjson to stop
+Input   : pid, max time to wait (s), status filled
+Output  : false if still running, it is then killed
+Comments: -
+====================================================================== */
+bool finish(pid_t pid, int seconds, int * status)
+{
+  for (int i = 0; i < seconds * 10; i++) {
+    if (waitpid(pid, status, WNOHANG) == pid)
+      return true;
+    usleep(100000);
+  }
+
+  kill(pid, SIGKILL);
+  waitpid(pid, status, 0);
+  return false;
+}
+
+/* ======================================================================
+Function: output
+Purpose : append what raspjson wrote since last call
+Input   : pipe, buffer, its size, length in buffer (updated)
+Output  : -
+Comments: oldest output is dropped when buffer is full
+====================================================================== */
+void output(int fd, char * buf, size_t size, size_t * len)
+{
+  ssize_t n;
+
+  while (true) {
+    if (*len > size / 2) {
+      memmove(buf, buf + *len - size / 4, size / 4);
+      *len = size / 4;
+    }
+    n = read(fd, buf + *len, size - 1 - *len);
+    if (n <= 0)
+      break;
+    *len += n;
+  }
+  buf[*len] = '\0';
+}
+
+/* ======================================================================
+Function: testProbe
+Purpose : speed detection against a pty meter
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+void testProbe(void)
+{
+  static char log[64 * 1024];
+  char frame[1024];
+  char east[16];
+  char port_str[8];
+  struct termios tio;
+  size_t len = 0;
+  pid_t pid;
+  int port = freePort();
+  int master, slave, out;
+  bool found = false;
+  bool decoded = false;
+  int scrapes = 0;
+  int status;
+  unsigned seq = 0;
+  time_t start;
+
+  master = posix_openpt(O_RDWR | O_NOCTTY);
+  CHECK(master >= 0 && grantpt(master) == 0 && unlockpt(master) == 0);
+  slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+  CHECK(slave >= 0);
+  fcntl(master, F_SETFL, O_NONBLOCK);
+
+  snprintf(port_str, sizeof(port_str), "%d", port);
+  const char * const argv[] = { RASPJSON, "-v", "-d", ptsname(master), "-w", port_str, NULL };
+  out = run(argv, &pid);
+  CHECK(out >= 0);
+
+  // Meter silent, raspjson tries 1200 then 9600 and so on, server must
+  // answer all along
+  usleep(500000);
+  start = time(NULL);
+  while (time(NULL) < start + 6) {
+    scrapes += scrape(port, 1500);
+    usleep(500000);
+  }
+  CHECK(scrapes >= 8);
+
+  // Now the meter talks, at the speed raspjson set
+  start = time(NULL);
+  while (time(NULL) < start + 20 && !decoded) {
+    size_t n = 0;
+
+    CHECK(tcgetattr(slave, &tio) == 0);
+    if (cfgetispeed(&tio) == B9600) {
+      frame[n++] = TINFO_STX;
+      sprintf(east, "%09u", 1000 + seq++);
+      testGroup(frame, &n, "ADSC", NULL, "041876543210", true);
+      testGroup(frame, &n, "EAST", NULL, east, true);
+      testGroup(frame, &n, "SINSTS", NULL, "00420", true);
+      frame[n++] = TINFO_ETX;
+    } else {
+      for (n = 0; n < 120; n++)
+        frame[n] = rand();
+    }
+    if (write(master, frame, n) < 0 && errno != EAGAIN)
+      break;
+
+    // what raspjson wrote on slave, nothing expected
+    while (read(master, frame, sizeof(frame)) > 0)
+      ;
+
+    output(out, log, sizeof(log), &len);
+    if (strstr(log, "Teleinfo found at 9600 bps, standard mode"))
+      found = true;
+    if (found && strstr(log, "\"ADSC\""))
+      decoded = true;
+    usleep(200000);
+  }
+  CHECK(found);
+  CHECK(decoded);
+  CHECK(scrape(port, 1500));
+
+  kill(pid, SIGTERM);
+  CHECK(finish(pid, 5, &status));
+  close(out);
+  close(slave);
+  close(master);
+}
+
+/* ======================================================================
+Function: testBadSpeed
+Purpose : a forced speed that can't be set stops raspjson
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+void testBadSpeed(void)
+{
+  char log[4096];
+  size_t len = 0;
+  pid_t pid;
+  int status = 0;
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  int out;
+
+  CHECK(master >= 0 && grantpt(master) == 0 && unlockpt(master) == 0);
+
+  const char * const argv[] = { RASPJSON, "-d", ptsname(master), "-b", "1234", NULL };
+  out = run(argv, &pid);
+  CHECK(out >= 0);
+
+  CHECK(finish(pid, 5, &status));
+  output(out, log, sizeof(log), &len);
+  CHECK(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_FAILURE);
+  CHECK(strstr(log, "FATAL") != NULL);
+
+  close(out);
+  close(master);
+}
+
+int main(void)
+{
+  signal(SIGPIPE, SIG_IGN);
+
+  if (access(RASPJSON, X_OK) < 0) {
+    fprintf(stderr, "probe_test: build %s first\n", RASPJSON);
+    return EXIT_FAILURE;
+  }
+
+  testBadSpeed();
+  testProbe();
+
+  return testDone("probe_test");
+}
@@ -0,0 +1,232 @@
+// **********************************************************************************
+// LibTeleinfo main loop profiler test
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo or use, see my blog
+// https://hallard.me/category/tinfo
+//
+// Drives TInfoProfiler with a fake clock moved by the test: task times,
+// receive buffer fill time at meter speeds, gaps between drains and the
+// overflow flag, clock wrap and the /sys JSON
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+#include "tinfotest.h"
+#include "../src/LibTeleinfoProfiler.h"
+
+static uint32_t g_now;
+
+/* ======================================================================
+Function: fakeClock
+Purpose : clock given to the profiler
+Input   : -
+Output  : time set by the test (us)
+Comments: -
+====================================================================== */
+uint32_t fakeClock(void)
+{
+  return g_now;
+}
+
+/* ======================================================================
+Function: testFill
+Purpose : receive buffer fill time at meter speeds
+Input   : -
+Output  : -
+Comments: 10 bits per char, 7E1
+====================================================================== */
+void testFill(void)
+{
+  TInfoProfiler prof;
+
+  prof.init(1200, 128, fakeClock);
+  CHECK(prof.fillTime() == 1066666);
+  prof.init(9600, 128, fakeClock);
+  CHECK(prof.fillTime() == 133333);
+  prof.init(9600, 256, fakeClock);
+  CHECK(prof.fillTime() == 266666);
+
+  // No speed, no overflow can be told
+  prof.init(0, 128, fakeClock);
+  CHECK(prof.fillTime() == 0);
+  g_now = 0;
+  prof.drain();
+  g_now = 100000000;
+  prof.drain();
+  CHECK(prof.gapMax() == 100000000);
+  CHECK(!prof.overflow());
+}
+
+/* ======================================================================
+Function: testTasks
+Purpose : task counts, max and average
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+void testTasks(void)
+{
+  TInfoProfiler prof;
+  _TInfoProfileTask * k;
+  int8_t web, post;
+
+  prof.init(1200, 128, fakeClock);
+  web = prof.task("web");
+  post = prof.task("post");
+  CHECK(web == 0 && post == 1);
+
+  g_now = 1000;
+  prof.begin(web);
+  g_now += 300;
+  prof.end(web);
+  prof.begin(web);
+  g_now += 100;
+  prof.end(web);
+
+  // Nested tasks are timed each on its own
+  prof.begin(post);
+  g_now += 50;
+  prof.begin(web);
+  g_now += 200;
+  prof.end(web);
+  g_now += 400000;
+  prof.end(post);
+
+  k = prof.get(web);
+  CHECK(k && !strcmp(k->name, "web"));
+  CHECK(k->count == 3 && k->max == 300 && k->total == 600);
+  k = prof.get(post);
+  CHECK(k && k->count == 1 && k->max == 400250);
+
+  // Unknown tasks are ignored
+  prof.begin(-1);
+  prof.end(5);
+  CHECK(prof.get(-1) == NULL && prof.get(2) == NULL);
+
+  // Task times across clock wrap
+  g_now = 0xFFFFFF00;
+  prof.begin(post);
+  g_now += 0x200;
+  prof.end(post);
+  CHECK(prof.get(post)->count == 2 && prof.get(post)->max == 400250);
+  CHECK(prof.get(post)->total == 400250 + 0x200);
+
+  // Clear keeps tasks, times start again
+  prof.clear();
+  CHECK(prof.get(web) && prof.get(web)->count == 0 && prof.get(web)->max == 0);
+  CHECK(prof.task("third") == 2);
+
+  for (uint8_t i = 3; i < TINFO_PROFILE_TASKS; i++)
+    CHECK(prof.task("more") == i);
+  CHECK(prof.task("too much") == -1);
+}
+
+/* ======================================================================
+Function: testGaps
+Purpose : gaps between drains and overflow flag
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+void testGaps(void)
+{
+  TInfoProfiler prof;
+
+  prof.init(9600, 128, fakeClock);
+
+  // First drain only starts counting
+  g_now = 5000000;
+  prof.drain();
+  CHECK(prof.gapMax() == 0);
+
+  g_now += 10000;
+  prof.drain();
+  g_now += 133333;
+  prof.drain();
+  CHECK(prof.gapMax() == 133333);
+  CHECK(!prof.overflow());
+
+  // One us more than fill time
+  g_now += 133334;
+  prof.drain();
+  CHECK(prof.gapMax() == 133334);
+  CHECK(prof.overflow());
+
+  // Shorter gaps don't change max
+  g_now += 10;
+  prof.drain();
+  CHECK(prof.gapMax() == 133334);
+
+  // Clear forgets last drain, a long time without drain is not a gap
+  prof.clear();
+  CHECK(!prof.overflow() && prof.gapMax() == 0);
+  g_now += 5000000;
+  prof.drain();
+  CHECK(prof.gapMax() == 0);
+
+  // Gap across clock wrap
+  prof.clear();
+  g_now = 0xFFFFFFF0;
+  prof.drain();
+  g_now = 0x10;
+  prof.drain();
+  CHECK(prof.gapMax() == 0x20);
+  CHECK(!prof.overflow());
+}
+
+/* ======================================================================
+Function: testJson
+Purpose : /sys rendering
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+void testJson(void)
+{
+  static const char expect[] =
+    "{\"gap_max\":200000,\"fill\":1066666,\"overflows\":0,\"tasks\":{"
+    "\"web\":{\"count\":2,\"max\":3000,\"avg\":2000},"
+    "\"tinfo\":{\"count\":0,\"max\":0,\"avg\":0}}}";
+  TInfoProfiler prof;
+  char buf[256];
+  int8_t web;
+
+  prof.init(1200, 128, fakeClock);
+  CHECK(prof.json(buf, sizeof(buf)) > 0);
+  CHECK(!strcmp(buf, "{\"gap_max\":0,\"fill\":1066666,\"overflows\":0,\"tasks\":{}}"));
+
+  web = prof.task("web");
+  prof.task("tinfo");
+  g_now = 0;
+  prof.drain();
+  prof.begin(web);
+  g_now += 1000;
+  prof.end(web);
+  prof.begin(web);
+  g_now += 3000;
+  prof.end(web);
+  g_now = 200000;
+  prof.drain();
+
+  CHECK(prof.json(buf, sizeof(buf)) == strlen(expect));
+  CHECK(!strcmp(buf, expect));
+
+  // Too small buffer at any place gives nothing
+  for (size_t size = 1; size <= strlen(expect); size++)
+    CHECK(prof.json(buf, size) == 0);
+  CHECK(prof.json(buf, strlen(expect) + 1) == strlen(expect));
+}
+
+int main(void)
+{
+  testFill();
+  testTasks();
+  testGaps();
+  testJson();
+
+  return testDone("profiler_test");
+}
@@ -0,0 +1,280 @@
+// **********************************************************************************
+// LibTeleinfo scan kernels differential test
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo or use, see my blog
+// https://hallard.me/category/tinfo
+//
+// Runs each kernel this CPU has (scalar, SSE2, AVX2, NEON) against a
+// reference written here on random buffers and on control chars at every
+// offset and at buffer tails, then checks bulk process() decodes as
+// process() called for each char with each kernel
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+#include "tinfotest.h"
+#include "../src/LibTeleinfoScan.h"
+
+static const char * g_kernels[] = { "scalar", "sse2", "avx2", "neon" };
+static const char g_controls[] = { TINFO_STX, TINFO_ETX, TINFO_SGR, TINFO_EGR };
+
+/* ======================================================================
+Function: refControl
+Purpose : reference of tinfoScanControl()
+Input   : buffer, length, separator (0 for none)
+Output  : offset of first control char, len if none
+Comments: -
+====================================================================== */
+size_t refControl(const char * buf, size_t len, char sep)
+{
+  for (size_t i = 0; i < len; i++) {
+    char c = buf[i] & 0x7F;
+    if (memchr(g_controls, c, sizeof(g_controls)) || (sep && c == (sep & 0x7F)))
+      return i;
+  }
+  return len;
+}
+
+/* ======================================================================
+Function: dataChar
+Purpose : random char that is not a control char nor a separator
+Input   : -
+Output  : char, 8th bit set sometimes
+Comments: -
+====================================================================== */
+char dataChar(void)
+{
+  char c;
+
+  do {
+    c = rand();
+  } while (refControl(&c, 1, ' ') == 0 || refControl(&c, 1, '\t') == 0);
+
+  return c;
+}
+
+/* ======================================================================
+Function: testControl
+Purpose : one control char at every offset, and none
+Input   : kernel name
+Output  : -
+Comments: buffers are allocated to their exact length so kernels reading
+          past the end are seen by valgrind or ASan
+====================================================================== */
+void testControl(const char * kernel)
+{
+  static const char seps[] = { 0, ' ', '\t' };
+  char found[sizeof(g_controls) + 2];
+  size_t n;
+  int failed = g_failed;
+
+  for (size_t len = 0; len <= 200; len++) {
+    char * buf = (char *) malloc(len ? len : 1);
+
+    for (size_t i = 0; i < len; i++)
+      buf[i] = dataChar();
+
+    for (uint8_t s = 0; s < sizeof(seps); s++) {
+      // nothing to find
+      CHECK(tinfoScanControl(buf, len, seps[s]) == len);
+
+      memcpy(found, g_controls, sizeof(g_controls));
+      n = sizeof(g_controls);
+      if (seps[s])
+        found[n++] = seps[s];
+
+      for (size_t pos = 0; pos < len; pos++) {
+        char keep = buf[pos];
+
+        for (size_t c = 0; c < n; c++) {
+          // with and without 8th bit, meters send 7 bits with parity
+          buf[pos] = found[c];
+          CHECK(tinfoScanControl(buf, len, seps[s]) == pos);
+          buf[pos] = found[c] | 0x80;
+          CHECK(tinfoScanControl(buf, len, seps[s]) == pos);
+        }
+        buf[pos] = keep;
+      }
+
+      // and the other separator is only data
+      if (seps[s] && len) {
+        buf[len - 1] = seps[s] == ' ' ? '\t' : ' ';
+        CHECK(tinfoScanControl(buf, len, seps[s]) == len);
+        buf[len - 1] = dataChar();
+      }
+    }
+    free(buf);
+  }
+
+  if (g_failed > failed)
+    fprintf(stderr, "testControl: kernel %s\n", kernel);
+}
+
+/* ======================================================================
+Function: testRandom
+Purpose : random buffers with few or many control chars
+Input   : kernel name
+Output  : -
+Comments: marks are read by small tables to check scan goes on
+====================================================================== */
+void testRandom(const char * kernel)
+{
+  _TInfoMark marks[7];
+  size_t pos, scanned, ref;
+  uint16_t n;
+  int failed = g_failed;
+
+  srand(2);
+  for (int it = 0; it < 3000; it++) {
+    size_t len = rand() % 2048;
+    int density = 1 + rand() % 300;
+    char sep = rand() % 2 ? ' ' : 0;
+    char * buf = (char *) malloc(len ? len : 1);
+
+    for (size_t i = 0; i < len; i++)
+      buf[i] = rand() % density ? dataChar() : g_controls[rand() % sizeof(g_controls)];
+
+    CHECK(tinfoScanControl(buf, len, sep) == refControl(buf, len, sep));
+
+    for (pos = 0; pos < len; pos += scanned) {
+      n = tinfoScanMarks(buf + pos, len - pos, sep, marks, 7, &scanned);
+      CHECK(scanned > 0);
+      ref = pos;
+      for (uint16_t i = 0; i < n; i++) {
+        ref += refControl(buf + ref, len - ref, sep);
+        CHECK(marks[i].offset == ref - pos);
+        CHECK(marks[i].kind == (buf[ref] & 0x7F));
+        ref++;
+      }
+      if (n < 7)
+        CHECK(refControl(buf + ref, len - ref, sep) == len - ref);
+      if (!scanned)
+        break;
+    }
+    free(buf);
+  }
+
+  if (g_failed > failed)
+    fprintf(stderr, "testRandom: kernel %s\n", kernel);
+}
+
+/* ======================================================================
+Function: testSums
+Purpose : batch checksums of a kernel against scalar kernel
+Input   : kernel name
+Output  : -
+Comments: groups end at buffer tail, so sum kernels must not read past
+          the end of buffer to mask chars they don't need
+====================================================================== */
+void testSums(const char * kernel)
+{
+  _TInfoGroupSpan groups[16];
+  char ref[16];
+  char sums[16];
+  int failed = g_failed;
+
+  srand(3);
+  for (int it = 0; it < 3000; it++) {
+    size_t len = 2 + rand() % 600;
+    char * buf = (char *) malloc(len);
+
+    for (size_t i = 0; i < len; i++)
+      buf[i] = rand();
+
+    for (uint8_t i = 0; i < 16; i++) {
+      groups[i].len = 2 + rand() % (len - 1);
+      groups[i].offset = rand() % 2 && groups[i].len < len ? len - 1 - groups[i].len : rand() % len;
+    }
+
+    for (uint8_t rule = TINFO_CHECKSUM_HISTORIC; rule <= TINFO_CHECKSUM_STANDARD; rule++) {
+      tinfoScanSelect("scalar");
+      uint16_t good = tinfoChecksumBatch(buf, len, groups, 16, rule, ref);
+      tinfoScanSelect(kernel);
+      CHECK(tinfoChecksumBatch(buf, len, groups, 16, rule, sums) == good);
+      CHECK(!memcmp(ref, sums, sizeof(sums)));
+    }
+    free(buf);
+  }
+
+  if (g_failed > failed)
+    fprintf(stderr, "testSums: kernel %s\n", kernel);
+}
+
+/* ======================================================================
+Function: testDecode
+Purpose : bulk process() and processBatch() against process() per char
+Input   : kernel name
+Output  : -
+Comments: good frames, damaged frames and line noise, read by random
+          pieces as a serial port would give them
+====================================================================== */
+void testDecode(const char * kernel)
+{
+  static char buf[32 * 1024];
+  size_t len, pos, n;
+  int failed = g_failed;
+
+  for (int standard = 0; standard < 2; standard++) {
+    for (int bad = 0; bad < 12; bad += 4) {
+      TInfo ref;
+      TInfo bulk;
+      TInfo batch;
+
+      ref.init();
+      bulk.init();
+      batch.init();
+
+      len = testFrames(buf, sizeof(buf), standard, bad, 10 + bad);
+
+      // some noise in the middle, 8th bit set on some chars
+      for (int i = 0; i < bad * 8; i++) {
+        pos = rand() % len;
+        buf[pos] = rand() % 4 ? buf[pos] | 0x80 : rand();
+      }
+
+      for (size_t i = 0; i < len; i++)
+        ref.process(buf[i]);
+
+      srand(bad);
+      for (pos = 0; pos < len; pos += n) {
+        n = 1 + rand() % (rand() % 2 ? 40 : 1500);
+        if (n > len - pos)
+          n = len - pos;
+        bulk.process(buf + pos, n);
+        batch.processBatch(buf + pos, n);
+      }
+
+      testSameDecode(ref, bulk);
+      testSameDecode(ref, batch);
+    }
+  }
+
+  if (g_failed > failed)
+    fprintf(stderr, "testDecode: kernel %s\n", kernel);
+}
+
+int main(void)
+{
+  const char * best = tinfoScanKernel();
+
+  for (uint8_t i = 0; i < sizeof(g_kernels) / sizeof(g_kernels[0]); i++) {
+    if (!tinfoScanSelect(g_kernels[i])) {
+      printf("scan_test: kernel %s not on this CPU\n", g_kernels[i]);
+      continue;
+    }
+    printf("scan_test: kernel %s%s\n", g_kernels[i], strcmp(g_kernels[i], best) ? "" : " (best)");
+
+    testControl(g_kernels[i]);
+    testRandom(g_kernels[i]);
+    testSums(g_kernels[i]);
+    testDecode(g_kernels[i]);
+  }
+  tinfoScanSelect(NULL);
+  CHECK(!strcmp(tinfoScanKernel(), best));
+
+  return testDone("scan_test");
+}
@@ -0,0 +1,378 @@
+// **********************************************************************************
+// LibTeleinfo load shedder test
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo or use, see my blog
+// https://hallard.me/category/tinfo
+//
+// Drives TInfoShedder with labels and ticks at times set by the test,
+// loads are a fake TInfoOutput that keeps their state. Checks overload
+// and ADPS shedding, settle and restore times, the band between low and
+// high, and the reaction time histogram with groups decoded by TInfo
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+#include "tinfotest.h"
+#include "../src/LibTeleinfoShedder.h"
+
+static uint32_t g_now;
+
+// Loads of the test, all off until init
+class FakeOutput : public TInfoOutput
+{
+  public:
+    FakeOutput() { memset(on, 0, sizeof(on)); sets = 0; }
+    void set(uint8_t load, boolean state) { CHECK(load < TINFO_SHED_LOADS); on[load] = state; sets++; }
+    boolean  on[TINFO_SHED_LOADS];
+    uint32_t sets;
+};
+
+static const _TInfoShedConfig g_config = { 1000, 800, 2000, 10000 };
+
+static TInfoShedder * g_shedder;
+
+/* ======================================================================
+Function: fakeClock
+Purpose : clock given to TInfo
+Input   : -
+Output  : time set by the test (ms)
+Comments: -
+====================================================================== */
+uint32_t fakeClock(void)
+{
+  return g_now;
+}
+
+/* ======================================================================
+Function: DataCallback
+Purpose : give a label decoded by TInfo to the shedder
+Input   : label value, flags
+Output  : -
+Comments: -
+====================================================================== */
+void DataCallback(ValueList * me, uint8_t flags)
+{
+  g_shedder->data(me, flags, fakeClock());
+}
+
+/* ======================================================================
+Function: label
+Purpose : give a label to the shedder as the data callback does
+Input   : shedder, label, value, time (ms), flags
+Output  : -
+Comments: -
+====================================================================== */
+void label(TInfoShedder & s, const char * name, const char * value, uint32_t t,
+           uint8_t flags = TINFO_FLAGS_UPDATED)
+{
+  ValueList me;
+
+  memset(&me, 0, sizeof(me));
+  strcpy(me.name, name);
+  strcpy(me.value, value);
+  s.data(&me, flags, t);
+}
+
+/* ======================================================================
+Function: loadsOn
+Purpose : loads switched on
+Input   : output, number of loads
+Output  : bit n set if load n is on
+Comments: -
+====================================================================== */
+uint32_t loadsOn(FakeOutput & out, uint8_t loads)
+{
+  uint32_t bits = 0;
+
+  for (uint8_t i = 0; i < loads; i++)
+    if (out.on[i])
+      bits |= 1 << i;
+  return bits;
+}
+
+/* ======================================================================
+Function: testInit
+Purpose : all loads on, load from current and power
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+void testInit(void)
+{
+  TInfoShedder s;
+  FakeOutput out;
+
+  s.init(NULL, &out, 3, &g_config);
+  CHECK(out.sets == 3 && loadsOn(out, TINFO_SHED_LOADS) == 0x07);
+  CHECK(s.shed() == 0 && s.load() == 0);
+
+  // Nothing until subscribed current is known
+  label(s, "IINST", "40", 0);
+  CHECK(s.shed() == 0 && s.load() == 0);
+  label(s, "ISOUSC", "30", 0);
+  CHECK(s.load() == 1333 && s.shed() == 1);
+
+  // Highest of phases and power
+  s.init(NULL, &out, 3, &g_config);
+  label(s, "ISOUSC", "30", 0);
+  label(s, "IINST1", "6", 0);
+  label(s, "IINST2", "15", 0);
+  label(s, "IINST3", "9", 0);
+  CHECK(s.load() == 500);
+  label(s, "PREF", "6", 0);
+  label(s, "SINSTS", "4200", 0);
+  CHECK(s.load() == 700);
+  label(s, "IINST4", "90", 0);
+  label(s, "IINST", "12a", 0);
+  label(s, "PAPP", "09000", 0);
+  CHECK(s.load() == 700 && s.shed() == 0);
+
+  // No more loads than the table
+  s.init(NULL, &out, TINFO_SHED_LOADS + 4, &g_config);
+  CHECK(loadsOn(out, TINFO_SHED_LOADS) == (1u << TINFO_SHED_LOADS) - 1);
+}
+
+/* ======================================================================
+Function: testOverload
+Purpose : loads shed one at a time, settle time between them
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+void testOverload(void)
+{
+  TInfoShedder s;
+  FakeOutput out;
+
+  s.init(NULL, &out, 3, &g_config);
+  label(s, "ISOUSC", "30", 0);
+  label(s, "IINST", "29", 1000);
+  CHECK(s.shed() == 0);
+
+  // Subscribed current reached, load 0 first
+  label(s, "IINST", "30", 1000);
+  CHECK(s.shed() == 1 && loadsOn(out, 3) == 0x06);
+
+  // Still over, meter has not seen new load yet
+  label(s, "IINST", "31", 2999);
+  s.tick(2999);
+  CHECK(s.shed() == 1);
+  s.tick(3000);
+  CHECK(s.shed() == 2 && loadsOn(out, 3) == 0x04);
+  label(s, "IINST", "32", 5000);
+  CHECK(s.shed() == 3 && loadsOn(out, 3) == 0);
+
+  // No more loads
+  label(s, "IINST", "33", 8000);
+  s.tick(20000);
+  CHECK(s.shed() == 3 && out.sets == 6);
+
+  // Power against reference power
+  s.init(NULL, &out, 2, &g_config);
+  label(s, "PREF", "6", 0);
+  label(s, "SINSTS", "6000", 100);
+  CHECK(s.shed() == 1 && s.load() == 1000);
+}
+
+/* ======================================================================
+Function: testADPS
+Purpose : overload alerts shed whatever the load
+Input   : -
+Output  : -
+Comments: settle time applies to them too
+====================================================================== */
+void testADPS(void)
+{
+  TInfoShedder s;
+  FakeOutput out;
+
+  s.init(NULL, &out, 4, &g_config);
+  label(s, "ADPS", "045", 1000);
+  CHECK(s.shed() == 1 && s.load() == 0);
+
+  // Alert within settle time is dropped
+  label(s, "ADPS", "046", 2000);
+  s.tick(3500);
+  CHECK(s.shed() == 1);
+
+  label(s, "ADIR2", "040", 3500);
+  CHECK(s.shed() == 2);
+  label(s, "BASE", "012345678", 5500, TINFO_FLAGS_ALERT);
+  CHECK(s.shed() == 3 && loadsOn(out, 4) == 0x08);
+
+  // No overload, loads come back after restore time
+  s.tick(6000);
+  s.tick(15999);
+  CHECK(s.shed() == 3);
+  s.tick(16000);
+  CHECK(s.shed() == 2 && loadsOn(out, 4) == 0x0C);
+}
+
+/* ======================================================================
+Function: testRestore
+Purpose : loads restored one at a time, last shed first
+Input   : -
+Output  : -
+Comments: -
+====================================================================== */
+void testRestore(void)
+{
+  TInfoShedder s;
+  FakeOutput out;
+
+  s.init(NULL, &out, 3, &g_config);
+  label(s, "ISOUSC", "30", 0);
+  label(s, "IINST", "35", 0);
+  label(s, "IINST", "36", 2000);
+  CHECK(s.shed() == 2 && loadsOn(out, 3) == 0x04);
+
+  // Below low from 3000
+  label(s, "IINST", "20", 3000);
+  s.tick(12999);
+  CHECK(s.shed() == 2);
+  s.tick(13000);
+  CHECK(s.shed() == 1 && loadsOn(out, 3) == 0x06);
+
+  // Next one a restore time later
+  s.tick(22999);
+  CHECK(s.shed() == 1);
+  s.tick(23000);
+  CHECK(s.shed() == 0 && loadsOn(out, 3) == 0x07);
+
+  // Nothing more to restore
+  s.tick(60000);
+  CHECK(s.shed() == 0 && out.sets == 7);
+}
+
+/* ======================================================================
+Function: testHysteresis
+Purpose : load between low and high neither sheds nor restores
+Input   : -
+Output  : -
+Comments: going back in the band starts restore time again
+====================================================================== */
+void testHysteresis(void)
+{
+  TInfoShedder s;
+  FakeOutput out;
+
+  s.init(NULL, &out, 2, &g_config);
+  label(s, "ISOUSC", "30", 0);
+  label(s, "IINST", "30", 0);
+  CHECK(s.shed() == 1);
+
+  // 800 to 999 is the band
+  label(s, "IINST", "24", 1000);
+  s.tick(30000);
+  label(s, "IINST", "29", 31000);
+  s.tick(60000);
+  CHECK(s.shed() == 1 && s.load() == 966);
+
+  // Below for less than restore time, then back in band
+  label(s, "IINST", "23", 61000);
+  s.tick(70000);
+  label(s, "IINST", "25", 70500);
+  label(s, "IINST", "23", 71000);
+  s.tick(80999);
+  CHECK(s.shed() == 1);
+  s.tick(81000);
+  CHECK(s.shed() == 0 && loadsOn(out, 2) == 0x03);
+
+  // Back over high sheds again, restore time starts over
+  label(s, "IINST", "30", 82000);
+  CHECK(s.shed() == 1);
+  label(s, "IINST", "10", 83000);
+  s.tick(92999);
+  CHECK(s.shed() == 1);
+  s.tick(93000);
+  CHECK(s.shed() == 0);
+}
+
+/* ======================================================================
+Function: sendFrame
+Purpose : give a historic frame to TInfo as read at a time
+Input   : decoder, IINST value, read time (ms)
+Output  : -
+Comments: -
+====================================================================== */
+void sendFrame(TInfo & tinfo, int iinst, uint32_t received)
+{
+  char buf[128];
+  char value[8];
+  size_t pos = 0;
+
+  sprintf(value, "%03d", iinst);
+  buf[pos++] = TINFO_STX;
+  testGroup(buf, &pos, "ISOUSC", NULL, "30", false);
+  testGroup(buf, &pos, "IINST", NULL, value, false);
+  buf[pos++] = TINFO_ETX;
+  tinfo.process(buf, pos, received);
+}
+
+/* ======================================================================
+Function: testLatency
+Purpose : reaction time histogram
+Input   : -
+Output  : -
+Comments: time from read of the group to the decision, sheds of tick()
+          are not counted
+====================================================================== */
+void testLatency(void)
+{
+  static const _TInfoShedConfig config = { 1000, 800, 0, 10000 };
+  static const uint32_t delay[] = { 0, 1, 3, 100, 70000 };
+  static const uint8_t bucket[] = { 0, 1, 2, 7, TINFO_SHED_LATENCY - 1 };
+  TInfoShedder s;
+  FakeOutput out;
+  TInfo tinfo;
+  uint16_t total = 0;
+
+  g_shedder = &s;
+  tinfo.init();
+  tinfo.attachClock(fakeClock);
+  tinfo.attachData(DataCallback);
+  s.init(&tinfo, &out, 8, &config);
+
+  // Decoder syncs on first frame
+  g_now = 100000;
+  sendFrame(tinfo, 10, g_now);
+  sendFrame(tinfo, 11, g_now);
+  CHECK(s.shed() == 0);
+
+  for (uint8_t i = 0; i < sizeof(delay) / sizeof(delay[0]); i++) {
+    g_now += 100000;
+    sendFrame(tinfo, 40 + i, g_now - delay[i]);
+    CHECK(s.shed() == i + 1);
+    CHECK(s.latency(bucket[i]) == 1);
+  }
+
+  // Shed from tick
+  g_now += 1000;
+  s.tick(g_now);
+  CHECK(s.shed() == 6);
+
+  for (uint8_t i = 0; i < TINFO_SHED_LATENCY + 2; i++)
+    total += s.latency(i);
+  CHECK(total == 5);
+
+  // Without TInfo, group is read when given
+  s.init(NULL, &out, 2, &g_config);
+  label(s, "ADPS", "040", 5000);
+  CHECK(s.latency(0) == 1);
+}
+
+int main(void)
+{
+  testInit();
+  testOverload();
+  testADPS();
+  testRestore();
+  testHysteresis();
+  testLatency();
+
+  return testDone("shedder_test");
+}
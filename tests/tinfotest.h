@@ -0,0 +1,148 @@
+// **********************************************************************************
+// LibTeleinfo Linux tests include file
+// **********************************************************************************
+// Creative Commons Attrib Share-Alike License
+// You are free to use/extend this library but please abide with the CC-BY-SA license:
+// http://creativecommons.org/licenses/by-sa/4.0/
+//
+// For any explanation about teleinfo or use, see my blog
+// https://hallard.me/category/tinfo
+//
+// Small helpers shared by test programs: a check macro that counts
+// failures and a frame builder that computes checksums from the meter
+// documentation, not with the library code under test
+//
+// All text above must be included in any redistribution.
+//
+// **********************************************************************************
+
+#ifndef TINFOTEST_H
+#define TINFOTEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/LibTeleinfo.h"
+
+static int g_checks;
+static int g_failed;
+
+// Count a check, tell where it failed
+#define CHECK(cond) do { \
+    g_checks++; \
+    if (!(cond)) { \
+      g_failed++; \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+    } \
+  } while (0)
+
+/* ======================================================================
+Function: testDone
+Purpose : write result of a test program
+Input   : program name
+Output  : exit code, 0 if all checks passed
+Comments: -
+====================================================================== */
+static inline int testDone(const char * name)
+{
+  printf("%s: %d checks, %d failed\n", name, g_checks, g_failed);
+  return g_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* ======================================================================
+Function: testGroup
+Purpose : append a group with its checksum to a buffer
+Input   : buffer, position (updated), label, horodate (NULL if none),
+          value, true for Standard mode, checksum to add to good one
+Output  : -
+Comments: historic sums label SP value, Standard sums label HT [horodate
+          HT] value HT (ENEDIS-NOI-CPT_54E)
+====================================================================== */
+static inline void testGroup(char * buf, size_t * pos, const char * label, const char * horodate,
+                      const char * value, bool standard, int error = 0)
+{
+  char sep = standard ? TINFO_SEP_STANDARD : TINFO_SEP_HISTORIC;
+  char * start;
+  uint8_t sum = 0;
+
+  buf[(*pos)++] = TINFO_SGR;
+  start = buf + *pos;
+  if (horodate)
+    *pos += sprintf(buf + *pos, "%s%c%s%c", label, sep, horodate, sep);
+  else
+    *pos += sprintf(buf + *pos, "%s%c", label, sep);
+  *pos += sprintf(buf + *pos, "%s%c", value, sep);
+
+  for (char * p = start; p < buf + *pos - (standard ? 0 : 1); p++)
+    sum += *p & 0x7F;
+  buf[(*pos)++] = ((sum & 0x3F) + 0x20 + error) & 0x7F;
+  buf[(*pos)++] = TINFO_EGR;
+}
+
+/* ======================================================================
+Function: testFrames
+Purpose : fill a buffer with frames of a meter
+Input   : buffer, its size, true for Standard mode, one group in bad is
+          damaged (0 for none), seed of rand()
+Output  : length filled
+Comments: values change from frame to frame, bad groups have a wrong
+          checksum, a wrong separator or a lost CR
+====================================================================== */
+static inline size_t testFrames(char * buf, size_t size, bool standard, int bad, unsigned seed)
+{
+  static const char * hist_labels[] = { "ADCO", "OPTARIF", "ISOUSC", "HCHC", "HCHP", "PTEC", "IINST", "PAPP" };
+  static const char * std_labels[] = { "ADSC", "VTIC", "EAST", "DATE", "EASF01", "IRMS1", "URMS1", "SINSTS" };
+  char value[32];
+  size_t pos = 0;
+  int error;
+
+  srand(seed);
+  while (pos + 512 < size) {
+    buf[pos++] = TINFO_STX;
+    for (int i = 0; i < 8; i++) {
+      error = bad && rand() % bad == 0 ? 1 + rand() % 3 : 0;
+      sprintf(value, "%09d", rand() % 1000000);
+      if (standard && i == 3)
+        testGroup(buf, &pos, std_labels[i], "E240101120000", "", true, error == 1);
+      else
+        testGroup(buf, &pos, standard ? std_labels[i] : hist_labels[i], NULL, value, standard, error == 1);
+      if (error == 2)
+        buf[pos - 3] = standard ? ' ' : '\t';
+      else if (error == 3)
+        pos--;
+    }
+    buf[pos++] = TINFO_ETX;
+  }
+
+  return pos;
+}
+
+/* ======================================================================
+Function: testSameDecode
+Purpose : check two decoders ended with same counters and values
+Input   : decoders
+Output  : -
+Comments: -
+====================================================================== */
+static inline void testSameDecode(TInfo & a, TInfo & b)
+{
+  TInfoStats sa, sb;
+  ValueList * ma = a.getList();
+  ValueList * mb = b.getList();
+
+  a.getStats(&sa);
+  b.getStats(&sb);
+  CHECK(!memcmp(&sa, &sb, sizeof(sa)));
+  CHECK(a.getMode() == b.getMode());
+
+  for (; ma && mb; ma = ma->next, mb = mb->next) {
+    CHECK(!strcmp(ma->name, mb->name));
+    CHECK(!strcmp(ma->value, mb->value));
+    CHECK(!strcmp(ma->horodate, mb->horodate));
+    CHECK(ma->checksum == mb->checksum);
+    CHECK(ma->changes == mb->changes);
+  }
+  CHECK(!ma && !mb);
+}
+
+#endif